@@ -0,0 +1,200 @@
+#include "AnnexBPacketizer.hpp"
+
+#include "Telemetry.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANNEXB_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline int CountTrailingZeros(uint32_t inMask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, inMask);
+    return (int)index;
+#else
+    return __builtin_ctz(inMask);
+#endif
+}
+
+const uint8_t* FindStartCode(const uint8_t* inBegin, const uint8_t* inEnd) {
+    const uint8_t* p = inBegin;
+#ifdef ANNEXB_SSE2
+    // 16 candidate positions per iteration: bytes p[i], p[i + 1], p[i + 2] == 0, 0, 1
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+    while (inEnd - p >= 18) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(p + 2));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+            _mm_cmpeq_epi8(b2, one));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+        if (mask) {
+            return p + CountTrailingZeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; inEnd - p >= 3; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return inEnd;
+}
+
+// Moves a start code found by FindStartCode back over the zero bytes in front of it
+// (zero_byte of 4 byte start codes, trailing_zero_8bits), bounded by inLimit
+static inline const uint8_t* IncludeLeadingZeros(const uint8_t* inStartCode, const uint8_t* inLimit) {
+    while (inStartCode > inLimit && inStartCode[-1] == 0) {
+        inStartCode--;
+    }
+    return inStartCode;
+}
+
+uint32_t
+RbspReader::readBits(int inCount)
+{
+    uint32_t value = 0;
+    while (inCount--) {
+        if (!mBitsLeft) {
+            if (mNext < mEnd && mZeros >= 2 && *mNext == 3) {
+                mNext++;
+                mZeros = 0;
+            }
+            if (mNext >= mEnd) {
+                mOk = false;
+                return 0;
+            }
+            mByte = *mNext++;
+            mZeros = mByte ? 0 : mZeros + 1;
+            mBitsLeft = 8;
+        }
+        value = (value << 1) | ((mByte >> --mBitsLeft) & 1);
+    }
+    return value;
+}
+
+uint32_t
+RbspReader::readUe()
+{
+    int leadingZeros = 0;
+    while (readBits(1) == 0) {
+        if (!mOk || ++leadingZeros > 31) {
+            mOk = false;
+            return 0;
+        }
+    }
+    return ((1u << leadingZeros) - 1) + readBits(leadingZeros);
+}
+
+// Walks the SEI messages of an SEI NAL unit (inPayload follows the NAL header) for a
+// recovery point (payloadType 6)
+static bool HasRecoveryPoint(const uint8_t* inPayload, const uint8_t* inEnd)
+{
+    RbspReader reader(inPayload, inEnd);
+    while (reader.ok()) {
+        uint32_t payloadType = 0, payloadSize = 0, byte;
+        while ((byte = reader.readBits(8)) == 0xff) {
+            payloadType += byte;
+        }
+        payloadType += byte;
+        while ((byte = reader.readBits(8)) == 0xff) {
+            payloadSize += byte;
+        }
+        payloadSize += byte;
+        if (!reader.ok()) {
+            break;
+        }
+        if (payloadType == 6) {
+            return true;
+        }
+        while (payloadSize-- && reader.ok()) {
+            reader.readBits(8);
+        }
+    }
+    return false;
+}
+
+AnnexBPacketizer::AnnexBPacketizer(const uint8_t* inData, size_t inSize)
+    : mData(inData)
+    , mEnd(inData + inSize)
+    , mNext(nullptr)
+    , mFrameIndex(0)
+{
+    reset();
+}
+
+void
+AnnexBPacketizer::reset(size_t inOffset, int64_t inFrameIndex)
+{
+    // Anything in front of the first start code is not part of the stream
+    mNext = IncludeLeadingZeros(FindStartCode(mData + inOffset, mEnd), mData + inOffset);
+    mFrameIndex = inFrameIndex;
+}
+
+bool
+AnnexBPacketizer::next(AccessUnit& outUnit)
+{
+    if (mNext >= mEnd) {
+        return false;
+    }
+
+    AccessUnit unit;
+    unit.data = mNext;
+    unit.offset = mNext - mData;
+    bool hasVcl = false;
+
+    const uint8_t* nal = mNext;
+    while (nal < mEnd) {
+        const uint8_t* header = nal;
+        while (header < mEnd && *header == 0) {
+            header++;
+        }
+        // Skip the 0x01 of the start code
+        header++;
+        if (header >= mEnd) {
+            nal = mEnd;
+            break;
+        }
+
+        const int type = *header & 0x1f;
+        const bool vcl = type == NalUnitType_Slice || type == NalUnitType_IdrSlice;
+        if (hasVcl) {
+            // first_mb_in_slice is ue(v), a leading 1 bit means 0, i.e. the first slice of a new picture
+            bool firstSlice = vcl && header + 1 < mEnd && (header[1] & 0x80);
+            bool prefix = type == NalUnitType_Sei || type == NalUnitType_Sps || type == NalUnitType_Pps
+                || type == NalUnitType_AccessUnitDelimiter || (type >= 14 && type <= 18);
+            if (firstSlice || prefix) {
+                break;
+            }
+        }
+
+        const uint8_t* next = IncludeLeadingZeros(FindStartCode(header + 1, mEnd), header + 1);
+        hasVcl |= vcl;
+        unit.idr |= type == NalUnitType_IdrSlice;
+        unit.sps |= type == NalUnitType_Sps;
+        unit.pps |= type == NalUnitType_Pps;
+        if (type == NalUnitType_Sei && !unit.recoveryPoint) {
+            unit.recoveryPoint = HasRecoveryPoint(header + 1, next);
+        }
+
+        nal = next;
+    }
+
+    unit.size = nal - unit.data;
+    unit.frameIndex = mFrameIndex;
+    unit.picture = hasVcl;
+    if (hasVcl) {
+        mFrameIndex++;
+    }
+    mNext = nal;
+    Telemetry::Count(TelemetryCounter::AccessUnits);
+    Telemetry::Count(TelemetryCounter::BytesParsed, unit.size);
+    outUnit = unit;
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "FramePool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// H.264 NAL unit types the packetizer cares about
+enum NalUnitType {
+    NalUnitType_Slice = 1,
+    NalUnitType_IdrSlice = 5,
+    NalUnitType_Sei = 6,
+    NalUnitType_Sps = 7,
+    NalUnitType_Pps = 8,
+    NalUnitType_AccessUnitDelimiter = 9,
+};
+
+// One access unit (all NAL units of one coded picture plus the parameter sets and SEI
+// in front of it). data points into the packetizer input, no copy is made.
+struct AccessUnit {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;          // Byte offset of data in the input
+    int64_t frameIndex = 0;     // Decode order index, used as timestamp
+    int64_t pts = kNoPts;       // Presentation time from the container, none in an elementary stream
+    bool idr = false;
+    bool sps = false;
+    bool pps = false;
+    bool recoveryPoint = false; // Carries a recovery point SEI message, decoding may start here
+    bool picture = false;       // Has a VCL NAL unit, false only for trailing non-VCL data
+};
+
+// Hands out the access units of one video stream, in decode order: an Annex-B elementary
+// stream (AnnexBPacketizer) or a container's video track (see ContainerDemuxer)
+class PacketSource {
+public:
+    virtual ~PacketSource() = default;
+
+    // Returns false once the input is exhausted. The unit's data is only guaranteed to stay
+    // valid while the source hands out as many further units as it was set up to keep in flight.
+    virtual bool next(AccessUnit& outUnit) = 0;
+};
+
+// Returns the first 00 00 01 start code prefix in [inBegin, inEnd), or inEnd if there is none
+const uint8_t* FindStartCode(const uint8_t* inBegin, const uint8_t* inEnd);
+
+// Reads the RBSP of a NAL unit (the bytes after the NAL header), skipping emulation prevention
+// bytes. Reads past inEnd return zero bits and clear ok().
+class RbspReader {
+public:
+    RbspReader(const uint8_t* inBegin, const uint8_t* inEnd) : mNext(inBegin), mEnd(inEnd) {}
+
+    uint32_t readBits(int inCount);
+    // Exp-Golomb ue(v)
+    uint32_t readUe();
+    bool moreData() const { return mNext < mEnd || mBitsLeft > 0; }
+    bool ok() const { return mOk; }
+
+private:
+    const uint8_t* mNext;
+    const uint8_t* mEnd;
+    uint32_t mByte = 0;
+    int mBitsLeft = 0;
+    int mZeros = 0;
+    bool mOk = true;
+};
+
+// Splits an H.264 Annex-B elementary stream into access units. An access unit ends where a
+// NAL unit that starts a new picture follows a VCL NAL unit: AUD, SPS, PPS, SEI, types 14-18,
+// or a slice whose first_mb_in_slice is 0.
+class AnnexBPacketizer : public PacketSource {
+public:
+    AnnexBPacketizer(const uint8_t* inData, size_t inSize);
+
+    // Returns false once the input is exhausted. data points into the input, so it stays valid.
+    bool next(AccessUnit& outUnit) override;
+
+    // Restarts at inOffset, which must be the start of an access unit
+    void reset(size_t inOffset = 0, int64_t inFrameIndex = 0);
+
+private:
+    const uint8_t* mData;
+    const uint8_t* mEnd;
+    const uint8_t* mNext;       // Start code (including leading zeros) of the next unconsumed NAL unit
+    int64_t mFrameIndex;
+};
@@ -0,0 +1,235 @@
+#include "AsyncFileWriter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Unbuffered I/O wants sector aligned memory, sizes and offsets; 4 KB covers every disk in use
+static const size_t kSectorSize = 4096;
+
+static size_t AlignUp(size_t inSize) {
+    return (inSize + kSectorSize - 1) & ~(kSectorSize - 1);
+}
+
+AsyncFileWriter::AsyncFileWriter(const std::string& inPath, size_t inBufferSize, int inBufferCount)
+    : mBufferSize(AlignUp((std::max)(inBufferSize, kSectorSize)))
+    , mBuffers((std::max)(inBufferCount, 2))
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(inPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    mFile = file;
+#else
+    mFile = open(inPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (mFile < 0 && errno == EINVAL) {
+        // File system without direct I/O (tmpfs), fall back to the page cache
+        mFile = open(inPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (mFile < 0) {
+        return;
+    }
+#endif
+
+    for (Buffer& buffer : mBuffers) {
+#ifdef _WIN32
+        buffer.data = (uint8_t*)_aligned_malloc(mBufferSize, kSectorSize);
+#else
+        void* pData = nullptr;
+        buffer.data = posix_memalign(&pData, kSectorSize, mBufferSize) == 0 ? (uint8_t*)pData : nullptr;
+#endif
+        if (!buffer.data) {
+            throw std::bad_alloc();
+        }
+        mFree.push_back(&buffer);
+    }
+    mThread = std::thread(&AsyncFileWriter::ioLoop, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    close();
+    for (Buffer& buffer : mBuffers) {
+#ifdef _WIN32
+        _aligned_free(buffer.data);
+#else
+        free(buffer.data);
+#endif
+    }
+}
+
+AsyncFileWriter::operator bool() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+#ifdef _WIN32
+    return mFile && !mFailed;
+#else
+    return mFile >= 0 && !mFailed;
+#endif
+}
+
+bool
+AsyncFileWriter::write(const void* inData, size_t inSize)
+{
+    const uint8_t* pData = (const uint8_t*)inData;
+    while (inSize) {
+        if (!mpCurrent) {
+            std::unique_lock<std::mutex> lock(mLock);
+            if (mFree.empty()) {
+                mStalls++;
+                mCondition.wait(lock, [this] { return !mFree.empty() || mFailed || !mThread.joinable(); });
+            }
+            if (mFailed || mFree.empty()) {
+                return false;
+            }
+            mpCurrent = mFree.front();
+            mFree.pop_front();
+            mpCurrent->size = 0;
+        }
+        const size_t size = (std::min)(inSize, mBufferSize - mpCurrent->size);
+        memcpy(mpCurrent->data + mpCurrent->size, pData, size);
+        mpCurrent->size += size;
+        mBytesWritten += size;
+        pData += size;
+        inSize -= size;
+        if (mpCurrent->size == mBufferSize && !submitCurrent()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+AsyncFileWriter::submitCurrent()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mPending.push_back(mpCurrent);
+    mpCurrent = nullptr;
+    mCondition.notify_all();
+    return !mFailed;
+}
+
+bool
+AsyncFileWriter::close()
+{
+    if (!mThread.joinable()) {
+        return !mFailed;
+    }
+    if (mpCurrent && mpCurrent->size) {
+        // Zero padded to the sector size, the padding is cut off below
+        memset(mpCurrent->data + mpCurrent->size, 0, AlignUp(mpCurrent->size) - mpCurrent->size);
+        submitCurrent();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStop = true;
+        mCondition.notify_all();
+    }
+    mThread.join();
+    closeFile();
+    return !mFailed;
+}
+
+void
+AsyncFileWriter::ioLoop()
+{
+    while (true) {
+        Buffer* pBuffer = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mCondition.wait(lock, [this] { return mStop || !mPending.empty(); });
+            if (mPending.empty()) {
+                return;
+            }
+            pBuffer = mPending.front();
+            mPending.pop_front();
+        }
+        const bool written = mFailed || writeFile(pBuffer->data, AlignUp(pBuffer->size));
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!written && !mFailed) {
+            std::cerr << "Writing output file failed" << std::endl;
+            mFailed = true;
+        }
+        mFree.push_back(pBuffer);
+        mCondition.notify_all();
+    }
+}
+
+#ifdef _WIN32
+
+bool
+AsyncFileWriter::writeFile(const uint8_t* inData, size_t inSize)
+{
+    while (inSize) {
+        DWORD written = 0;
+        if (!WriteFile(mFile, inData, (DWORD)(std::min)(inSize, (size_t)1 << 30), &written, nullptr) || !written) {
+            return false;
+        }
+        inData += written;
+        inSize -= written;
+    }
+    return true;
+}
+
+void
+AsyncFileWriter::closeFile()
+{
+    if (!mFile) {
+        return;
+    }
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)mBytesWritten;
+    if (!SetFilePointerEx(mFile, size, nullptr, FILE_BEGIN) || !SetEndOfFile(mFile)) {
+        mFailed = true;
+    }
+    CloseHandle(mFile);
+    mFile = nullptr;
+}
+
+#else
+
+bool
+AsyncFileWriter::writeFile(const uint8_t* inData, size_t inSize)
+{
+    while (inSize) {
+        ssize_t written = ::write(mFile, inData, inSize);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        inData += written;
+        inSize -= written;
+    }
+    return true;
+}
+
+void
+AsyncFileWriter::closeFile()
+{
+    if (mFile < 0) {
+        return;
+    }
+    if (ftruncate(mFile, (off_t)mBytesWritten) != 0) {
+        mFailed = true;
+    }
+    ::close(mFile);
+    mFile = -1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sequential file output that never makes the caller wait for the disk, unless the disk falls
+// behind by every buffer. write() only copies into the current buffer; full buffers go to an
+// I/O thread that writes them unbuffered (O_DIRECT / FILE_FLAG_NO_BUFFERING), so large frame
+// streams neither stall on the page cache nor evict everything else from it. Buffers are
+// aligned and a multiple of the sector size, the padded tail is truncated away in close().
+class AsyncFileWriter {
+public:
+    explicit AsyncFileWriter(const std::string& inPath, size_t inBufferSize = 8 << 20, int inBufferCount = 4);
+
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // False if the file could not be created or a write failed
+    explicit operator bool() const;
+
+    bool write(const void* inData, size_t inSize);
+
+    // Writes what is buffered, waits for the I/O thread and closes the file
+    bool close();
+
+    uint64_t getBytesWritten() const { return mBytesWritten; }
+    // Times write() had to wait for a free buffer
+    uint64_t getStalls() const { return mStalls; }
+
+private:
+    struct Buffer {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    void ioLoop();
+    bool submitCurrent();
+    bool writeFile(const uint8_t* inData, size_t inSize);
+    void closeFile();
+
+    size_t mBufferSize;
+    std::vector<Buffer> mBuffers;
+    Buffer* mpCurrent = nullptr;
+    uint64_t mBytesWritten = 0;
+    uint64_t mStalls = 0;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<Buffer*> mFree;
+    std::deque<Buffer*> mPending;
+    bool mStop = false;
+    bool mFailed = false;
+    std::thread mThread;
+
+#ifdef _WIN32
+    void* mFile = nullptr;
+#else
+    int mFile = -1;
+#endif
+};
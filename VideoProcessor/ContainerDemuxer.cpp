@@ -0,0 +1,204 @@
+#include "ContainerDemuxer.hpp"
+
+#include "MkvDemuxer.hpp"
+#include "Mp4Demuxer.hpp"
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const uint8_t kStartCode[4] = { 0, 0, 0, 1 };
+
+inline uint32_t ReadBe16(const uint8_t* p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+void AppendNal(std::vector<uint8_t>& ioOut, const uint8_t* inNal, size_t inSize) {
+    ioOut.insert(ioOut.end(), kStartCode, kStartCode + 4);
+    ioOut.insert(ioOut.end(), inNal, inNal + inSize);
+}
+
+}
+
+bool
+ParseAvcConfig(const uint8_t* inData, size_t inSize, VideoTrackInfo& ioTrack)
+{
+    // configurationVersion, profile, compatibility, level, lengthSizeMinusOne, numOfSequenceParameterSets
+    if (inSize < 7 || inData[0] != 1) {
+        return false;
+    }
+    ioTrack.codec = VideoCodec::H264;
+    ioTrack.nalLengthSize = (inData[4] & 3) + 1;
+    ioTrack.parameterSets.clear();
+    const uint8_t* p = inData + 5;
+    const uint8_t* pEnd = inData + inSize;
+    // SPS count in the low 5 bits, then the PPS count as a whole byte
+    for (int list = 0; list < 2; list++) {
+        if (p >= pEnd) {
+            return false;
+        }
+        const int count = list == 0 ? (*p++ & 0x1F) : *p++;
+        for (int i = 0; i < count; i++) {
+            if (pEnd - p < 2 || pEnd - p - 2 < (ptrdiff_t)ReadBe16(p)) {
+                return false;
+            }
+            const uint32_t size = ReadBe16(p);
+            AppendNal(ioTrack.parameterSets, p + 2, size);
+            p += 2 + size;
+        }
+    }
+    return ioTrack.nalLengthSize != 3;
+}
+
+bool
+ParseHevcConfig(const uint8_t* inData, size_t inSize, VideoTrackInfo& ioTrack)
+{
+    // 21 bytes of profile, tier and level, then lengthSizeMinusOne and numOfArrays
+    if (inSize < 23 || inData[0] != 1) {
+        return false;
+    }
+    ioTrack.codec = VideoCodec::Hevc;
+    ioTrack.nalLengthSize = (inData[21] & 3) + 1;
+    ioTrack.parameterSets.clear();
+    const uint8_t* p = inData + 23;
+    const uint8_t* pEnd = inData + inSize;
+    for (int array = 0; array < inData[22]; array++) {
+        // array_completeness, NAL_unit_type, numNalus
+        if (pEnd - p < 3) {
+            return false;
+        }
+        const uint32_t count = ReadBe16(p + 1);
+        p += 3;
+        for (uint32_t i = 0; i < count; i++) {
+            if (pEnd - p < 2 || pEnd - p - 2 < (ptrdiff_t)ReadBe16(p)) {
+                return false;
+            }
+            const uint32_t size = ReadBe16(p);
+            AppendNal(ioTrack.parameterSets, p + 2, size);
+            p += 2 + size;
+        }
+    }
+    return ioTrack.nalLengthSize != 3;
+}
+
+ContainerFormat
+ProbeContainer(const uint8_t* inData, size_t inSize)
+{
+    if (inSize >= 4 && inData[0] == 0x1A && inData[1] == 0x45 && inData[2] == 0xDF && inData[3] == 0xA3) {
+        return ContainerFormat::Matroska;
+    }
+    // An elementary stream starts with a start code, so a box header never looks like one
+    static const char* const kTopLevelBoxes[] = { "ftyp", "moov", "mdat", "free", "skip", "wide" };
+    if (inSize >= 8) {
+        for (const char* pType : kTopLevelBoxes) {
+            if (memcmp(inData + 4, pType, 4) == 0) {
+                return ContainerFormat::Mp4;
+            }
+        }
+    }
+    return ContainerFormat::AnnexB;
+}
+
+ContainerDemuxer::ContainerDemuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight)
+    : mData(inData)
+    , mSize(inSize)
+    , mBuffers(std::max(inUnitsInFlight, 1) + 1)
+{
+}
+
+void
+ContainerDemuxer::allocateBuffers()
+{
+    // Each length prefix shorter than a start code grows the sample by the difference, and a NAL
+    // unit is at least a length and a header byte. No sample is larger than the file.
+    const size_t sample = std::min(mTrack.maxSampleSize, mSize);
+    const size_t growth = mTrack.nalLengthSize < 4 ? sample / (mTrack.nalLengthSize + 1) * (4 - mTrack.nalLengthSize) : 0;
+    for (Buffer& buffer : mBuffers) {
+        buffer.capacity = mTrack.parameterSets.size() + sample + growth + 4;
+        buffer.data.reset(new uint8_t[buffer.capacity]);
+    }
+}
+
+bool
+ContainerDemuxer::emit(const uint8_t* inSample, size_t inSize, int64_t inPts, bool inKeyframe, AccessUnit& outUnit)
+{
+    const int lengthSize = mTrack.nalLengthSize;
+    const bool parameterSets = inKeyframe || !mParameterSetsSent;
+    Buffer& buffer = mBuffers[mNextBuffer];
+    const size_t growth = lengthSize < 4 ? inSize / (lengthSize + 1) * (4 - lengthSize) : 0;
+    const size_t needed = (parameterSets ? mTrack.parameterSets.size() : 0) + inSize + growth + 4;
+    if (buffer.capacity < needed) {
+        // Only while the largest sample is not known yet
+        buffer.capacity = needed + needed / 4;
+        buffer.data.reset(new uint8_t[buffer.capacity]);
+    }
+
+    uint8_t* pOut = buffer.data.get();
+    if (parameterSets && !mTrack.parameterSets.empty()) {
+        memcpy(pOut, mTrack.parameterSets.data(), mTrack.parameterSets.size());
+        pOut += mTrack.parameterSets.size();
+    }
+    const uint8_t* p = inSample;
+    const uint8_t* pEnd = inSample + inSize;
+    while (pEnd - p > lengthSize) {
+        size_t size = 0;
+        for (int i = 0; i < lengthSize; i++) {
+            size = (size << 8) | p[i];
+        }
+        p += lengthSize;
+        if (size == 0) {
+            continue;
+        }
+        if (size > (size_t)(pEnd - p)) {
+            LOG_WARNING("Demuxer: NAL unit of " << size << " bytes overruns sample " << mFrameIndex << " of " << inSize
+                << " bytes, skipped");
+            Telemetry::Count(TelemetryCounter::DecodeErrors);
+            mFrameIndex++;
+            return false;
+        }
+        memcpy(pOut, kStartCode, 4);
+        memcpy(pOut + 4, p, size);
+        pOut += 4 + size;
+        p += size;
+    }
+
+    outUnit = AccessUnit();
+    outUnit.data = buffer.data.get();
+    outUnit.size = pOut - buffer.data.get();
+    outUnit.offset = inSample - mData;
+    outUnit.frameIndex = mFrameIndex++;
+    outUnit.pts = inPts;
+    outUnit.idr = inKeyframe;
+    outUnit.sps = outUnit.pps = parameterSets && !mTrack.parameterSets.empty();
+    outUnit.picture = true;
+    mParameterSetsSent = true;
+    mNextBuffer = (mNextBuffer + 1) % mBuffers.size();
+    Telemetry::Count(TelemetryCounter::AccessUnits);
+    Telemetry::Count(TelemetryCounter::BytesParsed, inSize);
+    return true;
+}
+
+std::unique_ptr<PacketSource>
+OpenPacketSource(const uint8_t* inData, size_t inSize, int inUnitsInFlight, VideoTrackInfo& outTrack)
+{
+    std::unique_ptr<ContainerDemuxer> pDemuxer;
+    switch (ProbeContainer(inData, inSize)) {
+    case ContainerFormat::Mp4:
+        pDemuxer.reset(new Mp4Demuxer(inData, inSize, inUnitsInFlight));
+        break;
+    case ContainerFormat::Matroska:
+        pDemuxer.reset(new MkvDemuxer(inData, inSize, inUnitsInFlight));
+        break;
+    default:
+        outTrack = VideoTrackInfo();
+        return std::unique_ptr<PacketSource>(new AnnexBPacketizer(inData, inSize));
+    }
+    if (!*pDemuxer) {
+        LOG_ERROR("No H.264 or HEVC video track in the container");
+        return nullptr;
+    }
+    outTrack = pDemuxer->getTrack();
+    return std::unique_ptr<PacketSource>(pDemuxer.release());
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "Decoder.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// The video track a demuxer reads
+struct VideoTrackInfo {
+    VideoCodec codec = VideoCodec::H264;
+    int width = 0, height = 0;
+    int nalLengthSize = 4;                  // Bytes of the big endian length in front of each NAL unit
+    std::vector<uint8_t> parameterSets;     // From avcC/hvcC, as Annex-B
+    int64_t sampleCount = 0;                // 0 when the container does not tell (Matroska)
+    size_t maxSampleSize = 0;               // Same
+};
+
+// Reads the NAL length size and the parameter sets out of the payload of an avcC box
+// (AVCDecoderConfigurationRecord) or hvcC box (HEVCDecoderConfigurationRecord), which is also
+// Matroska's CodecPrivate. Returns false if the record is malformed.
+bool ParseAvcConfig(const uint8_t* inData, size_t inSize, VideoTrackInfo& ioTrack);
+bool ParseHevcConfig(const uint8_t* inData, size_t inSize, VideoTrackInfo& ioTrack);
+
+enum class ContainerFormat {
+    AnnexB,         // Elementary stream, anything not recognized as a container
+    Mp4,            // ISO base media file: MP4, MOV
+    Matroska,       // Matroska, WebM
+};
+
+ContainerFormat ProbeContainer(const uint8_t* inData, size_t inSize);
+
+// Reads the video track of a memory mapped container in place. Samples are length prefixed NAL
+// units; each is rewritten as Annex-B, with the track's parameter sets in front of keyframes, into
+// the next buffer of a small ring. The buffers are sized for the largest sample once (when the
+// container tells, else they grow to it), so there is no allocation per sample. An access unit
+// stays valid until unitsInFlight more were read, which must cover the units queued downstream.
+class ContainerDemuxer : public PacketSource {
+public:
+    // False when the input has no H.264/HEVC video track the demuxer understands
+    explicit operator bool() const { return mOpen; }
+
+    const VideoTrackInfo& getTrack() const { return mTrack; }
+
+protected:
+    ContainerDemuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight);
+
+    // Sizes the ring for mTrack, call once the track is known
+    void allocateBuffers();
+
+    // Rewrites one sample into outUnit. Returns false for a malformed sample, which is skipped.
+    bool emit(const uint8_t* inSample, size_t inSize, int64_t inPts, bool inKeyframe, AccessUnit& outUnit);
+
+    const uint8_t* mData;
+    size_t mSize;
+    VideoTrackInfo mTrack;
+    bool mOpen = false;
+
+private:
+    struct Buffer {
+        std::unique_ptr<uint8_t[]> data;    // Not initialized, pages are only touched when written
+        size_t capacity = 0;
+    };
+
+    std::vector<Buffer> mBuffers;
+    size_t mNextBuffer = 0;
+    int64_t mFrameIndex = 0;
+    bool mParameterSetsSent = false;
+};
+
+// An Mp4Demuxer or MkvDemuxer for a container, an AnnexBPacketizer (H.264) otherwise. Logs the
+// reason and returns null when a container has no usable video track.
+std::unique_ptr<PacketSource> OpenPacketSource(const uint8_t* inData, size_t inSize, int inUnitsInFlight,
+    VideoTrackInfo& outTrack);
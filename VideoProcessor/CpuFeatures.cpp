@@ -0,0 +1,161 @@
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#endif
+
+static void cpuid(int inLeaf, int inSubLeaf, uint32_t outRegs[4]) {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, inLeaf, inSubLeaf);
+    for (int i = 0; i < 4; i++) {
+        outRegs[i] = (uint32_t)regs[i];
+    }
+#else
+    __cpuid_count(inLeaf, inSubLeaf, outRegs[0], outRegs[1], outRegs[2], outRegs[3]);
+#endif
+}
+
+static uint64_t xgetbv0() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static SimdLevel DetectSimdLevel() {
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    const uint32_t maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    const bool sse41 = (regs[2] >> 19) & 1;
+    const bool osxsave = (regs[2] >> 27) & 1;
+    const bool avx = (regs[2] >> 28) & 1;
+    if (!sse41) {
+        return SimdLevel::Scalar;
+    }
+    if (!osxsave || !avx || maxLeaf < 7) {
+        return SimdLevel::SSE41;
+    }
+
+    const uint64_t xcr0 = xgetbv0();
+    // XMM and YMM state enabled by the OS
+    if ((xcr0 & 0x6) != 0x6) {
+        return SimdLevel::SSE41;
+    }
+    cpuid(7, 0, regs);
+    const bool avx2 = (regs[1] >> 5) & 1;
+    const bool avx512f = (regs[1] >> 16) & 1;
+    const bool avx512bw = (regs[1] >> 30) & 1;
+    if (!avx2) {
+        return SimdLevel::SSE41;
+    }
+    // Opmask, upper ZMM0-15 and ZMM16-31 state enabled by the OS
+    if (avx512f && avx512bw && (xcr0 & 0xe6) == 0xe6) {
+        return SimdLevel::AVX512;
+    }
+    return SimdLevel::AVX2;
+}
+
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+const char* GetSimdLevelName(SimdLevel inLevel) {
+    switch (inLevel) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE41:  return "sse4.1";
+    case SimdLevel::AVX2:   return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+std::vector<int> GetAvailableCpus() {
+    std::vector<int> cpus;
+#ifdef _WIN32
+    const int count = (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    for (int i = 0; i < count; i++) {
+        cpus.push_back(i);
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        for (int i = 0; i < (int)std::thread::hardware_concurrency(); i++) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+// Windows numbers processors within groups of up to 64; full groups are assumed
+int GetCpuNumaNode(int inCpu) {
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor = {};
+    processor.Group = (WORD)(inCpu / 64);
+    processor.Number = (BYTE)(inCpu % 64);
+    USHORT node = 0;
+    return GetNumaProcessorNodeEx(&processor, &node) && node != 0xffff ? node : 0;
+#else
+    // The cpu directory holds a nodeN link to its node
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(inCpu);
+    DIR* pDir = opendir(path.c_str());
+    if (!pDir) {
+        return 0;
+    }
+    int node = 0;
+    while (dirent* pEntry = readdir(pDir)) {
+        if (strncmp(pEntry->d_name, "node", 4) == 0 && pEntry->d_name[4] >= '0' && pEntry->d_name[4] <= '9') {
+            node = atoi(pEntry->d_name + 4);
+            break;
+        }
+    }
+    closedir(pDir);
+    return node;
+#endif
+}
+
+bool PinCurrentThread(int inCpu) {
+#ifdef _WIN32
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = (WORD)(inCpu / 64);
+    affinity.Mask = (KAFFINITY)1 << (inCpu % 64);
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(inCpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+// Instruction set levels the host kernels are built for, in increasing order
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512,     // AVX-512 F + BW
+};
+
+// Highest level supported by both the CPU and the OS (register state saving). Detected once.
+SimdLevel GetSimdLevel();
+
+const char* GetSimdLevelName(SimdLevel inLevel);
+
+// Logical processors the process may run on, in ascending order
+std::vector<int> GetAvailableCpus();
+
+// NUMA node of logical processor inCpu, 0 when unknown
+int GetCpuNumaNode(int inCpu);
+
+// Restricts the calling thread to logical processor inCpu. Returns false if the OS refused.
+bool PinCurrentThread(int inCpu);
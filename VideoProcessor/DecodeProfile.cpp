@@ -0,0 +1,81 @@
+#include "DecodeProfile.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+static DecodeProfile MakeProfile(DecodeProfileType inType, const char* inName, int inDisplayDelay, int inExtraDecodeSurfaces,
+    int inOutputSurfaces, bool inFrameThreading, int inPacketQueueDepth, int inFrameQueueDepth, int inImageQueueDepth)
+{
+    DecodeProfile profile;
+    profile.type = inType;
+    profile.name = inName;
+    profile.displayDelay = inDisplayDelay;
+    profile.extraDecodeSurfaces = inExtraDecodeSurfaces;
+    profile.outputSurfaces = inOutputSurfaces;
+    profile.frameThreading = inFrameThreading;
+    profile.packetQueueDepth = inPacketQueueDepth;
+    profile.frameQueueDepth = inFrameQueueDepth;
+    profile.imageQueueDepth = inImageQueueDepth;
+    return profile;
+}
+
+const DecodeProfile&
+GetDecodeProfile(DecodeProfileType inType)
+{
+    static const DecodeProfile profiles[] = {
+        MakeProfile(DecodeProfileType::LowLatency, "low-latency", 0, 0, 1, false, 1, 1, 1),
+        MakeProfile(DecodeProfileType::Balanced, "balanced", 1, 0, 2, true, 32, 4, 2),
+        MakeProfile(DecodeProfileType::Throughput, "throughput", 4, 4, 4, true, 64, 8, 4),
+    };
+    return profiles[(int)inType];
+}
+
+bool
+GetDecodeProfile(const std::string& inName, DecodeProfile& outProfile)
+{
+    for (DecodeProfileType type : { DecodeProfileType::LowLatency, DecodeProfileType::Balanced, DecodeProfileType::Throughput }) {
+        if (inName == GetDecodeProfile(type).name) {
+            outProfile = GetDecodeProfile(type);
+            return true;
+        }
+    }
+    return false;
+}
+
+int64_t
+DecodeLatencyTracker::NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DecodeLatencyTracker::DecodeLatencyTracker()
+{
+}
+
+void
+DecodeLatencyTracker::submit(int64_t inTimestamp, int64_t inSubmitNs)
+{
+    Pending& pending = mPending[inTimestamp & (kPendingCount - 1)];
+    pending.timestamp = inTimestamp;
+    pending.submitNs = inSubmitNs >= 0 ? inSubmitNs : NowNs();
+}
+
+void
+DecodeLatencyTracker::complete(int64_t inTimestamp)
+{
+    Pending& pending = mPending[inTimestamp & (kPendingCount - 1)];
+    if (pending.timestamp != inTimestamp) {
+        // Not submitted through this tracker, or overwritten by a later one
+        return;
+    }
+    pending.timestamp = -1;
+    const uint64_t latencyNs = (uint64_t)std::max<int64_t>(0, NowNs() - pending.submitNs);
+    mHistogram.record(latencyNs);
+    mMaxNs = std::max(mMaxNs, latencyNs);
+}
+
+double
+DecodeLatencyTracker::getPercentileMs(double inPercentile) const
+{
+    return std::min(getMaxMs(), mHistogram.getPercentileNs(inPercentile) / 1e6);
+}
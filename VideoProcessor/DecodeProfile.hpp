@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Telemetry.hpp"
+
+#include <cstdint>
+#include <string>
+
+enum class DecodeProfileType {
+    LowLatency,     // Every frame out as soon as it is decoded, nothing queued behind it
+    Balanced,       // The defaults
+    Throughput,     // Deep queues and many surfaces in flight, for batch jobs
+};
+
+// Settings that trade latency for throughput, chosen together. The decoders take the backend
+// specific part, the pipeline queue depths are applied by whoever builds the pipeline.
+struct DecodeProfile {
+    DecodeProfileType type = DecodeProfileType::Balanced;
+    const char* name = "balanced";
+    int displayDelay = 1;           // NVDEC: pictures the parser holds back before display (ulMaxDisplayDelay)
+    int extraDecodeSurfaces = 0;    // NVDEC: decode surfaces on top of the minimum the stream needs
+    int outputSurfaces = 2;         // NVDEC: output surfaces, unless mapped frames hold them
+    bool frameThreading = true;     // SW: frame threading, adds a frame of delay per thread
+    int packetQueueDepth = 32;
+    int frameQueueDepth = 4;
+    int imageQueueDepth = 2;
+};
+
+const DecodeProfile& GetDecodeProfile(DecodeProfileType inType);
+
+// "low-latency", "balanced" or "throughput"; false for anything else
+bool GetDecodeProfile(const std::string& inName, DecodeProfile& outProfile);
+
+// Time from submitting an access unit until its frame comes back from the decoder, matched
+// through the timestamp (the frame number given to decode()), recorded into a telemetry
+// LatencyHistogram. Not thread safe, submit() and complete() run on the decoding thread.
+class DecodeLatencyTracker {
+public:
+    DecodeLatencyTracker();
+
+    // When the access unit was submitted (steady clock, now by default), and when its frame
+    // came out of getFrame()
+    void submit(int64_t inTimestamp, int64_t inSubmitNs = -1);
+    void complete(int64_t inTimestamp);
+
+    static int64_t NowNs();
+
+    uint64_t getCount() const { return mHistogram.getCount(); }
+    double getMeanMs() const { return getCount() ? mHistogram.getSumNs() / 1e6 / getCount() : 0; }
+    double getMaxMs() const { return mMaxNs / 1e6; }
+    // Upper bound of the bucket holding the inPercentile (0..100) sample, at most the maximum
+    double getPercentileMs(double inPercentile) const;
+    const LatencyHistogram& getHistogram() const { return mHistogram; }
+
+private:
+    static const int kPendingCount = 256;       // Timestamps in flight at most, a power of 2
+
+    struct Pending {
+        int64_t timestamp = -1;
+        int64_t submitNs = 0;
+    };
+
+    Pending mPending[kPendingCount];
+    LatencyHistogram mHistogram;
+    uint64_t mMaxNs = 0;
+};
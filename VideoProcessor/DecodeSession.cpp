@@ -0,0 +1,69 @@
+#include "DecodeSession.hpp"
+
+DecodeSession::DecodeSession(int inId, const std::string& inPath, std::unique_ptr<Decoder> inDecoder, int inLoops)
+    : mId(inId)
+    , mPath(inPath)
+    , mInput(inPath)
+    , mPacketizer(mInput.data(), mInput.size())
+    , mDecoder(std::move(inDecoder))
+    , mLoopsLeft(inLoops > 1 ? inLoops : 1)
+{
+}
+
+double
+DecodeSession::getElapsedSeconds() const
+{
+    if (!mSlices) {
+        return 0;
+    }
+    const int64_t end = mEndOfStream ? mEnd.load() : std::chrono::steady_clock::now().time_since_epoch().count();
+    return std::chrono::duration<double>(std::chrono::steady_clock::duration(end - mStart)).count();
+}
+
+bool
+DecodeSession::runSlice(int inMaxUnits, std::chrono::steady_clock::time_point inDeadline)
+{
+    if (mEndOfStream) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!mSlices) {
+        mStart = start.time_since_epoch().count();
+    }
+    mSlices++;
+
+    AccessUnit unit;
+    for (int i = 0; i < inMaxUnits; i++) {
+        if (!mPacketizer.next(unit)) {
+            if (--mLoopsLeft > 0) {
+                mPacketizer.reset(0, mUnits);
+                continue;
+            }
+            drainFrames(mDecoder->decode(nullptr, 0));
+            mEnd = std::chrono::steady_clock::now().time_since_epoch().count();
+            mEndOfStream = true;
+            break;
+        }
+        drainFrames(mDecoder->decode(unit.data, unit.size, unit.frameIndex, true));
+        mUnits++;
+        if (std::chrono::steady_clock::now() >= inDeadline) {
+            break;
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    mBusyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return !mEndOfStream;
+}
+
+void
+DecodeSession::drainFrames(int inCount)
+{
+    while (inCount--) {
+        FrameHandle frame = mDecoder->getFrame();
+        mFrames++;
+        if (mFrameCallback) {
+            mFrameCallback(*this, frame);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "Decoder.hpp"
+#include "MappedFile.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// One input stream and the decoder that owns it, driven in slices by a SessionScheduler.
+// Only one worker runs a session at a time, so the session itself needs no locking; the
+// statistics are atomics because they are read while it runs.
+class DecodeSession {
+public:
+    // Called for every decoded frame on the worker thread that decoded it. Without a
+    // callback frames are released right away.
+    typedef std::function<void(DecodeSession&, FrameHandle&)> FrameCallback;
+
+    // inLoops > 1 restarts the input at its end, for long running benchmarks
+    DecodeSession(int inId, const std::string& inPath, std::unique_ptr<Decoder> inDecoder, int inLoops = 1);
+
+    DecodeSession(const DecodeSession&) = delete;
+    DecodeSession& operator=(const DecodeSession&) = delete;
+
+    // False if the input could not be opened
+    explicit operator bool() const { return (bool)mInput; }
+
+    void setFrameCallback(FrameCallback inCallback) { mFrameCallback = std::move(inCallback); }
+
+    // Decodes access units until inMaxUnits were fed or inDeadline passed, whichever comes
+    // first. Returns false once the stream is fully decoded and flushed.
+    bool runSlice(int inMaxUnits, std::chrono::steady_clock::time_point inDeadline);
+
+    int getId() const { return mId; }
+    const std::string& getPath() const { return mPath; }
+    Decoder& getDecoder() { return *mDecoder; }
+
+    uint64_t getFrames() const { return mFrames; }
+    uint64_t getUnits() const { return mUnits; }
+    uint64_t getSlices() const { return mSlices; }
+    // Time spent decoding, and from the first slice to the end of the stream
+    double getBusySeconds() const { return mBusyNs / 1e9; }
+    double getElapsedSeconds() const;
+
+private:
+    void drainFrames(int inCount);
+
+    int mId;
+    std::string mPath;
+    MappedFile mInput;
+    AnnexBPacketizer mPacketizer;
+    std::unique_ptr<Decoder> mDecoder;
+    int mLoopsLeft;
+    std::atomic<bool> mEndOfStream{ false };
+    FrameCallback mFrameCallback;
+
+    std::atomic<uint64_t> mFrames{ 0 };
+    std::atomic<uint64_t> mUnits{ 0 };
+    std::atomic<uint64_t> mSlices{ 0 };
+    std::atomic<uint64_t> mBusyNs{ 0 };
+    // steady_clock ticks
+    std::atomic<int64_t> mStart{ 0 }, mEnd{ 0 };
+};
@@ -1,24 +1,74 @@
 #pragma once
 
-#include <cuda.h>
-#include <cuviddec.h>
-#include <nvcuvid.h>
+#include "FramePool.hpp"
+#include "Telemetry.hpp"
 
+#include <cstddef>
 #include <cstdint>
-#include <istream>
-#include <mutex>
-#include <vector>
+#include <deque>
+#include <iostream>
+#include <memory>
 
+// Compressed video formats the backends are set up for
+enum class VideoCodec {
+    H264,
+    Hevc,
+};
+
+// Backend independent description of the stream being decoded
+struct VideoFormat {
+    int codedWidth = 0, codedHeight = 0;
+    int frameRateNum = 0, frameRateDen = 1;
+    int bitDepth = 8;
+    int matrixCoefficients = 0;
+    bool progressive = true;
+    struct {
+        int l, t, r, b;
+    } displayRect = {};
+};
+
+// Decode backend interface. Every backend produces frames in the same layout:
+// a GetWidth() * GetHeight() luma plane followed by an interleaved UV plane
+// (NV12 for 8 bit streams, P016 for high bit depth streams). The pitch is in FrameInfo, the
+// UV plane starts at pitch * height. Frames come out of a FramePool owned by the backend.
 class Decoder {
 public:
-	Decoder(CUcontext inCuContext);
+    virtual ~Decoder() = default;
+
+    // Feeds a chunk of bitstream. Null/empty input signals end of stream and flushes the backend.
+    // inTimestamp is attached to the picture(s) starting in the chunk. inAccessUnit tells the
+    // chunk is exactly one complete access unit (see AnnexBPacketizer), which lets backends
+    // skip their own bitstream splitting and output the picture without waiting for the next one.
+    // Returns the number of frames that can be fetched with getFrame().
+    virtual int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp = 0, bool inAccessUnit = false) = 0;
 
-	~Decoder();
+    // Returns the next decoded frame, or an empty handle if there is none. The frame stays
+    // valid as long as a handle to it is held; holding too many stalls or drops decoding,
+    // depending on the pool policy. All handles must be released before the decoder is destroyed.
+    FrameHandle getFrame() {
+        FrameHandle frame;
+        if (!mReadyFrames.empty()) {
+            frame = std::move(mReadyFrames.front());
+            mReadyFrames.pop_front();
+        }
+        return frame;
+    }
+
+    // Ends the stream and drops the frames it still had in flight, fetched or not, so decoding
+    // can start over at another IDR picture (see StreamSeeker)
+    void flush() {
+        decode(nullptr, 0);
+        mReadyFrames.clear();
+    }
 
-	int decode(uint8_t* inData, size_t inLength);
+    FrameMemoryType getFrameMemoryType() const { return mFramePool->getMemoryType(); }
 
-    CUdeviceptr getFrame();
-    CUVIDEOFORMAT GetVideoFormatInfo() { return mVideoFormat; }
+    FramePool& GetFramePool() { return *mFramePool; }
+
+    // Human readable backend name for logs and statistics
+    virtual const char* getName() const = 0;
+
+    const VideoFormat& GetVideoFormat() const { return mFormat; }
 
     int GetWidth() {
         return (mWidth + 1) & ~1;
@@ -26,45 +76,28 @@ public:
 
     int GetHeight() { return mLumaHeight; }
 
-private:
-    struct Rect {
-        int l, t, r, b;
-    };
-
-    static int CUDAAPI HandleVideoSequenceProc(void* pUserData, CUVIDEOFORMAT* pVideoFormat) { return ((Decoder*)pUserData)->HandleVideoSequence(pVideoFormat); }
-    static int CUDAAPI HandlePictureDecodeProc(void* pUserData, CUVIDPICPARAMS* pPicParams) { return ((Decoder*)pUserData)->HandlePictureDecode(pPicParams); }
-    static int CUDAAPI HandlePictureDisplayProc(void* pUserData, CUVIDPARSERDISPINFO* pDispInfo) { return ((Decoder*)pUserData)->HandlePictureDisplay(pDispInfo); }
-    static int CUDAAPI HandleOperatingPointProc(void* pUserData, CUVIDOPERATINGPOINTINFO* pOPInfo) { return ((Decoder*)pUserData)->GetOperatingPoint(pOPInfo); }
-
     int GetFrameSize() { return GetWidth() * (mLumaHeight + (mChromaHeight * mNumChromaPlanes)) * mBPP; }
 
-    int HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat);
-    int HandlePictureDecode(CUVIDPICPARAMS* pPicParams);
-    int HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo);
-    int GetOperatingPoint(CUVIDOPERATINGPOINTINFO* pOPInfo);
-    int ReconfigureDecoder(CUVIDEOFORMAT* pVideoFormat);
+protected:
+    // A pool slot for the next output frame. Waits for a free slot under the block policy, unless
+    // the slots are all sitting in mReadyFrames: nobody would release them, so the frame is dropped.
+    FrameHandle AcquireFrame(size_t inSize) {
+        FrameHandle frame = mFramePool->acquire(inSize, (int)mReadyFrames.size() < mFramePool->getConfig().capacity);
+        if (!frame) {
+            Telemetry::Count(TelemetryCounter::FramesDropped);
+            LOG_WARNING("Frame pool exhausted, dropping frame");
+            return frame;
+        }
+        Telemetry::Count(TelemetryCounter::FramesDecoded);
+        return frame;
+    }
 
-	CUcontext mCuContext;
-	CUvideoctxlock mCtxLock;
-	CUvideoparser mParser;
-	CUvideodecoder mDecoder;
-    CUstream mCuvidStream;
+    std::unique_ptr<FramePool> mFramePool;
+    // Decoded, not yet fetched. Declared after the pool, so it is released first.
+    std::deque<FrameHandle> mReadyFrames;
 
     unsigned int mWidth = 0, mLumaHeight = 0, mChromaHeight = 0;
     unsigned int mNumChromaPlanes = 0;
-    int mSurfaceHeight = 0;
-    int mSurfaceWidth = 0;
-    cudaVideoCodec mCodec = cudaVideoCodec_NumCodecs;
-    cudaVideoChromaFormat mChromaFormat = cudaVideoChromaFormat_420;
-    cudaVideoSurfaceFormat mOutputFormat = cudaVideoSurfaceFormat_NV12;
-    int mBitDepthMinus8 = 0;
     int mBPP = 1;
-    CUVIDEOFORMAT mVideoFormat = {};
-    unsigned int m_nMaxWidth = 0, m_nMaxHeight = 0;
-    Rect mDisplayRect = {};
-
-    std::mutex mVPFrameLock;
-    std::vector<CUdeviceptr> mVPFrames;
-    int mDecodedFrame;
-    int mDecodedFrameReturned;
-};
\ No newline at end of file
+    VideoFormat mFormat = {};
+};
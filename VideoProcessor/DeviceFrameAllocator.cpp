@@ -0,0 +1,22 @@
+#include "DeviceFrameAllocator.hpp"
+
+#include "Utils.hpp"
+
+uint8_t*
+DeviceFrameAllocator::allocate(size_t inSize)
+{
+    CUdeviceptr dpFrame = 0;
+    CUDA_DRVAPI_CALL(cuCtxPushCurrent(mCuContext));
+    CUresult result = cuMemAlloc(&dpFrame, inSize);
+    cuCtxPopCurrent(nullptr);
+    CUDA_DRVAPI_CALL(result);
+    return (uint8_t*)dpFrame;
+}
+
+void
+DeviceFrameAllocator::free(uint8_t* inData)
+{
+    cuCtxPushCurrent(mCuContext);
+    cuMemFree((CUdeviceptr)inData);
+    cuCtxPopCurrent(nullptr);
+}
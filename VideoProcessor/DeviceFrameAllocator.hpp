@@ -0,0 +1,19 @@
+#pragma once
+
+#include "FramePool.hpp"
+
+#include <cuda.h>
+
+// cuMemAlloc'ed frames in inCuContext. The context is pushed around every call, so the pool
+// may allocate and free from any thread.
+class DeviceFrameAllocator : public FrameAllocator {
+public:
+    explicit DeviceFrameAllocator(CUcontext inCuContext) : mCuContext(inCuContext) {}
+
+    uint8_t* allocate(size_t inSize) override;
+    void free(uint8_t* inData) override;
+    FrameMemoryType getMemoryType() const override { return FrameMemoryType::Device; }
+
+private:
+    CUcontext mCuContext;
+};
@@ -1 +1,340 @@
 #include "Displayer.hpp"
+
+#include "Telemetry.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DISPLAYER_SSE2
+#endif
+
+namespace {
+
+const int kMinRowsPerPart = 16;
+
+void RunRows(ThreadPool* pThreadPool, int inRows, const std::function<void(int, int)>& inFunc) {
+    if (!pThreadPool || pThreadPool->getThreadCount() == 1 || inRows < 2 * kMinRowsPerPart) {
+        inFunc(0, inRows);
+        return;
+    }
+    pThreadPool->parallelFor(inRows, inFunc);
+}
+
+inline uint8_t Average(uint8_t a, uint8_t b) {
+    return (uint8_t)((a + b + 1) >> 1);
+}
+
+// outRow = (inAbove + 2 inRow + inBelow) / 4, as two rounded averages (pavgb) so the SIMD and
+// the scalar columns agree
+void BlendRows(const uint8_t* inAbove, const uint8_t* inRow, const uint8_t* inBelow, uint8_t* outRow, int inWidth) {
+    int x = 0;
+#ifdef DISPLAYER_SSE2
+    for (; x + 16 <= inWidth; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(inAbove + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(inRow + x));
+        __m128i c = _mm_loadu_si128((const __m128i*)(inBelow + x));
+        _mm_storeu_si128((__m128i*)(outRow + x), _mm_avg_epu8(_mm_avg_epu8(a, c), b));
+    }
+#endif
+    for (; x < inWidth; x++) {
+        outRow[x] = Average(Average(inAbove[x], inBelow[x]), inRow[x]);
+    }
+}
+
+// The same [1 2 1] across the row, edge pixels repeated
+void BlendColumns(const uint8_t* inRow, uint8_t* outRow, int inWidth) {
+    if (inWidth < 2) {
+        memcpy(outRow, inRow, inWidth);
+        return;
+    }
+    outRow[0] = Average(Average(inRow[0], inRow[1]), inRow[0]);
+    int x = 1;
+#ifdef DISPLAYER_SSE2
+    for (; x + 17 <= inWidth; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(inRow + x - 1));
+        __m128i b = _mm_loadu_si128((const __m128i*)(inRow + x));
+        __m128i c = _mm_loadu_si128((const __m128i*)(inRow + x + 1));
+        _mm_storeu_si128((__m128i*)(outRow + x), _mm_avg_epu8(_mm_avg_epu8(a, c), b));
+    }
+#endif
+    for (; x < inWidth - 1; x++) {
+        outRow[x] = Average(Average(inRow[x - 1], inRow[x + 1]), inRow[x]);
+    }
+    outRow[inWidth - 1] = Average(Average(inRow[inWidth - 2], inRow[inWidth - 1]), inRow[inWidth - 1]);
+}
+
+// A 256 entry table has no SSE2 gather, so this is scalar, unrolled to keep four loads in flight
+void ApplyTable(const uint8_t* inTable, uint8_t* ioRow, int inWidth) {
+    int x = 0;
+    for (; x + 4 <= inWidth; x += 4) {
+        uint8_t v0 = inTable[ioRow[x]], v1 = inTable[ioRow[x + 1]];
+        uint8_t v2 = inTable[ioRow[x + 2]], v3 = inTable[ioRow[x + 3]];
+        ioRow[x] = v0;
+        ioRow[x + 1] = v1;
+        ioRow[x + 2] = v2;
+        ioRow[x + 3] = v3;
+    }
+    for (; x < inWidth; x++) {
+        ioRow[x] = inTable[ioRow[x]];
+    }
+}
+
+inline uint8_t ClampByte(double inValue) {
+    return (uint8_t)std::min(255.0, std::max(0.0, std::floor(inValue + 0.5)));
+}
+
+bool ParseNumber(const std::string& inText, double& outValue) {
+    if (inText.empty()) {
+        return false;
+    }
+    char* pEnd = nullptr;
+    outValue = strtod(inText.c_str(), &pEnd);
+    return *pEnd == '\0' && std::isfinite(outValue);
+}
+
+// Digits, ':' and '.' as 3x5 bitmaps, one row per byte, leftmost pixel in bit 2
+const uint8_t kGlyphs[12][5] = {
+    { 7, 5, 5, 5, 7 }, { 2, 6, 2, 2, 7 }, { 7, 1, 7, 4, 7 }, { 7, 1, 7, 1, 7 },
+    { 5, 5, 7, 1, 1 }, { 7, 4, 7, 1, 7 }, { 7, 4, 7, 5, 7 }, { 7, 1, 1, 1, 1 },
+    { 7, 5, 7, 5, 7 }, { 7, 5, 7, 1, 7 }, { 0, 2, 0, 2, 0 }, { 0, 0, 0, 0, 2 },
+};
+
+int GetGlyph(char inChar) {
+    return inChar == ':' ? 10 : inChar == '.' ? 11 : inChar - '0';
+}
+
+}
+
+Displayer::Displayer(const DisplayerConfig& inConfig)
+    : mConfig(inConfig)
+{
+    Pass pending;
+    bool hasPending = false;
+    for (int i = 0; i < 256; i++) {
+        pending.table[i] = (uint8_t)i;
+    }
+    // Point filters gathered since the last pass: onto the spatial pass in front of them when
+    // fusing, else a table pass of their own
+    auto flushPending = [&]() {
+        if (!hasPending) {
+            return;
+        }
+        if (mConfig.fuse && !mPasses.empty() && !mPasses.back().hasTable
+            && (mPasses.back().type == PassType::Deinterlace || mPasses.back().type == PassType::Denoise)) {
+            memcpy(mPasses.back().table, pending.table, sizeof(pending.table));
+            mPasses.back().hasTable = true;
+        } else {
+            pending.type = PassType::Table;
+            pending.hasTable = true;
+            mPasses.push_back(pending);
+        }
+        for (int i = 0; i < 256; i++) {
+            pending.table[i] = (uint8_t)i;
+        }
+        hasPending = false;
+    };
+
+    std::istringstream graph(mConfig.graph);
+    std::string filter;
+    while (std::getline(graph, filter, ',')) {
+        filter.erase(0, filter.find_first_not_of(" \t"));
+        filter.erase(filter.find_last_not_of(" \t") + 1);
+        if (filter.empty()) {
+            continue;
+        }
+        const size_t equals = filter.find('=');
+        const std::string name = filter.substr(0, equals);
+        const std::string argument = equals == std::string::npos ? std::string() : filter.substr(equals + 1);
+
+        if (name == "deinterlace" || name == "denoise" || name == "timestamp") {
+            flushPending();
+            Pass pass;
+            pass.type = name == "deinterlace" ? PassType::Deinterlace : name == "denoise" ? PassType::Denoise : PassType::Timestamp;
+            mPasses.push_back(pass);
+            continue;
+        }
+
+        double value = 0;
+        if (name != "brightness" && name != "contrast" && name != "gamma") {
+            std::cerr << "Unknown filter: " << name << std::endl;
+            throw std::exception();
+        }
+        if (!ParseNumber(argument, value) || (name == "gamma" && value <= 0)) {
+            std::cerr << "Invalid value for filter " << name << ": '" << argument << "'" << std::endl;
+            throw std::exception();
+        }
+        // Applied to the table so far, which composes the filters in order
+        for (int i = 0; i < 256; i++) {
+            const double y = pending.table[i];
+            pending.table[i] = name == "brightness" ? ClampByte(y + value)
+                : name == "contrast" ? ClampByte((y - 128) * value + 128)
+                : ClampByte(255 * std::pow(y / 255, 1 / value));
+        }
+        hasPending = true;
+        if (!mConfig.fuse) {
+            flushPending();
+        }
+    }
+    flushPending();
+
+    for (const Pass& pass : mPasses) {
+        static const char* const kPassNames[] = { "table", "deinterlace", "denoise", "timestamp" };
+        mDescription += (mDescription.empty() ? "" : ", ") + std::string(kPassNames[(int)pass.type]);
+        if (pass.hasTable && pass.type != PassType::Table) {
+            mDescription += "+table";
+        }
+    }
+
+    FramePoolConfig poolConfig;
+    poolConfig.capacity = std::max(2, mConfig.poolCapacity);
+    poolConfig.policy = FramePoolPolicy::Block;
+    mPool.reset(new FramePool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), poolConfig));
+}
+
+Displayer::~Displayer() = default;
+
+FrameHandle
+Displayer::acquireFrame(const FrameInfo& inInfo)
+{
+    FrameHandle frame = mPool->acquire((size_t)inInfo.pitch * (inInfo.height + (inInfo.height + 1) / 2));
+    if (frame) {
+        frame.info() = inInfo;
+    }
+    return frame;
+}
+
+FrameHandle
+Displayer::process(const FrameHandle& inFrame, bool inProgressive)
+{
+    const FrameInfo& info = inFrame.info();
+    if (info.bpp != 1 || inFrame.getMemoryType() != FrameMemoryType::Host) {
+        if (!mWarnedFormat) {
+            LOG_WARNING("Filter graph skipped: it runs on 8 bit frames in host memory only");
+            mWarnedFormat = true;
+        }
+        return inFrame;
+    }
+
+    FrameHandle frame = inFrame;
+    for (const Pass& pass : mPasses) {
+        if (pass.type == PassType::Table) {
+            runTable(pass, frame);
+        } else if (pass.type == PassType::Timestamp) {
+            DrawTimestamp(frame);
+        } else if (pass.type == PassType::Deinterlace && inProgressive) {
+            if (pass.hasTable) {
+                runTable(pass, frame);
+            }
+        } else {
+            FrameHandle target = acquireFrame(info);
+            if (!target) {
+                return FrameHandle();
+            }
+            runSpatial(pass, frame, target);
+            // The intermediate frame, if this was one, goes back to the pool here
+            frame = std::move(target);
+        }
+    }
+    return frame;
+}
+
+void
+Displayer::runTable(const Pass& inPass, const FrameHandle& ioFrame)
+{
+    const FrameInfo& info = ioFrame.info();
+    uint8_t* pLuma = ioFrame.data();
+    RunRows(mConfig.pThreadPool, info.height, [&](int inBegin, int inEnd) {
+        for (int y = inBegin; y < inEnd; y++) {
+            ApplyTable(inPass.table, pLuma + (size_t)y * info.pitch, info.width);
+        }
+    });
+}
+
+void
+Displayer::runSpatial(const Pass& inPass, const FrameHandle& inSource, const FrameHandle& outTarget)
+{
+    const FrameInfo& info = inSource.info();
+    const int pitch = info.pitch;
+    const int lumaHeight = info.height, chromaHeight = (info.height + 1) / 2;
+    const int chromaWidth = (info.width + 1) & ~1;
+    const uint8_t* pSource = inSource.data();
+    uint8_t* pTarget = outTarget.data();
+
+    // Luma rows first, then the rows of the interleaved UV plane, all in one split
+    RunRows(mConfig.pThreadPool, lumaHeight + chromaHeight, [&](int inBegin, int inEnd) {
+        std::vector<uint8_t> blended(inPass.type == PassType::Denoise ? info.width : 0);
+        for (int row = inBegin; row < inEnd; row++) {
+            const bool luma = row < lumaHeight;
+            const int y = luma ? row : row - lumaHeight;
+            const int height = luma ? lumaHeight : chromaHeight;
+            const size_t plane = luma ? 0 : (size_t)pitch * lumaHeight;
+            const uint8_t* pRow = pSource + plane + (size_t)y * pitch;
+            const uint8_t* pAbove = pSource + plane + (size_t)std::max(y - 1, 0) * pitch;
+            const uint8_t* pBelow = pSource + plane + (size_t)std::min(y + 1, height - 1) * pitch;
+            uint8_t* pOut = pTarget + plane + (size_t)y * pitch;
+
+            if (inPass.type == PassType::Deinterlace) {
+                BlendRows(pAbove, pRow, pBelow, pOut, luma ? info.width : chromaWidth);
+            } else if (luma) {
+                BlendRows(pAbove, pRow, pBelow, blended.data(), info.width);
+                BlendColumns(blended.data(), pOut, info.width);
+            } else {
+                memcpy(pOut, pRow, chromaWidth);
+            }
+            // Fused point filters, while the row is still in L1
+            if (luma && inPass.hasTable) {
+                ApplyTable(inPass.table, pOut, info.width);
+            }
+        }
+    });
+}
+
+void
+Displayer::DrawTimestamp(const FrameHandle& ioFrame)
+{
+    const FrameInfo& info = ioFrame.info();
+    if (info.pts == kNoPts) {
+        return;
+    }
+    const int64_t ms = std::max<int64_t>(0, info.pts) / 1000;
+    char text[32];
+    snprintf(text, sizeof(text), "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+        (int)(ms / 1000 % 60), (int)(ms % 1000));
+
+    // A dark box with light digits, about 1/50 of the frame high
+    const int scale = std::max(1, info.height / 270);
+    const int left = 8, top = 8, margin = 2 * scale;
+    const int length = (int)strlen(text);
+    const int right = std::min(info.width, left + 2 * margin + length * 4 * scale - scale) & ~1;
+    const int bottom = std::min(info.height, top + 2 * margin + 5 * scale) & ~1;
+    uint8_t* pLuma = ioFrame.data();
+    uint8_t* pChroma = pLuma + (size_t)info.pitch * info.height;
+    for (int y = top; y < bottom; y++) {
+        memset(pLuma + (size_t)y * info.pitch + left, 16, std::max(0, right - left));
+    }
+    for (int y = top / 2; y < bottom / 2; y++) {
+        memset(pChroma + (size_t)y * info.pitch + left, 128, std::max(0, right - left));
+    }
+    for (int i = 0; i < length; i++) {
+        const uint8_t* pGlyph = kGlyphs[GetGlyph(text[i])];
+        for (int y = 0; y < 5 * scale; y++) {
+            const int row = top + margin + y;
+            for (int x = 0; x < 3 * scale; x++) {
+                const int column = left + margin + (i * 4) * scale + x;
+                if (row < bottom && column < right && (pGlyph[y / scale] >> (2 - x / scale) & 1)) {
+                    pLuma[(size_t)row * info.pitch + column] = 235;
+                }
+            }
+        }
+    }
+}
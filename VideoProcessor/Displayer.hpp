@@ -1,5 +1,83 @@
 #pragma once
-class Displayer
-{
+
+#include "FramePool.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct DisplayerConfig {
+    // Comma separated filters, applied in order:
+    //   deinterlace         Vertical [1 2 1] blend of the fields, skipped on progressive frames
+    //   denoise             3x3 [1 2 1] smoothing of the luma plane
+    //   brightness=<n>      Adds n (-255..255) to luma
+    //   contrast=<c>        Scales luma around mid gray by c
+    //   gamma=<g>           Luma gamma, g > 1 brightens the midtones
+    //   timestamp           Draws the frame's PTS (hh:mm:ss.mmm) into the top left corner
+    std::string graph;
+    // Adjacent point filters are folded into one lookup table applied by the pass before them;
+    // off runs every filter as its own pass, for comparison
+    bool fuse = true;
+    int poolCapacity = 4;           // Frames handed out plus the intermediate ones
+    ThreadPool* pThreadPool = nullptr;
 };
 
+// Per-stream processing between decode and display: a filter graph over 8 bit NV12 host frames.
+// The graph is compiled into passes once. A run of point filters (brightness, contrast, gamma)
+// becomes a single 256 entry luma table, composed in order, so it costs the same however many
+// filters are chained. The table is applied to every row of the spatial pass in front of it
+// while the row is still in L1, which makes the frame's memory traffic one read and one write
+// for every spatial filter, and nothing extra for the point filters. Only a graph starting with
+// point filters needs a table pass of its own, which runs in place. Spatial filters write into
+// frames from the displayer's FramePool, the intermediate frames go back to it right away.
+class Displayer {
+public:
+    // Writes the problem to std::cerr and throws for a graph it cannot parse
+    explicit Displayer(const DisplayerConfig& inConfig);
+    ~Displayer();
+
+    Displayer(const Displayer&) = delete;
+    Displayer& operator=(const Displayer&) = delete;
+
+    // A frame from the pool for inInfo's layout, e.g. to download a device frame into
+    FrameHandle acquireFrame(const FrameInfo& inInfo);
+
+    // Runs the graph over an 8 bit host frame (other frames come back untouched), in place where
+    // the passes allow it. Returns the frame holding the result: inFrame itself when all passes
+    // ran in place, else a pool frame.
+    FrameHandle process(const FrameHandle& inFrame, bool inProgressive);
+
+    // Wakes a process() waiting for a pool frame and makes it return an empty handle
+    void close() { mPool->close(); }
+
+    // Frame passes per processed frame, the table pass included: what fusion saves
+    int getPassCount() const { return (int)mPasses.size(); }
+    const std::string& getDescription() const { return mDescription; }
+
+private:
+    enum class PassType {
+        Table,
+        Deinterlace,
+        Denoise,
+        Timestamp,
+    };
+
+    struct Pass {
+        PassType type = PassType::Table;
+        bool hasTable = false;
+        uint8_t table[256];
+    };
+
+    void runTable(const Pass& inPass, const FrameHandle& ioFrame);
+    void runSpatial(const Pass& inPass, const FrameHandle& inSource, const FrameHandle& outTarget);
+    static void DrawTimestamp(const FrameHandle& ioFrame);
+
+    DisplayerConfig mConfig;
+    std::vector<Pass> mPasses;
+    std::string mDescription;       // The passes, e.g. "denoise+table, timestamp"
+    std::unique_ptr<FramePool> mPool;
+    bool mWarnedFormat = false;
+};
@@ -0,0 +1,106 @@
+#include "FileSink.hpp"
+
+#include <iostream>
+#include <sstream>
+
+// Every other sample of an interleaved UV row
+template<class T>
+static void SplitChroma(const T* inRow, T* outPlane, int inWidth) {
+    for (int x = 0; x < inWidth; x++) {
+        outPlane[x] = inRow[2 * x];
+    }
+}
+
+FileSink::FileSink(const std::string& inPath, FileSinkFormat inFormat)
+    : mFormat(inFormat)
+    , mWriter(inPath)
+{
+}
+
+bool
+FileSink::writeHeader(const SinkFrame& inFrame)
+{
+    mWidth = inFrame.width;
+    mHeight = inFrame.height;
+    mBpp = inFrame.bpp;
+    mHeaderWritten = true;
+    if (mFormat != FileSinkFormat::Y4m) {
+        return true;
+    }
+
+    // Streams without timing info get the usual default of 30 fps
+    const bool frameRateKnown = inFrame.frameRateNum > 0 && inFrame.frameRateDen > 0;
+    std::ostringstream header;
+    header << "YUV4MPEG2 W" << mWidth << " H" << mHeight
+        << " F" << (frameRateKnown ? inFrame.frameRateNum : 30) << ":" << (frameRateKnown ? inFrame.frameRateDen : 1)
+        << " Ip A1:1 " << (mBpp == 2 ? "C420p16" : "C420mpeg2") << "\n";
+    const std::string text = header.str();
+    return mWriter.write(text.data(), text.size());
+}
+
+bool
+FileSink::write(const SinkFrame& inFrame)
+{
+    if (!mHeaderWritten && !writeHeader(inFrame)) {
+        return false;
+    }
+    if (inFrame.width != mWidth || inFrame.height != mHeight || inFrame.bpp != mBpp) {
+        // Neither format can change resolution midway
+        std::cerr << "Frame size changed to " << inFrame.width << "x" << inFrame.height << ", not written" << std::endl;
+        return true;
+    }
+
+    static const char kFrameMarker[] = "FRAME\n";
+    if (mFormat == FileSinkFormat::Y4m && !mWriter.write(kFrameMarker, sizeof(kFrameMarker) - 1)) {
+        return false;
+    }
+
+    const int lumaBytes = mWidth * mBpp;
+    for (int y = 0; y < mHeight; y++) {
+        if (!mWriter.write(inFrame.data + (size_t)y * inFrame.pitch, lumaBytes)) {
+            return false;
+        }
+    }
+
+    const uint8_t* pChroma = inFrame.data + (size_t)inFrame.pitch * mHeight;
+    const int chromaWidth = (mWidth + 1) / 2;
+    const int chromaHeight = (mHeight + 1) / 2;
+    const int chromaBytes = chromaWidth * 2 * mBpp;
+    if (mFormat == FileSinkFormat::Raw) {
+        for (int y = 0; y < chromaHeight; y++) {
+            if (!mWriter.write(pChroma + (size_t)y * inFrame.pitch, chromaBytes)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Y4M is planar: all U rows, then all V rows. Two passes over the UV plane keep the file
+    // writes sequential; the plane is small and still in cache for the second one.
+    mChromaRow.resize(chromaWidth * mBpp);
+    for (int plane = 0; plane < 2; plane++) {
+        for (int y = 0; y < chromaHeight; y++) {
+            const uint8_t* pRow = pChroma + (size_t)y * inFrame.pitch;
+            if (mBpp == 2) {
+                SplitChroma((const uint16_t*)pRow + plane, (uint16_t*)mChromaRow.data(), chromaWidth);
+            } else {
+                SplitChroma(pRow + plane, mChromaRow.data(), chromaWidth);
+            }
+            if (!mWriter.write(mChromaRow.data(), mChromaRow.size())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void
+FileSink::close()
+{
+    if (!mWriter.close()) {
+        std::cerr << "Writing output file failed" << std::endl;
+        return;
+    }
+    std::cout << "Output: " << mWriter.getBytesWritten() << " bytes written, writer stalled "
+        << mWriter.getStalls() << "x" << std::endl;
+}
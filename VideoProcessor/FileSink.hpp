@@ -0,0 +1,38 @@
+#pragma once
+
+#include "AsyncFileWriter.hpp"
+#include "FrameSink.hpp"
+
+#include <string>
+#include <vector>
+
+enum class FileSinkFormat {
+    Y4m,        // YUV4MPEG2 with planar 4:2:0, plays in ffplay/mpv and feeds ffmpeg -i directly
+    Raw,        // Packed NV12/P016 frames back to back, no header
+};
+
+// Writes decoded frames to a file through an AsyncFileWriter, so the output thread only pays
+// for copying the rows (and splitting the UV plane for Y4M), never for the disk.
+class FileSink : public FrameSink {
+public:
+    FileSink(const std::string& inPath, FileSinkFormat inFormat);
+
+    // False if the file could not be created
+    explicit operator bool() const { return (bool)mWriter; }
+
+    SinkFormat getFormat() const override { return SinkFormat::Nv12; }
+    bool needsHostMemory() const override { return true; }
+    bool write(const SinkFrame& inFrame) override;
+    void close() override;
+    const char* getName() const override { return mFormat == FileSinkFormat::Y4m ? "y4m" : "raw"; }
+
+private:
+    bool writeHeader(const SinkFrame& inFrame);
+
+    FileSinkFormat mFormat;
+    AsyncFileWriter mWriter;
+    bool mHeaderWritten = false;
+    int mWidth = 0, mHeight = 0, mBpp = 1;
+    // One chroma row of U followed by one of V, split from the interleaved NV12 row
+    std::vector<uint8_t> mChromaRow;
+};
@@ -0,0 +1,290 @@
+#include "FrameCache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <limits>
+
+FrameCache::FrameCache(const FrameCacheConfig& inConfig)
+    : mConfig(inConfig)
+{
+    mConfig.downscale = mConfig.downscale >= 4 ? 4 : mConfig.downscale >= 2 ? 2 : 1;
+}
+
+std::shared_ptr<const CachedFrame>
+FrameCache::find(int inStream, int64_t inFrame)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mEntries.find(Key(inStream, inFrame));
+    if (it == mEntries.end()) {
+        mMisses++;
+        Telemetry::Count(TelemetryCounter::FrameCacheMisses);
+        return nullptr;
+    }
+    mHits++;
+    Telemetry::Count(TelemetryCounter::FrameCacheHits);
+    it->second.lastUse = ++mUseClock;
+    return it->second.frame;
+}
+
+std::shared_ptr<const CachedFrame>
+FrameCache::insert(int inStream, int64_t inFrameNumber, const FrameHandle& inFrame)
+{
+    const FrameInfo& info = inFrame.info();
+    const Key key(inStream, inFrameNumber);
+    std::shared_ptr<CachedFrame> pFrame;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mEntries.find(key);
+        if (it != mEntries.end()) {
+            return it->second.frame;
+        }
+        pFrame = takeSpare();
+    }
+
+    // Copied and scaled outside the lock, other streams go on meanwhile
+    CachedFrame& frame = *pFrame;
+    frame.stream = inStream;
+    frame.frame = inFrameNumber;
+    frame.timestamp = info.timestamp;
+    frame.bpp = info.bpp;
+    frame.matrix = info.matrix;
+    frame.pts = info.pts;
+    const size_t sourceSize = (size_t)info.pitch * (info.height + (info.height + 1) / 2);
+    // The scaler is 8 bit only, P016 frames are kept at their size
+    const bool scale = mConfig.downscale > 1 && info.bpp == 1;
+    std::unique_lock<std::mutex> downloadLock(mDownloadLock, std::defer_lock);
+    const uint8_t* pSource = inFrame.data();
+    if (inFrame.getMemoryType() == FrameMemoryType::Device) {
+        if (!mConfig.downloadFrame) {
+            std::cerr << "Caching device frames needs FrameCacheConfig::downloadFrame" << std::endl;
+            throw std::exception();
+        }
+        if (scale) {
+            downloadLock.lock();
+            mDownload.resize(sourceSize);
+            mConfig.downloadFrame(inFrame, mDownload.data(), sourceSize);
+            pSource = mDownload.data();
+        } else {
+            frame.data.resize(sourceSize);
+            mConfig.downloadFrame(inFrame, frame.data.data(), sourceSize);
+            pSource = nullptr;
+        }
+    }
+    if (scale) {
+        frame.width = std::max(2, (info.width / mConfig.downscale) & ~1);
+        frame.height = std::max(2, (info.height / mConfig.downscale) & ~1);
+        frame.pitch = frame.width;
+        frame.data.resize((size_t)frame.pitch * frame.height * 3 / 2);
+        ScaleOutput output;
+        output.data = frame.data.data();
+        output.pitch = frame.pitch;
+        output.width = frame.width;
+        output.height = frame.height;
+        Nv12ScaleHost(pSource, info.pitch, info.width, info.height, CropRect(), output, mConfig.filter,
+            mConfig.pScalePool);
+    } else {
+        frame.width = info.width;
+        frame.height = info.height;
+        frame.pitch = info.pitch;
+        if (pSource) {
+            frame.data.resize(sourceSize);
+            memcpy(frame.data.data(), pSource, sourceSize);
+        }
+    }
+    if (downloadLock.owns_lock()) {
+        downloadLock.unlock();
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    Entry& entry = mEntries[key];
+    if (entry.frame) {
+        // Another thread cached the same frame meanwhile
+        release(pFrame);
+        return entry.frame;
+    }
+    entry.frame = pFrame;
+    entry.lastUse = ++mUseClock;
+    mBytes += frame.data.size();
+    mInsertions++;
+    evict(key);
+    return pFrame;
+}
+
+void
+FrameCache::setPlayhead(int inStream, int64_t inFrame)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mPlayheads[inStream] = inFrame;
+}
+
+void
+FrameCache::erase(int inStream)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mEntries.lower_bound(Key(inStream, std::numeric_limits<int64_t>::min()));
+    while (it != mEntries.end() && it->first.first == inStream) {
+        mBytes -= it->second.frame->data.size();
+        release(it->second.frame);
+        it = mEntries.erase(it);
+    }
+    mPlayheads.erase(inStream);
+}
+
+void
+FrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.clear();
+    mPlayheads.clear();
+    mSpares.clear();
+    mBytes = 0;
+}
+
+size_t
+FrameCache::getBytes() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mBytes;
+}
+
+size_t
+FrameCache::getFrameCount() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEntries.size();
+}
+
+std::shared_ptr<CachedFrame>
+FrameCache::takeSpare()
+{
+    if (mSpares.empty()) {
+        return std::make_shared<CachedFrame>();
+    }
+    std::shared_ptr<CachedFrame> pFrame = std::move(mSpares.back());
+    mSpares.pop_back();
+    return pFrame;
+}
+
+void
+FrameCache::release(std::shared_ptr<CachedFrame>& ioFrame)
+{
+    // Still held by a caller otherwise, whose copy must not change under it
+    if (ioFrame.use_count() == 1 && (int)mSpares.size() < kMaxSpares) {
+        mSpares.push_back(std::move(ioFrame));
+    }
+    ioFrame.reset();
+}
+
+void
+FrameCache::evict(const Key& inKeep)
+{
+    // A linear scan per eviction: the budget holds hundreds to a few thousand frames, and
+    // every eviction stands for a frame decoded, which costs far more
+    while (mBytes > mConfig.budget && mEntries.size() > 1) {
+        auto victim = mEntries.end();
+        int64_t victimDistance = -1;
+        for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+            if (it->first == inKeep) {
+                continue;
+            }
+            auto playhead = mPlayheads.find(it->first.first);
+            const int64_t distance = playhead == mPlayheads.end() ? std::numeric_limits<int64_t>::max()
+                : std::abs(it->first.second - playhead->second);
+            if (distance > victimDistance
+                || (distance == victimDistance && it->second.lastUse < victim->second.lastUse)) {
+                victim = it;
+                victimDistance = distance;
+            }
+        }
+        mBytes -= victim->second.frame->data.size();
+        release(victim->second.frame);
+        mEntries.erase(victim);
+        mEvictions++;
+    }
+}
+
+void
+FrameCache::printStatistics(std::ostream& inStream) const
+{
+    const uint64_t lookups = mHits + mMisses;
+    inStream << "Frame cache: " << mHits << " hits, " << mMisses << " misses ("
+        << (lookups ? 100.0 * mHits / lookups : 0) << "% hit rate), " << getFrameCount() << " frames in "
+        << getBytes() / 1048576.0 << " of " << mConfig.budget / 1048576.0 << " MB, " << mInsertions << " inserted, "
+        << mEvictions << " evicted" << std::endl;
+}
+
+FrameScrubber::FrameScrubber(const StreamIndex& inIndex, const uint8_t* inStream, AnnexBPacketizer& ioPacketizer,
+    Decoder& ioDecoder, FrameCache& ioCache, int inStreamId)
+    : mIndex(inIndex)
+    , mPacketizer(ioPacketizer)
+    , mDecoder(ioDecoder)
+    , mCache(ioCache)
+    , mStreamId(inStreamId)
+    , mSeeker(inIndex, inStream, ioPacketizer, ioDecoder)
+{
+}
+
+std::shared_ptr<const CachedFrame>
+FrameScrubber::get(int64_t inFrame)
+{
+    if (inFrame < 0 || inFrame >= mIndex.getFrameCount()) {
+        return nullptr;
+    }
+    mCache.setPlayhead(mStreamId, inFrame);
+    std::shared_ptr<const CachedFrame> pFrame = mCache.find(mStreamId, inFrame);
+    if (pFrame) {
+        return pFrame;
+    }
+
+    // Not out of the decoder yet, and its GOP already reached: decoding goes on from there.
+    // A closed GOP holds the same frame numbers in presentation as in decode order.
+    const int64_t keyframe = mIndex.findKeyframe(inFrame);
+    const bool ahead = mNextOutput >= 0 && inFrame >= mNextOutput && keyframe <= mNextUnit;
+    if (!ahead) {
+        if (!mSeeker.seek(inFrame)) {
+            return nullptr;
+        }
+        mNextOutput = keyframe;
+        mNextUnit = keyframe;
+        mPts = PtsTracker();
+        mSeeks++;
+    }
+
+    AccessUnit unit;
+    while (!pFrame && mNextOutput >= 0) {
+        if (mPacketizer.next(unit)) {
+            mNextUnit = unit.frameIndex + 1;
+            mDecodedFrames++;
+            collect(mDecoder.decode(unit.data, unit.size, unit.frameIndex, true), inFrame, pFrame);
+        } else {
+            // End of stream: out with what the decoder holds, the next miss seeks
+            collect(mDecoder.decode(nullptr, 0), inFrame, pFrame);
+            mNextOutput = -1;
+        }
+    }
+    return pFrame;
+}
+
+void
+FrameScrubber::collect(int inFrameCount, int64_t inTarget, std::shared_ptr<const CachedFrame>& outFrame)
+{
+    const VideoFormat& format = mDecoder.GetVideoFormat();
+    while (inFrameCount--) {
+        FrameHandle frame = mDecoder.getFrame();
+        if (!frame) {
+            continue;
+        }
+        // Counted up in output order from the keyframe, the first frame out
+        FrameInfo& info = frame.info();
+        info.pts = mPts.stamp(info.timestamp, format.frameRateNum, format.frameRateDen);
+        const int64_t frameNumber = mNextOutput++;
+        // The references decoded on the way to the target are frames to keep as well
+        std::shared_ptr<const CachedFrame> pFrame = mCache.insert(mStreamId, frameNumber, frame);
+        if (frameNumber == inTarget) {
+            outFrame = std::move(pFrame);
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "Decoder.hpp"
+#include "HostScaleConvert.hpp"
+#include "PresentationClock.hpp"
+#include "StreamIndex.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+struct FrameCacheConfig {
+    size_t budget = (size_t)512 << 20;      // Bytes of frame data kept; the newest frame is kept even above it
+    // 1 keeps frames at the decoded size, 2 or 4 keep 8 bit frames at 1/2 or 1/4 of the width
+    // and height (1/4 or 1/16 of the bytes). NV12 either way, 1.5 bytes per pixel instead of 4 for BGRA.
+    int downscale = 1;
+    ScaleFilter filter = ScaleFilter::Area;
+    ThreadPool* pScalePool = nullptr;
+    // Copies a device frame (NVDEC) into inSize bytes of host memory
+    std::function<void(const FrameHandle& inFrame, uint8_t* outHost, size_t inSize)> downloadFrame;
+};
+
+// A decoded frame a FrameCache keeps: NV12 (P016 when bpp == 2) in host memory, the UV plane at
+// pitch * height. Immutable once cached; a holder keeps it alive past its eviction.
+struct CachedFrame {
+    int stream = 0;
+    int64_t frame = 0;              // Presentation order index, the cache key
+    int64_t timestamp = 0;          // FrameInfo::timestamp of the decoded frame, its decode order index
+    int width = 0, height = 0;
+    int pitch = 0;
+    int bpp = 1;
+    int matrix = 0;
+    int64_t pts = kNoPts;
+    std::vector<uint8_t> data;
+};
+
+// Decoded frames kept in host memory under a byte budget, keyed by stream and frame number, so a
+// viewer stepping back or looping over a short range gets them without decoding their GOP again.
+// When the budget is exceeded the frames farthest from the playhead of their stream go first,
+// least recently used among equally far ones; frames of streams without a playhead go before
+// any other. Evicted buffers nobody holds are reused for the next frames, so a cache at its
+// budget stops allocating. Safe to share between the threads of several streams.
+class FrameCache {
+public:
+    explicit FrameCache(const FrameCacheConfig& inConfig);
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    // The cached frame, or null. Counted as a hit or a miss.
+    std::shared_ptr<const CachedFrame> find(int inStream, int64_t inFrame);
+
+    // Copies a decoded frame (downscaled, if configured) under inStream and inFrameNumber, its
+    // presentation order index, then evicts down to the budget. Returns the copy, which stays
+    // valid for the caller even if it was evicted right away. A frame already cached is
+    // returned as is.
+    std::shared_ptr<const CachedFrame> insert(int inStream, int64_t inFrameNumber, const FrameHandle& inFrame);
+
+    // Where the viewer of inStream is now, what eviction measures distance from
+    void setPlayhead(int inStream, int64_t inFrame);
+
+    // Drops the frames and the playhead of inStream, e.g. when it closes
+    void erase(int inStream);
+    void clear();
+
+    void printStatistics(std::ostream& inStream) const;
+
+    size_t getBudget() const { return mConfig.budget; }
+    size_t getBytes() const;
+    size_t getFrameCount() const;
+    uint64_t getHits() const { return mHits; }
+    uint64_t getMisses() const { return mMisses; }
+    uint64_t getInsertions() const { return mInsertions; }
+    uint64_t getEvictions() const { return mEvictions; }
+
+private:
+    typedef std::pair<int, int64_t> Key;
+
+    struct Entry {
+        std::shared_ptr<CachedFrame> frame;
+        uint64_t lastUse = 0;
+    };
+
+    // Under mLock
+    std::shared_ptr<CachedFrame> takeSpare();
+    void evict(const Key& inKeep);
+    void release(std::shared_ptr<CachedFrame>& ioFrame);
+
+    FrameCacheConfig mConfig;
+    mutable std::mutex mLock;
+    std::map<Key, Entry> mEntries;
+    std::map<int, int64_t> mPlayheads;
+    // Evicted frames nobody else held, kept for their buffers: at most this many beyond the budget
+    static const int kMaxSpares = 2;
+    std::vector<std::shared_ptr<CachedFrame>> mSpares;
+    size_t mBytes = 0;
+    uint64_t mUseClock = 0;
+
+    // Device frames are downloaded here before they are downscaled
+    std::mutex mDownloadLock;
+    std::vector<uint8_t> mDownload;
+
+    std::atomic<uint64_t> mHits{ 0 };
+    std::atomic<uint64_t> mMisses{ 0 };
+    std::atomic<uint64_t> mInsertions{ 0 };
+    std::atomic<uint64_t> mEvictions{ 0 };
+};
+
+// Frame-accurate random access for interactive scrubbing on top of a FrameCache. get() returns
+// any frame of the stream: from the cache, or by seeking to its keyframe (see StreamSeeker) and
+// decoding forward. Every frame decoded on the way is cached, not only the one asked for, so
+// stepping back through a GOP or looping over a short range decodes it once. A frame ahead of
+// the decoder output continues decoding where it stopped instead of seeking again.
+// Frames are numbered in presentation order, the order the decoder outputs them in: a GOP's
+// IDR picture keeps its decode order index and the frames after it count up from there, and
+// their PTS are the ones PtsTracker stamps a stream without PTS with. GOPs are assumed closed,
+// which IDR pictures are; a GOP starting at a recovery point may number a few frames off.
+class FrameScrubber {
+public:
+    // All references must outlive the scrubber. inStreamId keys the frames in the cache.
+    FrameScrubber(const StreamIndex& inIndex, const uint8_t* inStream, AnnexBPacketizer& ioPacketizer,
+        Decoder& ioDecoder, FrameCache& ioCache, int inStreamId = 0);
+
+    // Frame inFrame in presentation order, null if it is out of range or could not be decoded
+    std::shared_ptr<const CachedFrame> get(int64_t inFrame);
+
+    // Access units handed to the decoder, over all get() calls
+    uint64_t getDecodedFrames() const { return mDecodedFrames; }
+    uint64_t getSeeks() const { return mSeeks; }
+
+private:
+    void collect(int inFrameCount, int64_t inTarget, std::shared_ptr<const CachedFrame>& outFrame);
+
+    const StreamIndex& mIndex;
+    AnnexBPacketizer& mPacketizer;
+    Decoder& mDecoder;
+    FrameCache& mCache;
+    int mStreamId;
+    StreamSeeker mSeeker;
+    // Presentation index of the next frame out of the decoder, -1 while decoding has to start
+    // with a seek
+    int64_t mNextOutput = -1;
+    // Next access unit the packetizer hands out
+    int64_t mNextUnit = -1;
+    PtsTracker mPts;
+    uint64_t mDecodedFrames = 0;
+    uint64_t mSeeks = 0;
+};
@@ -0,0 +1,232 @@
+#include "FramePool.hpp"
+
+#include "Telemetry.hpp"
+
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+struct FrameHandle::Slot {
+    FramePool* pool = nullptr;
+    uint8_t* data = nullptr;        // Owned, allocated by the pool's allocator
+    size_t size = 0;
+    uint8_t* external = nullptr;    // Borrowed, see FrameHandle::setExternal()
+    std::function<void()> onRelease;
+    std::atomic<int> references{ 0 };
+    FrameInfo info;
+};
+
+uint8_t*
+HostFrameAllocator::allocate(size_t inSize)
+{
+    void* pData = nullptr;
+#ifdef _WIN32
+    pData = _aligned_malloc(inSize, 64);
+#else
+    if (posix_memalign(&pData, 64, inSize) != 0) {
+        pData = nullptr;
+    }
+#endif
+    if (!pData) {
+        throw std::bad_alloc();
+    }
+    return (uint8_t*)pData;
+}
+
+void
+HostFrameAllocator::free(uint8_t* inData)
+{
+#ifdef _WIN32
+    _aligned_free(inData);
+#else
+    ::free(inData);
+#endif
+}
+
+FrameHandle::FrameHandle(const FrameHandle& inOther)
+    : mSlot(inOther.mSlot)
+{
+    if (mSlot) {
+        mSlot->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameHandle::FrameHandle(FrameHandle&& inOther) noexcept
+    : mSlot(inOther.mSlot)
+{
+    inOther.mSlot = nullptr;
+}
+
+FrameHandle&
+FrameHandle::operator=(FrameHandle inOther) noexcept
+{
+    std::swap(mSlot, inOther.mSlot);
+    return *this;
+}
+
+uint8_t*
+FrameHandle::data() const
+{
+    if (!mSlot) {
+        return nullptr;
+    }
+    return mSlot->external ? mSlot->external : mSlot->data;
+}
+
+size_t
+FrameHandle::capacity() const
+{
+    return mSlot && !mSlot->external ? mSlot->size : 0;
+}
+
+FrameMemoryType
+FrameHandle::getMemoryType() const
+{
+    return mSlot->pool->getMemoryType();
+}
+
+FrameInfo&
+FrameHandle::info() const
+{
+    return mSlot->info;
+}
+
+void
+FrameHandle::setExternal(uint8_t* inData, std::function<void()> inOnRelease)
+{
+    mSlot->external = inData;
+    mSlot->onRelease = std::move(inOnRelease);
+}
+
+void
+FrameHandle::reset()
+{
+    if (mSlot && mSlot->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        mSlot->pool->release(mSlot);
+    }
+    mSlot = nullptr;
+}
+
+FramePool::FramePool(std::unique_ptr<FrameAllocator> inAllocator, const FramePoolConfig& inConfig)
+    : mAllocator(std::move(inAllocator))
+    , mConfig(inConfig)
+{
+    if (mConfig.capacity < 1) {
+        mConfig.capacity = 1;
+    }
+    mSlots.reserve(mConfig.capacity);
+    mFree.reserve(mConfig.capacity);
+}
+
+FramePool::~FramePool()
+{
+    if (getInUse()) {
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("Frame pool destroyed with " << getInUse() << " frames still in use");
+    }
+    for (std::unique_ptr<FrameHandle::Slot>& slot : mSlots) {
+        if (slot->data) {
+            mAllocator->free(slot->data);
+        }
+    }
+}
+
+FrameHandle
+FramePool::acquire(size_t inSize, bool inMayBlock)
+{
+    FrameHandle::Slot* pSlot = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        const bool mayBlock = inMayBlock && mConfig.policy == FramePoolPolicy::Block;
+        bool waited = false;
+        while (!mClosed && mFree.empty() && (int)mSlots.size() == mConfig.capacity && mayBlock) {
+            if (!waited) {
+                mWaits++;
+                waited = true;
+            }
+            mReleased.wait(lock);
+        }
+        if (mClosed) {
+            return FrameHandle();
+        }
+        if (!mFree.empty()) {
+            pSlot = mFree.back();
+            mFree.pop_back();
+        } else if ((int)mSlots.size() < mConfig.capacity) {
+            mSlots.emplace_back(new FrameHandle::Slot);
+            pSlot = mSlots.back().get();
+            pSlot->pool = this;
+        } else {
+            mDropped++;
+            return FrameHandle();
+        }
+        const int inUse = (int)(mSlots.size() - mFree.size());
+        if (inUse > mPeakInUse) {
+            mPeakInUse = inUse;
+        }
+    }
+
+    // Allocation may take a while (and a CUDA context), keep it out of the lock
+    if (pSlot->size < inSize) {
+        try {
+            if (pSlot->data) {
+                mAllocator->free(pSlot->data);
+                pSlot->data = nullptr;
+                pSlot->size = 0;
+            }
+            pSlot->data = mAllocator->allocate(inSize);
+            pSlot->size = inSize;
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mLock);
+            mFree.push_back(pSlot);
+            mReleased.notify_one();
+            throw;
+        }
+    }
+    pSlot->info = FrameInfo();
+    pSlot->references.store(1, std::memory_order_relaxed);
+    mAcquired++;
+    return FrameHandle(pSlot);
+}
+
+void
+FramePool::close()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mClosed = true;
+    mReleased.notify_all();
+}
+
+int
+FramePool::getInUse() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return (int)(mSlots.size() - mFree.size());
+}
+
+int
+FramePool::getPeakInUse() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mPeakInUse;
+}
+
+void
+FramePool::release(FrameHandle::Slot* inSlot)
+{
+    // E.g. unmapping a decoder surface, must be done before anyone can reuse the slot
+    if (inSlot->onRelease) {
+        inSlot->onRelease();
+        inSlot->onRelease = nullptr;
+    }
+    inSlot->external = nullptr;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mFree.push_back(inSlot);
+    mReleased.notify_one();
+}
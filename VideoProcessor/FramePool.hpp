@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Where the frames handed out by a decoder live
+enum class FrameMemoryType {
+    Device,     // CUDA device memory, pointer is a CUdeviceptr
+    Host,       // Host memory
+};
+
+// Allocation policy of a FramePool
+class FrameAllocator {
+public:
+    virtual ~FrameAllocator() = default;
+    virtual uint8_t* allocate(size_t inSize) = 0;
+    virtual void free(uint8_t* inData) = 0;
+    virtual FrameMemoryType getMemoryType() const = 0;
+};
+
+// 64 byte aligned host memory, so the SIMD kernels never straddle cache lines at row 0
+class HostFrameAllocator : public FrameAllocator {
+public:
+    uint8_t* allocate(size_t inSize) override;
+    void free(uint8_t* inData) override;
+    FrameMemoryType getMemoryType() const override { return FrameMemoryType::Host; }
+};
+
+// What happens when every slot is in use
+enum class FramePoolPolicy {
+    Block,      // Wait for a handle to be released
+    Drop,       // Fail immediately, the caller drops the frame
+};
+
+struct FramePoolConfig {
+    int capacity = 0;       // Frames in flight, 0 = backend default
+    FramePoolPolicy policy = FramePoolPolicy::Block;
+    // NVDEC only: hand out the mapped decoder surface instead of a copy of it. The surface
+    // stays mapped until the last handle goes away, capacity caps the mapped surfaces.
+    bool mapSurfaces = false;
+};
+
+// Presentation timestamps are in microseconds, this one means there is none
+const int64_t kNoPts = INT64_MIN;
+
+// What a SceneAnalyzer found out about a frame, compared to the one analyzed before it
+struct FrameAnalysis {
+    bool valid = false;             // Set once the frame went through an analyzer
+    float meanLuma = 0;             // 0..255
+    float sad = 0;                  // Mean absolute luma difference per pixel, 0..255
+    float motion = 0;               // Share of the blocks that changed, 0..1
+    float histogramDelta = 0;       // Distance of the luma histograms, 0 (same) .. 1 (disjoint)
+    bool sceneCut = false;          // Also set on the first frame and after a resolution change
+    bool isStatic = false;          // Nothing changed worth looking at again
+};
+
+// Layout of the NV12/P016 frame in a handle. The UV plane always starts at pitch * height.
+struct FrameInfo {
+    int width = 0, height = 0;
+    int pitch = 0;
+    int bpp = 1;
+    int matrix = 0;
+    int64_t timestamp = 0;          // What the access unit was decoded with, its frame index
+    int64_t pts = kNoPts;           // Set by whoever consumes the decoder, see PtsTracker
+    FrameAnalysis analysis;
+};
+
+class FramePool;
+
+// Shared, reference counted ownership of one pool slot. The slot goes back to the pool when
+// the last copy of the handle is destroyed or reset. Handles must not outlive their pool.
+class FrameHandle {
+public:
+    FrameHandle() = default;
+    FrameHandle(const FrameHandle& inOther);
+    FrameHandle(FrameHandle&& inOther) noexcept;
+    FrameHandle& operator=(FrameHandle inOther) noexcept;
+    ~FrameHandle() { reset(); }
+
+    explicit operator bool() const { return mSlot != nullptr; }
+
+    uint8_t* data() const;
+    size_t capacity() const;
+    FrameMemoryType getMemoryType() const;
+    FrameInfo& info() const;
+
+    // Points the handle at memory it does not own (e.g. a mapped decoder surface). inOnRelease
+    // runs once the slot comes back to the pool, before the slot can be handed out again.
+    void setExternal(uint8_t* inData, std::function<void()> inOnRelease);
+
+    void reset();
+
+private:
+    friend class FramePool;
+    struct Slot;
+    explicit FrameHandle(Slot* inSlot) : mSlot(inSlot) {}
+
+    Slot* mSlot = nullptr;
+};
+
+// Fixed number of reusable frame buffers. Buffers are allocated on first use and grown when a
+// larger frame is requested, so the memory footprint is bounded by capacity * largest frame.
+class FramePool {
+public:
+    FramePool(std::unique_ptr<FrameAllocator> inAllocator, const FramePoolConfig& inConfig);
+
+    // All handles must have been released
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Returns a handle to a slot with at least inSize bytes, or an empty handle when the pool
+    // is exhausted under FramePoolPolicy::Drop (or inMayBlock is false) or was closed.
+    FrameHandle acquire(size_t inSize, bool inMayBlock = true);
+
+    // Wakes blocked acquire() calls and makes them fail, for shutting down a pipeline
+    void close();
+
+    const FramePoolConfig& getConfig() const { return mConfig; }
+    FrameMemoryType getMemoryType() const { return mAllocator->getMemoryType(); }
+
+    int getInUse() const;
+    int getPeakInUse() const;
+    uint64_t getAcquired() const { return mAcquired; }
+    uint64_t getDropped() const { return mDropped; }
+    uint64_t getWaits() const { return mWaits; }
+
+private:
+    friend class FrameHandle;
+    void release(FrameHandle::Slot* inSlot);
+
+    std::unique_ptr<FrameAllocator> mAllocator;
+    FramePoolConfig mConfig;
+    std::vector<std::unique_ptr<FrameHandle::Slot>> mSlots;
+
+    mutable std::mutex mLock;
+    std::condition_variable mReleased;
+    std::vector<FrameHandle::Slot*> mFree;
+    bool mClosed = false;
+    int mPeakInUse = 0;
+    std::atomic<uint64_t> mAcquired{ 0 };
+    std::atomic<uint64_t> mDropped{ 0 };
+    std::atomic<uint64_t> mWaits{ 0 };
+};
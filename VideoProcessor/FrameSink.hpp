@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FramePool.hpp"
+
+#include <cstdint>
+
+enum class SinkFormat {
+    Nv12,       // Decoded frame as is: NV12, or P016 when bpp == 2
+    Bgra,       // Converted 32 bit image
+};
+
+// One frame handed to a sink. Only valid during FrameSink::write().
+struct SinkFrame {
+    const uint8_t* data = nullptr;
+    FrameMemoryType memoryType = FrameMemoryType::Host;
+    SinkFormat format = SinkFormat::Nv12;
+    int width = 0, height = 0;
+    int pitch = 0;              // For NV12 the UV plane starts at pitch * height
+    int bpp = 1;
+    int64_t timestamp = 0;
+    int64_t pts = kNoPts;       // Microseconds
+    int frameRateNum = 0, frameRateDen = 1;
+    FrameAnalysis analysis;     // Valid when the pipeline analyzes scenes
+};
+
+// End of the pipeline: where frames go after decoding (and conversion, if the sink asks for it).
+// write() and close() are called from one thread.
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    virtual SinkFormat getFormat() const = 0;
+
+    // True if the sink can only read host memory, device frames are downloaded for it
+    virtual bool needsHostMemory() const = 0;
+
+    // Returns false when the sink stops taking frames (window closed, write failed), which
+    // stops the pipeline.
+    virtual bool write(const SinkFrame& inFrame) = 0;
+
+    // End of stream or pipeline stopped: flush whatever is pending
+    virtual void close() {}
+
+    virtual const char* getName() const = 0;
+};
+
+// Swallows every frame, device frames included, for measuring decode throughput alone
+class NullSink : public FrameSink {
+public:
+    SinkFormat getFormat() const override { return SinkFormat::Nv12; }
+    bool needsHostMemory() const override { return false; }
+    bool write(const SinkFrame&) override { return true; }
+    const char* getName() const override { return "null"; }
+};
@@ -0,0 +1,214 @@
+#include "GopParallelDecoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+GopParallelDecoder::GopParallelDecoder(const StreamIndex& inIndex, const uint8_t* inStream, size_t inStreamSize,
+    const DecoderFactory& inFactory, const GopParallelConfig& inConfig)
+    : mIndex(inIndex)
+    , mStream(inStream)
+    , mStreamSize(inStreamSize)
+    , mConfig(inConfig)
+{
+    const int decoderCount = mConfig.decoderCount > 0 ? mConfig.decoderCount : std::max(1, (int)std::thread::hardware_concurrency());
+    if (mConfig.maxSegmentsAhead <= 0) {
+        mConfig.maxSegmentsAhead = 2 * decoderCount;
+    }
+
+    // Frames in front of the first IDR picture go with the first segment, as they would when
+    // decoding sequentially
+    const int64_t frameCount = mIndex.getFrameCount();
+    if (frameCount > 0) {
+        mSegments.emplace_back();
+    }
+    for (int64_t i = 0; i < mIndex.getKeyframeCount(); i++) {
+        const int64_t keyframe = mIndex.getKeyframe(i);
+        if (keyframe - mSegments.back().firstFrame >= mConfig.minSegmentFrames) {
+            mSegments.back().endFrame = keyframe;
+            mSegments.emplace_back();
+            mSegments.back().firstFrame = keyframe;
+        }
+    }
+    if (frameCount > 0) {
+        mSegments.back().endFrame = frameCount;
+    }
+
+    for (int i = 0; i < decoderCount; i++) {
+        mDecoders.push_back(inFactory(i));
+    }
+    mStatistics.resize(decoderCount);
+    for (int i = 0; i < decoderCount; i++) {
+        mThreads.emplace_back(&GopParallelDecoder::decoderLoop, this, i);
+    }
+}
+
+GopParallelDecoder::~GopParallelDecoder()
+{
+    stop();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+    // Frames nobody fetched go back to their pools while the decoders still exist
+    mSegments.clear();
+}
+
+void
+GopParallelDecoder::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mSegmentDone.notify_all();
+    mFrameReady.notify_all();
+    // Wakes decoders waiting for a frame slot
+    for (std::unique_ptr<Decoder>& decoder : mDecoders) {
+        decoder->GetFramePool().close();
+    }
+}
+
+FrameHandle
+GopParallelDecoder::getFrame()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+    bool waited = false;
+    while (true) {
+        if (mError) {
+            std::rethrow_exception(mError);
+        }
+        if (mOutputSegment == (int)mSegments.size() || mStopping) {
+            return FrameHandle();
+        }
+        Segment& segment = mSegments[mOutputSegment];
+        if (!segment.frames.empty()) {
+            FrameHandle frame = std::move(segment.frames.front());
+            segment.frames.pop_front();
+            mBufferedFrames--;
+            mLastDecoder = segment.decoder;
+            return frame;
+        }
+        if (segment.done) {
+            mOutputSegment++;
+            mSegmentDone.notify_all();
+            continue;
+        }
+        if (!waited) {
+            mOutputWaits++;
+            waited = true;
+        }
+        mFrameReady.wait(lock);
+    }
+}
+
+const VideoFormat&
+GopParallelDecoder::GetVideoFormat() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mDecoders[mLastDecoder]->GetVideoFormat();
+}
+
+void
+GopParallelDecoder::decoderLoop(int inDecoder)
+{
+    try {
+        while (true) {
+            int segment;
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mSegmentDone.wait(lock, [&] {
+                    return mStopping || mNextSegment == (int)mSegments.size()
+                        || mNextSegment < mOutputSegment + mConfig.maxSegmentsAhead;
+                });
+                if (mStopping || mNextSegment == (int)mSegments.size()) {
+                    return;
+                }
+                segment = mNextSegment++;
+                mSegments[segment].decoder = inDecoder;
+            }
+            decodeSegment(inDecoder, segment);
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mError) {
+                mError = std::current_exception();
+            }
+        }
+        mFrameReady.notify_all();
+    }
+}
+
+void
+GopParallelDecoder::decodeSegment(int inDecoder, int inSegment)
+{
+    auto start = std::chrono::steady_clock::now();
+    Decoder& decoder = *mDecoders[inDecoder];
+    const int64_t firstFrame = mSegments[inSegment].firstFrame;
+    const int64_t endFrame = mSegments[inSegment].endFrame;
+    uint64_t frames = 0;
+
+    auto takeFrames = [&](int inCount, bool inDone) {
+        std::vector<FrameHandle> decoded;
+        while (inCount--) {
+            FrameHandle frame = decoder.getFrame();
+            // Whatever the decoder makes of the parameter sets
+            if (frame && frame.info().timestamp >= firstFrame) {
+                decoded.push_back(std::move(frame));
+            }
+        }
+        frames += decoded.size();
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            Segment& segment = mSegments[inSegment];
+            for (FrameHandle& frame : decoded) {
+                segment.frames.push_back(std::move(frame));
+            }
+            mBufferedFrames += (int)decoded.size();
+            mPeakBufferedFrames = std::max(mPeakBufferedFrames, mBufferedFrames);
+            segment.done = inDone;
+        }
+        mFrameReady.notify_one();
+    };
+
+    // The previous segment ended with a flush, the decoder starts from scratch
+    std::vector<uint8_t> parameterSets;
+    for (const StreamIndexParameterSet* pParameterSet : mIndex.getParameterSets(firstFrame)) {
+        const uint8_t* pNal = mStream + pParameterSet->offset;
+        parameterSets.insert(parameterSets.end(), pNal, pNal + pParameterSet->size);
+    }
+    if (!parameterSets.empty()) {
+        takeFrames(decoder.decode(parameterSets.data(), parameterSets.size(), firstFrame - 1, true), false);
+    }
+
+    // The packetizer sees the stream up to the end of the segment only
+    const size_t endOffset = endFrame < mIndex.getFrameCount() ? (size_t)mIndex.getEntry(endFrame).offset : mStreamSize;
+    AnnexBPacketizer packetizer(mStream, endOffset);
+    packetizer.reset((size_t)mIndex.getEntry(firstFrame).offset, firstFrame);
+    AccessUnit unit;
+    while (packetizer.next(unit)) {
+        if (mStopping) {
+            return;
+        }
+        takeFrames(decoder.decode(unit.data, unit.size, unit.frameIndex, true), false);
+    }
+    takeFrames(decoder.decode(nullptr, 0), true);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    DecoderStatistics& statistics = mStatistics[inDecoder];
+    statistics.segments++;
+    statistics.frames += frames;
+    statistics.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void
+GopParallelDecoder::printStatistics(std::ostream& inStream) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    inStream << "GOP parallel: " << mSegments.size() << " segments on " << mDecoders.size() << " decoders, up to "
+        << mPeakBufferedFrames << " frames in the reorder buffer, output waited " << mOutputWaits << "x" << std::endl;
+    for (size_t i = 0; i < mDecoders.size(); i++) {
+        const DecoderStatistics& statistics = mStatistics[i];
+        inStream << "\tdecoder " << i << " (" << mDecoders[i]->getName() << ")\t: " << statistics.segments << " segments, "
+            << statistics.frames << " frames, busy " << statistics.busyNs / 1e9 << " s" << std::endl;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Decoder.hpp"
+#include "StreamIndex.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct GopParallelConfig {
+    int decoderCount = 0;           // 0 = one per logical processor
+    int minSegmentFrames = 60;      // GOPs are merged into segments of at least this many frames
+    int maxSegmentsAhead = 0;       // Segments decoded ahead of the one being output, 0 = 2 * decoders
+};
+
+// Decodes one file on several decoders at once. The file is cut at IDR pictures into segments
+// that reference nothing outside themselves; every decoder thread takes the next segment,
+// primes its decoder with the parameter sets the segment needs and decodes it to the end.
+// getFrame() hands the frames out segment by segment, i.e. in presentation order.
+//
+// Memory stays bounded: a decoder blocks in its frame pool once all of its frames wait in the
+// reorder buffer, and no segment more than maxSegmentsAhead after the one being output is
+// started. The decoders should use FramePoolPolicy::Block, under the drop policy a decoder
+// that runs ahead loses frames.
+class GopParallelDecoder {
+public:
+    // inDecoderIndex runs from 0 to decoderCount - 1
+    typedef std::function<std::unique_ptr<Decoder>(int inDecoderIndex)> DecoderFactory;
+
+    // Starts decoding. inIndex and inStream must outlive the decoder.
+    GopParallelDecoder(const StreamIndex& inIndex, const uint8_t* inStream, size_t inStreamSize,
+        const DecoderFactory& inFactory, const GopParallelConfig& inConfig);
+
+    // Stops the decoder threads. All frames must have been released.
+    ~GopParallelDecoder();
+
+    GopParallelDecoder(const GopParallelDecoder&) = delete;
+    GopParallelDecoder& operator=(const GopParallelDecoder&) = delete;
+
+    // Blocks for the next frame in presentation order. Returns an empty handle after the last
+    // frame. Rethrows the first exception raised by a decoder thread.
+    FrameHandle getFrame();
+
+    // Ends decoding from any thread: the decoder threads leave their segments and getFrame()
+    // returns an empty handle from then on
+    void stop();
+
+    // Format of the stream the last frame came from
+    const VideoFormat& GetVideoFormat() const;
+
+    int getDecoderCount() const { return (int)mDecoders.size(); }
+    int getSegmentCount() const { return (int)mSegments.size(); }
+
+    void printStatistics(std::ostream& inStream) const;
+
+private:
+    struct Segment {
+        int64_t firstFrame = 0, endFrame = 0;
+        int decoder = -1;
+        std::deque<FrameHandle> frames;
+        bool done = false;
+    };
+
+    struct DecoderStatistics {
+        uint64_t segments = 0;
+        uint64_t frames = 0;
+        uint64_t busyNs = 0;
+    };
+
+    void decoderLoop(int inDecoder);
+    void decodeSegment(int inDecoder, int inSegment);
+
+    const StreamIndex& mIndex;
+    const uint8_t* mStream;
+    size_t mStreamSize;
+    GopParallelConfig mConfig;
+    std::vector<std::unique_ptr<Decoder>> mDecoders;
+    std::vector<std::thread> mThreads;
+
+    mutable std::mutex mLock;
+    std::condition_variable mSegmentDone;       // A segment may start, or the stop flag was set
+    std::condition_variable mFrameReady;
+    // Declared after the decoders, the buffered frames go back to their pools first
+    std::vector<Segment> mSegments;
+    int mNextSegment = 0;                       // Next to decode
+    int mOutputSegment = 0;                     // Being output
+    int mLastDecoder = 0;
+    std::atomic<bool> mStopping{ false };      // Set under mLock for the waits
+    std::exception_ptr mError;
+    int mBufferedFrames = 0;
+    int mPeakBufferedFrames = 0;
+    uint64_t mOutputWaits = 0;
+    std::vector<DecoderStatistics> mStatistics;
+};
@@ -0,0 +1,120 @@
+#include "HostColorSpace.hpp"
+
+#include "HostColorSpaceKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+template <int iMatrix>
+constexpr YuvToRgbCoefficients MakeYuvToRgbCoefficients() {
+    typedef YuvToRgbMatrix<iMatrix> M;
+    return YuvToRgbCoefficients{
+        { { M::y, 0.0f, M::rv }, { M::y, M::gu, M::gv }, { M::y, M::bu, 0.0f } },
+        (int16_t)M::yFixed, (int16_t)M::rvFixed, (int16_t)M::guFixed, (int16_t)M::gvFixed, (int16_t)M::buFixed
+    };
+}
+
+constexpr double Abs(double x) { return x < 0 ? -x : x; }
+
+constexpr double Max(double a, double b) { return a > b ? a : b; }
+
+// Worst case deviation of the fixed point kernels from the float matrix over the 8 bit input
+// range, in output LSB: luma is at most 255 - 16 and chroma 128 away from its offset
+template <int iMatrix>
+constexpr double GetFixedPointError() {
+    typedef YuvToRgbMatrix<iMatrix> M;
+    const double scale = 1 << kYuvToRgbShift;
+    const double y = Abs(M::y - M::yFixed / scale) * 239;
+    return Max(Max(y + Abs(M::rv - M::rvFixed / scale) * 128,
+        y + (Abs(M::gu - M::guFixed / scale) + Abs(M::gv - M::gvFixed / scale)) * 128),
+        y + Abs(M::bu - M::buFixed / scale) * 128);
+}
+
+// Every distinct matrix; the others map to these through GetCanonicalColorSpace()
+static_assert(GetFixedPointError<ColorSpaceStandard_BT709>() < 0.05, "BT.709 fixed point coefficients too coarse");
+static_assert(GetFixedPointError<ColorSpaceStandard_FCC>() < 0.05, "FCC fixed point coefficients too coarse");
+static_assert(GetFixedPointError<ColorSpaceStandard_BT601>() < 0.05, "BT.601 fixed point coefficients too coarse");
+static_assert(GetFixedPointError<ColorSpaceStandard_SMPTE240M>() < 0.05, "SMPTE 240M fixed point coefficients too coarse");
+static_assert(GetFixedPointError<ColorSpaceStandard_BT2020>() < 0.05, "BT.2020 fixed point coefficients too coarse");
+
+const YuvToRgbCoefficients&
+GetYuvToRgbCoefficients(int iMatrix) {
+    static constexpr YuvToRgbCoefficients kBT709 = MakeYuvToRgbCoefficients<ColorSpaceStandard_BT709>();
+    static constexpr YuvToRgbCoefficients kFCC = MakeYuvToRgbCoefficients<ColorSpaceStandard_FCC>();
+    static constexpr YuvToRgbCoefficients kBT601 = MakeYuvToRgbCoefficients<ColorSpaceStandard_BT601>();
+    static constexpr YuvToRgbCoefficients kSMPTE240M = MakeYuvToRgbCoefficients<ColorSpaceStandard_SMPTE240M>();
+    static constexpr YuvToRgbCoefficients kBT2020 = MakeYuvToRgbCoefficients<ColorSpaceStandard_BT2020>();
+    switch (GetCanonicalColorSpace(iMatrix)) {
+    case ColorSpaceStandard_FCC:        return kFCC;
+    case ColorSpaceStandard_BT601:      return kBT601;
+    case ColorSpaceStandard_SMPTE240M:  return kSMPTE240M;
+    case ColorSpaceStandard_BT2020:     return kBT2020;
+    default:                            return kBT709;
+    }
+}
+
+// Float reference, a line by line port of YuvToRgbForPixel/YuvToRgbKernel
+template <class COLOR32>
+void Nv12ToColor32Rows_Scalar(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight,
+    int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c) {
+    auto clamp = [](float x) { return x < 0.0f ? 0.0f : (x > 255.0f ? 255.0f : x); };
+    for (int pair = nPairBegin; pair < nPairEnd; pair++) {
+        const int y = pair * 2;
+        const uint8_t* pUV = pNv12 + (nHeight + pair) * nNv12Pitch;
+        for (int x = 0; x + 1 < nWidth; x += 2) {
+            float fu = (int)pUV[x] - 128.0f, fv = (int)pUV[x + 1] - 128.0f;
+            for (int row = 0; row < 2; row++) {
+                for (int i = 0; i < 2; i++) {
+                    float fy = (int)pNv12[(y + row) * nNv12Pitch + x + i] - 16.0f;
+                    COLOR32 rgb{};
+                    rgb.c.r = (uint8_t)clamp(c.mat[0][0] * fy + c.mat[0][1] * fu + c.mat[0][2] * fv);
+                    rgb.c.g = (uint8_t)clamp(c.mat[1][0] * fy + c.mat[1][1] * fu + c.mat[1][2] * fv);
+                    rgb.c.b = (uint8_t)clamp(c.mat[2][0] * fy + c.mat[2][1] * fu + c.mat[2][2] * fv);
+                    *(uint32_t*)(pDst + (y + row) * nDstPitch + (x + i) * 4) = rgb.d;
+                }
+            }
+        }
+    }
+}
+
+INSTANTIATE_NV12_KERNEL(Nv12ToColor32Rows_Scalar);
+
+template <class COLOR32>
+Nv12RowsKernel<COLOR32> GetNv12RowsKernel(SimdLevel eSimdLevel) {
+    switch ((std::min)(eSimdLevel, GetSimdLevel())) {
+    case SimdLevel::AVX512: return Nv12ToColor32Rows_AVX512<COLOR32>;
+    case SimdLevel::AVX2:   return Nv12ToColor32Rows_AVX2<COLOR32>;
+    case SimdLevel::SSE41:  return Nv12ToColor32Rows_SSE41<COLOR32>;
+    case SimdLevel::Scalar: break;
+    }
+    return Nv12ToColor32Rows_Scalar<COLOR32>;
+}
+
+template Nv12RowsKernel<BGRA32> GetNv12RowsKernel<BGRA32>(SimdLevel eSimdLevel);
+template Nv12RowsKernel<RGBA32> GetNv12RowsKernel<RGBA32>(SimdLevel eSimdLevel);
+
+// Row pairs handed to one thread at least, keeps tiny frames on the calling thread
+static const int kMinPairsPerThread = 8;
+
+template <class COLOR32>
+void Nv12ToColor32Host(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pBgra, int nBgraPitch, int nWidth, int nHeight,
+    int iMatrix, ThreadPool* pThreadPool, SimdLevel eSimdLevel) {
+    const Nv12RowsKernel<COLOR32> kernel = GetNv12RowsKernel<COLOR32>(eSimdLevel);
+
+    const YuvToRgbCoefficients& c = GetYuvToRgbCoefficients(iMatrix);
+    const int nPairs = nHeight / 2;
+    if (!pThreadPool || pThreadPool->getThreadCount() == 1 || nPairs < 2 * kMinPairsPerThread) {
+        kernel(pNv12, nNv12Pitch, pBgra, nBgraPitch, nWidth, nHeight, 0, nPairs, c);
+        return;
+    }
+    pThreadPool->parallelFor(nPairs, [&](int begin, int end) {
+        kernel(pNv12, nNv12Pitch, pBgra, nBgraPitch, nWidth, nHeight, begin, end, c);
+    });
+}
+
+// Explicit Instantiation
+template void Nv12ToColor32Host<BGRA32>(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pBgra, int nBgraPitch, int nWidth, int nHeight,
+    int iMatrix, ThreadPool* pThreadPool, SimdLevel eSimdLevel);
+template void Nv12ToColor32Host<RGBA32>(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pBgra, int nBgraPitch, int nWidth, int nHeight,
+    int iMatrix, ThreadPool* pThreadPool, SimdLevel eSimdLevel);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "ColorSpace.h"
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+
+class ThreadPool;
+
+// Host counterpart of Nv12ToColor32 for frames in host memory (software backend, CPU-only nodes).
+// Same semantics as the CUDA kernel: the frame is converted in 2x2 blocks, iMatrix is a
+// ColorSpaceStandard and alpha is left 0. eSimdLevel picks the kernel and is clamped to what
+// the CPU supports; SimdLevel::Scalar is the float reference the vector kernels are checked
+// against. With a thread pool the row pairs are split across its threads.
+template <class COLOR32>
+void Nv12ToColor32Host(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pBgra, int nBgraPitch, int nWidth, int nHeight,
+    int iMatrix = 0, ThreadPool* pThreadPool = nullptr, SimdLevel eSimdLevel = GetSimdLevel());
@@ -0,0 +1,100 @@
+#pragma once
+
+// Internal to the HostColorSpace*.cpp translation units
+
+#include "ColorSpace.h"
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+
+// YuvToRgbMatrix<iMatrix> as data, for kernels that take the standard at run time. The vector
+// kernels broadcast the coefficients into registers once per call, so specializing them on the
+// standard as well would only multiply the instantiations.
+struct YuvToRgbCoefficients {
+    float mat[3][3];        // Same values the CUDA kernels are specialized on
+    int16_t y, rv, gu, gv, bu;
+};
+
+// Compile time table entry of the standard, nothing is computed per call
+const YuvToRgbCoefficients& GetYuvToRgbCoefficients(int iMatrix);
+
+// Byte order of the 32 bit formats for the vector kernels
+template <class COLOR32> struct Color32Traits;
+template <> struct Color32Traits<BGRA32> { static const bool bBlueFirst = true; };
+template <> struct Color32Traits<RGBA32> { static const bool bBlueFirst = false; };
+
+template <class COLOR32>
+inline void StoreColor32(uint8_t* pDst, int r, int g, int b) {
+    COLOR32 rgb{};
+    rgb.c.r = (uint8_t)(r < 0 ? 0 : (r > 255 ? 255 : r));
+    rgb.c.g = (uint8_t)(g < 0 ? 0 : (g > 255 ? 255 : g));
+    rgb.c.b = (uint8_t)(b < 0 ? 0 : (b > 255 ? 255 : b));
+    *(uint32_t*)pDst = rgb.d;
+}
+
+// Fixed point conversion of the 2x2 blocks starting at columns [xBegin, xEnd) of one row pair.
+// Does exactly what the vector kernels do per pixel, used for the columns left over after them.
+template <class COLOR32>
+inline void Nv12ToColor32RowPairFixed(const uint8_t* pY0, const uint8_t* pY1, const uint8_t* pUV,
+    uint8_t* pDst0, uint8_t* pDst1, int xBegin, int xEnd, const YuvToRgbCoefficients& c) {
+    for (int x = xBegin; x < xEnd; x += 2) {
+        int u = pUV[x] - 128, v = pUV[x + 1] - 128;
+        int rc = c.rv * v, gc = c.gu * u + c.gv * v, bc = c.bu * u;
+        const uint8_t* pY[2] = { pY0, pY1 };
+        uint8_t* pDst[2] = { pDst0, pDst1 };
+        for (int row = 0; row < 2; row++) {
+            for (int i = 0; i < 2; i++) {
+                int yc = c.y * (pY[row][x + i] - 16);
+                StoreColor32<COLOR32>(pDst[row] + (x + i) * 4,
+                    (yc + rc) >> kYuvToRgbShift, (yc + gc) >> kYuvToRgbShift, (yc + bc) >> kYuvToRgbShift);
+            }
+        }
+    }
+}
+
+// Converts row pairs [nPairBegin, nPairEnd), i.e. luma rows 2 * nPairBegin .. 2 * nPairEnd - 1
+#define DECLARE_NV12_KERNEL(name) \
+    template <class COLOR32> \
+    void name(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight, \
+        int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c)
+
+DECLARE_NV12_KERNEL(Nv12ToColor32Rows_Scalar);
+DECLARE_NV12_KERNEL(Nv12ToColor32Rows_SSE41);
+DECLARE_NV12_KERNEL(Nv12ToColor32Rows_AVX2);
+DECLARE_NV12_KERNEL(Nv12ToColor32Rows_AVX512);
+
+#define INSTANTIATE_NV12_KERNEL(name) \
+    template void name<BGRA32>(const uint8_t*, int, uint8_t*, int, int, int, int, int, const YuvToRgbCoefficients&); \
+    template void name<RGBA32>(const uint8_t*, int, uint8_t*, int, int, int, int, int, const YuvToRgbCoefficients&)
+
+template <class COLOR32>
+using Nv12RowsKernel = void (*)(const uint8_t*, int, uint8_t*, int, int, int, int, int, const YuvToRgbCoefficients&);
+
+// Fastest kernel up to eSimdLevel the CPU runs
+template <class COLOR32>
+Nv12RowsKernel<COLOR32> GetNv12RowsKernel(SimdLevel eSimdLevel);
+
+// Fractional bits of the resampling weights. The taps of one output sample sum to
+// 1 << kFilterShift, which still fits int16 for _mm_madd_epi16.
+const int kFilterShift = 14;
+
+// pDst[x] = rounded sum of ppRows[t][x] * pWeights[t] over nTaps rows, for x < nWidth.
+// The vertical half of the resampler, the only part that touches every source pixel.
+#define DECLARE_VERTICAL_FILTER(name) \
+    void name(const uint8_t* const* ppRows, const int16_t* pWeights, int nTaps, uint8_t* pDst, int nWidth)
+
+DECLARE_VERTICAL_FILTER(FilterRowsVertical_Scalar);
+DECLARE_VERTICAL_FILTER(FilterRowsVertical_SSE41);
+DECLARE_VERTICAL_FILTER(FilterRowsVertical_AVX2);
+
+inline void FilterRowsVerticalFixed(const uint8_t* const* ppRows, const int16_t* pWeights, int nTaps, uint8_t* pDst,
+    int xBegin, int xEnd) {
+    for (int x = xBegin; x < xEnd; x++) {
+        int sum = 1 << (kFilterShift - 1);
+        for (int t = 0; t < nTaps; t++) {
+            sum += ppRows[t][x] * pWeights[t];
+        }
+        sum >>= kFilterShift;
+        pDst[x] = (uint8_t)(sum > 255 ? 255 : sum);
+    }
+}
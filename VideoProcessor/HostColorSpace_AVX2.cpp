@@ -0,0 +1,94 @@
+#include "HostColorSpaceKernels.hpp"
+
+#include <immintrin.h>
+
+template <class COLOR32>
+static inline void StorePixels(uint8_t* pDst, __m256i r16, __m256i g16, __m256i b16) {
+    const bool bgra = Color32Traits<COLOR32>::bBlueFirst;
+    __m256i r8 = _mm256_packus_epi16(r16, r16);
+    __m256i g8 = _mm256_packus_epi16(g16, g16);
+    __m256i b8 = _mm256_packus_epi16(b16, b16);
+    __m256i first = bgra ? b8 : r8, third = bgra ? r8 : b8;
+    __m256i fg = _mm256_unpacklo_epi8(first, g8);
+    __m256i ta = _mm256_unpacklo_epi8(third, _mm256_setzero_si256());
+    // Lane 0 holds pixels 0-7, lane 1 pixels 8-15
+    __m256i lo = _mm256_unpacklo_epi16(fg, ta), hi = _mm256_unpackhi_epi16(fg, ta);
+    _mm256_storeu_si256((__m256i*)pDst, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(pDst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline __m256i Channel(__m256i yLo, __m256i yHi, __m256i cLo, __m256i cHi) {
+    return _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(yLo, cLo), kYuvToRgbShift),
+        _mm256_srai_epi32(_mm256_add_epi32(yHi, cHi), kYuvToRgbShift));
+}
+
+// 16 pixels of two rows per iteration, same scheme as the SSE4.1 kernel. Every step but the
+// final store stays within 128 bit lanes, so lane k always holds pixels 8k..8k+7 and their
+// 4 chroma blocks.
+template <class COLOR32>
+void Nv12ToColor32Rows_AVX2(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight,
+    int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i yOffset = _mm256_set1_epi16(16), uvOffset = _mm256_set1_epi16(128);
+    const __m256i yCoef = _mm256_set1_epi32(c.y);
+    const __m256i rCoef = _mm256_set1_epi32((uint32_t)(uint16_t)c.rv << 16);
+    const __m256i gCoef = _mm256_set1_epi32((uint16_t)c.gu | ((uint32_t)(uint16_t)c.gv << 16));
+    const __m256i bCoef = _mm256_set1_epi32((uint16_t)c.bu);
+    const int nBlockWidth = nWidth & ~1;
+    const int nVectorWidth = nBlockWidth & ~15;
+
+    for (int pair = nPairBegin; pair < nPairEnd; pair++) {
+        const uint8_t* pY0 = pNv12 + pair * 2 * nNv12Pitch;
+        const uint8_t* pY1 = pY0 + nNv12Pitch;
+        const uint8_t* pUV = pNv12 + (nHeight + pair) * nNv12Pitch;
+        uint8_t* pDst0 = pDst + pair * 2 * nDstPitch;
+        uint8_t* pDst1 = pDst0 + nDstPitch;
+
+        for (int x = 0; x < nVectorWidth; x += 16) {
+            __m256i uv = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pUV + x))), uvOffset);
+            __m256i rc = _mm256_madd_epi16(uv, rCoef), gc = _mm256_madd_epi16(uv, gCoef), bc = _mm256_madd_epi16(uv, bCoef);
+            __m256i rcLo = _mm256_unpacklo_epi32(rc, rc), rcHi = _mm256_unpackhi_epi32(rc, rc);
+            __m256i gcLo = _mm256_unpacklo_epi32(gc, gc), gcHi = _mm256_unpackhi_epi32(gc, gc);
+            __m256i bcLo = _mm256_unpacklo_epi32(bc, bc), bcHi = _mm256_unpackhi_epi32(bc, bc);
+
+            const uint8_t* pY[2] = { pY0, pY1 };
+            uint8_t* pOut[2] = { pDst0, pDst1 };
+            for (int row = 0; row < 2; row++) {
+                __m256i y = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pY[row] + x))), yOffset);
+                __m256i yLo = _mm256_madd_epi16(_mm256_unpacklo_epi16(y, zero), yCoef);
+                __m256i yHi = _mm256_madd_epi16(_mm256_unpackhi_epi16(y, zero), yCoef);
+                StorePixels<COLOR32>(pOut[row] + x * 4,
+                    Channel(yLo, yHi, rcLo, rcHi), Channel(yLo, yHi, gcLo, gcHi), Channel(yLo, yHi, bcLo, bcHi));
+            }
+        }
+        Nv12ToColor32RowPairFixed<COLOR32>(pY0, pY1, pUV, pDst0, pDst1, nVectorWidth, nBlockWidth, c);
+    }
+}
+
+INSTANTIATE_NV12_KERNEL(Nv12ToColor32Rows_AVX2);
+
+// 32 pixels per iteration, the SSE4.1 scheme per 128 bit lane
+void FilterRowsVertical_AVX2(const uint8_t* const* ppRows, const int16_t* pWeights, int nTaps, uint8_t* pDst, int nWidth) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(1 << (kFilterShift - 1));
+    const int nVectorWidth = nWidth & ~31;
+
+    for (int x = 0; x < nVectorWidth; x += 32) {
+        __m256i acc[4] = { round, round, round, round };
+        for (int t = 0; t < nTaps; t += 2) {
+            const bool pair = t + 1 < nTaps;
+            __m256i a = _mm256_loadu_si256((const __m256i*)(ppRows[t] + x));
+            __m256i b = pair ? _mm256_loadu_si256((const __m256i*)(ppRows[t + 1] + x)) : zero;
+            __m256i w = _mm256_set1_epi32((uint16_t)pWeights[t] | (pair ? (uint32_t)(uint16_t)pWeights[t + 1] << 16 : 0));
+            __m256i abLo = _mm256_unpacklo_epi8(a, b), abHi = _mm256_unpackhi_epi8(a, b);
+            acc[0] = _mm256_add_epi32(acc[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(abLo, zero), w));
+            acc[1] = _mm256_add_epi32(acc[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(abLo, zero), w));
+            acc[2] = _mm256_add_epi32(acc[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(abHi, zero), w));
+            acc[3] = _mm256_add_epi32(acc[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(abHi, zero), w));
+        }
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(acc[0], kFilterShift), _mm256_srai_epi32(acc[1], kFilterShift));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(acc[2], kFilterShift), _mm256_srai_epi32(acc[3], kFilterShift));
+        _mm256_storeu_si256((__m256i*)(pDst + x), _mm256_packus_epi16(lo, hi));
+    }
+    FilterRowsVerticalFixed(ppRows, pWeights, nTaps, pDst, nVectorWidth, nWidth);
+}
@@ -0,0 +1,68 @@
+#include "HostColorSpaceKernels.hpp"
+
+#include <immintrin.h>
+
+template <class COLOR32>
+static inline void StorePixels(uint8_t* pDst, __m512i r16, __m512i g16, __m512i b16) {
+    const bool bgra = Color32Traits<COLOR32>::bBlueFirst;
+    __m512i r8 = _mm512_packus_epi16(r16, r16);
+    __m512i g8 = _mm512_packus_epi16(g16, g16);
+    __m512i b8 = _mm512_packus_epi16(b16, b16);
+    __m512i first = bgra ? b8 : r8, third = bgra ? r8 : b8;
+    __m512i fg = _mm512_unpacklo_epi8(first, g8);
+    __m512i ta = _mm512_unpacklo_epi8(third, _mm512_setzero_si512());
+    // Lane k of lo holds pixels 8k..8k+3, lane k of hi pixels 8k+4..8k+7
+    __m512i lo = _mm512_unpacklo_epi16(fg, ta), hi = _mm512_unpackhi_epi16(fg, ta);
+    const __m512i first16 = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i last16 = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    _mm512_storeu_si512(pDst, _mm512_permutex2var_epi64(lo, first16, hi));
+    _mm512_storeu_si512(pDst + 64, _mm512_permutex2var_epi64(lo, last16, hi));
+}
+
+static inline __m512i Channel(__m512i yLo, __m512i yHi, __m512i cLo, __m512i cHi) {
+    return _mm512_packs_epi32(_mm512_srai_epi32(_mm512_add_epi32(yLo, cLo), kYuvToRgbShift),
+        _mm512_srai_epi32(_mm512_add_epi32(yHi, cHi), kYuvToRgbShift));
+}
+
+// 32 pixels of two rows per iteration, the AVX2 scheme over four 128 bit lanes
+template <class COLOR32>
+void Nv12ToColor32Rows_AVX512(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight,
+    int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i yOffset = _mm512_set1_epi16(16), uvOffset = _mm512_set1_epi16(128);
+    const __m512i yCoef = _mm512_set1_epi32(c.y);
+    const __m512i rCoef = _mm512_set1_epi32((uint32_t)(uint16_t)c.rv << 16);
+    const __m512i gCoef = _mm512_set1_epi32((uint16_t)c.gu | ((uint32_t)(uint16_t)c.gv << 16));
+    const __m512i bCoef = _mm512_set1_epi32((uint16_t)c.bu);
+    const int nBlockWidth = nWidth & ~1;
+    const int nVectorWidth = nBlockWidth & ~31;
+
+    for (int pair = nPairBegin; pair < nPairEnd; pair++) {
+        const uint8_t* pY0 = pNv12 + pair * 2 * nNv12Pitch;
+        const uint8_t* pY1 = pY0 + nNv12Pitch;
+        const uint8_t* pUV = pNv12 + (nHeight + pair) * nNv12Pitch;
+        uint8_t* pDst0 = pDst + pair * 2 * nDstPitch;
+        uint8_t* pDst1 = pDst0 + nDstPitch;
+
+        for (int x = 0; x < nVectorWidth; x += 32) {
+            __m512i uv = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(pUV + x))), uvOffset);
+            __m512i rc = _mm512_madd_epi16(uv, rCoef), gc = _mm512_madd_epi16(uv, gCoef), bc = _mm512_madd_epi16(uv, bCoef);
+            __m512i rcLo = _mm512_unpacklo_epi32(rc, rc), rcHi = _mm512_unpackhi_epi32(rc, rc);
+            __m512i gcLo = _mm512_unpacklo_epi32(gc, gc), gcHi = _mm512_unpackhi_epi32(gc, gc);
+            __m512i bcLo = _mm512_unpacklo_epi32(bc, bc), bcHi = _mm512_unpackhi_epi32(bc, bc);
+
+            const uint8_t* pY[2] = { pY0, pY1 };
+            uint8_t* pOut[2] = { pDst0, pDst1 };
+            for (int row = 0; row < 2; row++) {
+                __m512i y = _mm512_sub_epi16(_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(pY[row] + x))), yOffset);
+                __m512i yLo = _mm512_madd_epi16(_mm512_unpacklo_epi16(y, zero), yCoef);
+                __m512i yHi = _mm512_madd_epi16(_mm512_unpackhi_epi16(y, zero), yCoef);
+                StorePixels<COLOR32>(pOut[row] + x * 4,
+                    Channel(yLo, yHi, rcLo, rcHi), Channel(yLo, yHi, gcLo, gcHi), Channel(yLo, yHi, bcLo, bcHi));
+            }
+        }
+        Nv12ToColor32RowPairFixed<COLOR32>(pY0, pY1, pUV, pDst0, pDst1, nVectorWidth, nBlockWidth, c);
+    }
+}
+
+INSTANTIATE_NV12_KERNEL(Nv12ToColor32Rows_AVX512);
@@ -0,0 +1,94 @@
+#include "HostColorSpaceKernels.hpp"
+
+#include <smmintrin.h>
+
+template <class COLOR32>
+static inline void StorePixels(uint8_t* pDst, __m128i r16, __m128i g16, __m128i b16) {
+    const bool bgra = Color32Traits<COLOR32>::bBlueFirst;
+    __m128i r8 = _mm_packus_epi16(r16, r16);
+    __m128i g8 = _mm_packus_epi16(g16, g16);
+    __m128i b8 = _mm_packus_epi16(b16, b16);
+    __m128i first = bgra ? b8 : r8, third = bgra ? r8 : b8;
+    __m128i fg = _mm_unpacklo_epi8(first, g8);
+    __m128i ta = _mm_unpacklo_epi8(third, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i*)pDst, _mm_unpacklo_epi16(fg, ta));
+    _mm_storeu_si128((__m128i*)(pDst + 16), _mm_unpackhi_epi16(fg, ta));
+}
+
+static inline __m128i Channel(__m128i yLo, __m128i yHi, __m128i cLo, __m128i cHi) {
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(yLo, cLo), kYuvToRgbShift),
+        _mm_srai_epi32(_mm_add_epi32(yHi, cHi), kYuvToRgbShift));
+}
+
+// 8 pixels of two rows per iteration. The interleaved UV row is widened to 16 bit pairs so one
+// _mm_madd_epi16 per channel yields the chroma term of 4 blocks, which is then shared by the
+// 2x2 luma pixels of each block.
+template <class COLOR32>
+void Nv12ToColor32Rows_SSE41(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight,
+    int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yOffset = _mm_set1_epi16(16), uvOffset = _mm_set1_epi16(128);
+    const __m128i yCoef = _mm_set1_epi32(c.y);
+    const __m128i rCoef = _mm_set1_epi32((uint32_t)(uint16_t)c.rv << 16);
+    const __m128i gCoef = _mm_set1_epi32((uint16_t)c.gu | ((uint32_t)(uint16_t)c.gv << 16));
+    const __m128i bCoef = _mm_set1_epi32((uint16_t)c.bu);
+    const int nBlockWidth = nWidth & ~1;
+    const int nVectorWidth = nBlockWidth & ~7;
+
+    for (int pair = nPairBegin; pair < nPairEnd; pair++) {
+        const uint8_t* pY0 = pNv12 + pair * 2 * nNv12Pitch;
+        const uint8_t* pY1 = pY0 + nNv12Pitch;
+        const uint8_t* pUV = pNv12 + (nHeight + pair) * nNv12Pitch;
+        uint8_t* pDst0 = pDst + pair * 2 * nDstPitch;
+        uint8_t* pDst1 = pDst0 + nDstPitch;
+
+        for (int x = 0; x < nVectorWidth; x += 8) {
+            __m128i uv = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pUV + x))), uvOffset);
+            __m128i rc = _mm_madd_epi16(uv, rCoef), gc = _mm_madd_epi16(uv, gCoef), bc = _mm_madd_epi16(uv, bCoef);
+            __m128i rcLo = _mm_unpacklo_epi32(rc, rc), rcHi = _mm_unpackhi_epi32(rc, rc);
+            __m128i gcLo = _mm_unpacklo_epi32(gc, gc), gcHi = _mm_unpackhi_epi32(gc, gc);
+            __m128i bcLo = _mm_unpacklo_epi32(bc, bc), bcHi = _mm_unpackhi_epi32(bc, bc);
+
+            const uint8_t* pY[2] = { pY0, pY1 };
+            uint8_t* pOut[2] = { pDst0, pDst1 };
+            for (int row = 0; row < 2; row++) {
+                __m128i y = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pY[row] + x))), yOffset);
+                __m128i yLo = _mm_madd_epi16(_mm_unpacklo_epi16(y, zero), yCoef);
+                __m128i yHi = _mm_madd_epi16(_mm_unpackhi_epi16(y, zero), yCoef);
+                StorePixels<COLOR32>(pOut[row] + x * 4,
+                    Channel(yLo, yHi, rcLo, rcHi), Channel(yLo, yHi, gcLo, gcHi), Channel(yLo, yHi, bcLo, bcHi));
+            }
+        }
+        Nv12ToColor32RowPairFixed<COLOR32>(pY0, pY1, pUV, pDst0, pDst1, nVectorWidth, nBlockWidth, c);
+    }
+}
+
+INSTANTIATE_NV12_KERNEL(Nv12ToColor32Rows_SSE41);
+
+// 16 pixels per iteration. Two rows at a time are interleaved byte by byte and widened, so one
+// _mm_madd_epi16 applies both of their weights. Everything stays in input order: the unpacks
+// and the final packs pair up the same way.
+void FilterRowsVertical_SSE41(const uint8_t* const* ppRows, const int16_t* pWeights, int nTaps, uint8_t* pDst, int nWidth) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (kFilterShift - 1));
+    const int nVectorWidth = nWidth & ~15;
+
+    for (int x = 0; x < nVectorWidth; x += 16) {
+        __m128i acc[4] = { round, round, round, round };
+        for (int t = 0; t < nTaps; t += 2) {
+            const bool pair = t + 1 < nTaps;
+            __m128i a = _mm_loadu_si128((const __m128i*)(ppRows[t] + x));
+            __m128i b = pair ? _mm_loadu_si128((const __m128i*)(ppRows[t + 1] + x)) : zero;
+            __m128i w = _mm_set1_epi32((uint16_t)pWeights[t] | (pair ? (uint32_t)(uint16_t)pWeights[t + 1] << 16 : 0));
+            __m128i abLo = _mm_unpacklo_epi8(a, b), abHi = _mm_unpackhi_epi8(a, b);
+            acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi8(abLo, zero), w));
+            acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi8(abLo, zero), w));
+            acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi8(abHi, zero), w));
+            acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi8(abHi, zero), w));
+        }
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc[0], kFilterShift), _mm_srai_epi32(acc[1], kFilterShift));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc[2], kFilterShift), _mm_srai_epi32(acc[3], kFilterShift));
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(lo, hi));
+    }
+    FilterRowsVerticalFixed(ppRows, pWeights, nTaps, pDst, nVectorWidth, nWidth);
+}
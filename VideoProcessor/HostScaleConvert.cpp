@@ -0,0 +1,337 @@
+#include "HostScaleConvert.hpp"
+
+#include "HostColorSpaceKernels.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+void FilterRowsVertical_Scalar(const uint8_t* const* ppRows, const int16_t* pWeights, int nTaps, uint8_t* pDst, int nWidth) {
+    FilterRowsVerticalFixed(ppRows, pWeights, nTaps, pDst, 0, nWidth);
+}
+
+namespace {
+
+typedef void (*VerticalFilter)(const uint8_t* const*, const int16_t*, int, uint8_t*, int);
+
+VerticalFilter GetVerticalFilter(SimdLevel eSimdLevel) {
+    switch ((std::min)(eSimdLevel, GetSimdLevel())) {
+    // Memory bound, 512 bit registers would not make it any faster
+    case SimdLevel::AVX512:
+    case SimdLevel::AVX2:   return FilterRowsVertical_AVX2;
+    case SimdLevel::SSE41:  return FilterRowsVertical_SSE41;
+    case SimdLevel::Scalar: break;
+    }
+    return FilterRowsVertical_Scalar;
+}
+
+// Output sample i of a resampler is the weighted sum of source samples start[i] .. start[i] + taps - 1,
+// with weights[i * taps ..]. Every output has the same number of taps, unused ones weigh 0.
+struct FilterTable {
+    int taps = 0;
+    bool identity = false;      // Same size, output sample i is source sample i
+    std::vector<int> start;
+    std::vector<int16_t> weights;
+
+    int last(int i) const { return start[i] + taps - 1; }
+};
+
+FilterTable BuildFilterTable(int nSrcSize, int nDstSize, ScaleFilter eFilter) {
+    const double scale = (double)nSrcSize / nDstSize;
+    std::vector<std::vector<std::pair<int, double>>> contributions(nDstSize);
+    for (int i = 0; i < nDstSize; i++) {
+        std::vector<std::pair<int, double>>& taps = contributions[i];
+        if (eFilter == ScaleFilter::Area && scale > 1.0) {
+            // Coverage of the source pixels by [i * scale, (i + 1) * scale)
+            const double begin = i * scale, end = (std::min)((i + 1) * scale, (double)nSrcSize);
+            for (int s = (int)begin; s < end; s++) {
+                const double weight = ((std::min)(end, s + 1.0) - (std::max)(begin, (double)s)) / scale;
+                if (weight > 1e-6) {
+                    taps.emplace_back(s, weight);
+                }
+            }
+        } else {
+            // Pixel centers aligned, upscaling with area falls back to this too
+            const double center = (std::max)(0.0, (std::min)((i + 0.5) * scale - 0.5, nSrcSize - 1.0));
+            const int s = (std::min)((int)center, nSrcSize - 1);
+            const double fraction = center - s;
+            taps.emplace_back(s, 1.0 - fraction);
+            if (fraction > 1e-6) {
+                taps.emplace_back(s + 1, fraction);
+            }
+        }
+    }
+
+    FilterTable table;
+    for (const std::vector<std::pair<int, double>>& taps : contributions) {
+        table.taps = (std::max)(table.taps, taps.back().first - taps.front().first + 1);
+    }
+    table.start.resize(nDstSize);
+    table.weights.assign((size_t)nDstSize * table.taps, 0);
+    for (int i = 0; i < nDstSize; i++) {
+        const std::vector<std::pair<int, double>>& taps = contributions[i];
+        // Keep the window inside the source, the shifted in samples get weight 0
+        const int start = (std::max)(0, (std::min)(taps.front().first, nSrcSize - table.taps));
+        int16_t* pWeights = &table.weights[(size_t)i * table.taps];
+        int sum = 0, largest = 0;
+        for (const std::pair<int, double>& tap : taps) {
+            const int k = tap.first - start;
+            pWeights[k] = (int16_t)std::lround(tap.second * (1 << kFilterShift));
+            sum += pWeights[k];
+            if (pWeights[k] > pWeights[largest]) {
+                largest = k;
+            }
+        }
+        // Rounding must not change the brightness
+        pWeights[largest] = (int16_t)(pWeights[largest] + (1 << kFilterShift) - sum);
+        table.start[i] = start;
+    }
+    table.identity = nSrcSize == nDstSize && table.taps == 1;
+    return table;
+}
+
+// Resampling of the cropped frame to one output size
+struct ScalePlan {
+    int width, height;
+    FilterTable lumaX, lumaY;
+    FilterTable chromaX, chromaY;     // In chroma samples, chromaX for U/V pairs
+
+    // Last source luma row output row pair inPair reads
+    int lastRow(int inPair) const {
+        return (std::max)(lumaY.last(2 * inPair + 1), 2 * chromaY.last(inPair) + 1);
+    }
+};
+
+// Cropped source frame
+struct Source {
+    const uint8_t* pLuma;       // Top left of the crop
+    const uint8_t* pChroma;
+    int pitch;
+    int width, height;          // Of the crop, in luma samples
+};
+
+void MakePlan(const Source& source, int nWidth, int nHeight, ScaleFilter eFilter, ScalePlan& plan) {
+    plan.width = nWidth & ~1;
+    plan.height = nHeight & ~1;
+    plan.lumaX = BuildFilterTable(source.width, plan.width, eFilter);
+    plan.lumaY = BuildFilterTable(source.height, plan.height, eFilter);
+    plan.chromaX = BuildFilterTable((source.width + 1) / 2, plan.width / 2, eFilter);
+    plan.chromaY = BuildFilterTable((source.height + 1) / 2, plan.height / 2, eFilter);
+}
+
+bool MakeSource(const uint8_t* pNv12, int nPitch, int nWidth, int nHeight, const CropRect& crop, Source& source) {
+    int left = 0, top = 0, right = nWidth, bottom = nHeight;
+    if (crop.right > crop.left && crop.bottom > crop.top) {
+        left = (std::max)(0, crop.left) & ~1;
+        top = (std::max)(0, crop.top) & ~1;
+        right = (std::min)(crop.right, nWidth);
+        bottom = (std::min)(crop.bottom, nHeight);
+    }
+    if (right - left < 2 || bottom - top < 2) {
+        return false;
+    }
+    source.pitch = nPitch;
+    source.width = right - left;
+    source.height = bottom - top;
+    source.pLuma = pNv12 + (size_t)top * nPitch + left;
+    source.pChroma = pNv12 + (size_t)(nHeight + top / 2) * nPitch + left;
+    return true;
+}
+
+// Horizontal half of the resampler, on one vertically filtered row. kTaps > 0 fixes the tap
+// count at compile time for the common filters, kChannels is 2 for interleaved UV rows.
+template <int kTaps, int kChannels>
+void FilterRowHorizontal(const uint8_t* pSrc, const FilterTable& table, int nWidth, uint8_t* pDst) {
+    const int taps = kTaps > 0 ? kTaps : table.taps;
+    const int16_t* pWeights = table.weights.data();
+    for (int x = 0; x < nWidth; x++, pWeights += taps) {
+        const uint8_t* p = pSrc + kChannels * table.start[x];
+        for (int channel = 0; channel < kChannels; channel++) {
+            int sum = 1 << (kFilterShift - 1);
+            for (int t = 0; t < taps; t++) {
+                sum += p[kChannels * t + channel] * pWeights[t];
+            }
+            sum >>= kFilterShift;
+            pDst[kChannels * x + channel] = (uint8_t)(sum > 255 ? 255 : sum);
+        }
+    }
+}
+
+template <int kChannels>
+void FilterRowHorizontal(const uint8_t* pSrc, const FilterTable& table, int nWidth, uint8_t* pDst) {
+    if (table.identity) {
+        memcpy(pDst, pSrc, (size_t)nWidth * kChannels);
+        return;
+    }
+    switch (table.taps) {
+    case 2:  FilterRowHorizontal<2, kChannels>(pSrc, table, nWidth, pDst); break;
+    case 3:  FilterRowHorizontal<3, kChannels>(pSrc, table, nWidth, pDst); break;
+    default: FilterRowHorizontal<0, kChannels>(pSrc, table, nWidth, pDst); break;
+    }
+}
+
+// Produces output row pairs into NV12 rows. Owns the per thread scratch.
+class RowPairScaler {
+public:
+    RowPairScaler(const Source& inSource, VerticalFilter inVerticalFilter)
+        : mSource(inSource)
+        , mVerticalFilter(inVerticalFilter)
+        , mVertical(inSource.width + 1)
+    {
+    }
+
+    void scale(const ScalePlan& inPlan, int inPair, uint8_t* outY0, uint8_t* outY1, uint8_t* outUV) {
+        uint8_t* pY[2] = { outY0, outY1 };
+        for (int row = 0; row < 2; row++) {
+            const uint8_t* pRow = filterVertical(inPlan.lumaY, 2 * inPair + row, mSource.pLuma, mSource.width);
+            FilterRowHorizontal<1>(pRow, inPlan.lumaX, inPlan.width, pY[row]);
+        }
+        const uint8_t* pRow = filterVertical(inPlan.chromaY, inPair, mSource.pChroma, 2 * ((mSource.width + 1) / 2));
+        FilterRowHorizontal<2>(pRow, inPlan.chromaX, inPlan.width / 2, outUV);
+    }
+
+private:
+    const uint8_t* filterVertical(const FilterTable& inTable, int inRow, const uint8_t* inPlane, int inBytes) {
+        const int16_t* pWeights = &inTable.weights[(size_t)inRow * inTable.taps];
+        mRows.resize(inTable.taps);
+        for (int t = 0; t < inTable.taps; t++) {
+            mRows[t] = inPlane + (size_t)(inTable.start[inRow] + t) * mSource.pitch;
+        }
+        if (inTable.taps == 1) {
+            // Same height, no filtering
+            return mRows[0];
+        }
+        mVerticalFilter(mRows.data(), pWeights, inTable.taps, mVertical.data(), inBytes);
+        return mVertical.data();
+    }
+
+    const Source& mSource;
+    VerticalFilter mVerticalFilter;
+    std::vector<uint8_t> mVertical;
+    std::vector<const uint8_t*> mRows;
+};
+
+// Source rows every output advances past together, about what stays in L2 next to the scratch
+const int kBandRows = 16;
+
+// Calls inFunc(output, pair) for the pairs [begin, end) of every output, in an order that walks
+// the source top to bottom once: a pair is produced as soon as the band holds all rows it needs.
+template <class Func>
+void ForEachPairBanded(const std::vector<ScalePlan>& plans, const std::vector<int>& begins, const std::vector<int>& ends,
+    Func inFunc) {
+    std::vector<int> next = begins;
+    int bandEnd = 0;
+    bool done = false;
+    while (!done) {
+        bandEnd += kBandRows;
+        done = true;
+        for (size_t i = 0; i < plans.size(); i++) {
+            while (next[i] < ends[i] && plans[i].lastRow(next[i]) < bandEnd) {
+                inFunc((int)i, next[i]++);
+            }
+            done = done && next[i] == ends[i];
+        }
+    }
+}
+
+// Splits the work in strips of equal share of every output, one thread per strip
+const int kStrips = 64;
+const int kMinPairsPerStrip = 8;
+
+template <class Func>
+void RunStrips(const std::vector<ScalePlan>& plans, ThreadPool* pThreadPool, Func inFunc) {
+    int maxPairs = 0;
+    for (const ScalePlan& plan : plans) {
+        maxPairs = (std::max)(maxPairs, plan.height / 2);
+    }
+    auto runRange = [&](int begin, int end) {
+        std::vector<int> begins, ends;
+        for (const ScalePlan& plan : plans) {
+            const int pairs = plan.height / 2;
+            begins.push_back((int)((int64_t)pairs * begin / kStrips));
+            ends.push_back((int)((int64_t)pairs * end / kStrips));
+        }
+        inFunc(begins, ends);
+    };
+    if (!pThreadPool || pThreadPool->getThreadCount() == 1 || maxPairs < 2 * kMinPairsPerStrip) {
+        runRange(0, kStrips);
+        return;
+    }
+    pThreadPool->parallelFor(kStrips, runRange);
+}
+
+}
+
+template <class COLOR32>
+void Nv12ScaleToColor32Host(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput* pOutputs, int nOutputCount, ScaleFilter eFilter, int iMatrix,
+    ThreadPool* pThreadPool, SimdLevel eSimdLevel) {
+    Source source;
+    if (!MakeSource(pNv12, nNv12Pitch, nWidth, nHeight, crop, source)) {
+        return;
+    }
+    std::vector<ScalePlan> plans(nOutputCount);
+    int maxWidth = 0;
+    for (int i = 0; i < nOutputCount; i++) {
+        MakePlan(source, pOutputs[i].width, pOutputs[i].height, eFilter, plans[i]);
+        maxWidth = (std::max)(maxWidth, plans[i].width);
+    }
+
+    const Nv12RowsKernel<COLOR32> kernel = GetNv12RowsKernel<COLOR32>(eSimdLevel);
+    const VerticalFilter verticalFilter = GetVerticalFilter(eSimdLevel);
+    const YuvToRgbCoefficients& c = GetYuvToRgbCoefficients(iMatrix);
+    RunStrips(plans, pThreadPool, [&](const std::vector<int>& begins, const std::vector<int>& ends) {
+        RowPairScaler scaler(source, verticalFilter);
+        // Y0, Y1 and UV row of one output row pair, the layout the conversion kernels expect
+        // of a 2 row frame. Padded so the vector kernels may read past the width.
+        const int pitch = (maxWidth + 63) & ~31;
+        std::vector<uint8_t> scratch((size_t)pitch * 3);
+        ForEachPairBanded(plans, begins, ends, [&](int output, int pair) {
+            const ScalePlan& plan = plans[output];
+            scaler.scale(plan, pair, scratch.data(), scratch.data() + pitch, scratch.data() + 2 * pitch);
+            kernel(scratch.data(), pitch, pOutputs[output].data + (size_t)2 * pair * pOutputs[output].pitch,
+                pOutputs[output].pitch, plan.width, 2, 0, 1, c);
+        });
+    });
+}
+
+void Nv12ScaleHost(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput& output, ScaleFilter eFilter, ThreadPool* pThreadPool, SimdLevel eSimdLevel) {
+    Source source;
+    if (!MakeSource(pNv12, nNv12Pitch, nWidth, nHeight, crop, source)) {
+        return;
+    }
+    std::vector<ScalePlan> plans(1);
+    MakePlan(source, output.width, output.height, eFilter, plans[0]);
+
+    const VerticalFilter verticalFilter = GetVerticalFilter(eSimdLevel);
+    uint8_t* pChroma = output.data + (size_t)output.pitch * plans[0].height;
+    RunStrips(plans, pThreadPool, [&](const std::vector<int>& begins, const std::vector<int>& ends) {
+        RowPairScaler scaler(source, verticalFilter);
+        ForEachPairBanded(plans, begins, ends, [&](int, int pair) {
+            uint8_t* pY0 = output.data + (size_t)2 * pair * output.pitch;
+            scaler.scale(plans[0], pair, pY0, pY0 + output.pitch, pChroma + (size_t)pair * output.pitch);
+        });
+    });
+}
+
+void P016ToNv12Host(const uint8_t* pP016, int nP016Pitch, uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight) {
+    // Interleaved UV rows hold as many samples as an even width of luma
+    const int samples = (nWidth + 1) & ~1;
+    const int rows = nHeight + (nHeight + 1) / 2;
+    for (int y = 0; y < rows; y++) {
+        const uint8_t* pSrc = pP016 + (size_t)y * nP016Pitch;
+        uint8_t* pDst = pNv12 + (size_t)y * nNv12Pitch;
+        for (int x = 0; x < samples; x++) {
+            pDst[x] = pSrc[2 * x + 1];
+        }
+    }
+}
+
+// Explicit Instantiation
+template void Nv12ScaleToColor32Host<BGRA32>(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput* pOutputs, int nOutputCount, ScaleFilter eFilter, int iMatrix, ThreadPool* pThreadPool, SimdLevel eSimdLevel);
+template void Nv12ScaleToColor32Host<RGBA32>(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput* pOutputs, int nOutputCount, ScaleFilter eFilter, int iMatrix, ThreadPool* pThreadPool, SimdLevel eSimdLevel);
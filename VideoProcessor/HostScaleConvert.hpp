@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ColorSpace.h"
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+
+class ThreadPool;
+
+enum class ScaleFilter {
+    Bilinear,   // 2 taps, for upscaling and mild downscaling
+    Area,       // Box average over the covered source pixels, alias free at any downscale ratio
+};
+
+// Source region in pixels, right/bottom exclusive. left and top are rounded down to even, so
+// the region starts on a chroma sample. An empty rectangle selects the whole frame.
+struct CropRect {
+    int left = 0, top = 0, right = 0, bottom = 0;
+};
+
+// One rung of an output ladder. Width and height are rounded down to even.
+struct ScaleOutput {
+    uint8_t* data = nullptr;
+    int pitch = 0;
+    int width = 0, height = 0;
+};
+
+// Crops, resamples and converts an NV12 host frame to every output in one pass: each output
+// row pair is filtered vertically, then horizontally, into a small NV12 scratch and converted
+// by the Nv12ToColor32Host kernels while still in L1. All outputs advance together over bands
+// of source rows, so the source is read from memory once for the whole ladder. Matrix, 2x2
+// chroma handling and alpha are those of Nv12ToColor32Host. With a thread pool every thread
+// takes a horizontal strip of each output.
+template <class COLOR32>
+void Nv12ScaleToColor32Host(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput* pOutputs, int nOutputCount, ScaleFilter eFilter = ScaleFilter::Bilinear, int iMatrix = 0,
+    ThreadPool* pThreadPool = nullptr, SimdLevel eSimdLevel = GetSimdLevel());
+
+// Narrows a P016 host frame (MSB aligned 16 bit little endian samples, UV plane at pitch *
+// height) to an NV12 frame at nNv12Pitch, for the 8 bit scaler and converters: the high byte of
+// each sample, the 8 bit value truncated. Both pitches are in bytes.
+void P016ToNv12Host(const uint8_t* pP016, int nP016Pitch, uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight);
+
+// Crops and resamples an NV12 host frame into another NV12 frame (UV plane at pitch * height),
+// same filters as Nv12ScaleToColor32Host. The separate scale pass the fused one replaces.
+void Nv12ScaleHost(const uint8_t* pNv12, int nNv12Pitch, int nWidth, int nHeight, const CropRect& crop,
+    const ScaleOutput& output, ScaleFilter eFilter = ScaleFilter::Bilinear,
+    ThreadPool* pThreadPool = nullptr, SimdLevel eSimdLevel = GetSimdLevel());
@@ -0,0 +1,655 @@
+#include "LiveIngest.hpp"
+
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const uint8_t kStartCode[4] = { 0, 0, 0, 1 };
+const int kTsPacketSize = 188;
+const int kRtpHeaderSize = 12;
+const int kRtpPayloadMp2t = 33;
+const int kPollMs = 5;
+
+// RFC 3550 sequence validation: a packet up to kMaxMisorder behind the next to release is late
+// or a duplicate. One further behind, or too far ahead for the reorder buffer, is out of the
+// window; kResyncPackets of those in sequence are a restarted sender and the receiver follows.
+const int kMaxMisorder = 100;
+const int kResyncPackets = 2;
+
+// RFC 6184 payload structures
+const int kNalStapA = 24;
+const int kNalFuA = 28;
+
+// PMT stream types
+const int kStreamTypeH264 = 0x1B;
+const int kStreamTypeHevc = 0x24;
+
+inline uint32_t ReadBe16(const uint8_t* p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+inline uint32_t ReadBe32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+bool
+ParseLiveUrl(const std::string& inUrl, LiveProtocol& outProtocol, std::string& outHost, int& outPort)
+{
+    std::string rest;
+    if (inUrl.compare(0, 6, "rtp://") == 0) {
+        outProtocol = LiveProtocol::Rtp;
+        rest = inUrl.substr(6);
+    } else if (inUrl.compare(0, 6, "udp://") == 0) {
+        outProtocol = LiveProtocol::Ts;
+        rest = inUrl.substr(6);
+    } else {
+        return false;
+    }
+    const size_t colon = rest.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
+    }
+    outHost = rest.substr(0, colon);
+    outPort = atoi(rest.c_str() + colon + 1);
+    return outPort > 0 && outPort < 65536;
+}
+
+LiveIngest::LiveIngest(const LiveIngestConfig& inConfig)
+    : mConfig(inConfig)
+    , mSocket(inConfig.batchSize)
+    , mUnitQueue(std::max(inConfig.queueDepth, 1))
+{
+    // Sequence numbers are 16 bits, the reorder window has to stay well inside half their range
+    int slots = 1;
+    while (slots < std::min(std::max(mConfig.packetSlots, 2 * mConfig.batchSize), 16384)) {
+        slots <<= 1;
+    }
+    mConfig.packetSlots = slots;
+    mConfig.batchSize = mSocket.getBatchSize();
+    mBatch.resize(mConfig.batchSize);
+    mBatchSlots.resize(mConfig.batchSize);
+    mEntries.resize(slots);
+    mProbation.reserve(kResyncPackets);
+    // Every unit queued, every unit handed out and still valid, and the one being written
+    mBuffers.resize(mConfig.queueDepth + std::max(mConfig.unitsInFlight, 1) + 1);
+}
+
+bool
+LiveIngest::start()
+{
+    const int slots = mConfig.packetSlots;
+    mSlots.reset(new uint8_t[(size_t)slots * mConfig.slotSize]);
+    mFreeSlots.reserve(slots);
+    for (int slot = slots - 1; slot >= 0; slot--) {
+        mFreeSlots.push_back(slot);
+    }
+    if (!mSocket.bind(mConfig.address, mConfig.port, mConfig.receiveBuffer)) {
+        mUnitQueue.close();
+        return false;
+    }
+    mOpen = true;
+    mThread = std::thread(&LiveIngest::receiveLoop, this);
+    return true;
+}
+
+LiveIngest::~LiveIngest()
+{
+    stop();
+    // The receiver thread may wait on nothing but the socket, which it polls
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void
+LiveIngest::stop()
+{
+    mStop = true;
+}
+
+bool
+LiveIngest::next(AccessUnit& outUnit)
+{
+    return mUnitQueue.pop(outUnit);
+}
+
+void
+LiveIngest::receiveLoop()
+{
+    int64_t lastPacketNs = 0;
+    int64_t now = NowNs();
+    while (!mStop) {
+        if (mFreeSlots.empty()) {
+            // The reorder buffer holds every slot: give its gaps up rather than the socket's packets
+            releaseRtp(now, true);
+        }
+        const int count = std::min(mConfig.batchSize, (int)mFreeSlots.size());
+        for (int i = 0; i < count; i++) {
+            const int slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+            mBatchSlots[i] = slot;
+            mBatch[i].data = mSlots.get() + (size_t)slot * mConfig.slotSize;
+            mBatch[i].capacity = mConfig.slotSize;
+        }
+        const int received = mSocket.receive(mBatch.data(), count, kPollMs);
+        now = NowNs();
+        if (received < 0) {
+            LOG_ERROR("Live ingest: receive failed, stream ended");
+            break;
+        }
+        if (received > 0) {
+            lastPacketNs = now;
+            mBatches++;
+            Telemetry::Count(TelemetryCounter::PacketsReceived, received);
+        }
+        for (int i = 0; i < received; i++) {
+            const Datagram& datagram = mBatch[i];
+            const int slot = mBatchSlots[i];
+            mPackets++;
+            mBytes += datagram.size;
+            if (datagram.truncated) {
+                mPacketsDropped++;
+                mFreeSlots.push_back(slot);
+            } else if (mConfig.protocol == LiveProtocol::Ts) {
+                demuxTs(datagram.data, datagram.size);
+                mFreeSlots.push_back(slot);
+            } else {
+                insertRtp(slot, datagram.size, now);
+            }
+        }
+        for (int i = count - 1; i >= received; i--) {
+            mFreeSlots.push_back(mBatchSlots[i]);
+        }
+        if (mConfig.protocol == LiveProtocol::Rtp) {
+            releaseRtp(now, false);
+        }
+        if (mConfig.idleTimeoutMs > 0 && lastPacketNs && now - lastPacketNs > (int64_t)mConfig.idleTimeoutMs * 1000000) {
+            break;
+        }
+    }
+
+    releaseRtp(now, true);
+    finishUnit();
+    dropProbation();
+    mUnitQueue.close();
+}
+
+void
+LiveIngest::insertRtp(int inSlot, size_t inSize, int64_t inNowNs)
+{
+    const uint8_t* pPacket = mSlots.get() + (size_t)inSlot * mConfig.slotSize;
+    if (inSize < kRtpHeaderSize || (pPacket[0] >> 6) != 2) {
+        mPacketsDropped++;
+        mFreeSlots.push_back(inSlot);
+        return;
+    }
+    const uint16_t sequence = (uint16_t)ReadBe16(pPacket + 2);
+    const uint32_t ssrc = ReadBe32(pPacket + 8);
+    if (!mSequenceStarted) {
+        mSequenceStarted = true;
+        mNextSequence = mHighestSequence = sequence;
+        mSsrc = ssrc;
+    }
+    if (ssrc != mSsrc) {
+        // A new source: its sequence numbers and timestamps have nothing to do with the old ones
+        dropProbation();
+        resyncRtp(sequence, ssrc, inNowNs);
+    }
+    const int capacity = (int)mEntries.size();
+    const int offset = (int16_t)(sequence - mNextSequence);
+    if (offset < -kMaxMisorder || offset >= capacity) {
+        // Held until the run is long enough to resync on, or broken by a packet that is not next in it
+        if (!mProbation.empty() && sequence != (uint16_t)(mProbationSequence + 1)) {
+            dropProbation();
+        }
+        Entry held;
+        held.slot = inSlot;
+        held.size = inSize;
+        held.arrivalNs = inNowNs;
+        mProbation.push_back(held);
+        mProbationSequence = sequence;
+        if ((int)mProbation.size() < kResyncPackets) {
+            return;
+        }
+        resyncRtp((uint16_t)(sequence - (kResyncPackets - 1)), ssrc, inNowNs);
+        for (size_t i = 0; i < mProbation.size(); i++) {
+            bufferRtp((uint16_t)(mNextSequence + i), mProbation[i]);
+        }
+        mProbation.clear();
+        return;
+    }
+    dropProbation();
+    if (offset < 0) {
+        // Released or given up on already: a duplicate, or later than the jitter delay
+        mPacketsLate++;
+        mFreeSlots.push_back(inSlot);
+        return;
+    }
+    Entry received;
+    received.slot = inSlot;
+    received.size = inSize;
+    received.arrivalNs = inNowNs;
+    bufferRtp(sequence, received);
+}
+
+void
+LiveIngest::bufferRtp(uint16_t inSequence, const Entry& inPacket)
+{
+    Entry& entry = mEntries[inSequence & (mEntries.size() - 1)];
+    if (entry.slot >= 0) {
+        mPacketsLate++;
+        mFreeSlots.push_back(inPacket.slot);
+        return;
+    }
+    if ((int16_t)(inSequence - mHighestSequence) < 0) {
+        mPacketsReordered++;
+    } else {
+        mHighestSequence = inSequence;
+    }
+    entry = inPacket;
+    mBuffered++;
+}
+
+void
+LiveIngest::dropProbation()
+{
+    for (const Entry& held : mProbation) {
+        mPacketsLate++;
+        mFreeSlots.push_back(held.slot);
+    }
+    mProbation.clear();
+}
+
+void
+LiveIngest::resyncRtp(uint16_t inSequence, uint32_t inSsrc, int64_t inNowNs)
+{
+    // What the reorder buffer holds is still in order, and the unit it ends in is complete or not
+    releaseRtp(inNowNs, true);
+    finishUnit();
+    LOG_WARNING("Live ingest: " << (inSsrc != mSsrc ? "new SSRC" : "sequence jump") << ", resynchronized from sequence number "
+        << mNextSequence << " to " << inSequence);
+    mNextSequence = mHighestSequence = inSequence;
+    mSsrc = inSsrc;
+    mResyncs++;
+    // The PTS go on from the last one, one frame later
+    mPtsBase = mLastPts + mPtsStep;
+    mTimeStarted = false;
+}
+
+void
+LiveIngest::releaseRtp(int64_t inNowNs, bool inFlush)
+{
+    const int capacity = (int)mEntries.size();
+    const int64_t delayNs = (int64_t)mConfig.jitterMs * 1000000;
+    while (mBuffered > 0) {
+        Entry& entry = mEntries[mNextSequence & (capacity - 1)];
+        if (entry.slot >= 0) {
+            depacketize(mSlots.get() + (size_t)entry.slot * mConfig.slotSize, entry.size);
+            mFreeSlots.push_back(entry.slot);
+            entry.slot = -1;
+            mBuffered--;
+            mNextSequence++;
+            continue;
+        }
+        // A gap: the packets behind it wait for it until the first of them waited jitterMs
+        int gap = 1;
+        while (mEntries[(mNextSequence + gap) & (capacity - 1)].slot < 0) {
+            gap++;
+        }
+        if (!inFlush && inNowNs - mEntries[(mNextSequence + gap) & (capacity - 1)].arrivalNs < delayNs) {
+            break;
+        }
+        mPacketsLost += gap;
+        Telemetry::Count(TelemetryCounter::PacketsLost, gap);
+        dropFragment();
+        mUnitDamaged |= mInUnit;
+        mNextSequence = (uint16_t)(mNextSequence + gap);
+    }
+}
+
+void
+LiveIngest::depacketize(const uint8_t* inPacket, size_t inSize)
+{
+    // Fixed header, CSRCs, header extension, padding
+    size_t header = kRtpHeaderSize + 4 * (inPacket[0] & 0x0F);
+    if ((inPacket[0] & 0x10) && header + 4 <= inSize) {
+        header += 4 + 4 * ReadBe16(inPacket + header + 2);
+    }
+    size_t end = inSize;
+    if (inPacket[0] & 0x20) {
+        end -= std::min<size_t>(inPacket[inSize - 1], inSize);
+    }
+    if (header >= end) {
+        mPacketsDropped++;
+        return;
+    }
+    const int payloadType = inPacket[1] & 0x7F;
+    if (payloadType == kRtpPayloadMp2t) {
+        demuxTs(inPacket + header, end - header);
+    } else {
+        depacketizeH264(inPacket + header, end - header, ReadBe32(inPacket + 4), (inPacket[1] & 0x80) != 0);
+    }
+}
+
+void
+LiveIngest::depacketizeH264(const uint8_t* inPayload, size_t inSize, uint32_t inTimestamp, bool inMarker)
+{
+    // All packets of an access unit share its timestamp, the marker bit is on the last one
+    if (!mInUnit || inTimestamp != mRtpTimestamp) {
+        finishUnit();
+        beginUnit(toPts(inTimestamp, 32), false);
+        mRtpTimestamp = inTimestamp;
+    }
+    const int type = inPayload[0] & 0x1F;
+    if (type >= 1 && type < kNalStapA) {
+        appendNal(inPayload, inSize);
+    } else if (type == kNalStapA) {
+        // Aggregate of whole NAL units, each behind a 16 bit size
+        const uint8_t* p = inPayload + 1;
+        const uint8_t* pEnd = inPayload + inSize;
+        while (pEnd - p >= 2) {
+            const size_t size = ReadBe16(p);
+            p += 2;
+            if (!size || size > (size_t)(pEnd - p)) {
+                mPacketsDropped++;
+                mUnitDamaged = true;
+                break;
+            }
+            appendNal(p, size);
+            p += size;
+        }
+    } else if (type == kNalFuA && inSize > 2) {
+        // A NAL unit in fragments: indicator (F, NRI), header (start, end, type), data
+        const uint8_t fuHeader = inPayload[1];
+        if (fuHeader & 0x80) {
+            dropFragment();
+            mFragmentStart = mUnitSize;
+            mInFragment = true;
+            // Its type counts once it is complete, a NAL unit cut short is dropped
+            const uint8_t nalHeader = (uint8_t)((inPayload[0] & 0xE0) | (fuHeader & 0x1F));
+            appendBytes(kStartCode, 4);
+            appendBytes(&nalHeader, 1);
+        } else if (!mInFragment) {
+            // Its start was lost
+            mPacketsDropped++;
+            mUnitDamaged = true;
+            return;
+        }
+        appendBytes(inPayload + 2, inSize - 2);
+        if (fuHeader & 0x40) {
+            mInFragment = false;
+            noteNalType(fuHeader & 0x1F);
+        }
+    } else {
+        // STAP-B, MTAP and FU-B are for interleaved mode only
+        mPacketsDropped++;
+    }
+    if (inMarker) {
+        finishUnit();
+    }
+}
+
+void
+LiveIngest::demuxTs(const uint8_t* inData, size_t inSize)
+{
+    for (size_t offset = 0; offset + kTsPacketSize <= inSize; offset += kTsPacketSize) {
+        if (inData[offset] != 0x47) {
+            mPacketsDropped++;
+            return;
+        }
+        demuxTsPacket(inData + offset);
+    }
+}
+
+void
+LiveIngest::demuxTsPacket(const uint8_t* inPacket)
+{
+    // Transport error, payload unit start, PID, adaptation field control, continuity counter
+    if (inPacket[1] & 0x80) {
+        return;
+    }
+    const bool unitStart = (inPacket[1] & 0x40) != 0;
+    const int pid = ((inPacket[1] & 0x1F) << 8) | inPacket[2];
+    const int adaptation = (inPacket[3] >> 4) & 3;
+    const int continuity = inPacket[3] & 0x0F;
+    const uint8_t* p = inPacket + 4;
+    const uint8_t* pEnd = inPacket + kTsPacketSize;
+    if (adaptation & 2) {
+        p += 1 + p[0];
+    }
+    if (!(adaptation & 1) || p >= pEnd) {
+        return;
+    }
+
+    if (pid == 0 || pid == mPmtPid) {
+        // PAT and PMT fit in one packet, the pointer field skips to the section
+        if (unitStart && p + 1 + p[0] < pEnd) {
+            parsePsi(p + 1 + p[0], pEnd - (p + 1 + p[0]));
+        }
+        return;
+    }
+    if (pid != mVideoPid) {
+        return;
+    }
+    if (continuity == mContinuity) {
+        // A duplicate, sent for robustness
+        return;
+    }
+    if (mContinuity >= 0 && continuity != ((mContinuity + 1) & 0x0F)) {
+        const int missing = (continuity - mContinuity - 1) & 0x0F;
+        mPacketsLost += missing;
+        Telemetry::Count(TelemetryCounter::PacketsLost, missing);
+        mUnitDamaged |= mInUnit;
+    }
+    mContinuity = continuity;
+
+    if (unitStart) {
+        // A PES packet is an access unit: start code, stream id, length, flags, header length, PTS
+        finishUnit();
+        if (pEnd - p < 9 || p[0] != 0 || p[1] != 0 || p[2] != 1 || p + 9 + p[8] > pEnd) {
+            mPacketsDropped++;
+            return;
+        }
+        int64_t pts = kNoPts;
+        if ((p[7] & 0x80) && p[8] >= 5) {
+            const uint8_t* t = p + 9;
+            const int64_t ticks = ((int64_t)(t[0] & 0x0E) << 29) | ((int64_t)t[1] << 22) | ((int64_t)(t[2] & 0xFE) << 14)
+                | ((int64_t)t[3] << 7) | (t[4] >> 1);
+            pts = toPts(ticks, 33);
+        }
+        beginUnit(pts, true);
+        p += 9 + p[8];
+    } else if (!mInUnit) {
+        return;
+    }
+    appendBytes(p, pEnd - p);
+}
+
+void
+LiveIngest::parsePsi(const uint8_t* inSection, size_t inSize)
+{
+    // Table id, section length, then the 5 bytes up to last_section_number
+    if (inSize < 8) {
+        return;
+    }
+    const int tableId = inSection[0];
+    const size_t length = std::min<size_t>(((inSection[1] & 0x0F) << 8) | inSection[2], inSize - 3);
+    // Without the CRC
+    const uint8_t* pEnd = inSection + 3 + length - std::min<size_t>(length, 4);
+    if (tableId == 0) {
+        // Program number and PMT PID pairs, program 0 is the network PID
+        for (const uint8_t* p = inSection + 8; p + 4 <= pEnd; p += 4) {
+            if (ReadBe16(p)) {
+                mPmtPid = (int)(ReadBe16(p + 2) & 0x1FFF);
+                break;
+            }
+        }
+    } else if (tableId == 2 && inSection + 12 <= pEnd) {
+        // PCR PID, program info, then stream type, PID and ES info per stream
+        const uint8_t* p = inSection + 12 + (ReadBe16(inSection + 10) & 0x0FFF);
+        for (; p + 5 <= pEnd; p += 5 + (ReadBe16(p + 3) & 0x0FFF)) {
+            const int streamType = p[0];
+            if (streamType == kStreamTypeH264) {
+                const int pid = (int)(ReadBe16(p + 1) & 0x1FFF);
+                if (pid != mVideoPid) {
+                    mVideoPid = pid;
+                    mContinuity = -1;
+                }
+                return;
+            }
+            if (streamType == kStreamTypeHevc && !mWarnedCodec) {
+                LOG_WARNING("Live ingest: HEVC stream in the transport stream skipped, H.264 only");
+                mWarnedCodec = true;
+            }
+        }
+    }
+}
+
+int64_t
+LiveIngest::toPts(int64_t inTicks, int inBits)
+{
+    if (!mTimeStarted) {
+        mTimeStarted = true;
+        mFirstTicks = mLastTicks = inTicks;
+    } else {
+        // Nearest to the last timestamp, modulo the timestamp range
+        const int64_t range = (int64_t)1 << inBits;
+        int64_t delta = (inTicks - mLastTicks) & (range - 1);
+        if (delta >= range / 2) {
+            delta -= range;
+        }
+        mLastTicks += delta;
+    }
+    // 90 kHz clock
+    const int64_t pts = mPtsBase + (mLastTicks - mFirstTicks) * 100 / 9;
+    if (pts > mLastPts) {
+        mPtsStep = pts - mLastPts;
+    }
+    mLastPts = pts;
+    return pts;
+}
+
+void
+LiveIngest::beginUnit(int64_t inPts, bool inAnnexB)
+{
+    mInUnit = true;
+    mUnitAnnexB = inAnnexB;
+    mUnitSize = 0;
+    mUnitIdr = mUnitSps = mUnitPps = mUnitPicture = mUnitDamaged = false;
+    mUnitPts = inPts;
+    mInFragment = false;
+}
+
+void
+LiveIngest::appendBytes(const uint8_t* inData, size_t inSize)
+{
+    Buffer& buffer = mBuffers[mWriteBuffer];
+    if (mUnitSize + inSize > buffer.capacity) {
+        // Grows to the largest access unit once, then never again
+        const size_t capacity = std::max(std::max(2 * buffer.capacity, mUnitSize + inSize), (size_t)64 << 10);
+        std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+        if (mUnitSize) {
+            memcpy(data.get(), buffer.data.get(), mUnitSize);
+        }
+        buffer.data = std::move(data);
+        buffer.capacity = capacity;
+    }
+    memcpy(buffer.data.get() + mUnitSize, inData, inSize);
+    mUnitSize += inSize;
+}
+
+void
+LiveIngest::appendNal(const uint8_t* inData, size_t inSize)
+{
+    appendBytes(kStartCode, 4);
+    appendBytes(inData, inSize);
+    noteNalType(inData[0] & 0x1F);
+}
+
+void
+LiveIngest::noteNalType(int inType)
+{
+    mUnitIdr |= inType == NalUnitType_IdrSlice;
+    mUnitSps |= inType == NalUnitType_Sps;
+    mUnitPps |= inType == NalUnitType_Pps;
+    mUnitPicture |= inType >= NalUnitType_Slice && inType <= NalUnitType_IdrSlice;
+}
+
+void
+LiveIngest::dropFragment()
+{
+    // The rest of a fragmented NAL unit is gone, and a NAL unit cut short only confuses the decoder
+    if (mInFragment) {
+        mUnitSize = mFragmentStart;
+        mInFragment = false;
+        mUnitDamaged = true;
+    }
+}
+
+void
+LiveIngest::finishUnit()
+{
+    if (!mInUnit) {
+        return;
+    }
+    dropFragment();
+    mInUnit = false;
+    if (!mUnitSize) {
+        return;
+    }
+    Buffer& buffer = mBuffers[mWriteBuffer];
+    if (mUnitAnnexB) {
+        // PES payloads are Annex-B already, their NAL unit types are only known from a scan
+        const uint8_t* pEnd = buffer.data.get() + mUnitSize;
+        for (const uint8_t* p = FindStartCode(buffer.data.get(), pEnd); p != pEnd; p = FindStartCode(p, pEnd)) {
+            p += 3;
+            if (p < pEnd) {
+                noteNalType(p[0] & 0x1F);
+            }
+        }
+    }
+
+    AccessUnit unit;
+    unit.data = buffer.data.get();
+    unit.size = mUnitSize;
+    unit.frameIndex = mFrameIndex;
+    unit.pts = mUnitPts;
+    unit.idr = mUnitIdr;
+    unit.sps = mUnitSps;
+    unit.pps = mUnitPps;
+    unit.picture = mUnitPicture;
+    // A live source does not wait: with next() behind, the unit is dropped rather than the packets
+    if (!mUnitQueue.tryPush(unit)) {
+        mUnitsDropped++;
+        return;
+    }
+    mFrameIndex++;
+    mUnits++;
+    mUnitsDamaged += mUnitDamaged;
+    Telemetry::Count(TelemetryCounter::AccessUnits);
+    Telemetry::Count(TelemetryCounter::BytesParsed, mUnitSize);
+    mWriteBuffer = (mWriteBuffer + 1) % mBuffers.size();
+}
+
+void
+LiveIngest::printStatistics(std::ostream& inStream) const
+{
+    const uint64_t batches = mBatches;
+    inStream << "Live ingest (" << (mConfig.protocol == LiveProtocol::Rtp ? "RTP" : "MPEG-TS") << " on " << mConfig.address
+        << ":" << mConfig.port << "): " << mPackets << " packets, " << mBytes / 1000000.0 << " MB in " << batches
+        << " batches (" << (batches ? (double)mPackets / batches : 0) << " per receive), " << mPacketsLost << " lost, "
+        << mPacketsLate << " late, " << mPacketsReordered << " reordered, " << mPacketsDropped << " dropped, " << mResyncs
+        << " resyncs; " << mUnits
+        << " access units, " << mUnitsDamaged << " damaged, " << mUnitsDropped << " dropped with the decoder behind" << std::endl;
+}
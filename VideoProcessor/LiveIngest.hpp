@@ -0,0 +1,174 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "SpscQueue.hpp"
+#include "UdpSocket.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LiveProtocol {
+    Rtp,            // RTP, H.264 payload (RFC 6184) or MPEG-TS payload (RFC 2250, payload type 33)
+    Ts,             // MPEG-TS straight in UDP datagrams
+};
+
+// Splits rtp://host:port or udp://host:port (MPEG-TS); false if inUrl is neither
+bool ParseLiveUrl(const std::string& inUrl, LiveProtocol& outProtocol, std::string& outHost, int& outPort);
+
+struct LiveIngestConfig {
+    LiveProtocol protocol = LiveProtocol::Rtp;
+    std::string address = "127.0.0.1";      // A multicast group is joined
+    int port = 5004;
+    int batchSize = 64;                     // Datagrams per receive call
+    int packetSlots = 4096;                 // Preallocated datagram buffers, rounded to a power of two up to 16384
+    int slotSize = 2048;                    // Bytes per buffer, longer datagrams are dropped
+    int receiveBuffer = 8 << 20;            // Kernel socket buffer
+    // Longest a packet waits for a missing one in front of it before that one is given up.
+    // This is the latency the reorder buffer adds, and only while there is a gap.
+    int jitterMs = 50;
+    int queueDepth = 64;                    // Access units between the receiver thread and next()
+    int unitsInFlight = 34;                 // Units next() handed out that must stay valid
+    int idleTimeoutMs = 2000;               // Silence after the first packet ends the stream, 0 never
+};
+
+// Live H.264 source for the pipeline. A dedicated thread receives datagrams in batches into
+// preallocated slots, puts RTP packets back in sequence order in a bounded reorder buffer,
+// depacketizes them (single NAL unit, STAP-A, FU-A; or MPEG-TS, PAT/PMT/PES) and writes each
+// complete access unit as Annex-B into a ring of buffers that next() hands out. A packet lost
+// for good is skipped after jitterMs; the NAL unit it was part of is dropped and the decoder
+// conceals the rest. Nothing is allocated per packet: buffers only grow to the largest access
+// unit seen. PTS come from the RTP or PES timestamps, in microseconds from the first one. A new
+// SSRC, or a run of packets out of the reorder window (RFC 3550 probation, a sender that
+// restarted), resynchronizes: the buffer is flushed and the sequence numbers and PTS restart.
+class LiveIngest : public PacketSource {
+public:
+    explicit LiveIngest(const LiveIngestConfig& inConfig);
+
+    ~LiveIngest();
+
+    LiveIngest(const LiveIngest&) = delete;
+    LiveIngest& operator=(const LiveIngest&) = delete;
+
+    // Binds the socket and starts receiving; false if the socket could not be set up
+    bool start();
+
+    explicit operator bool() const { return mOpen; }
+
+    // Waits for the next access unit once started. Returns false at end of stream: idle timeout,
+    // stop() or a failed start().
+    bool next(AccessUnit& outUnit) override;
+
+    // Ends the stream from any thread; next() returns what was complete first
+    void stop();
+
+    void printStatistics(std::ostream& inStream) const;
+
+    uint64_t getPackets() const { return mPackets; }
+    uint64_t getBytes() const { return mBytes; }
+    uint64_t getPacketsLost() const { return mPacketsLost; }
+    uint64_t getPacketsLate() const { return mPacketsLate; }
+    uint64_t getPacketsReordered() const { return mPacketsReordered; }
+    uint64_t getPacketsDropped() const { return mPacketsDropped; }
+    uint64_t getResyncs() const { return mResyncs; }
+    uint64_t getUnits() const { return mUnits; }
+    uint64_t getUnitsDropped() const { return mUnitsDropped; }
+
+private:
+    // One received datagram waiting in the reorder buffer
+    struct Entry {
+        int slot = -1;
+        size_t size = 0;
+        int64_t arrivalNs = 0;
+    };
+
+    struct Buffer {
+        std::unique_ptr<uint8_t[]> data;
+        size_t capacity = 0;
+    };
+
+    void receiveLoop();
+    void insertRtp(int inSlot, size_t inSize, int64_t inNowNs);
+    void bufferRtp(uint16_t inSequence, const Entry& inPacket);
+    void dropProbation();
+    void resyncRtp(uint16_t inSequence, uint32_t inSsrc, int64_t inNowNs);
+    void releaseRtp(int64_t inNowNs, bool inFlush);
+    void depacketize(const uint8_t* inPacket, size_t inSize);
+    void depacketizeH264(const uint8_t* inPayload, size_t inSize, uint32_t inTimestamp, bool inMarker);
+    void demuxTs(const uint8_t* inData, size_t inSize);
+    void demuxTsPacket(const uint8_t* inPacket);
+    void parsePsi(const uint8_t* inSection, size_t inSize);
+
+    // Access unit assembly on the receiver thread
+    // inAnnexB: the payload comes with start codes (PES) instead of as NAL units (RTP)
+    void beginUnit(int64_t inPts, bool inAnnexB);
+    void appendNal(const uint8_t* inData, size_t inSize);
+    void appendBytes(const uint8_t* inData, size_t inSize);
+    void noteNalType(int inType);
+    void dropFragment();
+    void finishUnit();
+    int64_t toPts(int64_t inTicks, int inBits);
+
+    LiveIngestConfig mConfig;
+    bool mOpen = false;
+    UdpSocket mSocket;
+    std::unique_ptr<uint8_t[]> mSlots;
+    std::vector<int> mFreeSlots;
+    std::vector<Datagram> mBatch;
+    std::vector<int> mBatchSlots;
+
+    // Reorder buffer, indexed by sequence number
+    std::vector<Entry> mEntries;
+    int mBuffered = 0;
+    bool mSequenceStarted = false;
+    uint16_t mNextSequence = 0;             // Next to release
+    uint16_t mHighestSequence = 0;
+    uint32_t mSsrc = 0;
+    // Packets out of the window, in sequence, that may be the start of a restarted stream
+    std::vector<Entry> mProbation;
+    uint16_t mProbationSequence = 0;
+
+    // The access unit being assembled
+    std::vector<Buffer> mBuffers;
+    size_t mWriteBuffer = 0;
+    size_t mUnitSize = 0;
+    bool mInUnit = false;
+    bool mUnitAnnexB = false;
+    bool mUnitIdr = false, mUnitSps = false, mUnitPps = false, mUnitPicture = false, mUnitDamaged = false;
+    int64_t mUnitPts = kNoPts;
+    int64_t mFrameIndex = 0;
+    uint32_t mRtpTimestamp = 0;
+    bool mInFragment = false;
+    size_t mFragmentStart = 0;
+
+    // Timestamps unwrapped from 32 (RTP) or 33 (PES) bits, relative to the first
+    bool mTimeStarted = false;
+    int64_t mFirstTicks = 0, mLastTicks = 0;
+    // PTS of the timeline before the last resync, the last PTS and the last step between two
+    int64_t mPtsBase = 0, mLastPts = 0, mPtsStep = 0;
+
+    // MPEG-TS
+    int mPmtPid = -1, mVideoPid = -1;
+    int mContinuity = -1;
+    bool mWarnedCodec = false;
+
+    SpscQueue<AccessUnit> mUnitQueue;
+    std::atomic<bool> mStop{ false };
+    std::thread mThread;
+
+    std::atomic<uint64_t> mPackets{ 0 };
+    std::atomic<uint64_t> mBytes{ 0 };
+    std::atomic<uint64_t> mBatches{ 0 };
+    std::atomic<uint64_t> mPacketsLost{ 0 };
+    std::atomic<uint64_t> mPacketsLate{ 0 };
+    std::atomic<uint64_t> mPacketsReordered{ 0 };
+    std::atomic<uint64_t> mPacketsDropped{ 0 };     // Truncated, malformed, unsupported or no slot
+    std::atomic<uint64_t> mResyncs{ 0 };
+    std::atomic<uint64_t> mUnitsDamaged{ 0 };
+    std::atomic<uint64_t> mUnitsDropped{ 0 };
+    std::atomic<uint64_t> mUnits{ 0 };
+};
@@ -0,0 +1,285 @@
+#include "LiveSender.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const int kRtpHeaderSize = 12;
+const int kPayloadTypeH264 = 96;        // Dynamic, as announced in SDP
+const int kNalStapA = 24;
+const int kNalFuA = 28;
+
+const int kTsPacketSize = 188;
+const int kTsPacketsPerDatagram = 7;
+const int kPmtPid = 0x1000;
+const int kVideoPid = 0x100;
+const int kStreamTypeH264 = 0x1B;
+// Presentation times start a second after the PCR, which starts at 0
+const int64_t kPtsOffset = 90000;
+
+inline void WriteBe16(uint8_t* p, uint32_t inValue) {
+    p[0] = (uint8_t)(inValue >> 8);
+    p[1] = (uint8_t)inValue;
+}
+
+inline void WriteBe32(uint8_t* p, uint32_t inValue) {
+    WriteBe16(p, inValue >> 16);
+    WriteBe16(p + 2, inValue);
+}
+
+// CRC-32/MPEG-2 of PSI sections, once per IDR picture so bitwise is plenty
+uint32_t Crc32Mpeg(const uint8_t* inData, size_t inSize) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < inSize; i++) {
+        crc ^= (uint32_t)inData[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+}
+
+LiveSender::LiveSender(const LiveSenderConfig& inConfig)
+    : mConfig(inConfig)
+    , mSocket(inConfig.batchSize)
+    , mSsrc((uint32_t)std::chrono::steady_clock::now().time_since_epoch().count())
+{
+    mConfig.payloadSize = std::max(64, std::min(mConfig.payloadSize, 65000));
+    mDatagramCapacity = std::max<size_t>(kRtpHeaderSize + mConfig.payloadSize, kTsPacketSize * kTsPacketsPerDatagram);
+    mBatch.resize(mSocket.getBatchSize());
+    mArena.reset(new uint8_t[mDatagramCapacity * mBatch.size()]);
+    for (size_t i = 0; i < mBatch.size(); i++) {
+        mBatch[i].data = mArena.get() + i * mDatagramCapacity;
+        mBatch[i].capacity = mDatagramCapacity;
+    }
+    mSocket.connect(mConfig.address, mConfig.port, mConfig.sendBuffer);
+}
+
+bool
+LiveSender::send(const uint8_t* inStream, size_t inSize)
+{
+    AnnexBPacketizer packetizer(inStream, inSize);
+    AccessUnit unit;
+    const double fps = mConfig.fps > 0 ? mConfig.fps : 30;
+    const auto start = std::chrono::steady_clock::now();
+    int64_t unitCount = 0;
+    for (int loop = 0; loop < mConfig.loops && !mStop && !mFailed; loop++) {
+        packetizer.reset();
+        while (!mStop && !mFailed && packetizer.next(unit)) {
+            if (mConfig.fps > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration<double>(unitCount / fps));
+            }
+            const int64_t ticks = (int64_t)(unitCount * 90000 / fps);
+            if (mConfig.protocol == LiveProtocol::Rtp) {
+                packetizeRtp(unit, (uint32_t)ticks);
+            } else {
+                packetizeTs(unit, ticks, unit.idr || unitCount == 0);
+            }
+            unitCount++;
+            mUnits++;
+            // Paced, every access unit leaves on time; otherwise only full batches go out
+            if (mConfig.fps > 0) {
+                flush();
+            }
+        }
+    }
+    flush();
+    return !mFailed;
+}
+
+uint8_t*
+LiveSender::nextDatagram(size_t inSize)
+{
+    if (mPending == (int)mBatch.size()) {
+        flush();
+    }
+    Datagram& datagram = mBatch[mPending++];
+    datagram.size = inSize;
+    return datagram.data;
+}
+
+bool
+LiveSender::flush()
+{
+    if (mPending) {
+        const int sent = mSocket.send(mBatch.data(), mPending);
+        if (sent < 0) {
+            mFailed = true;
+        } else {
+            mPackets += sent;
+            for (int i = 0; i < sent; i++) {
+                mBytes += mBatch[i].size;
+            }
+        }
+    }
+    mPending = 0;
+    mTsDatagram = nullptr;
+    return !mFailed;
+}
+
+void
+LiveSender::packetizeRtp(const AccessUnit& inUnit, uint32_t inTimestamp)
+{
+    mNals.clear();
+    const uint8_t* pEnd = inUnit.data + inUnit.size;
+    for (const uint8_t* p = FindStartCode(inUnit.data, pEnd); p != pEnd;) {
+        p += 3;
+        const uint8_t* pNext = FindStartCode(p, pEnd);
+        const uint8_t* pNalEnd = pNext;
+        // The leading zero of the next 4 byte start code
+        while (pNalEnd > p && pNalEnd[-1] == 0) {
+            pNalEnd--;
+        }
+        if (pNalEnd > p) {
+            mNals.emplace_back(p, pNalEnd - p);
+        }
+        p = pNext;
+    }
+
+    const size_t payloadSize = (size_t)mConfig.payloadSize;
+    auto writeHeader = [&](uint8_t* p, bool inMarker) {
+        p[0] = 0x80;
+        p[1] = (uint8_t)((inMarker ? 0x80 : 0) | kPayloadTypeH264);
+        WriteBe16(p + 2, mSequence++);
+        WriteBe32(p + 4, inTimestamp);
+        WriteBe32(p + 8, mSsrc);
+    };
+    for (size_t i = 0; i < mNals.size(); i++) {
+        const uint8_t* pNal = mNals[i].first;
+        const size_t size = mNals[i].second;
+        if (size > payloadSize) {
+            // FU-A: the NAL header becomes the indicator (F, NRI) and the type in the FU header
+            const uint8_t indicator = (uint8_t)((pNal[0] & 0xE0) | kNalFuA);
+            const uint8_t type = pNal[0] & 0x1F;
+            for (size_t offset = 1; offset < size;) {
+                const size_t chunk = std::min(size - offset, payloadSize - 2);
+                const bool last = offset + chunk == size;
+                uint8_t* p = nextDatagram(kRtpHeaderSize + 2 + chunk);
+                writeHeader(p, last && i + 1 == mNals.size());
+                p[kRtpHeaderSize] = indicator;
+                p[kRtpHeaderSize + 1] = (uint8_t)((offset == 1 ? 0x80 : 0) | (last ? 0x40 : 0) | type);
+                memcpy(p + kRtpHeaderSize + 2, pNal + offset, chunk);
+                offset += chunk;
+            }
+            continue;
+        }
+        // A run of NAL units that fit one packet together (parameter sets, SEI) goes as STAP-A
+        size_t end = i, total = 1;
+        uint8_t nri = 0;
+        while (end < mNals.size() && total + 2 + mNals[end].second <= payloadSize) {
+            total += 2 + mNals[end].second;
+            nri = std::max<uint8_t>(nri, mNals[end].first[0] & 0x60);
+            end++;
+        }
+        if (end - i >= 2) {
+            uint8_t* p = nextDatagram(kRtpHeaderSize + total);
+            writeHeader(p, end == mNals.size());
+            uint8_t* pOut = p + kRtpHeaderSize;
+            *pOut++ = (uint8_t)(nri | kNalStapA);
+            for (size_t j = i; j < end; j++) {
+                WriteBe16(pOut, (uint32_t)mNals[j].second);
+                memcpy(pOut + 2, mNals[j].first, mNals[j].second);
+                pOut += 2 + mNals[j].second;
+            }
+            i = end - 1;
+        } else {
+            uint8_t* p = nextDatagram(kRtpHeaderSize + size);
+            writeHeader(p, i + 1 == mNals.size());
+            memcpy(p + kRtpHeaderSize, pNal, size);
+        }
+    }
+}
+
+void
+LiveSender::packetizeTs(const AccessUnit& inUnit, int64_t inPts, bool inTables)
+{
+    if (inTables) {
+        // PAT: program 1 on the PMT PID
+        uint8_t pat[16] = { 0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01,
+            (uint8_t)(0xE0 | (kPmtPid >> 8)), (uint8_t)kPmtPid };
+        WriteBe32(pat + 12, Crc32Mpeg(pat, 12));
+        writeSection(0, pat, sizeof(pat));
+        // PMT: PCR on the video PID, one H.264 stream
+        uint8_t pmt[21] = { 0x02, 0xB0, 18, 0x00, 0x01, 0xC1, 0x00, 0x00, (uint8_t)(0xE0 | (kVideoPid >> 8)),
+            (uint8_t)kVideoPid, 0xF0, 0x00, kStreamTypeH264, (uint8_t)(0xE0 | (kVideoPid >> 8)), (uint8_t)kVideoPid,
+            0xF0, 0x00 };
+        WriteBe32(pmt + 17, Crc32Mpeg(pmt, 17));
+        writeSection(kPmtPid, pmt, sizeof(pmt));
+    }
+
+    // PES header with a PTS, unbounded length as usual for video
+    const int64_t pts = inPts + kPtsOffset;
+    const uint8_t pes[14] = { 0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05,
+        (uint8_t)(0x21 | ((pts >> 29) & 0x0E)), (uint8_t)(pts >> 22), (uint8_t)(((pts >> 14) & 0xFE) | 1),
+        (uint8_t)(pts >> 7), (uint8_t)(((pts << 1) & 0xFE) | 1) };
+    const uint8_t* p = inUnit.data;
+    const uint8_t* pEnd = inUnit.data + inUnit.size;
+    p += writeTsPacket(kVideoPid, true, pes, sizeof(pes), p, pEnd - p, inPts);
+    while (p < pEnd) {
+        p += writeTsPacket(kVideoPid, false, nullptr, 0, p, pEnd - p, -1);
+    }
+}
+
+void
+LiveSender::writeSection(int inPid, const uint8_t* inSection, size_t inSize)
+{
+    const uint8_t pointer = 0;
+    writeTsPacket(inPid, true, &pointer, 1, inSection, inSize, -1);
+}
+
+size_t
+LiveSender::writeTsPacket(int inPid, bool inUnitStart, const uint8_t* inHeader, size_t inHeaderSize,
+    const uint8_t* inData, size_t inSize, int64_t inPcr)
+{
+    if (!mTsDatagram || mBatch[mPending - 1].size == kTsPacketSize * kTsPacketsPerDatagram) {
+        mTsDatagram = nextDatagram(0);
+    }
+    Datagram& datagram = mBatch[mPending - 1];
+    uint8_t* pPacket = datagram.data + datagram.size;
+    datagram.size += kTsPacketSize;
+
+    // Continuity counters of PAT, PMT and video
+    uint8_t& continuity = mContinuity[inPid == 0 ? 0 : inPid == kPmtPid ? 1 : 2];
+    const size_t room = kTsPacketSize - 4 - (inPcr >= 0 ? 8 : 0);
+    const size_t taken = std::min(inSize, room - inHeaderSize);
+    const size_t stuffing = room - inHeaderSize - taken;
+    const bool adaptation = inPcr >= 0 || stuffing > 0;
+    pPacket[0] = 0x47;
+    pPacket[1] = (uint8_t)((inUnitStart ? 0x40 : 0) | (inPid >> 8));
+    pPacket[2] = (uint8_t)inPid;
+    pPacket[3] = (uint8_t)((adaptation ? 0x30 : 0x10) | continuity);
+    continuity = (continuity + 1) & 0x0F;
+
+    uint8_t* p = pPacket + 4;
+    if (adaptation) {
+        // Length, flags, PCR, stuffing; a single byte of stuffing is a zero length field
+        const size_t length = (inPcr >= 0 ? 7 : 0) + stuffing - (inPcr >= 0 ? 0 : 1);
+        *p++ = (uint8_t)length;
+        if (length > 0) {
+            *p++ = inPcr >= 0 ? 0x10 : 0x00;
+            if (inPcr >= 0) {
+                p[0] = (uint8_t)(inPcr >> 25);
+                p[1] = (uint8_t)(inPcr >> 17);
+                p[2] = (uint8_t)(inPcr >> 9);
+                p[3] = (uint8_t)(inPcr >> 1);
+                p[4] = (uint8_t)(((inPcr & 1) << 7) | 0x7E);
+                p[5] = 0;
+                p += 6;
+            }
+            const size_t fill = (pPacket + 4 + 1 + length) - p;
+            memset(p, 0xFF, fill);
+            p += fill;
+        }
+    }
+    if (inHeaderSize) {
+        memcpy(p, inHeader, inHeaderSize);
+        p += inHeaderSize;
+    }
+    memcpy(p, inData, taken);
+    return taken;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "LiveIngest.hpp"
+#include "UdpSocket.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct LiveSenderConfig {
+    LiveProtocol protocol = LiveProtocol::Rtp;
+    std::string address = "127.0.0.1";
+    int port = 5004;
+    double fps = 30;                // Access units per second, 0 as fast as the socket takes them
+    int loops = 1;
+    int payloadSize = 1400;         // RTP payload bytes; MPEG-TS datagrams carry 7 packets
+    int batchSize = 64;             // Datagrams per send call
+    int sendBuffer = 4 << 20;
+};
+
+// Replays an H.264 elementary stream to a LiveIngest, for loopback tests and benchmarks: as RTP
+// (single NAL unit packets, STAP-A for runs of small NAL units, FU-A for large ones, marker bit on
+// the last packet of an access unit) or as MPEG-TS in UDP (PAT and PMT in front of every IDR
+// picture, one PES packet per access unit). Timestamps count access units at fps on a 90 kHz
+// clock, in decode order. Datagrams are built in a preallocated batch and sent with one call.
+class LiveSender {
+public:
+    explicit LiveSender(const LiveSenderConfig& inConfig);
+
+    explicit operator bool() const { return bool(mSocket); }
+
+    // Blocks until the stream went out loops times or stop() was called. False on a socket error.
+    bool send(const uint8_t* inStream, size_t inSize);
+
+    void stop() { mStop = true; }
+
+    uint64_t getPackets() const { return mPackets; }
+    uint64_t getBytes() const { return mBytes; }
+    uint64_t getUnits() const { return mUnits; }
+
+private:
+    void packetizeRtp(const AccessUnit& inUnit, uint32_t inTimestamp);
+    void packetizeTs(const AccessUnit& inUnit, int64_t inPts, bool inTables);
+    // One 188 byte packet of inHeader and as much of inData as fits, stuffed; returns the bytes of inData taken
+    size_t writeTsPacket(int inPid, bool inUnitStart, const uint8_t* inHeader, size_t inHeaderSize,
+        const uint8_t* inData, size_t inSize, int64_t inPcr);
+    void writeSection(int inPid, const uint8_t* inSection, size_t inSize);
+    uint8_t* nextDatagram(size_t inSize);
+    bool flush();
+
+    LiveSenderConfig mConfig;
+    UdpSocket mSocket;
+    std::unique_ptr<uint8_t[]> mArena;
+    size_t mDatagramCapacity;
+    std::vector<Datagram> mBatch;
+    int mPending = 0;
+    bool mFailed = false;
+    std::atomic<bool> mStop{ false };
+
+    // RTP
+    uint16_t mSequence = 0;
+    uint32_t mSsrc;
+    std::vector<std::pair<const uint8_t*, size_t>> mNals;
+
+    // MPEG-TS: packets go into the open datagram until it holds 7
+    uint8_t mContinuity[3] = {};    // PAT, PMT, video
+    uint8_t* mTsDatagram = nullptr;
+
+    uint64_t mPackets = 0;
+    uint64_t mBytes = 0;
+    uint64_t mUnits = 0;
+};
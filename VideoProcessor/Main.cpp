@@ -1,20 +1,42 @@
 #include "Utils.hpp"
 
 #include <cuda.h>
-#include "Decoder.hpp"
+#include "NvDecoder.hpp"
+#include "SwDecoder.hpp"
+#include "SyntheticDecoder.hpp"
+#include "DecodeProfile.hpp"
+#include "FrameCache.hpp"
+#include "SessionScheduler.hpp"
+#include "ThreadPool.hpp"
+#include "MappedFile.hpp"
+#include "AnnexBPacketizer.hpp"
+#include "ContainerDemuxer.hpp"
+#include "LiveIngest.hpp"
+#include "LiveSender.hpp"
+#include "StreamIndex.hpp"
+#include "GopParallelDecoder.hpp"
+#include "MosaicCompositor.hpp"
+#include "ThumbnailExtractor.hpp"
+#include "Pipeline.hpp"
+#include "FileSink.hpp"
+#include "PresenterSink.hpp"
+#include "SharedMemorySink.hpp"
 
-#include <fstream>
 #include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "FramePresenterGLUT.h"
 #include "ColorSpace.h"
 #include "NvCodecUtils.h"
 
-#define START_TIMER(name) auto start##name = std::chrono::high_resolution_clock::now();
-#define STOP_TIMER(name) std::cout << #name" " << \
-    std::chrono::duration_cast<std::chrono::milliseconds>( \
-    std::chrono::high_resolution_clock::now() - start##name).count() \
-    << " ms " << std::endl;
-
 void createCudaContext(CUcontext *outContext, int inGpu, CUctx_flags inFlags) {
     CUdevice cuDevice = 0;
     ck(cuDeviceGet(&cuDevice, inGpu));
@@ -24,55 +46,831 @@ void createCudaContext(CUcontext *outContext, int inGpu, CUctx_flags inFlags) {
     ck(cuCtxCreate(outContext, inFlags, cuDevice));
 }
 
-uint8_t buffer[2 * 1024];
+void showHelpAndExit(const char* inBadOption = nullptr) {
+    if (inBadOption) {
+        std::cerr << "Error parsing \"" << inBadOption << "\"" << std::endl;
+    }
+    std::cout << "Options:" << std::endl
+        << "-i             Input file: H.264 elementary stream, or H.264/HEVC in MP4 or Matroska (default: sample.h264)," << std::endl
+        << "               comma separated list of elementary streams with -sessions" << std::endl
+        << "-listen        Decode a live stream instead: rtp://host:port (RTP, H.264 or MPEG-TS payload) or" << std::endl
+        << "               udp://host:port (MPEG-TS), a multicast host is joined; ends after 2 s without packets" << std::endl
+        << "-jitter        With -listen: ms a packet waits for a missing one in front of it (default: 50)" << std::endl
+        << "-send          Replay the H.264 elementary stream of -i to rtp://host:port or udp://host:port and exit" << std::endl
+        << "-send-fps      With -send: access units per second, 0 as fast as possible (default: 30)" << std::endl
+        << "-backend       nvdec (default), sw or synthetic (CPU-only stand-in decoder)" << std::endl
+        << "-threads       Number of software decoder threads (default: all cores, 1 per session with -sessions)" << std::endl
+        << "-convert       Color conversion of host frames: gpu (default) or cpu" << std::endl
+        << "-profile       low-latency, balanced (default) or throughput: decoder delay, surfaces and queue depths" << std::endl
+        << "-packet-queue  Access units queued between read and decode (default: from the profile, 32)" << std::endl
+        << "-frame-queue   Decoded frames queued between decode and convert (default: from the profile, 4)" << std::endl
+        << "-image-queue   Converted images queued between convert and output (default: from the profile, 2)" << std::endl
+        << "-output        window (default), null, y4m, raw (NV12/P016 file) or shm (shared memory ring)" << std::endl
+        << "-size          Output image size WxH, scaled on the CPU (default: window 1920x800, frame size otherwise," << std::endl
+        << "               thumbnails 160 wide)" << std::endl
+        << "-crop          Source region l,t,r,b to scale from (default: whole frame)" << std::endl
+        << "-scale-filter  bilinear (default) or area" << std::endl
+        << "-realtime      1 presents at the stream's frame rate and drops late frames, 0 as fast as possible (default: 1 for window)" << std::endl
+        << "-filters       Filter graph run before conversion, comma separated: deinterlace, denoise, brightness=<n>," << std::endl
+        << "               contrast=<c>, gamma=<g>, timestamp (default: none)" << std::endl
+        << "-fuse          1 folds adjacent brightness/contrast/gamma filters into the pass before them, 0 one pass each (default: 1)" << std::endl
+        << "-analyze       1 scores every frame for scene cuts and motion before conversion (default: 0)" << std::endl
+        << "-static-every  With -analyze: convert and output only every Nth frame of a static run (default: 0 = all)" << std::endl
+        << "-seek          Start output at the picture of this access unit (decode order), indexed through <input>.idx (default: 0)" << std::endl
+        << "-scrub         Show these frames (presentation order) in order and exit, e.g. 0-120,119-60,60-90: a range with" << std::endl
+        << "               a lower end steps back; stepping back and repeats come out of the frame cache" << std::endl
+        << "-cache-mb      With -scrub: frame cache budget in MB (default: 512)" << std::endl
+        << "-cache-scale   With -scrub: 1 caches frames at their size, 2 or 4 at 1/2 or 1/4 width and height (default: 1)" << std::endl
+        << "-o             Output file for y4m/raw (default: output.y4m/output.nv12), ring name for shm" << std::endl
+        << "-pool-size     Decoded frames in flight (default: from the profile, 8 for nvdec, threads + 4 for sw)" << std::endl
+        << "-pool-policy   When all frames are in flight: block (default) or drop" << std::endl
+        << "-map-surfaces  nvdec: 1 hands out mapped decoder surfaces instead of copies (default: 0)" << std::endl
+        << "-thumbnails    Decode only the IDR pictures into <prefix><frame>.ppm thumbnails, -output is ignored" << std::endl
+        << "-thumb-frames  Minimum frames between thumbnails (default: 0 = every IDR picture)" << std::endl
+        << "-gop-decoders  Decode the input on this many decoders at once, one GOP segment each (default: 0 = off)" << std::endl
+        << "-gop-frames    Minimum frames per GOP segment (default: 60)" << std::endl
+        << "-metrics       Keep the counters and stage latency histograms in this Prometheus text file, updated every second" << std::endl
+        << "-trace         Record the pipeline stages and write them to this Chrome trace JSON file at exit" << std::endl
+        << "-sessions      Decode this many streams at once without presenting them (default: 0 = single stream)" << std::endl
+        << "-workers       Session worker threads (default: one per processor)" << std::endl
+        << "-max-sessions  Sessions admitted at once, more are refused (default: 64)" << std::endl
+        << "-loops         Times every session decodes its input, -send replays it or -scrub shows its frames (default: 1)" << std::endl
+        << "-mosaic        CxR: show the sessions tiled C x R on one canvas of -size (default: 3840x2160), window or null output" << std::endl
+        << "-mosaic-fps    Composites per second of the mosaic (default: 30)" << std::endl
+        << "-scaling       1 runs the sessions on 1, 2, 4, ... workers and reports the speedup (default: 0)" << std::endl;
+    exit(inBadOption ? 1 : 0);
+}
 
-int
-main() {
-    ck(cuInit(0));
+// inCtxLock: the lock of inCuContext that decoders on it share, nullptr for a decoder on its own
+std::unique_ptr<Decoder> createDecoder(const std::string& inBackend, CUcontext inCuContext, int inThreadCount,
+    const FramePoolConfig& inPoolConfig, const DecodeProfile& inProfile, VideoCodec inCodec = VideoCodec::H264,
+    CUvideoctxlock inCtxLock = nullptr) {
+    std::unique_ptr<Decoder> pDecoder;
+    if (inBackend == "nvdec") {
+        pDecoder.reset(new NvDecoder(inCuContext, inPoolConfig, inProfile, inCodec, inCtxLock));
+    } else if (inBackend == "sw") {
+        pDecoder.reset(new SwDecoder(inThreadCount, inPoolConfig, inProfile, inCodec));
+    } else if (inBackend == "synthetic") {
+        pDecoder.reset(new SyntheticDecoder(320, 240, 200000, inPoolConfig));
+    }
+    return pDecoder;
+}
+
+// Decodes inSessionCount streams at once on a SessionScheduler, frames are dropped right after
+// decoding. With inScaling the same sessions run on 1, 2, 4, ... workers up to the configured count.
+int runServer(const std::vector<std::string>& inInputs, const std::string& inBackend, int inThreadCount,
+    int inSessionCount, int inLoops, const SchedulerConfig& inSchedulerConfig, const FramePoolConfig& inPoolConfig,
+    const DecodeProfile& inProfile, bool inScaling, const std::string& inOutput, MosaicConfig inMosaicConfig,
+    double inMosaicFps) {
+    const bool mosaic = !inMosaicConfig.tiles.empty();
+    // NVDEC sessions share one context and serialize on it with one cuvidCtxLock
     CUcontext cuContext = nullptr;
-    createCudaContext(&cuContext, 0, CU_CTX_SCHED_BLOCKING_SYNC);
+    CUvideoctxlock ctxLock = nullptr;
+    if (inBackend == "nvdec" || (mosaic && inOutput == "window")) {
+        ck(cuInit(0));
+        createCudaContext(&cuContext, 0, CU_CTX_SCHED_BLOCKING_SYNC);
+    }
+    if (inBackend == "nvdec") {
+        ck(cuvidCtxLockCreate(&ctxLock, cuContext));
+    }
+
+    // The mosaic shows every session in its tile, composited at inMosaicFps on a thread of its own
+    std::unique_ptr<ThreadPool> pMosaicPool;
+    std::unique_ptr<MosaicCompositor> pMosaic;
+    std::unique_ptr<FramePresenterGLUT> pPresenter;
+    std::unique_ptr<FrameSink> pMosaicSink;
+    if (mosaic) {
+        pMosaicPool.reset(new ThreadPool());
+        inMosaicConfig.pThreadPool = pMosaicPool.get();
+        inMosaicConfig.downloadFrame = [cuContext](const FrameHandle& inFrame, uint8_t* outHost, size_t inSize) {
+            ck(cuCtxPushCurrent(cuContext));
+            ck(cuMemcpyDtoH(outHost, (CUdeviceptr)inFrame.data(), inSize));
+            ck(cuCtxPopCurrent(nullptr));
+        };
+        pMosaic.reset(new MosaicCompositor(inMosaicConfig));
+        const SinkFrame canvas = pMosaic->getCanvas();
+        if (inOutput == "window") {
+            pPresenter.reset(new FramePresenterGLUT(cuContext, canvas.width, canvas.height));
+            pMosaicSink.reset(new PresenterSink(*pPresenter, canvas.width, canvas.height));
+        } else {
+            pMosaicSink.reset(new NullSink());
+        }
+    }
+
+    const int maxWorkers = SessionScheduler(inSchedulerConfig).getWorkerCount();
+    std::vector<int> workerCounts;
+    for (int workers = 1; inScaling && workers < maxWorkers; workers *= 2) {
+        workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(maxWorkers);
+
+    double baseFps = 0;
+    for (int workers : workerCounts) {
+        SchedulerConfig schedulerConfig = inSchedulerConfig;
+        schedulerConfig.workerCount = workers;
+        SessionScheduler scheduler(schedulerConfig);
+        for (int i = 0; i < inSessionCount; i++) {
+            const std::string& path = inInputs[i % inInputs.size()];
+            std::unique_ptr<DecodeSession> pSession(new DecodeSession(i, path,
+                createDecoder(inBackend, cuContext, inThreadCount, inPoolConfig, inProfile, VideoCodec::H264, ctxLock), inLoops));
+            if (!*pSession) {
+                std::cerr << "Open file " << path << " failed" << std::endl;
+                return -1;
+            }
+            if (pMosaic) {
+                MosaicCompositor* pCompositor = pMosaic.get();
+                pSession->setFrameCallback([pCompositor](DecodeSession& inSession, FrameHandle& inFrame) {
+                    pCompositor->submit(inSession.getId(), inFrame);
+                });
+            }
+            scheduler.addSession(std::move(pSession));
+        }
 
-    std::basic_ifstream<uint8_t, std::char_traits<uint8_t>> inputStream("sample.h264",
-        std::ios::binary);
-    if (!inputStream) {
-        std::cerr << "Open file sample.h264 failed" << std::endl;
+        std::atomic<bool> decoding{ true };
+        std::thread compositor;
+        if (pMosaic) {
+            compositor = std::thread([&] {
+                Telemetry::SetThreadName("mosaic");
+                if (cuContext) {
+                    ck(cuCtxPushCurrent(cuContext));
+                }
+                const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1 / (inMosaicFps > 0 ? inMosaicFps : 30.0)));
+                auto next = std::chrono::steady_clock::now();
+                // Compositing goes on after the window closed, it hands the frames back to the sessions
+                bool showing = true;
+                while (true) {
+                    const bool last = !decoding;
+                    if (pMosaic->composite() > 0 && showing) {
+                        showing = pMosaicSink->write(pMosaic->getCanvas());
+                    }
+                    if (last) {
+                        break;
+                    }
+                    next += period;
+                    std::this_thread::sleep_until(next);
+                }
+                if (cuContext) {
+                    ck(cuCtxPopCurrent(nullptr));
+                }
+            });
+        }
+        scheduler.run();
+        decoding = false;
+        if (compositor.joinable()) {
+            compositor.join();
+        }
+
+        const double fps = scheduler.getElapsedSeconds() > 0 ? scheduler.getFrames() / scheduler.getElapsedSeconds() : 0;
+        if (!baseFps) {
+            baseFps = fps;
+        }
+        if (inScaling) {
+            std::cout << "Workers " << workers << ": " << fps << " fps, speedup " << fps / baseFps
+                << ", efficiency " << 100.0 * fps / baseFps / workers << "%" << std::endl;
+        }
+        if (workers == workerCounts.back()) {
+            AsyncLogger::get().flush();
+            scheduler.printStatistics(std::cout);
+            if (pMosaic) {
+                pMosaic->printStatistics(std::cout);
+            }
+        }
+    }
+
+    if (pMosaicSink) {
+        pMosaicSink->close();
+    }
+    pMosaicSink.reset();
+    pPresenter.reset();
+    if (ctxLock) {
+        ck(cuvidCtxLockDestroy(ctxLock));
+    }
+    if (cuContext) {
+        ck(cuCtxDestroy(cuContext));
+    }
+    return 0;
+}
+
+// Decodes inInput on several decoders at once, one GOP segment each, and writes the frames to
+// inSink in presentation order. NVDEC decoders share inCuContext and its inCtxLock.
+int runGopParallel(const std::string& inInputFile, const MappedFile& inInput, const std::string& inBackend,
+    int inThreadCount, const GopParallelConfig& inConfig, FramePoolConfig inPoolConfig, const DecodeProfile& inProfile,
+    FrameSink& inSink, CUcontext inCuContext, CUvideoctxlock inCtxLock) {
+    auto start = std::chrono::high_resolution_clock::now();
+    StreamIndex index;
+    if (!index.open(inInputFile, inInput)) {
+        std::cerr << "Index " << inInputFile << " failed" << std::endl;
         return -1;
     }
 
-    int nWidth = (1920 + 1) & ~1;
-    int nPitch = 1920 * 4;
-
-    Decoder decoder(cuContext);
-    FramePresenterGLUT gInstance(cuContext, nWidth, 800);
-    int& nFrame = gInstance.nFrame;
-
-    CUdeviceptr dpFrame;
-    int iMatrix = 0;
-    do {
-        START_TIMER(read)
-        inputStream.read(buffer, sizeof(buffer));
-        size_t bytesRead = inputStream.gcount();
-        STOP_TIMER(read)
-        START_TIMER(decode)
-        int frameCount = decoder.decode(buffer, bytesRead);
-        STOP_TIMER(decode)
-
-        START_TIMER(render)
-        while (frameCount--) {
-            CUdeviceptr frame = decoder.getFrame();
-            gInstance.GetDeviceFrameBuffer(&dpFrame, &nPitch);
-            iMatrix = decoder.GetVideoFormatInfo().video_signal_description.matrix_coefficients;
-            // Launch cuda kernels for colorspace conversion from raw video to raw image formats which OpenGL textures can work with
-            Nv12ToColor32<BGRA32>((uint8_t*)frame, decoder.GetWidth(), (uint8_t*)dpFrame, nPitch, decoder.GetWidth(), decoder.GetHeight(), iMatrix);
-
-            gInstance.ReleaseDeviceFrameBuffer();
-        }
-        STOP_TIMER(render)
-
-        if (!inputStream) {
+    // A decoder ahead of the output has to wait for it, not lose frames
+    inPoolConfig.policy = FramePoolPolicy::Block;
+    const int threadCount = inThreadCount > 0 ? inThreadCount : 1;
+    GopParallelDecoder decoder(index, inInput.data(), inInput.size(), [&](int) {
+        return createDecoder(inBackend, inCuContext, threadCount, inPoolConfig, inProfile, VideoCodec::H264, inCtxLock);
+    }, inConfig);
+
+    std::vector<uint8_t> download;
+    PtsTracker ptsTracker;
+    uint64_t nFrame = 0;
+    for (FrameHandle frame = decoder.getFrame(); frame; frame = decoder.getFrame()) {
+        FrameInfo& info = frame.info();
+        const VideoFormat& format = decoder.GetVideoFormat();
+        info.pts = ptsTracker.stamp(info.timestamp, format.frameRateNum, format.frameRateDen);
+        SinkFrame image;
+        image.data = frame.data();
+        image.memoryType = frame.getMemoryType();
+        image.format = SinkFormat::Nv12;
+        image.width = info.width;
+        image.height = info.height;
+        image.pitch = info.pitch;
+        image.bpp = info.bpp;
+        image.timestamp = info.timestamp;
+        image.pts = info.pts;
+        image.frameRateNum = format.frameRateNum;
+        image.frameRateDen = format.frameRateDen;
+        if (image.memoryType == FrameMemoryType::Device && inSink.needsHostMemory()) {
+            download.resize((size_t)info.pitch * (info.height + (info.height + 1) / 2));
+            ck(cuMemcpyDtoH(download.data(), (CUdeviceptr)frame.data(), download.size()));
+            image.data = download.data();
+            image.memoryType = FrameMemoryType::Host;
+        }
+        if (!inSink.write(image)) {
             break;
         }
-    } while (true);
+        nFrame++;
+    }
+    inSink.close();
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    AsyncLogger::get().flush();
+    decoder.printStatistics(std::cout);
+    std::cout << "Backend " << inBackend << " x" << decoder.getDecoderCount() << ": " << nFrame << " frames in "
+        << seconds << " s, " << nFrame / seconds << " fps" << std::endl;
+    return 0;
+}
+
+// Binary PPM, the alpha channel of the BGRA image is dropped
+bool writePpm(const std::string& inPath, const Thumbnail& inThumbnail) {
+    std::ofstream file(inPath, std::ios::binary);
+    file << "P6\n" << inThumbnail.width << " " << inThumbnail.height << "\n255\n";
+    std::vector<uint8_t> row(inThumbnail.width * 3);
+    for (int y = 0; y < inThumbnail.height; y++) {
+        const uint8_t* pBgra = inThumbnail.bgra.data() + (size_t)y * inThumbnail.pitch;
+        for (int x = 0; x < inThumbnail.width; x++) {
+            row[x * 3] = pBgra[x * 4 + 2];
+            row[x * 3 + 1] = pBgra[x * 4 + 1];
+            row[x * 3 + 2] = pBgra[x * 4];
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+// Decodes the IDR pictures of inInput only, one thumbnail each, and writes them to
+// <inPrefix><frame>.ppm
+int runThumbnails(const std::string& inInputFile, const MappedFile& inInput, Decoder& inDecoder,
+    const ThumbnailConfig& inConfig, const std::string& inPrefix) {
+    auto start = std::chrono::high_resolution_clock::now();
+    StreamIndex index;
+    if (!index.open(inInputFile, inInput)) {
+        std::cerr << "Index " << inInputFile << " failed" << std::endl;
+        return -1;
+    }
+
+    ThumbnailExtractor extractor(index, inInput.data(), inDecoder, inConfig);
+    Thumbnail thumbnail;
+    uint64_t nThumbnail = 0;
+    while (extractor.next(thumbnail)) {
+        const std::string path = inPrefix + std::to_string(thumbnail.frame) + ".ppm";
+        if (!writePpm(path, thumbnail)) {
+            std::cerr << "Write file " << path << " failed" << std::endl;
+            return -1;
+        }
+        nThumbnail++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    AsyncLogger::get().flush();
+    std::cout << "Thumbnails (" << inDecoder.getName() << "): " << nThumbnail << " of " << thumbnail.width << "x"
+        << thumbnail.height << " from " << extractor.getKeyframeCount() << " IDR pictures, " << extractor.getSkippedFrames()
+        << " frames skipped, in " << seconds << " s = " << nThumbnail / seconds << " thumbnails/s" << std::endl;
+    return 0;
+}
 
-    ck(cuCtxDestroy(cuContext));
+// Parses a,b-c,... into ranges of frames, a single frame being a range of one
+bool parseScrubList(const std::string& inList, std::vector<std::pair<int64_t, int64_t>>& outRanges) {
+    std::istringstream list(inList);
+    for (std::string item; std::getline(list, item, ',');) {
+        long long first = 0, last = 0;
+        char dash = 0;
+        const int fields = sscanf(item.c_str(), "%lld%c%lld", &first, &dash, &last);
+        if (fields == 1) {
+            last = first;
+        } else if (fields != 3 || dash != '-') {
+            return false;
+        }
+        if (first < 0 || last < 0) {
+            return false;
+        }
+        outRanges.emplace_back(first, last);
+    }
+    return !outRanges.empty();
+}
+
+// Shows the frames of inRanges, inLoops times, through a FrameScrubber and writes them to inSink:
+// what an interactive viewer stepping and looping through the stream asks of the decoder
+int runScrub(const std::string& inInputFile, const MappedFile& inInput, Decoder& inDecoder,
+    const FrameCacheConfig& inCacheConfig, const std::vector<std::pair<int64_t, int64_t>>& inRanges, int inLoops,
+    FrameSink& inSink) {
+    auto start = std::chrono::high_resolution_clock::now();
+    StreamIndex index;
+    if (!index.open(inInputFile, inInput)) {
+        std::cerr << "Index " << inInputFile << " failed" << std::endl;
+        return -1;
+    }
+
+    AnnexBPacketizer packetizer(inInput.data(), inInput.size());
+    FrameCache cache(inCacheConfig);
+    FrameScrubber scrubber(index, inInput.data(), packetizer, inDecoder, cache);
+    uint64_t nFrame = 0;
+    bool running = true;
+    for (int loop = 0; loop < inLoops && running; loop++) {
+        for (size_t i = 0; i < inRanges.size() && running; i++) {
+            const int64_t step = inRanges[i].second >= inRanges[i].first ? 1 : -1;
+            for (int64_t frame = inRanges[i].first; running; frame += step) {
+                std::shared_ptr<const CachedFrame> pFrame = scrubber.get(frame);
+                if (!pFrame) {
+                    std::cerr << "Frame " << frame << " is not in " << inInputFile << " (" << index.getFrameCount()
+                        << " frames)" << std::endl;
+                    return -1;
+                }
+                const VideoFormat& format = inDecoder.GetVideoFormat();
+                SinkFrame image;
+                image.data = pFrame->data.data();
+                image.format = SinkFormat::Nv12;
+                image.width = pFrame->width;
+                image.height = pFrame->height;
+                image.pitch = pFrame->pitch;
+                image.bpp = pFrame->bpp;
+                image.timestamp = pFrame->timestamp;
+                image.pts = pFrame->pts;
+                image.frameRateNum = format.frameRateNum;
+                image.frameRateDen = format.frameRateDen;
+                running = inSink.write(image);
+                nFrame += running;
+                if (frame == inRanges[i].second) {
+                    break;
+                }
+            }
+        }
+    }
+    inSink.close();
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    AsyncLogger::get().flush();
+    cache.printStatistics(std::cout);
+    std::cout << "Scrub (" << inDecoder.getName() << "): " << nFrame << " frames in " << seconds << " s, "
+        << nFrame / seconds << " fps, " << scrubber.getDecodedFrames() << " access units decoded, "
+        << scrubber.getSeeks() << " seeks" << std::endl;
+    return 0;
+}
+
+int
+main(int argc, char* argv[]) {
+    std::string inputFile = "sample.h264";
+    std::string backend = "nvdec";
+    int threadCount = 0;
+    std::string convert = "gpu";
+    std::string output = "window";
+    std::string outputPath;
+    int64_t seekFrame = 0;
+    int realTime = -1;
+    std::string thumbnailPrefix;
+    std::string metricsPath, tracePath;
+    ThumbnailConfig thumbnailConfig;
+    PipelineConfig pipelineConfig;
+    DecodeProfile profile;
+    std::string profileName = profile.name;
+    int packetQueueDepth = 0, frameQueueDepth = 0, imageQueueDepth = 0;     // 0 = from the profile
+    FramePoolConfig poolConfig;
+    SchedulerConfig schedulerConfig;
+    GopParallelConfig gopConfig;
+    int sessionCount = 0;
+    int loops = 1;
+    bool scaling = false;
+    int mosaicColumns = 0, mosaicRows = 0;
+    double mosaicFps = 30;
+    std::string listenUrl, sendUrl;
+    int jitterMs = -1;
+    double sendFps = 30;
+    std::vector<std::pair<int64_t, int64_t>> scrubRanges;
+    FrameCacheConfig cacheConfig;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "-h") {
+            showHelpAndExit();
+        }
+        if (i + 1 >= argc) {
+            showHelpAndExit(argv[i]);
+        }
+        if (option == "-i") {
+            inputFile = argv[++i];
+        } else if (option == "-listen") {
+            listenUrl = argv[++i];
+        } else if (option == "-jitter") {
+            jitterMs = atoi(argv[++i]);
+        } else if (option == "-send") {
+            sendUrl = argv[++i];
+        } else if (option == "-send-fps") {
+            sendFps = atof(argv[++i]);
+        } else if (option == "-backend") {
+            backend = argv[++i];
+        } else if (option == "-threads") {
+            threadCount = atoi(argv[++i]);
+        } else if (option == "-convert") {
+            convert = argv[++i];
+        } else if (option == "-output") {
+            output = argv[++i];
+        } else if (option == "-size") {
+            if (sscanf(argv[++i], "%dx%d", &pipelineConfig.outputWidth, &pipelineConfig.outputHeight) != 2) {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-crop") {
+            CropRect& crop = pipelineConfig.crop;
+            if (sscanf(argv[++i], "%d,%d,%d,%d", &crop.left, &crop.top, &crop.right, &crop.bottom) != 4) {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-scale-filter") {
+            std::string filter = argv[++i];
+            if (filter == "bilinear") {
+                pipelineConfig.scaleFilter = ScaleFilter::Bilinear;
+            } else if (filter == "area") {
+                pipelineConfig.scaleFilter = ScaleFilter::Area;
+            } else {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-realtime") {
+            realTime = atoi(argv[++i]);
+        } else if (option == "-filters") {
+            pipelineConfig.filterGraph = argv[++i];
+        } else if (option == "-fuse") {
+            pipelineConfig.fuseFilters = atoi(argv[++i]) != 0;
+        } else if (option == "-analyze") {
+            pipelineConfig.analyzeScenes = atoi(argv[++i]) != 0;
+        } else if (option == "-static-every") {
+            pipelineConfig.staticFrameInterval = atoi(argv[++i]);
+        } else if (option == "-seek") {
+            seekFrame = atoll(argv[++i]);
+        } else if (option == "-scrub") {
+            if (!parseScrubList(argv[++i], scrubRanges)) {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-cache-mb") {
+            cacheConfig.budget = (size_t)atoll(argv[++i]) << 20;
+        } else if (option == "-cache-scale") {
+            cacheConfig.downscale = atoi(argv[++i]);
+        } else if (option == "-o") {
+            outputPath = argv[++i];
+        } else if (option == "-profile") {
+            profileName = argv[++i];
+        } else if (option == "-packet-queue") {
+            packetQueueDepth = atoi(argv[++i]);
+        } else if (option == "-frame-queue") {
+            frameQueueDepth = atoi(argv[++i]);
+        } else if (option == "-image-queue") {
+            imageQueueDepth = atoi(argv[++i]);
+        } else if (option == "-pool-size") {
+            poolConfig.capacity = atoi(argv[++i]);
+        } else if (option == "-pool-policy") {
+            std::string policy = argv[++i];
+            if (policy == "block") {
+                poolConfig.policy = FramePoolPolicy::Block;
+            } else if (policy == "drop") {
+                poolConfig.policy = FramePoolPolicy::Drop;
+            } else {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-map-surfaces") {
+            poolConfig.mapSurfaces = atoi(argv[++i]) != 0;
+        } else if (option == "-thumbnails") {
+            thumbnailPrefix = argv[++i];
+        } else if (option == "-thumb-frames") {
+            thumbnailConfig.minInterval = atoll(argv[++i]);
+        } else if (option == "-gop-decoders") {
+            gopConfig.decoderCount = atoi(argv[++i]);
+        } else if (option == "-gop-frames") {
+            gopConfig.minSegmentFrames = atoi(argv[++i]);
+        } else if (option == "-metrics") {
+            metricsPath = argv[++i];
+        } else if (option == "-trace") {
+            tracePath = argv[++i];
+        } else if (option == "-sessions") {
+            sessionCount = atoi(argv[++i]);
+        } else if (option == "-workers") {
+            schedulerConfig.workerCount = atoi(argv[++i]);
+        } else if (option == "-max-sessions") {
+            schedulerConfig.maxSessions = atoi(argv[++i]);
+        } else if (option == "-loops") {
+            loops = atoi(argv[++i]);
+        } else if (option == "-mosaic") {
+            if (sscanf(argv[++i], "%dx%d", &mosaicColumns, &mosaicRows) != 2 || mosaicColumns <= 0 || mosaicRows <= 0) {
+                showHelpAndExit(argv[i]);
+            }
+        } else if (option == "-mosaic-fps") {
+            mosaicFps = atof(argv[++i]);
+        } else if (option == "-scaling") {
+            scaling = atoi(argv[++i]) != 0;
+        } else {
+            showHelpAndExit(argv[i]);
+        }
+    }
+
+    if (backend != "nvdec" && backend != "sw" && backend != "synthetic") {
+        showHelpAndExit(backend.c_str());
+    }
+    if (output != "window" && output != "null" && output != "y4m" && output != "raw" && output != "shm") {
+        showHelpAndExit(output.c_str());
+    }
+    if (!GetDecodeProfile(profileName, profile)) {
+        showHelpAndExit(profileName.c_str());
+    }
+    LiveIngestConfig ingestConfig;
+    if (!listenUrl.empty() && !ParseLiveUrl(listenUrl, ingestConfig.protocol, ingestConfig.address, ingestConfig.port)) {
+        showHelpAndExit(listenUrl.c_str());
+    }
+    LiveSenderConfig senderConfig;
+    if (!sendUrl.empty() && !ParseLiveUrl(sendUrl, senderConfig.protocol, senderConfig.address, senderConfig.port)) {
+        showHelpAndExit(sendUrl.c_str());
+    }
+    pipelineConfig.packetQueueDepth = packetQueueDepth > 0 ? packetQueueDepth : profile.packetQueueDepth;
+    pipelineConfig.frameQueueDepth = frameQueueDepth > 0 ? frameQueueDepth : profile.frameQueueDepth;
+    pipelineConfig.imageQueueDepth = imageQueueDepth > 0 ? imageQueueDepth : profile.imageQueueDepth;
+    // A window shows the stream as it is meant to be watched, files and rings take frames as fast as they come
+    pipelineConfig.realTime = realTime < 0 ? output == "window" : realTime != 0;
+
+    // Exports once more on the way out, whichever way main() returns
+    TelemetryExporter telemetryExporter(metricsPath, tracePath);
+
+    if (!sendUrl.empty()) {
+        MappedFile input(inputFile);
+        if (!input) {
+            std::cerr << "Open file " << inputFile << " failed" << std::endl;
+            return -1;
+        }
+        if (ProbeContainer(input.data(), input.size()) != ContainerFormat::AnnexB) {
+            std::cerr << "-send replays an H.264 elementary stream, not an MP4 or Matroska file" << std::endl;
+            return -1;
+        }
+        senderConfig.fps = sendFps;
+        senderConfig.loops = loops;
+        LiveSender sender(senderConfig);
+        if (!sender) {
+            return -1;
+        }
+        auto sendStart = std::chrono::high_resolution_clock::now();
+        const bool sent = sender.send(input.data(), input.size());
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sendStart).count();
+        std::cout << "Sent " << sender.getUnits() << " access units in " << sender.getPackets() << " packets to " << sendUrl
+            << " in " << seconds << " s, " << sender.getBytes() * 8 / seconds / 1e6 << " Mbit/s" << std::endl;
+        return sent ? 0 : -1;
+    }
+
+    const bool scrub = !scrubRanges.empty();
+    if (!listenUrl.empty() && (sessionCount > 0 || seekFrame > 0 || scrub || !thumbnailPrefix.empty() || gopConfig.decoderCount > 0)) {
+        std::cerr << "-sessions, -seek, -scrub, -thumbnails and -gop-decoders take files, not -listen" << std::endl;
+        return -1;
+    }
+
+    if (gopConfig.decoderCount > 0 && output == "window") {
+        std::cerr << "-gop-decoders writes the decoded frames, use -output null, y4m, raw or shm" << std::endl;
+        return -1;
+    }
+    if (scrub && output == "window") {
+        std::cerr << "-scrub writes the frames it shows, use -output null, y4m, raw or shm" << std::endl;
+        return -1;
+    }
+
+    if (sessionCount > 0) {
+        std::vector<std::string> inputs;
+        std::istringstream inputList(inputFile);
+        for (std::string path; std::getline(inputList, path, ',');) {
+            if (!path.empty()) {
+                inputs.push_back(path);
+            }
+        }
+        if (inputs.empty()) {
+            showHelpAndExit(inputFile.c_str());
+        }
+        MosaicConfig mosaicConfig;
+        if (mosaicColumns > 0) {
+            if (output != "window" && output != "null") {
+                std::cerr << "-mosaic shows the canvas in a window or discards it, use -output window or null" << std::endl;
+                return -1;
+            }
+            if (pipelineConfig.outputWidth > 0 && pipelineConfig.outputHeight > 0) {
+                mosaicConfig.width = pipelineConfig.outputWidth;
+                mosaicConfig.height = pipelineConfig.outputHeight;
+            }
+            mosaicConfig.tiles = MakeMosaicGrid(mosaicConfig.width & ~1, mosaicConfig.height & ~1, mosaicColumns, mosaicRows, 2);
+        }
+        // Sessions run side by side, one decoder thread each unless asked otherwise
+        return runServer(inputs, backend, threadCount > 0 ? threadCount : 1, sessionCount, loops, schedulerConfig,
+            poolConfig, profile, scaling, output, mosaicConfig, mosaicFps);
+    }
+
+    // Headless outputs of a CPU backend run without a GPU
+    CUcontext cuContext = nullptr;
+    if (backend == "nvdec" || (output == "window" && thumbnailPrefix.empty())) {
+        ck(cuInit(0));
+        createCudaContext(&cuContext, 0, CU_CTX_SCHED_BLOCKING_SYNC);
+    }
+
+    // Every access unit queued between read and decode, plus the one each of them holds
+    const int unitsInFlight = pipelineConfig.packetQueueDepth + 2;
+    if (jitterMs >= 0) {
+        ingestConfig.jitterMs = jitterMs;
+    }
+    ingestConfig.unitsInFlight = unitsInFlight;
+    // Only started with -listen
+    LiveIngest liveIngest(ingestConfig);
+    std::unique_ptr<MappedFile> pInput;
+    std::unique_ptr<PacketSource> pFileSource;
+    PacketSource* pPacketSource = &liveIngest;
+    VideoTrackInfo track;
+    ContainerFormat container = ContainerFormat::AnnexB;
+    if (!listenUrl.empty()) {
+        if (!liveIngest.start()) {
+            return -1;
+        }
+        std::cout << "Listening on " << listenUrl << std::endl;
+    } else {
+        pInput.reset(new MappedFile(inputFile));
+        if (!*pInput) {
+            std::cerr << "Open file " << inputFile << " failed" << std::endl;
+            return -1;
+        }
+        // Containers are demuxed in place; seeking, thumbnails and GOP parallel decoding index the
+        // start codes of an elementary stream
+        container = ProbeContainer(pInput->data(), pInput->size());
+        if (container != ContainerFormat::AnnexB && (seekFrame > 0 || scrub || !thumbnailPrefix.empty() || gopConfig.decoderCount > 0)) {
+            std::cerr << "-seek, -scrub, -thumbnails and -gop-decoders take an H.264 elementary stream, not an MP4 or Matroska file" << std::endl;
+            return -1;
+        }
+        pFileSource = OpenPacketSource(pInput->data(), pInput->size(), unitsInFlight, track);
+        if (!pFileSource) {
+            return -1;
+        }
+        pPacketSource = pFileSource.get();
+    }
+    if (container != ContainerFormat::AnnexB) {
+        std::cout << (container == ContainerFormat::Mp4 ? "MP4" : "Matroska") << " input: "
+            << (track.codec == VideoCodec::Hevc ? "HEVC" : "H.264") << " " << track.width << "x" << track.height;
+        if (track.sampleCount > 0) {
+            std::cout << ", " << track.sampleCount << " samples";
+        }
+        std::cout << std::endl;
+    }
+
+    if (!thumbnailPrefix.empty()) {
+        if (pipelineConfig.outputWidth > 0) {
+            thumbnailConfig.width = pipelineConfig.outputWidth;
+            thumbnailConfig.height = pipelineConfig.outputHeight;
+        }
+        thumbnailConfig.downloadFrame = [](const FrameHandle& inFrame, uint8_t* outHost, size_t inSize) {
+            ck(cuMemcpyDtoH(outHost, (CUdeviceptr)inFrame.data(), inSize));
+        };
+        int result;
+        {
+            std::unique_ptr<Decoder> pDecoder = createDecoder(backend, cuContext, threadCount, poolConfig, profile);
+            result = runThumbnails(inputFile, *pInput, *pDecoder, thumbnailConfig, thumbnailPrefix);
+        }
+        if (cuContext) {
+            ck(cuCtxDestroy(cuContext));
+        }
+        return result;
+    }
+
+    int nWidth = (1920 + 1) & ~1;
+    int nHeight = 800;
+    if (pipelineConfig.outputWidth > 0 && pipelineConfig.outputHeight > 0) {
+        nWidth = pipelineConfig.outputWidth & ~1;
+        nHeight = pipelineConfig.outputHeight & ~1;
+    }
+
+    std::unique_ptr<FramePresenterGLUT> pPresenter;
+    std::unique_ptr<FrameSink> pSink;
+    if (output == "window") {
+        pPresenter.reset(new FramePresenterGLUT(cuContext, nWidth, nHeight));
+        pSink.reset(new PresenterSink(*pPresenter, nWidth, nHeight));
+    } else if (output == "null") {
+        pSink.reset(new NullSink());
+    } else if (output == "shm") {
+        SharedMemorySinkConfig shmConfig;
+        if (!outputPath.empty()) {
+            shmConfig.name = outputPath;
+        }
+        pSink.reset(new SharedMemorySink(shmConfig));
+    } else {
+        const bool y4m = output == "y4m";
+        if (outputPath.empty()) {
+            outputPath = y4m ? "output.y4m" : "output.nv12";
+        }
+        std::unique_ptr<FileSink> pFileSink(new FileSink(outputPath, y4m ? FileSinkFormat::Y4m : FileSinkFormat::Raw));
+        if (!*pFileSink) {
+            std::cerr << "Create file " << outputPath << " failed" << std::endl;
+            return -1;
+        }
+        pSink = std::move(pFileSink);
+    }
+
+    if (gopConfig.decoderCount > 0) {
+        CUvideoctxlock ctxLock = nullptr;
+        if (backend == "nvdec") {
+            ck(cuvidCtxLockCreate(&ctxLock, cuContext));
+        }
+        int result = runGopParallel(inputFile, *pInput, backend, threadCount, gopConfig, poolConfig, profile, *pSink,
+            cuContext, ctxLock);
+        pSink.reset();
+        if (ctxLock) {
+            ck(cuvidCtxLockDestroy(ctxLock));
+        }
+        if (cuContext) {
+            ck(cuCtxDestroy(cuContext));
+        }
+        return result;
+    }
+
+    if (scrub) {
+        cacheConfig.downloadFrame = [](const FrameHandle& inFrame, uint8_t* outHost, size_t inSize) {
+            ck(cuMemcpyDtoH(outHost, (CUdeviceptr)inFrame.data(), inSize));
+        };
+        int result;
+        {
+            std::unique_ptr<Decoder> pDecoder = createDecoder(backend, cuContext, threadCount, poolConfig, profile);
+            result = runScrub(inputFile, *pInput, *pDecoder, cacheConfig, scrubRanges, loops, *pSink);
+        }
+        pSink.reset();
+        if (cuContext) {
+            ck(cuCtxDestroy(cuContext));
+        }
+        return result;
+    }
+
+    std::unique_ptr<Decoder> pDecoder = createDecoder(backend, cuContext, threadCount, poolConfig, profile, track.codec);
+    int coreCount = 1;
+    if (SwDecoder* pSwDecoder = dynamic_cast<SwDecoder*>(pDecoder.get())) {
+        coreCount = pSwDecoder->GetThreadCount();
+    }
+    Decoder& decoder = *pDecoder;
+
+    // Kept for the lifetime of the pipeline, the index may map its sidecar
+    StreamIndex index;
+    if (seekFrame > 0) {
+        auto indexStart = std::chrono::high_resolution_clock::now();
+        if (!index.open(inputFile, *pInput)) {
+            std::cerr << "Index " << inputFile << " failed" << std::endl;
+            return -1;
+        }
+        double indexSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - indexStart).count();
+        StreamSeeker seeker(index, pInput->data(), static_cast<AnnexBPacketizer&>(*pPacketSource), decoder);
+        if (!seeker.seek(seekFrame)) {
+            std::cerr << "Frame " << seekFrame << " is not in " << inputFile << " (" << index.getFrameCount() << " frames)" << std::endl;
+            return -1;
+        }
+        pipelineConfig.firstFrame = seekFrame;
+        std::cout << "Seek to frame " << seekFrame << ": decoding from keyframe " << seeker.getKeyframe() << ", index of "
+            << index.getFrameCount() << " frames ready in " << indexSeconds * 1000 << " ms" << std::endl;
+    }
+
+    const bool hostConvert = convert == "cpu";
+    std::unique_ptr<ThreadPool> pConvertPool(hostConvert ? new ThreadPool(threadCount) : nullptr);
+    pipelineConfig.hostConvert = hostConvert;
+    pipelineConfig.pConvertPool = pConvertPool.get();
+    pipelineConfig.sceneAnalysis.pThreadPool = pConvertPool.get();
+
+    uint64_t nFrame = 0;
+    auto decodeStart = std::chrono::high_resolution_clock::now();
+    {
+        Pipeline pipeline(pipelineConfig, *pPacketSource, decoder, *pSink, cuContext);
+        pipeline.run();
+        AsyncLogger::get().flush();
+        pipeline.printStatistics(std::cout);
+        if (liveIngest) {
+            liveIngest.printStatistics(std::cout);
+        }
+        nFrame = pipeline.getFrames();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+    std::cout << "Backend " << decoder.getName() << " (" << profile.name << "): " << nFrame << " frames in " << seconds << " s, "
+        << nFrame / seconds << " fps, " << nFrame / seconds / coreCount << " fps/core" << std::endl;
+
+    pSink.reset();
+    pPresenter.reset();
+    pDecoder.reset();
+    if (cuContext) {
+        ck(cuCtxDestroy(cuContext));
+    }
 }
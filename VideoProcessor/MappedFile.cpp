@@ -0,0 +1,98 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& inPath)
+{
+    HANDLE file = CreateFileA(inPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    mFile = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        return;
+    }
+    mSize = (size_t)size.QuadPart;
+    mOpen = true;
+    if (mSize == 0) {
+        // Empty files cannot be mapped
+        return;
+    }
+
+    mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping) {
+        mOpen = false;
+        return;
+    }
+    mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mData) {
+        mOpen = false;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData) {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping) {
+        CloseHandle(mMapping);
+    }
+    if (mFile) {
+        CloseHandle(mFile);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& inPath)
+{
+    mFile = open(inPath.c_str(), O_RDONLY);
+    if (mFile < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(mFile, &st) != 0) {
+        return;
+    }
+    mSize = (size_t)st.st_size;
+    mOpen = true;
+    if (mSize == 0) {
+        return;
+    }
+
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (data == MAP_FAILED) {
+        mOpen = false;
+        return;
+    }
+    // Aggressive read-ahead, pages behind the parser can be dropped early
+    madvise(data, mSize, MADV_SEQUENTIAL);
+    mData = (const uint8_t*)data;
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData) {
+        munmap((void*)mData, mSize);
+    }
+    if (mFile >= 0) {
+        close(mFile);
+    }
+}
+
+#endif
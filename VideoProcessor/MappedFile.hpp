@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file, hinted for sequential access.
+// Check with operator bool like a stream; data() stays valid for the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& inPath);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    explicit operator bool() const { return mOpen; }
+
+    const uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    bool mOpen = false;
+#ifdef _WIN32
+    void* mFile = nullptr;
+    void* mMapping = nullptr;
+#else
+    int mFile = -1;
+#endif
+};
@@ -0,0 +1,303 @@
+#include "MkvDemuxer.hpp"
+
+#include "Telemetry.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Element IDs, marker bits included
+const uint32_t kEbmlHeader = 0x1A45DFA3;
+const uint32_t kSegment = 0x18538067;
+const uint32_t kSeekHead = 0x114D9B74;
+const uint32_t kInfo = 0x1549A966;
+const uint32_t kTimecodeScale = 0x2AD7B1;
+const uint32_t kTracks = 0x1654AE6B;
+const uint32_t kTrackEntry = 0xAE;
+const uint32_t kTrackNumber = 0xD7;
+const uint32_t kTrackType = 0x83;
+const uint32_t kCodecId = 0x86;
+const uint32_t kCodecPrivate = 0x63A2;
+const uint32_t kContentEncodings = 0x6D80;
+const uint32_t kVideo = 0xE0;
+const uint32_t kPixelWidth = 0xB0;
+const uint32_t kPixelHeight = 0xBA;
+const uint32_t kCluster = 0x1F43B675;
+const uint32_t kTimecode = 0xE7;
+const uint32_t kSimpleBlock = 0xA3;
+const uint32_t kBlockGroup = 0xA0;
+const uint32_t kBlock = 0xA1;
+const uint32_t kReferenceBlock = 0xFB;
+const uint32_t kCues = 0x1C53BB6B;
+const uint32_t kChapters = 0x1043A770;
+const uint32_t kTags = 0x1254C367;
+const uint32_t kAttachments = 0x1941A469;
+
+const int kTrackTypeVideo = 1;
+
+// Elements that end a cluster (or anything else) of unknown size
+bool IsTopLevel(uint32_t inId) {
+    return inId == kCluster || inId == kSeekHead || inId == kInfo || inId == kTracks || inId == kCues
+        || inId == kChapters || inId == kTags || inId == kAttachments || inId == kSegment || inId == kEbmlHeader;
+}
+
+// A variable length integer: the count of leading zero bits of the first byte is the count of
+// bytes that follow. IDs keep the length marker bit, sizes and track numbers do not.
+bool ReadVint(const uint8_t*& ioPosition, const uint8_t* inEnd, int inMaxLength, bool inKeepMarker, uint64_t& outValue,
+    bool* outAllOnes = nullptr)
+{
+    if (ioPosition >= inEnd || *ioPosition == 0) {
+        return false;
+    }
+    int length = 1;
+    while (!(*ioPosition & (0x80 >> (length - 1)))) {
+        length++;
+    }
+    if (length > inMaxLength || inEnd - ioPosition < length) {
+        return false;
+    }
+    const uint8_t marker = (uint8_t)(0x80 >> (length - 1));
+    uint64_t value = inKeepMarker ? *ioPosition : (*ioPosition & (marker - 1));
+    bool allOnes = (*ioPosition & (marker - 1)) == marker - 1;
+    for (int i = 1; i < length; i++) {
+        value = (value << 8) | ioPosition[i];
+        allOnes = allOnes && ioPosition[i] == 0xFF;
+    }
+    ioPosition += length;
+    outValue = value;
+    if (outAllOnes) {
+        *outAllOnes = allOnes;
+    }
+    return true;
+}
+
+// Payload of an element, after its header. An element of unknown size reaches to inEnd.
+struct Element {
+    uint32_t id = 0;
+    const uint8_t* begin = nullptr;
+    const uint8_t* end = nullptr;
+    bool unknownSize = false;
+};
+
+// Reads the element header at ioPosition and moves past the whole element, or only the header
+// for an unknown size. An element overrunning inEnd (a truncated file) is cut at inEnd.
+bool ReadElement(const uint8_t*& ioPosition, const uint8_t* inEnd, Element& outElement) {
+    const uint8_t* p = ioPosition;
+    uint64_t id = 0, size = 0;
+    bool unknownSize = false;
+    if (!ReadVint(p, inEnd, 4, true, id) || !ReadVint(p, inEnd, 8, false, size, &unknownSize)) {
+        return false;
+    }
+    outElement.id = (uint32_t)id;
+    outElement.begin = p;
+    outElement.unknownSize = unknownSize;
+    outElement.end = unknownSize || size > (uint64_t)(inEnd - p) ? inEnd : p + size;
+    ioPosition = unknownSize ? p : outElement.end;
+    return true;
+}
+
+uint64_t ReadUnsigned(const Element& inElement) {
+    uint64_t value = 0;
+    for (const uint8_t* p = inElement.begin; p < inElement.end && p < inElement.begin + 8; p++) {
+        value = (value << 8) | *p;
+    }
+    return value;
+}
+
+}
+
+MkvDemuxer::MkvDemuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight)
+    : ContainerDemuxer(inData, inSize, inUnitsInFlight)
+{
+    const uint8_t* p = mData;
+    const uint8_t* pEnd = mData + mSize;
+    Element element;
+    if (!ReadElement(p, pEnd, element) || element.id != kEbmlHeader || element.unknownSize) {
+        return;
+    }
+    if (!ReadElement(p, pEnd, element) || element.id != kSegment) {
+        LOG_ERROR("Matroska: no segment");
+        return;
+    }
+    p = element.begin;
+    mSegmentEnd = element.end;
+
+    // The header, up to the first cluster
+    while (ReadElement(p, mSegmentEnd, element)) {
+        if (element.id == kCluster) {
+            mPosition = element.begin;
+            mClusterEnd = element.end;
+            break;
+        }
+        if (element.unknownSize) {
+            break;
+        }
+        const uint8_t* pChild = element.begin;
+        Element child;
+        if (element.id == kInfo) {
+            while (ReadElement(pChild, element.end, child)) {
+                if (child.id == kTimecodeScale && ReadUnsigned(child)) {
+                    mTimecodeScale = ReadUnsigned(child);
+                }
+            }
+        } else if (element.id == kTracks) {
+            while (!mTrackNumber && ReadElement(pChild, element.end, child)) {
+                if (child.id == kTrackEntry) {
+                    parseTrackEntry(child.begin, child.end);
+                }
+            }
+        }
+    }
+    mOpen = mTrackNumber != 0 && mPosition != nullptr;
+    if (mOpen) {
+        allocateBuffers();
+    }
+}
+
+bool
+MkvDemuxer::parseTrackEntry(const uint8_t* inBegin, const uint8_t* inEnd)
+{
+    uint64_t number = 0, type = 0;
+    std::string codec;
+    Element codecPrivate;
+    int width = 0, height = 0;
+    bool encoded = false;
+    Element element;
+    while (ReadElement(inBegin, inEnd, element)) {
+        switch (element.id) {
+        case kTrackNumber:
+            number = ReadUnsigned(element);
+            break;
+        case kTrackType:
+            type = ReadUnsigned(element);
+            break;
+        case kCodecId:
+            codec.assign((const char*)element.begin, element.end - element.begin);
+            codec.resize(strnlen(codec.c_str(), codec.size()));
+            break;
+        case kCodecPrivate:
+            codecPrivate = element;
+            break;
+        case kContentEncodings:
+            encoded = true;
+            break;
+        case kVideo: {
+            const uint8_t* p = element.begin;
+            Element child;
+            while (ReadElement(p, element.end, child)) {
+                if (child.id == kPixelWidth) {
+                    width = (int)ReadUnsigned(child);
+                } else if (child.id == kPixelHeight) {
+                    height = (int)ReadUnsigned(child);
+                }
+            }
+            break;
+        }
+        }
+    }
+    if (type != kTrackTypeVideo || !number) {
+        return false;
+    }
+    if (encoded) {
+        LOG_WARNING("Matroska: track " << number << " is compressed or encrypted, skipped");
+        return false;
+    }
+    const size_t privateSize = codecPrivate.end - codecPrivate.begin;
+    if (codec == "V_MPEG4/ISO/AVC") {
+        if (!ParseAvcConfig(codecPrivate.begin, privateSize, mTrack)) {
+            LOG_ERROR("Matroska: invalid AVC CodecPrivate in track " << number);
+            return false;
+        }
+    } else if (codec == "V_MPEGH/ISO/HEVC") {
+        if (!ParseHevcConfig(codecPrivate.begin, privateSize, mTrack)) {
+            LOG_ERROR("Matroska: invalid HEVC CodecPrivate in track " << number);
+            return false;
+        }
+    } else {
+        return false;
+    }
+    mTrackNumber = number;
+    mTrack.width = width;
+    mTrack.height = height;
+    return true;
+}
+
+bool
+MkvDemuxer::next(AccessUnit& outUnit)
+{
+    Element element;
+    while (mPosition) {
+        if (mClusterEnd && mPosition >= mClusterEnd) {
+            mClusterEnd = nullptr;
+        }
+        if (!ReadElement(mPosition, mClusterEnd ? mClusterEnd : mSegmentEnd, element)) {
+            mPosition = nullptr;
+            break;
+        }
+        if (IsTopLevel(element.id)) {
+            mClusterEnd = nullptr;
+            if (element.id == kCluster) {
+                // Into the cluster, element by element
+                mPosition = element.begin;
+                mClusterEnd = element.end;
+                mClusterTimecode = 0;
+                continue;
+            }
+        }
+        if (element.unknownSize && element.id != kCluster) {
+            LOG_WARNING("Matroska: element " << std::hex << element.id << std::dec << " of unknown size, stopped");
+            mPosition = nullptr;
+            break;
+        }
+        if (!mClusterEnd) {
+            continue;
+        }
+        if (element.id == kTimecode) {
+            mClusterTimecode = (int64_t)ReadUnsigned(element);
+        } else if (element.id == kSimpleBlock) {
+            if (readBlock(element.begin, element.end, true, false, outUnit)) {
+                return true;
+            }
+        } else if (element.id == kBlockGroup) {
+            const uint8_t* p = element.begin;
+            Element child, block;
+            bool keyframe = true;
+            while (ReadElement(p, element.end, child)) {
+                if (child.id == kBlock) {
+                    block = child;
+                } else if (child.id == kReferenceBlock) {
+                    keyframe = false;
+                }
+            }
+            if (block.begin && readBlock(block.begin, block.end, false, keyframe, outUnit)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool
+MkvDemuxer::readBlock(const uint8_t* inBegin, const uint8_t* inEnd, bool inSimpleBlock, bool inKeyframe,
+    AccessUnit& outUnit)
+{
+    // Track number, signed 16 bit timecode relative to the cluster, flags
+    const uint8_t* p = inBegin;
+    uint64_t track = 0;
+    if (!ReadVint(p, inEnd, 8, false, track) || inEnd - p < 3 || track != mTrackNumber) {
+        return false;
+    }
+    const int16_t timecode = (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+    const uint8_t flags = p[2];
+    p += 3;
+    if (flags & 0x06) {
+        if (!mWarnedLacing) {
+            LOG_WARNING("Matroska: laced video blocks are not supported, skipped");
+            mWarnedLacing = true;
+        }
+        return false;
+    }
+    const int64_t pts = (mClusterTimecode + timecode) * (int64_t)mTimecodeScale / 1000;
+    return emit(p, inEnd - p, pts, inSimpleBlock ? (flags & 0x80) != 0 : inKeyframe, outUnit);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ContainerDemuxer.hpp"
+
+#include <cstdint>
+
+// Demuxes the first H.264 (V_MPEG4/ISO/AVC) or HEVC (V_MPEGH/ISO/HEVC) video track of a
+// Matroska or WebM file. The header is read up to the first cluster; next() then walks the
+// clusters in file order, one SimpleBlock or BlockGroup at a time, without any index. Clusters
+// and segments of unknown size (live muxers) end at the next top level element. Laced blocks,
+// which video tracks do not use, are skipped.
+class MkvDemuxer : public ContainerDemuxer {
+public:
+    MkvDemuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight = 64);
+
+    bool next(AccessUnit& outUnit) override;
+
+private:
+    bool parseTrackEntry(const uint8_t* inBegin, const uint8_t* inEnd);
+    // inKeyframe is for a Block, a SimpleBlock has its own flag
+    bool readBlock(const uint8_t* inBegin, const uint8_t* inEnd, bool inSimpleBlock, bool inKeyframe, AccessUnit& outUnit);
+
+    uint64_t mTrackNumber = 0;
+    uint64_t mTimecodeScale = 1000000;      // Nanoseconds per timecode tick
+    const uint8_t* mPosition = nullptr;     // Next element to read
+    const uint8_t* mSegmentEnd = nullptr;
+    const uint8_t* mClusterEnd = nullptr;   // Set while inside a cluster
+    int64_t mClusterTimecode = 0;
+    bool mWarnedLacing = false;
+};
@@ -0,0 +1,224 @@
+#include "MosaicCompositor.hpp"
+
+#include "Telemetry.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+std::vector<MosaicTile>
+MakeMosaicGrid(int inWidth, int inHeight, int inColumns, int inRows, int inGap)
+{
+    std::vector<MosaicTile> tiles;
+    if (inColumns <= 0 || inRows <= 0) {
+        return tiles;
+    }
+    for (int row = 0; row < inRows; row++) {
+        for (int column = 0; column < inColumns; column++) {
+            // Edges from the exact fractions, so rounding never leaves a strip uncovered
+            MosaicTile tile;
+            tile.x = (int)((int64_t)inWidth * column / inColumns);
+            tile.y = (int)((int64_t)inHeight * row / inRows);
+            tile.width = (int)((int64_t)inWidth * (column + 1) / inColumns) - tile.x - (column + 1 < inColumns ? inGap : 0);
+            tile.height = (int)((int64_t)inHeight * (row + 1) / inRows) - tile.y - (row + 1 < inRows ? inGap : 0);
+            tiles.push_back(tile);
+        }
+    }
+    return tiles;
+}
+
+MosaicCompositor::MosaicCompositor(const MosaicConfig& inConfig)
+    : mConfig(inConfig)
+{
+    mConfig.width &= ~1;
+    mConfig.height &= ~1;
+    if (mConfig.width <= 0 || mConfig.height <= 0) {
+        std::cerr << "Invalid mosaic size " << mConfig.width << "x" << mConfig.height << std::endl;
+        throw std::exception();
+    }
+    mPitch = mConfig.width * 4;
+    // Opaque black, what an empty or letterboxed tile shows
+    mCanvas.resize((size_t)mPitch * mConfig.height);
+    for (size_t i = 0; i < mCanvas.size(); i += 4) {
+        mCanvas[i + 3] = 0xFF;
+    }
+
+    for (const MosaicTile& area : mConfig.tiles) {
+        std::unique_ptr<Tile> tile(new Tile);
+        // Clipped to the canvas
+        tile->area.x = std::max(0, std::min(area.x, mConfig.width));
+        tile->area.y = std::max(0, std::min(area.y, mConfig.height));
+        tile->area.width = std::max(0, std::min(area.x + area.width, mConfig.width) - tile->area.x);
+        tile->area.height = std::max(0, std::min(area.y + area.height, mConfig.height) - tile->area.y);
+        mTiles.push_back(std::move(tile));
+    }
+    mDirty.reserve(mTiles.size());
+}
+
+void
+MosaicCompositor::submit(int inTile, const FrameHandle& inFrame)
+{
+    if (inTile < 0 || inTile >= (int)mTiles.size() || !inFrame) {
+        return;
+    }
+    const FrameInfo& info = inFrame.info();
+    if (info.bpp != 1) {
+        if (!mWarnedFormat.exchange(true)) {
+            LOG_WARNING("Mosaic: 16 bit frames are not shown, the scaler takes NV12 only");
+        }
+        return;
+    }
+
+    Tile& tile = *mTiles[inTile];
+    const bool device = inFrame.getMemoryType() == FrameMemoryType::Device;
+    std::vector<uint8_t> host;
+    if (device) {
+        if (!mConfig.downloadFrame) {
+            std::cerr << "A mosaic of device frames needs MosaicConfig::downloadFrame" << std::endl;
+            throw std::exception();
+        }
+        // Downloaded outside the lock, so composite() never waits for a transfer
+        {
+            std::lock_guard<std::mutex> lock(tile.lock);
+            host.swap(tile.spareHost);
+        }
+        host.resize((size_t)info.pitch * (info.height + (info.height + 1) / 2));
+        mConfig.downloadFrame(inFrame, host.data(), host.size());
+    }
+
+    std::lock_guard<std::mutex> lock(tile.lock);
+    if (tile.dirty) {
+        mFramesReplaced++;
+    }
+    tile.pendingInfo = info;
+    if (device) {
+        tile.pendingFrame.reset();
+        tile.pendingHost.swap(host);
+        // The buffer it replaced serves the next download
+        tile.spareHost.swap(host);
+    } else {
+        tile.pendingFrame = inFrame;
+    }
+    tile.dirty = true;
+}
+
+int
+MosaicCompositor::composite()
+{
+    mDirty.clear();
+    for (std::unique_ptr<Tile>& tile : mTiles) {
+        std::lock_guard<std::mutex> lock(tile->lock);
+        if (!tile->dirty) {
+            continue;
+        }
+        // The pending side becomes the drawing side, a source goes on filling the other one
+        std::swap(tile->frame, tile->pendingFrame);
+        std::swap(tile->host, tile->pendingHost);
+        tile->info = tile->pendingInfo;
+        tile->pendingFrame.reset();
+        tile->dirty = false;
+        mDirty.push_back(tile.get());
+    }
+    mComposites++;
+    mTilesSkipped += mTiles.size() - mDirty.size();
+    if (mDirty.empty()) {
+        return 0;
+    }
+
+    ThreadPool* pThreadPool = mConfig.pThreadPool;
+    const int threadCount = pThreadPool ? pThreadPool->getThreadCount() : 1;
+    if (threadCount > 1 && (int)mDirty.size() >= threadCount) {
+        // Whole tiles per thread, no synchronization inside a tile
+        pThreadPool->parallelFor((int)mDirty.size(), [&](int inBegin, int inEnd) {
+            for (int i = inBegin; i < inEnd; i++) {
+                drawTile(*mDirty[i], nullptr);
+            }
+        });
+    } else {
+        for (Tile* pTile : mDirty) {
+            drawTile(*pTile, pThreadPool);
+        }
+    }
+    for (Tile* pTile : mDirty) {
+        if (pTile->info.pts != kNoPts && (mPts == kNoPts || pTile->info.pts > mPts)) {
+            mPts = pTile->info.pts;
+        }
+        // Back to the source's pool before the next composite
+        pTile->frame.reset();
+    }
+    mTilesDrawn += mDirty.size();
+    return (int)mDirty.size();
+}
+
+void
+MosaicCompositor::drawTile(Tile& ioTile, ThreadPool* pThreadPool)
+{
+    const FrameInfo& info = ioTile.info;
+    const MosaicTile& area = ioTile.area;
+    if (area.width < 2 || area.height < 2 || info.width <= 0 || info.height <= 0) {
+        return;
+    }
+
+    MosaicTile content = area;
+    if (mConfig.keepAspect) {
+        // Fit the frame into the tile, centered
+        if ((int64_t)info.width * area.height > (int64_t)info.height * area.width) {
+            content.height = (int)((int64_t)area.width * info.height / info.width);
+        } else {
+            content.width = (int)((int64_t)area.height * info.width / info.height);
+        }
+        content.width = std::max(2, content.width & ~1);
+        content.height = std::max(2, content.height & ~1);
+        content.x = area.x + (area.width - content.width) / 2;
+        content.y = area.y + (area.height - content.height) / 2;
+    }
+    if (content.x != ioTile.content.x || content.y != ioTile.content.y || content.width != ioTile.content.width
+        || content.height != ioTile.content.height) {
+        // New layout of the tile, e.g. the source changed resolution: clear the bars once
+        for (int y = area.y; y < area.y + area.height; y++) {
+            uint8_t* pRow = mCanvas.data() + (size_t)y * mPitch + (size_t)area.x * 4;
+            for (int x = 0; x < area.width; x++) {
+                pRow[4 * x] = pRow[4 * x + 1] = pRow[4 * x + 2] = 0;
+                pRow[4 * x + 3] = 0xFF;
+            }
+        }
+        ioTile.content = content;
+    }
+
+    ScaleOutput output;
+    output.data = mCanvas.data() + (size_t)content.y * mPitch + (size_t)content.x * 4;
+    output.pitch = mPitch;
+    output.width = content.width;
+    output.height = content.height;
+    const uint8_t* pNv12 = ioTile.frame ? ioTile.frame.data() : ioTile.host.data();
+    Nv12ScaleToColor32Host<BGRA32>(pNv12, info.pitch, info.width, info.height, CropRect(), &output, 1, mConfig.filter,
+        info.matrix, pThreadPool);
+}
+
+SinkFrame
+MosaicCompositor::getCanvas() const
+{
+    SinkFrame canvas;
+    canvas.data = mCanvas.data();
+    canvas.memoryType = FrameMemoryType::Host;
+    canvas.format = SinkFormat::Bgra;
+    canvas.width = mConfig.width;
+    canvas.height = mConfig.height;
+    canvas.pitch = mPitch;
+    canvas.timestamp = (int64_t)mComposites;
+    canvas.pts = mPts;
+    return canvas;
+}
+
+void
+MosaicCompositor::printStatistics(std::ostream& inStream) const
+{
+    const uint64_t tiles = mTilesDrawn + mTilesSkipped;
+    inStream << "Mosaic: " << mTiles.size() << " tiles on " << mConfig.width << "x" << mConfig.height << ", "
+        << mComposites << " composites, " << mTilesDrawn << " tiles drawn, " << mTilesSkipped << " clean ("
+        << (tiles ? 100.0 * mTilesSkipped / tiles : 0) << "% skipped), " << mFramesReplaced
+        << " frames replaced before drawn" << std::endl;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "FramePool.hpp"
+#include "FrameSink.hpp"
+#include "HostScaleConvert.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+class ThreadPool;
+
+// Where one source goes on the canvas, in pixels
+struct MosaicTile {
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+};
+
+struct MosaicConfig {
+    int width = 3840, height = 2160;        // Canvas, rounded down to even
+    std::vector<MosaicTile> tiles;          // One per source, any layout, see MakeMosaicGrid()
+    ScaleFilter filter = ScaleFilter::Area;
+    bool keepAspect = true;                 // Letterbox or pillarbox a feed inside its tile
+    ThreadPool* pThreadPool = nullptr;
+    // Copies a device frame (NVDEC) into inSize bytes of host memory, called by submit()
+    std::function<void(const FrameHandle& inFrame, uint8_t* outHost, size_t inSize)> downloadFrame;
+};
+
+// inColumns x inRows equal tiles covering an inWidth x inHeight canvas, row by row, with inGap
+// pixels between them
+std::vector<MosaicTile> MakeMosaicGrid(int inWidth, int inHeight, int inColumns, int inRows, int inGap = 0);
+
+// Video wall output: tiles the newest frame of many sources into one BGRA canvas. Sources
+// submit() from whatever thread decodes them; a tile keeps only the newest frame, so a slow
+// composite never holds a decoder back by more than one frame. composite() redraws only the
+// tiles that got a frame since the last composite, each scaled and converted straight into its
+// canvas region by the fused host scaler. Many dirty tiles are spread over the thread pool a
+// whole tile per thread, a few are split into strips instead.
+class MosaicCompositor {
+public:
+    explicit MosaicCompositor(const MosaicConfig& inConfig);
+
+    MosaicCompositor(const MosaicCompositor&) = delete;
+    MosaicCompositor& operator=(const MosaicCompositor&) = delete;
+
+    int getTileCount() const { return (int)mTiles.size(); }
+
+    // Thread safe. Hands the newest frame of source inTile over, replacing a frame not drawn
+    // yet. Host frames are kept until drawn, device frames are downloaded right away, without
+    // holding up composite(). Sources beyond the layout are ignored.
+    void submit(int inTile, const FrameHandle& inFrame);
+
+    // Redraws the dirty tiles, one thread at a time. Returns how many were redrawn.
+    int composite();
+
+    // The BGRA host canvas, valid until the next composite()
+    SinkFrame getCanvas() const;
+
+    uint64_t getComposites() const { return mComposites; }
+    uint64_t getTilesDrawn() const { return mTilesDrawn; }
+    // Tiles left as they were because their source had nothing new
+    uint64_t getTilesSkipped() const { return mTilesSkipped; }
+    // Frames replaced by a newer one before they were drawn
+    uint64_t getFramesReplaced() const { return mFramesReplaced; }
+
+    void printStatistics(std::ostream& inStream) const;
+
+private:
+    struct Tile {
+        MosaicTile area;
+        // Written by submit()
+        std::mutex lock;
+        FrameHandle pendingFrame;
+        std::vector<uint8_t> pendingHost;
+        std::vector<uint8_t> spareHost;     // What the next download goes into
+        FrameInfo pendingInfo;
+        bool dirty = false;
+        // Compositor only: what is being drawn, swapped with the pending side
+        FrameHandle frame;
+        std::vector<uint8_t> host;
+        FrameInfo info;
+        MosaicTile content;                 // Where the last frame went, the rest is background
+    };
+
+    void drawTile(Tile& ioTile, ThreadPool* pThreadPool);
+
+    MosaicConfig mConfig;
+    std::vector<std::unique_ptr<Tile>> mTiles;
+    std::vector<uint8_t> mCanvas;
+    int mPitch = 0;
+    int64_t mPts = kNoPts;                  // Newest PTS on the canvas
+    std::vector<Tile*> mDirty;
+
+    std::atomic<uint64_t> mComposites{ 0 };
+    std::atomic<uint64_t> mTilesDrawn{ 0 };
+    std::atomic<uint64_t> mTilesSkipped{ 0 };
+    std::atomic<uint64_t> mFramesReplaced{ 0 };
+    std::atomic<bool> mWarnedFormat{ false };
+};
@@ -0,0 +1,327 @@
+#include "Mp4Demuxer.hpp"
+
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+inline uint32_t ReadBe16(const uint8_t* p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+inline uint32_t ReadBe32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline uint64_t ReadBe64(const uint8_t* p) {
+    return ((uint64_t)ReadBe32(p) << 32) | ReadBe32(p + 4);
+}
+
+constexpr uint32_t FourCc(const char (&inType)[5]) {
+    return ((uint32_t)(uint8_t)inType[0] << 24) | ((uint32_t)(uint8_t)inType[1] << 16)
+        | ((uint32_t)(uint8_t)inType[2] << 8) | (uint32_t)(uint8_t)inType[3];
+}
+
+// Payload of a box, after its header
+struct Box {
+    uint32_t type = 0;
+    const uint8_t* begin = nullptr;
+    const uint8_t* end = nullptr;
+
+    size_t size() const { return end - begin; }
+    explicit operator bool() const { return begin != nullptr; }
+};
+
+// Reads the box at ioPosition and moves past it. Returns false at inEnd or on a box that does
+// not fit, which ends the enclosing box.
+bool ReadBox(const uint8_t*& ioPosition, const uint8_t* inEnd, Box& outBox) {
+    const uint8_t* p = ioPosition;
+    if (inEnd - p < 8) {
+        return false;
+    }
+    uint64_t size = ReadBe32(p);
+    outBox.type = ReadBe32(p + 4);
+    size_t header = 8;
+    if (size == 1) {
+        if (inEnd - p < 16) {
+            return false;
+        }
+        size = ReadBe64(p + 8);
+        header = 16;
+    } else if (size == 0) {
+        // Up to the end of the file, only for the last box
+        size = inEnd - p;
+    }
+    if (size < header || size > (uint64_t)(inEnd - p)) {
+        return false;
+    }
+    outBox.begin = p + header;
+    outBox.end = p + size;
+    ioPosition = outBox.end;
+    return true;
+}
+
+Box FindBox(const uint8_t* inBegin, const uint8_t* inEnd, uint32_t inType) {
+    Box box;
+    while (ReadBox(inBegin, inEnd, box)) {
+        if (box.type == inType) {
+            return box;
+        }
+    }
+    return Box();
+}
+
+// A full box's table: version and flags, entry count, then inEntrySize bytes per entry. Returns
+// the entries, null if the box is missing or too short for its count.
+const uint8_t* TableEntries(const Box& inBox, size_t inEntrySize, uint32_t& outCount) {
+    outCount = 0;
+    if (!inBox || inBox.size() < 8) {
+        return nullptr;
+    }
+    const uint32_t count = ReadBe32(inBox.begin + 4);
+    if ((uint64_t)count * inEntrySize > inBox.size() - 8) {
+        return nullptr;
+    }
+    outCount = count;
+    return inBox.begin + 8;
+}
+
+}
+
+Mp4Demuxer::Mp4Demuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight)
+    : ContainerDemuxer(inData, inSize, inUnitsInFlight)
+{
+    const uint8_t* p = mData;
+    const uint8_t* pEnd = mData + mSize;
+    bool fragmented = false;
+    Box box;
+    while (ReadBox(p, pEnd, box)) {
+        if (box.type == FourCc("moof")) {
+            fragmented = true;
+        }
+        if (box.type != FourCc("moov") || mOpen) {
+            continue;
+        }
+        const uint8_t* pTrack = box.begin;
+        Box track;
+        while (!mOpen && ReadBox(pTrack, box.end, track)) {
+            if (track.type == FourCc("trak")) {
+                mOpen = parseTrack(track.begin, track.end);
+            }
+        }
+    }
+    if (mOpen) {
+        allocateBuffers();
+    } else if (fragmented) {
+        LOG_ERROR("Fragmented MP4 files (moof) are not supported");
+    }
+}
+
+bool
+Mp4Demuxer::parseTrack(const uint8_t* inBegin, const uint8_t* inEnd)
+{
+    const Box media = FindBox(inBegin, inEnd, FourCc("mdia"));
+    if (!media) {
+        return false;
+    }
+    // hdlr: version and flags, pre_defined, handler_type
+    const Box handler = FindBox(media.begin, media.end, FourCc("hdlr"));
+    if (!handler || handler.size() < 12 || ReadBe32(handler.begin + 8) != FourCc("vide")) {
+        return false;
+    }
+    const Box header = FindBox(media.begin, media.end, FourCc("mdhd"));
+    if (!header || header.size() < 24) {
+        return false;
+    }
+    // Version 1 has 64 bit creation and modification times in front of the timescale
+    const uint32_t timescale = ReadBe32(header.begin + (header.begin[0] == 1 ? 20 : 12));
+    const Box info = FindBox(media.begin, media.end, FourCc("minf"));
+    const Box table = info ? FindBox(info.begin, info.end, FourCc("stbl")) : Box();
+    if (!table || !timescale) {
+        return false;
+    }
+
+    // stsd: version and flags, entry count, then the first sample entry. A visual sample entry
+    // has 78 bytes of fields (width and height at 24) in front of its child boxes.
+    const Box descriptions = FindBox(table.begin, table.end, FourCc("stsd"));
+    const uint8_t* pEntry = descriptions ? descriptions.begin + 8 : nullptr;
+    Box entry;
+    if (!descriptions || descriptions.size() < 8 || !ReadBox(pEntry, descriptions.end, entry) || entry.size() < 78) {
+        return false;
+    }
+    if (entry.type == FourCc("avc1") || entry.type == FourCc("avc3")) {
+        const Box config = FindBox(entry.begin + 78, entry.end, FourCc("avcC"));
+        if (!config || !ParseAvcConfig(config.begin, config.size(), mTrack)) {
+            LOG_ERROR("MP4: invalid avcC box");
+            return false;
+        }
+    } else if (entry.type == FourCc("hvc1") || entry.type == FourCc("hev1")) {
+        const Box config = FindBox(entry.begin + 78, entry.end, FourCc("hvcC"));
+        if (!config || !ParseHevcConfig(config.begin, config.size(), mTrack)) {
+            LOG_ERROR("MP4: invalid hvcC box");
+            return false;
+        }
+    } else {
+        return false;
+    }
+    mTrack.width = (int)ReadBe16(entry.begin + 24);
+    mTrack.height = (int)ReadBe16(entry.begin + 26);
+
+    // Sample sizes: stsz with a constant size or 32 bit entries, or stz2 with 4, 8 or 16 bit ones
+    std::vector<uint32_t> sizes;
+    const Box sampleSizes = FindBox(table.begin, table.end, FourCc("stsz"));
+    const Box compactSizes = FindBox(table.begin, table.end, FourCc("stz2"));
+    if (sampleSizes && sampleSizes.size() >= 12) {
+        const uint32_t constant = ReadBe32(sampleSizes.begin + 4);
+        const uint32_t count = ReadBe32(sampleSizes.begin + 8);
+        if (constant) {
+            // Not a table the box has to hold, only a count: at most what fits in the file
+            if (count > mSize / constant) {
+                LOG_ERROR("MP4: stsz claims " << count << " samples of " << constant << " bytes, more than the file holds");
+                return false;
+            }
+            sizes.assign(count, constant);
+        } else if ((uint64_t)count * 4 <= sampleSizes.size() - 12) {
+            sizes.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                sizes[i] = ReadBe32(sampleSizes.begin + 12 + 4 * i);
+            }
+        }
+    } else if (compactSizes && compactSizes.size() >= 12) {
+        const int fieldSize = compactSizes.begin[7];
+        const uint32_t count = ReadBe32(compactSizes.begin + 8);
+        const uint8_t* pSizes = compactSizes.begin + 12;
+        if ((fieldSize == 4 || fieldSize == 8 || fieldSize == 16)
+            && ((uint64_t)count * fieldSize + 7) / 8 <= compactSizes.size() - 12) {
+            sizes.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                sizes[i] = fieldSize == 16 ? ReadBe16(pSizes + 2 * i)
+                    : fieldSize == 8 ? pSizes[i]
+                    : (pSizes[i / 2] >> (i & 1 ? 0 : 4)) & 0xF;
+            }
+        }
+    }
+    if (sizes.empty()) {
+        return false;
+    }
+
+    // Chunk offsets, 32 or 64 bit
+    std::vector<uint64_t> chunks;
+    uint32_t chunkCount = 0;
+    if (const uint8_t* pOffsets = TableEntries(FindBox(table.begin, table.end, FourCc("stco")), 4, chunkCount)) {
+        chunks.resize(chunkCount);
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            chunks[i] = ReadBe32(pOffsets + 4 * i);
+        }
+    } else if (const uint8_t* pOffsets64 = TableEntries(FindBox(table.begin, table.end, FourCc("co64")), 8, chunkCount)) {
+        chunks.resize(chunkCount);
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            chunks[i] = ReadBe64(pOffsets64 + 8 * i);
+        }
+    }
+
+    // Samples per chunk, as runs: first_chunk (1 based), samples_per_chunk, sample_description_index
+    mSamples.resize(sizes.size());
+    uint32_t runCount = 0;
+    const uint8_t* pRuns = TableEntries(FindBox(table.begin, table.end, FourCc("stsc")), 12, runCount);
+    size_t sample = 0;
+    for (uint32_t run = 0; pRuns && run < runCount && sample < mSamples.size(); run++) {
+        const uint32_t firstChunk = ReadBe32(pRuns + 12 * run);
+        const uint32_t perChunk = ReadBe32(pRuns + 12 * run + 4);
+        const uint32_t lastChunk = run + 1 < runCount ? ReadBe32(pRuns + 12 * (run + 1)) : chunkCount + 1;
+        for (uint32_t chunk = std::max(firstChunk, 1u); chunk < lastChunk && chunk <= chunkCount; chunk++) {
+            uint64_t offset = chunks[chunk - 1];
+            for (uint32_t i = 0; i < perChunk && sample < mSamples.size(); i++, sample++) {
+                mSamples[sample].offset = offset;
+                mSamples[sample].size = sizes[sample];
+                offset += sizes[sample];
+            }
+        }
+    }
+    if (sample < mSamples.size()) {
+        LOG_WARNING("MP4: the chunk tables place " << sample << " of " << mSamples.size() << " samples");
+        mSamples.resize(sample);
+    }
+
+    // Decode times from the stts runs, composition offsets from the ctts runs (signed in version
+    // 1, and in practice in version 0 too), shifted by the start of the first non-empty edit
+    int64_t mediaStart = 0;
+    const Box edits = FindBox(inBegin, inEnd, FourCc("edts"));
+    const Box editList = edits ? FindBox(edits.begin, edits.end, FourCc("elst")) : Box();
+    const bool longEdits = editList && editList.size() >= 4 && editList.begin[0] == 1;
+    uint32_t editCount = 0;
+    if (const uint8_t* pEdits = TableEntries(editList, longEdits ? 20 : 12, editCount)) {
+        for (uint32_t i = 0; i < editCount; i++) {
+            const int64_t mediaTime = longEdits ? (int64_t)ReadBe64(pEdits + 20 * i + 8) : (int32_t)ReadBe32(pEdits + 12 * i + 4);
+            if (mediaTime >= 0) {
+                mediaStart = mediaTime;
+                break;
+            }
+        }
+    }
+    std::vector<int64_t> times(mSamples.size(), 0);
+    uint32_t deltaCount = 0;
+    const uint8_t* pDeltas = TableEntries(FindBox(table.begin, table.end, FourCc("stts")), 8, deltaCount);
+    int64_t dts = 0;
+    sample = 0;
+    for (uint32_t run = 0; pDeltas && run < deltaCount; run++) {
+        const uint32_t count = ReadBe32(pDeltas + 8 * run);
+        const uint32_t delta = ReadBe32(pDeltas + 8 * run + 4);
+        for (uint32_t i = 0; i < count && sample < times.size(); i++, sample++) {
+            times[sample] = dts;
+            dts += delta;
+        }
+    }
+    uint32_t offsetCount = 0;
+    const uint8_t* pOffsets = TableEntries(FindBox(table.begin, table.end, FourCc("ctts")), 8, offsetCount);
+    sample = 0;
+    for (uint32_t run = 0; pOffsets && run < offsetCount; run++) {
+        const uint32_t count = ReadBe32(pOffsets + 8 * run);
+        const int32_t offset = (int32_t)ReadBe32(pOffsets + 8 * run + 4);
+        for (uint32_t i = 0; i < count && sample < times.size(); i++, sample++) {
+            times[sample] += offset;
+        }
+    }
+
+    // Sync samples (1 based); without stss every sample is one
+    uint32_t syncCount = 0;
+    const uint8_t* pSync = TableEntries(FindBox(table.begin, table.end, FourCc("stss")), 4, syncCount);
+    for (Sample& s : mSamples) {
+        s.keyframe = pSync == nullptr;
+    }
+    for (uint32_t i = 0; i < syncCount; i++) {
+        const uint32_t number = ReadBe32(pSync + 4 * i);
+        if (number >= 1 && number <= mSamples.size()) {
+            mSamples[number - 1].keyframe = true;
+        }
+    }
+
+    for (size_t i = 0; i < mSamples.size(); i++) {
+        const Sample& s = mSamples[i];
+        if (s.offset > mSize || s.size > mSize - s.offset) {
+            // Before the buffers are sized for it: a sample size is whatever the file says
+            LOG_WARNING("MP4: sample " << i << " at " << s.offset << " is past the end of the file, the file is truncated");
+            mSamples.resize(i);
+            break;
+        }
+        mSamples[i].pts = (times[i] - mediaStart) * 1000000 / timescale;
+        mTrack.maxSampleSize = std::max(mTrack.maxSampleSize, (size_t)s.size);
+    }
+    mTrack.sampleCount = (int64_t)mSamples.size();
+    return !mSamples.empty();
+}
+
+bool
+Mp4Demuxer::next(AccessUnit& outUnit)
+{
+    while (mNextSample < mSamples.size()) {
+        // Samples past the end of the file were dropped when the tables were read
+        const Sample& sample = mSamples[mNextSample++];
+        if (emit(mData + sample.offset, sample.size, sample.pts, sample.keyframe, outUnit)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ContainerDemuxer.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Demuxes the first H.264 (avc1/avc3) or HEVC (hvc1/hev1) video track of an ISO base media file
+// (MP4, MOV). The moov box is read once up front into a flat table of sample offsets, sizes,
+// presentation times and sync flags; next() then walks that table, so mdat is read once, in file
+// order for an interleaved file. Fragmented files (moof) are not supported.
+class Mp4Demuxer : public ContainerDemuxer {
+public:
+    Mp4Demuxer(const uint8_t* inData, size_t inSize, int inUnitsInFlight = 64);
+
+    bool next(AccessUnit& outUnit) override;
+
+private:
+    struct Sample {
+        uint64_t offset;
+        uint32_t size;
+        bool keyframe;
+        int64_t pts;                        // Microseconds
+    };
+
+    bool parseTrack(const uint8_t* inBegin, const uint8_t* inEnd);
+
+    std::vector<Sample> mSamples;
+    size_t mNextSample = 0;
+};
@@ -1,12 +1,12 @@
-#include "Decoder.hpp"
+#include "NvDecoder.hpp"
 
+#include "DeviceFrameAllocator.hpp"
 #include "Utils.hpp"
 
-#define START_TIMER auto start = std::chrono::high_resolution_clock::now();
-#define STOP_TIMER(print_message) std::cout << print_message << \
-    std::chrono::duration_cast<std::chrono::milliseconds>( \
-    std::chrono::high_resolution_clock::now() - start).count() \
-    << " ms " << std::endl;
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 
 static const char* GetVideoCodecString(cudaVideoCodec eCodec) {
     static struct {
@@ -62,22 +62,37 @@ static const char* GetVideoChromaFormatString(cudaVideoChromaFormat eChromaForma
 }
 
 
-Decoder::Decoder(CUcontext inCuContext)
+NvDecoder::NvDecoder(CUcontext inCuContext, const FramePoolConfig& inPoolConfig, const DecodeProfile& inProfile,
+    VideoCodec inCodec, CUvideoctxlock inCtxLock)
 	: mCuContext(inCuContext)
-    , mCtxLock(nullptr)
+    , mProfile(inProfile)
+    , mCtxLock(inCtxLock)
+    , mOwnCtxLock(inCtxLock == nullptr)
     , mParser(nullptr)
     , mDecoder(nullptr)
     , mCuvidStream(0)
-    , mDecodedFrame(0)
-    , mDecodedFrameReturned(0)
 {
-    NVDEC_API_CALL(cuvidCtxLockCreate(&mCtxLock, mCuContext));
+    FramePoolConfig poolConfig = inPoolConfig;
+    if (poolConfig.capacity <= 0) {
+        // 8 for the balanced profile
+        poolConfig.capacity = 4 + 2 * mProfile.displayDelay + mProfile.outputSurfaces;
+    }
+    if (poolConfig.mapSurfaces && poolConfig.capacity > 64) {
+        // Most output surfaces NVDEC can keep mapped at once
+        poolConfig.capacity = 64;
+    }
+    mFramePool.reset(new FramePool(std::unique_ptr<FrameAllocator>(new DeviceFrameAllocator(mCuContext)), poolConfig));
+
+    if (mOwnCtxLock) {
+        NVDEC_API_CALL(cuvidCtxLockCreate(&mCtxLock, mCuContext));
+    }
 
     CUVIDPARSERPARAMS videoParserParameters = {};
-    videoParserParameters.CodecType = cudaVideoCodec_H264;
+    videoParserParameters.CodecType = inCodec == VideoCodec::Hevc ? cudaVideoCodec_HEVC : cudaVideoCodec_H264;
     videoParserParameters.ulMaxNumDecodeSurfaces = 1;
     videoParserParameters.ulClockRate = 0;
-    videoParserParameters.ulMaxDisplayDelay = 1;
+    // 0 hands every picture out right after it was decoded, more lets decoding run ahead of display
+    videoParserParameters.ulMaxDisplayDelay = mProfile.displayDelay;
     videoParserParameters.pUserData = this;
     videoParserParameters.pfnSequenceCallback = HandleVideoSequenceProc;
     videoParserParameters.pfnDecodePicture = HandlePictureDecodeProc;
@@ -86,63 +101,51 @@ Decoder::Decoder(CUcontext inCuContext)
     NVDEC_API_CALL(cuvidCreateVideoParser(&mParser, &videoParserParameters));
 }
 
-Decoder::~Decoder()
+NvDecoder::~NvDecoder()
 {
     if (mParser) {
         cuvidDestroyVideoParser(mParser);
     }
+    // Unmaps surfaces of frames nobody fetched, while the decoder still exists
+    mReadyFrames.clear();
+
     cuCtxPushCurrent(mCuContext);
     if (mDecoder) {
         cuvidDestroyDecoder(mDecoder);
     }
-
-    {
-        std::lock_guard<std::mutex> lock(mVPFrameLock);
-        for (CUdeviceptr pFrame : mVPFrames) {
-            cuMemFree(pFrame);
-        }
-    }
     cuCtxPopCurrent(NULL);
 
-    cuvidCtxLockDestroy(mCtxLock);
+    if (mOwnCtxLock) {
+        cuvidCtxLockDestroy(mCtxLock);
+    }
 }
 
 int
-Decoder::decode(uint8_t* inData, size_t inLength)
+NvDecoder::decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp, bool inAccessUnit)
 {
-    mDecodedFrame = 0;
-    mDecodedFrameReturned = 0;
     CUVIDSOURCEDATAPACKET packet = { 0 };
     packet.payload = inData;
     packet.payload_size = static_cast<unsigned long>(inLength);
     packet.flags = 0 | CUVID_PKT_TIMESTAMP;
-    packet.timestamp = 0;
+    packet.timestamp = inTimestamp;
+    if (inAccessUnit) {
+        packet.flags |= CUVID_PKT_ENDOFPICTURE;
+    }
     if (!inData || inLength == 0) {
         packet.flags |= CUVID_PKT_ENDOFSTREAM;
     }
     NVDEC_API_CALL(cuvidParseVideoData(mParser, &packet));
     mCuvidStream = 0;
 
-    return mDecodedFrame;
-}
-
-CUdeviceptr
-Decoder::getFrame()
-{
-    if (mDecodedFrame > 0) {
-        std::lock_guard<std::mutex> lock(mVPFrameLock);
-        mDecodedFrame--;
-        return mVPFrames[mDecodedFrameReturned++];
-    }
-    return 0;
+    return (int)mReadyFrames.size();
 }
 
 
 int
-Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
+NvDecoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
 {
-    START_TIMER
-    std::cout << "Video Input Information" << std::endl
+    auto start = std::chrono::steady_clock::now();
+    LOG_INFO("Video Input Information" << std::endl
         << "\tCodec        : " << GetVideoCodecString(pVideoFormat->codec) << std::endl
         << "\tFrame rate   : " << pVideoFormat->frame_rate.numerator << "/" << pVideoFormat->frame_rate.denominator
         << " = " << 1.0 * pVideoFormat->frame_rate.numerator / pVideoFormat->frame_rate.denominator << " fps" << std::endl
@@ -151,10 +154,11 @@ Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
         << "\tDisplay area : [" << pVideoFormat->display_area.left << ", " << pVideoFormat->display_area.top << ", "
         << pVideoFormat->display_area.right << ", " << pVideoFormat->display_area.bottom << "]" << std::endl
         << "\tChroma       : " << GetVideoChromaFormatString(pVideoFormat->chroma_format) << std::endl
-        << "\tBit depth    : " << pVideoFormat->bit_depth_luma_minus8 + 8
-        << std::endl;
+        << "\tBit depth    : " << pVideoFormat->bit_depth_luma_minus8 + 8);
 
-    int decodeSurface = pVideoFormat->min_num_decode_surfaces;
+    // Surfaces on top of the minimum let the hardware decode ahead while frames are displayed
+    const int kMaxDecodeSurfaces = 32;
+    int decodeSurface = (std::min)(pVideoFormat->min_num_decode_surfaces + mProfile.extraDecodeSurfaces, kMaxDecodeSurfaces);
 
     CUVIDDECODECAPS decodecaps;
     memset(&decodecaps, 0, sizeof(decodecaps));
@@ -167,33 +171,25 @@ Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
     NVDEC_API_CALL(cuvidGetDecoderCaps(&decodecaps));
     CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
 
+    // A rejected sequence is not decoded at all: every picture of it is an error
     if (!decodecaps.bIsSupported) {
-        std::cerr << "Codec not supported on this GPU" << std::endl;
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("Codec " << GetVideoCodecString(pVideoFormat->codec) << " not supported on this GPU");
         return decodeSurface;
     }
 
     if ((pVideoFormat->coded_width > decodecaps.nMaxWidth) ||
         (pVideoFormat->coded_height > decodecaps.nMaxHeight)) {
-        std::ostringstream errorString;
-        errorString << std::endl
-            << "Resolution          : " << pVideoFormat->coded_width << "x" << pVideoFormat->coded_height << std::endl
-            << "Max Supported (wxh) : " << decodecaps.nMaxWidth << "x" << decodecaps.nMaxHeight << std::endl
-            << "Resolution not supported on this GPU";
-
-        const std::string cErr = errorString.str();
-        std::cerr << cErr << std::endl;
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("Resolution " << pVideoFormat->coded_width << "x" << pVideoFormat->coded_height
+            << " not supported on this GPU, max " << decodecaps.nMaxWidth << "x" << decodecaps.nMaxHeight);
         return decodeSurface;
     }
 
     if ((pVideoFormat->coded_width >> 4) * (pVideoFormat->coded_height >> 4) > decodecaps.nMaxMBCount) {
-        std::ostringstream errorString;
-        errorString << std::endl
-            << "MBCount             : " << (pVideoFormat->coded_width >> 4) * (pVideoFormat->coded_height >> 4) << std::endl
-            << "Max Supported mbcnt : " << decodecaps.nMaxMBCount << std::endl
-            << "MBCount not supported on this GPU";
-
-        const std::string cErr = errorString.str();
-        std::cerr << cErr << std::endl;
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("MBCount " << (pVideoFormat->coded_width >> 4) * (pVideoFormat->coded_height >> 4)
+            << " not supported on this GPU, max " << decodecaps.nMaxMBCount);
         return decodeSurface;
     }
 
@@ -209,11 +205,22 @@ Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
     mBPP = mBitDepthMinus8 > 0 ? 2 : 1;
     // Check if output format supported. If not, check falback options
     if (!(decodecaps.nOutputFormatMask & (1 << mOutputFormat))) {
-        std::cerr << "No supported output format found" << std::endl;
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("No supported output format found");
+        AsyncLogger::get().flush();
         throw std::exception();
     }
 
     mVideoFormat = *pVideoFormat;
+    mFormat.codedWidth = pVideoFormat->coded_width;
+    mFormat.codedHeight = pVideoFormat->coded_height;
+    mFormat.frameRateNum = pVideoFormat->frame_rate.numerator;
+    mFormat.frameRateDen = pVideoFormat->frame_rate.denominator;
+    mFormat.bitDepth = pVideoFormat->bit_depth_luma_minus8 + 8;
+    mFormat.matrixCoefficients = pVideoFormat->video_signal_description.matrix_coefficients;
+    mFormat.progressive = pVideoFormat->progressive_sequence != 0;
+    mFormat.displayRect = { pVideoFormat->display_area.left, pVideoFormat->display_area.top,
+        pVideoFormat->display_area.right, pVideoFormat->display_area.bottom };
 
     CUVIDDECODECREATEINFO videoDecodeCreateInfo = { 0 };
     videoDecodeCreateInfo.CodecType = pVideoFormat->codec;
@@ -224,7 +231,8 @@ Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
         videoDecodeCreateInfo.DeinterlaceMode = cudaVideoDeinterlaceMode_Weave;
     else
         videoDecodeCreateInfo.DeinterlaceMode = cudaVideoDeinterlaceMode_Adaptive;
-    videoDecodeCreateInfo.ulNumOutputSurfaces = 2;
+    // Mapped frames hold an output surface until released
+    videoDecodeCreateInfo.ulNumOutputSurfaces = mFramePool->getConfig().mapSurfaces ? mFramePool->getConfig().capacity : mProfile.outputSurfaces;
     // With PreferCUVID, JPEG is still decoded by CUDA while video is decoded by NVDEC hardware
     videoDecodeCreateInfo.ulCreationFlags = cudaVideoCreate_PreferCUVID;
     videoDecodeCreateInfo.ulNumDecodeSurfaces = decodeSurface;
@@ -255,27 +263,29 @@ Decoder::HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat)
     mDisplayRect.l = videoDecodeCreateInfo.display_area.left;
     mDisplayRect.r = videoDecodeCreateInfo.display_area.right;
 
-    std::cout << "Video Decoding Params:" << std::endl
+    LOG_INFO("Video Decoding Params:" << std::endl
         << "\tNum Surfaces : " << videoDecodeCreateInfo.ulNumDecodeSurfaces << std::endl
         << "\tCrop         : [" << videoDecodeCreateInfo.display_area.left << ", " << videoDecodeCreateInfo.display_area.top << ", "
         << videoDecodeCreateInfo.display_area.right << ", " << videoDecodeCreateInfo.display_area.bottom << "]" << std::endl
         << "\tResize       : " << videoDecodeCreateInfo.ulTargetWidth << "x" << videoDecodeCreateInfo.ulTargetHeight << std::endl
-        << "\tDeinterlace  : " << std::vector<const char*>{"Weave", "Bob", "Adaptive"} [videoDecodeCreateInfo.DeinterlaceMode]
-        << std::endl;
+        << "\tDeinterlace  : " << (std::vector<const char*>{"Weave", "Bob", "Adaptive"} [videoDecodeCreateInfo.DeinterlaceMode]));
 
     CUDA_DRVAPI_CALL(cuCtxPushCurrent(mCuContext));
     NVDEC_API_CALL(cuvidCreateDecoder(&mDecoder, &videoDecodeCreateInfo));
     CUDA_DRVAPI_CALL(cuCtxPopCurrent(nullptr));
-    STOP_TIMER("Session Initialization Time: ");
+    LOG_INFO("Session Initialization Time: "
+        << (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()) << " ms");
     return decodeSurface;
 }
 
 int
-Decoder::HandlePictureDecode(CUVIDPICPARAMS* pPicParams)
+NvDecoder::HandlePictureDecode(CUVIDPICPARAMS* pPicParams)
 {
     if (!mDecoder)
     {
-        std::cerr << "Decoder not initialized." << std::endl;
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("Decoder not initialized");
+        AsyncLogger::get().flush();
         throw std::exception();
         return 0;
     }
@@ -286,8 +296,18 @@ Decoder::HandlePictureDecode(CUVIDPICPARAMS* pPicParams)
 }
 
 int
-Decoder::HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo)
+NvDecoder::HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo)
 {
+    // The mapped surface can only stand in for a frame when its UV plane starts right after
+    // the luma plane, NVDEC aligns the luma height by 2
+    const bool mapSurface = mFramePool->getConfig().mapSurfaces && (mSurfaceHeight & 1) == 0;
+
+    // Get the slot before mapping, waiting for it must not hold an output surface
+    FrameHandle frame = AcquireFrame(mapSurface ? 0 : GetFrameSize());
+    if (!frame) {
+        return 1;
+    }
+
     CUVIDPROCPARAMS videoProcessingParameters = {};
     videoProcessingParameters.progressive_frame = pDispInfo->progressive_frame;
     videoProcessingParameters.second_field = pDispInfo->repeat_first_field + 1;
@@ -303,23 +323,40 @@ Decoder::HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo)
     CUVIDGETDECODESTATUS DecodeStatus;
     memset(&DecodeStatus, 0, sizeof(DecodeStatus));
     CUresult result = cuvidGetDecodeStatus(mDecoder, pDispInfo->picture_index, &DecodeStatus);
-    if (result == CUDA_SUCCESS && (DecodeStatus.decodeStatus == cuvidDecodeStatus_Error
-        || DecodeStatus.decodeStatus == cuvidDecodeStatus_Error_Concealed)) {
-        std::cerr << "Decode Error occurred for picture" << std::endl;
+    if (result == CUDA_SUCCESS && DecodeStatus.decodeStatus == cuvidDecodeStatus_Error) {
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_WARNING("Decode Error occurred for picture");
+    } else if (result == CUDA_SUCCESS && DecodeStatus.decodeStatus == cuvidDecodeStatus_Error_Concealed) {
+        Telemetry::Count(TelemetryCounter::FramesConcealed);
+        LOG_WARNING("Decode Error occurred for picture, concealed");
     }
 
-    CUdeviceptr pDecodedFrame = 0;
-    {
-        std::lock_guard<std::mutex> lock(mVPFrameLock);
-        if ((unsigned)++mDecodedFrame > mVPFrames.size()) {
-            // Not enough frames in stock
-            CUdeviceptr pFrame = 0;
-            CUDA_DRVAPI_CALL(cuMemAlloc((CUdeviceptr*)&pFrame, GetFrameSize()));
-            mVPFrames.push_back(pFrame);
-        }
-        pDecodedFrame = mVPFrames[mDecodedFrame - 1];
+    FrameInfo& info = frame.info();
+    info.width = GetWidth();
+    info.height = mLumaHeight;
+    info.bpp = mBPP;
+    info.matrix = mFormat.matrixCoefficients;
+    info.timestamp = pDispInfo->timestamp;
+
+    if (mapSurface) {
+        // No copy: the surface stays mapped until the last handle is released
+        CUvideodecoder decoder = mDecoder;
+        frame.setExternal((uint8_t*)dpSrcFrame, [decoder, dpSrcFrame]() {
+            CUresult result = cuvidUnmapVideoFrame(decoder, dpSrcFrame);
+            if (result != CUDA_SUCCESS) {
+                Telemetry::Count(TelemetryCounter::DecodeErrors);
+                LOG_ERROR("cuvidUnmapVideoFrame returned error " << result);
+            }
+        });
+        info.pitch = nSrcPitch;
+        CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+        mReadyFrames.push_back(frame);
+        return 1;
     }
 
+    CUdeviceptr pDecodedFrame = (CUdeviceptr)frame.data();
+    info.pitch = GetWidth() * mBPP;
+
     // Copy luma plane
     CUDA_MEMCPY2D m = { 0 };
     m.srcMemoryType = CU_MEMORYTYPE_DEVICE;
@@ -327,7 +364,7 @@ Decoder::HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo)
     m.srcPitch = nSrcPitch;
     m.dstMemoryType = CU_MEMORYTYPE_DEVICE;
     m.dstDevice = pDecodedFrame;
-    m.dstPitch = GetWidth() * mBPP;
+    m.dstPitch = info.pitch;
     m.WidthInBytes = GetWidth() * mBPP;
     m.Height = mLumaHeight;
     CUDA_DRVAPI_CALL(cuMemcpy2DAsync(&m, mCuvidStream));
@@ -343,17 +380,18 @@ Decoder::HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo)
     CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
 
     NVDEC_API_CALL(cuvidUnmapVideoFrame(mDecoder, dpSrcFrame));
+    mReadyFrames.push_back(frame);
     return 1;
 }
 
 int
-Decoder::GetOperatingPoint(CUVIDOPERATINGPOINTINFO* pOPInfo)
+NvDecoder::GetOperatingPoint(CUVIDOPERATINGPOINTINFO* pOPInfo)
 {
     return -1;
 }
 
 int
-Decoder::ReconfigureDecoder(CUVIDEOFORMAT* pVideoFormat)
+NvDecoder::ReconfigureDecoder(CUVIDEOFORMAT* pVideoFormat)
 {
     return -1;
 }
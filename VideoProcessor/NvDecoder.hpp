@@ -0,0 +1,66 @@
+#pragma once
+
+#include "DecodeProfile.hpp"
+#include "Decoder.hpp"
+
+#include <cuda.h>
+#include <cuviddec.h>
+#include <nvcuvid.h>
+
+#include <cstdint>
+#include <vector>
+
+// NVDEC hardware backend. Frames are handed out in device memory: pool buffers the decoded
+// surface is copied into, or with FramePoolConfig::mapSurfaces the mapped surface itself.
+// The profile sets the display delay and surface counts; the default pool capacity covers the
+// pictures held back by the display delay, the output surfaces and a few frames downstream.
+// Decoders sharing a context should share one inCtxLock, created with cuvidCtxLockCreate() and
+// destroyed after them; without one the decoder creates its own.
+class NvDecoder : public Decoder {
+public:
+	NvDecoder(CUcontext inCuContext, const FramePoolConfig& inPoolConfig = FramePoolConfig(),
+        const DecodeProfile& inProfile = DecodeProfile(), VideoCodec inCodec = VideoCodec::H264,
+        CUvideoctxlock inCtxLock = nullptr);
+
+	~NvDecoder();
+
+	int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp = 0, bool inAccessUnit = false) override;
+
+    const char* getName() const override { return "nvdec"; }
+
+    CUVIDEOFORMAT GetVideoFormatInfo() { return mVideoFormat; }
+
+private:
+    struct Rect {
+        int l, t, r, b;
+    };
+
+    static int CUDAAPI HandleVideoSequenceProc(void* pUserData, CUVIDEOFORMAT* pVideoFormat) { return ((NvDecoder*)pUserData)->HandleVideoSequence(pVideoFormat); }
+    static int CUDAAPI HandlePictureDecodeProc(void* pUserData, CUVIDPICPARAMS* pPicParams) { return ((NvDecoder*)pUserData)->HandlePictureDecode(pPicParams); }
+    static int CUDAAPI HandlePictureDisplayProc(void* pUserData, CUVIDPARSERDISPINFO* pDispInfo) { return ((NvDecoder*)pUserData)->HandlePictureDisplay(pDispInfo); }
+    static int CUDAAPI HandleOperatingPointProc(void* pUserData, CUVIDOPERATINGPOINTINFO* pOPInfo) { return ((NvDecoder*)pUserData)->GetOperatingPoint(pOPInfo); }
+
+    int HandleVideoSequence(CUVIDEOFORMAT* pVideoFormat);
+    int HandlePictureDecode(CUVIDPICPARAMS* pPicParams);
+    int HandlePictureDisplay(CUVIDPARSERDISPINFO* pDispInfo);
+    int GetOperatingPoint(CUVIDOPERATINGPOINTINFO* pOPInfo);
+    int ReconfigureDecoder(CUVIDEOFORMAT* pVideoFormat);
+
+	CUcontext mCuContext;
+    DecodeProfile mProfile;
+	CUvideoctxlock mCtxLock;
+    bool mOwnCtxLock;
+	CUvideoparser mParser;
+	CUvideodecoder mDecoder;
+    CUstream mCuvidStream;
+
+    int mSurfaceHeight = 0;
+    int mSurfaceWidth = 0;
+    cudaVideoCodec mCodec = cudaVideoCodec_NumCodecs;
+    cudaVideoChromaFormat mChromaFormat = cudaVideoChromaFormat_420;
+    cudaVideoSurfaceFormat mOutputFormat = cudaVideoSurfaceFormat_NV12;
+    int mBitDepthMinus8 = 0;
+    CUVIDEOFORMAT mVideoFormat = {};
+    unsigned int m_nMaxWidth = 0, m_nMaxHeight = 0;
+    Rect mDisplayRect = {};
+};
@@ -0,0 +1,495 @@
+#include "Pipeline.hpp"
+
+#include "HostColorSpace.hpp"
+#include "Telemetry.hpp"
+#include "Utils.hpp"
+
+#include <cuda.h>
+#include "ColorSpace.h"
+#include "NvCodecUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+namespace {
+
+const char* kStageNames[] = { "read", "decode", "convert", "output" };
+
+// Adds the wall time of its scope to a stage's busy time and latency histogram, and to the
+// trace while tracing
+class BusyTimer {
+public:
+    BusyTimer(std::atomic<uint64_t>& ioBusyNs, LatencyHistogram& ioLatency, const char* inTraceName)
+        : mBusyNs(ioBusyNs), mLatency(ioLatency), mTrace(inTraceName), mStart(std::chrono::steady_clock::now()) {}
+    ~BusyTimer() {
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count();
+        mBusyNs.fetch_add(ns, std::memory_order_relaxed);
+        mLatency.record(ns);
+    }
+
+private:
+    std::atomic<uint64_t>& mBusyNs;
+    LatencyHistogram& mLatency;
+    TraceScope mTrace;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+}
+
+Pipeline::Pipeline(const PipelineConfig& inConfig, PacketSource& inPacketizer, Decoder& inDecoder,
+    FrameSink& inSink, CUcontext inCuContext)
+    : mConfig(inConfig)
+    , mPacketizer(inPacketizer)
+    , mDecoder(inDecoder)
+    , mSink(inSink)
+    , mCuContext(inCuContext)
+    , mPackets(inConfig.packetQueueDepth)
+    , mFrames(inConfig.frameQueueDepth)
+    , mImages(inConfig.imageQueueDepth)
+    , mFreeImages(inConfig.imageQueueDepth)
+    , mImageBuffers(mImages.capacity())
+    , mClock(inConfig.presentation)
+    , mSceneAnalyzer(inConfig.sceneAnalysis)
+    , mAnalyzeLatency(&Telemetry::get().getHistogram("stage_latency_seconds", "stage=\"analyze\""))
+{
+    mPreroll = mConfig.firstFrame > 0;
+    for (int i = 0; i < (int)mImageBuffers.size(); i++) {
+        mFreeImages.push(i);
+    }
+    if (!mConfig.filterGraph.empty()) {
+        DisplayerConfig displayerConfig;
+        displayerConfig.graph = mConfig.filterGraph;
+        displayerConfig.fuse = mConfig.fuseFilters;
+        // The frames queued for output or read by the sink, plus two intermediate ones
+        displayerConfig.poolCapacity = mImages.capacity() + 3;
+        displayerConfig.pThreadPool = mConfig.pConvertPool;
+        mpDisplayer.reset(new Displayer(displayerConfig));
+        LOG_INFO("Filter graph: " << mpDisplayer->getDescription());
+    }
+    for (int stage = 0; stage < Stage_Count; stage++) {
+        mStageLatency[stage] = &Telemetry::get().getHistogram("stage_latency_seconds",
+            std::string("stage=\"") + kStageNames[stage] + "\"");
+    }
+}
+
+Pipeline::~Pipeline()
+{
+    if (mCuContext) {
+        cuCtxPushCurrent(mCuContext);
+    }
+    for (Buffer& buffer : mImageBuffers) {
+        FreeBuffer(buffer);
+    }
+    FreeBuffer(mUploadBuffer);
+    FreeBuffer(mDownloadBuffer);
+    FreeBuffer(mNarrowBuffer);
+    if (mCuContext) {
+        cuCtxPopCurrent(nullptr);
+    }
+}
+
+void
+Pipeline::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<NvThread> threads;
+        for (int stage = 0; stage < Stage_Count; stage++) {
+            threads.emplace_back(std::thread(&Pipeline::runStage, this, (Stage)stage));
+        }
+    }
+    mElapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    mSink.close();
+
+    if (mError) {
+        std::rethrow_exception(mError);
+    }
+}
+
+void
+Pipeline::printStatistics(std::ostream& inStream) const
+{
+    const uint64_t frames = mStatistics[Stage_Output].items;
+    inStream << "Pipeline (" << mSink.getName() << "): " << frames << " frames in " << mElapsedSeconds << " s = "
+        << (mElapsedSeconds > 0 ? frames / mElapsedSeconds : 0) << " fps" << std::endl;
+    for (int stage = 0; stage < Stage_Count; stage++) {
+        const uint64_t items = mStatistics[stage].items;
+        const double busy = mStatistics[stage].busyNs / 1e9;
+        inStream << "\t" << kStageNames[stage] << "\t: " << items << " items, busy " << busy << " s ("
+            << (mElapsedSeconds > 0 ? 100.0 * busy / mElapsedSeconds : 0) << "%)";
+        if (items) {
+            inStream << ", " << 1e3 * busy / items << " ms/item";
+        }
+        inStream << std::endl;
+    }
+    FramePool& framePool = mDecoder.GetFramePool();
+    inStream << "\tstalls\t: decode waited " << framePool.getWaits() << "x for a frame slot, convert waited "
+        << mFreeImages.getEmptyWaits() << "x for an image slot" << std::endl;
+    inStream << "\tframes\t: " << framePool.getAcquired() << " acquired, " << framePool.getDropped() << " dropped, "
+        << framePool.getPeakInUse() << "/" << framePool.getConfig().capacity << " slots in use at peak"
+        << (framePool.getConfig().mapSurfaces ? ", mapped surfaces" : "") << std::endl;
+    inStream << "\tlatency\t: read to decoded frame p50 " << mDecodeLatency.getPercentileMs(50) << " ms, p99 "
+        << mDecodeLatency.getPercentileMs(99) << " ms, max " << mDecodeLatency.getMaxMs() << " ms over "
+        << mDecodeLatency.getCount() << " frames" << std::endl;
+    if (mConfig.realTime) {
+        inStream << "\tclock\t: " << mClock.getPresented() << " frames presented, " << mClock.getDropped()
+            << " dropped late, lateness mean " << mClock.getMeanLatenessMs() << " ms, max " << mClock.getMaxLatenessMs()
+            << " ms, " << mClock.getResyncs() << " resyncs" << std::endl;
+    }
+    if (mConfig.analyzeScenes) {
+        inStream << "\tscenes\t: " << mSceneAnalyzer.getFrames() << " frames analyzed, " << mSceneAnalyzer.getSceneCuts()
+            << " scene cuts, " << mSceneAnalyzer.getStaticFrames() << " static, " << mStaticSkipped
+            << " static frames skipped" << std::endl;
+    }
+}
+
+void
+Pipeline::runStage(Stage inStage)
+{
+    try {
+        Telemetry::SetThreadName(kStageNames[inStage]);
+        if (inStage != Stage_Read && mCuContext) {
+            CUDA_DRVAPI_CALL(cuCtxSetCurrent(mCuContext));
+        }
+        switch (inStage) {
+        case Stage_Read:    readStage(); break;
+        case Stage_Decode:  decodeStage(); break;
+        case Stage_Convert: convertStage(); break;
+        case Stage_Output:  outputStage(); break;
+        default: break;
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mErrorLock);
+            if (!mError) {
+                mError = std::current_exception();
+            }
+        }
+        abort();
+    }
+}
+
+void
+Pipeline::abort()
+{
+    mPackets.close();
+    mFrames.close();
+    // Wakes the decoder if it waits for a frame slot
+    mDecoder.GetFramePool().close();
+    if (mpDisplayer) {
+        mpDisplayer->close();
+    }
+    mImages.close();
+    mFreeImages.close();
+}
+
+void
+Pipeline::readStage()
+{
+    PacketItem item;
+    while (true) {
+        {
+            BusyTimer timer(mStatistics[Stage_Read].busyNs, *mStageLatency[Stage_Read], kStageNames[Stage_Read]);
+            item.endOfStream = !mPacketizer.next(item.unit);
+            item.readNs = DecodeLatencyTracker::NowNs();
+        }
+        if (!mPackets.push(item) || item.endOfStream) {
+            return;
+        }
+        mStatistics[Stage_Read].items++;
+    }
+}
+
+void
+Pipeline::decodeStage()
+{
+    PacketItem packet;
+    while (mPackets.pop(packet)) {
+        int frameCount;
+        {
+            BusyTimer timer(mStatistics[Stage_Decode].busyNs, *mStageLatency[Stage_Decode], kStageNames[Stage_Decode]);
+            if (packet.endOfStream) {
+                frameCount = mDecoder.decode(nullptr, 0);
+            } else {
+                mDecodeLatency.submit(packet.unit.frameIndex, packet.readNs);
+                mPts.record(packet.unit.frameIndex, packet.unit.pts);
+                frameCount = mDecoder.decode(packet.unit.data, packet.unit.size, packet.unit.frameIndex, true);
+            }
+        }
+
+        const VideoFormat& format = mDecoder.GetVideoFormat();
+        while (frameCount--) {
+            FrameItem frame;
+            frame.frame = mDecoder.getFrame();
+            if (frame.frame) {
+                FrameInfo& info = frame.frame.info();
+                mDecodeLatency.complete(info.timestamp);
+                info.pts = mPts.stamp(info.timestamp, format.frameRateNum, format.frameRateDen);
+            }
+            if (mPreroll && frame.frame) {
+                if (frame.frame.info().timestamp != mConfig.firstFrame) {
+                    continue;
+                }
+                mPreroll = false;
+            }
+            frame.frameRateNum = format.frameRateNum;
+            frame.frameRateDen = format.frameRateDen;
+            frame.progressive = format.progressive || (frame.frame && frame.frame.getMemoryType() == FrameMemoryType::Device);
+            mStatistics[Stage_Decode].items++;
+            if (!mFrames.push(std::move(frame))) {
+                return;
+            }
+        }
+
+        if (packet.endOfStream) {
+            FrameItem endOfStream;
+            endOfStream.endOfStream = true;
+            mFrames.push(endOfStream);
+            return;
+        }
+    }
+}
+
+void
+Pipeline::convertStage()
+{
+    FrameItem frame;
+    while (mFrames.pop(frame)) {
+        ImageItem image;
+        image.endOfStream = frame.endOfStream;
+        if (frame.endOfStream) {
+            mImages.push(image);
+            return;
+        }
+        if (mConfig.realTime && mClock.shouldDrop(frame.frame.info().pts,
+            PtsTracker::GetFrameDuration(frame.frameRateNum, frame.frameRateDen))) {
+            // The consumer fell behind, skip the work instead of adding to the lag
+            Telemetry::Count(TelemetryCounter::FramesLate);
+            frame.frame.reset();
+            continue;
+        }
+        if (mConfig.analyzeScenes) {
+            FrameInfo& info = frame.frame.info();
+            if (info.bpp == 1) {
+                BusyTimer timer(mStatistics[Stage_Convert].busyNs, *mAnalyzeLatency, "analyze");
+                const uint8_t* pLuma = frame.frame.data();
+                if (frame.frame.getMemoryType() == FrameMemoryType::Device) {
+                    // The luma plane is all the analyzer reads
+                    EnsureBuffer(mDownloadBuffer, (size_t)info.pitch * info.height, FrameMemoryType::Host);
+                    CUDA_DRVAPI_CALL(cuMemcpyDtoH(mDownloadBuffer.data, (CUdeviceptr)pLuma, (size_t)info.pitch * info.height));
+                    pLuma = mDownloadBuffer.data;
+                }
+                info.analysis = mSceneAnalyzer.analyze(pLuma, info.pitch, info.width, info.height);
+                if (info.analysis.sceneCut) {
+                    Telemetry::Count(TelemetryCounter::SceneCuts);
+                }
+            }
+            mStaticRun = info.analysis.isStatic ? mStaticRun + 1 : 0;
+            if (mStaticRun && mConfig.staticFrameInterval > 0 && mStaticRun % mConfig.staticFrameInterval) {
+                // Nothing new to convert or show
+                Telemetry::Count(TelemetryCounter::FramesStatic);
+                mStaticSkipped++;
+                frame.frame.reset();
+                continue;
+            }
+        }
+        if (!mFreeImages.pop(image.slot)) {
+            return;
+        }
+
+        {
+            BusyTimer timer(mStatistics[Stage_Convert].busyNs, *mStageLatency[Stage_Convert], kStageNames[Stage_Convert]);
+            if (mpDisplayer) {
+                if (frame.frame.getMemoryType() == FrameMemoryType::Device && frame.frame.info().bpp == 1) {
+                    const FrameInfo& info = frame.frame.info();
+                    FrameHandle host = mpDisplayer->acquireFrame(info);
+                    if (!host) {
+                        return;
+                    }
+                    CUDA_DRVAPI_CALL(cuMemcpyDtoH(host.data(), (CUdeviceptr)frame.frame.data(),
+                        (size_t)info.pitch * (info.height + (info.height + 1) / 2)));
+                    frame.frame = std::move(host);
+                }
+                frame.frame = mpDisplayer->process(frame.frame, frame.progressive);
+                if (!frame.frame) {
+                    return;
+                }
+            }
+            const FrameHandle& source = frame.frame;
+            const FrameInfo& info = source.info();
+            SinkFrame& target = image.image;
+            target.width = info.width;
+            target.height = info.height;
+            target.timestamp = info.timestamp;
+            target.pts = info.pts;
+            target.frameRateNum = frame.frameRateNum;
+            target.frameRateDen = frame.frameRateDen;
+            target.analysis = info.analysis;
+            Buffer& buffer = mImageBuffers[image.slot];
+
+            const CropRect& crop = mConfig.crop;
+            const bool scale = mConfig.outputWidth > 0 || mConfig.outputHeight > 0
+                || (crop.right > crop.left && crop.bottom > crop.top);
+            if (mSink.getFormat() == SinkFormat::Bgra && scale) {
+                int nv12Pitch = 0;
+                const uint8_t* pNv12 = getHostNv12(source, nv12Pitch);
+                ScaleOutput output;
+                output.width = (mConfig.outputWidth > 0 ? mConfig.outputWidth : info.width) & ~1;
+                output.height = (mConfig.outputHeight > 0 ? mConfig.outputHeight : info.height) & ~1;
+                output.pitch = output.width * 4;
+                EnsureBuffer(buffer, (size_t)output.pitch * output.height, FrameMemoryType::Host);
+                output.data = buffer.data;
+                Nv12ScaleToColor32Host<BGRA32>(pNv12, nv12Pitch, info.width, info.height, crop, &output, 1,
+                    mConfig.scaleFilter, info.matrix, mConfig.pConvertPool);
+                target.format = SinkFormat::Bgra;
+                target.data = buffer.data;
+                target.memoryType = FrameMemoryType::Host;
+                target.width = output.width;
+                target.height = output.height;
+                target.pitch = output.pitch;
+            } else if (mSink.getFormat() == SinkFormat::Bgra) {
+                // The GPU kernels take NV12 only, P016 frames are narrowed and converted on the host
+                const bool hostConvert = (source.getMemoryType() == FrameMemoryType::Host && mConfig.hostConvert)
+                    || info.bpp == 2;
+                const int pitch = info.width * 4;
+                EnsureBuffer(buffer, (size_t)pitch * info.height, hostConvert ? FrameMemoryType::Host : FrameMemoryType::Device);
+                if (hostConvert) {
+                    int nv12Pitch = 0;
+                    const uint8_t* pNv12 = getHostNv12(source, nv12Pitch);
+                    Nv12ToColor32Host<BGRA32>(pNv12, nv12Pitch, buffer.data, pitch, info.width, info.height,
+                        info.matrix, mConfig.pConvertPool);
+                } else {
+                    uint8_t* pNv12 = source.data();
+                    if (source.getMemoryType() == FrameMemoryType::Host) {
+                        const size_t frameSize = (size_t)info.pitch * (info.height + (info.height + 1) / 2);
+                        EnsureBuffer(mUploadBuffer, frameSize, FrameMemoryType::Device);
+                        CUDA_DRVAPI_CALL(cuMemcpyHtoD((CUdeviceptr)mUploadBuffer.data, pNv12, frameSize));
+                        pNv12 = mUploadBuffer.data;
+                    }
+                    // The matrix only changes with a new sequence, so does the specialized kernel
+                    if (info.matrix != mConvertMatrix) {
+                        mConvert = GetNv12ToColor32<BGRA32>(info.matrix);
+                        mConvertMatrix = info.matrix;
+                    }
+                    mConvert(pNv12, info.pitch, buffer.data, pitch, info.width, info.height);
+                    CUDA_DRVAPI_CALL(cuStreamSynchronize(0));
+                }
+                target.format = SinkFormat::Bgra;
+                target.data = buffer.data;
+                target.memoryType = buffer.type;
+                target.pitch = pitch;
+            } else if (source.getMemoryType() == FrameMemoryType::Host || !mSink.needsHostMemory()) {
+                // The sink reads the decoded frame itself, no copy
+                target.data = source.data();
+                target.memoryType = source.getMemoryType();
+                target.pitch = info.pitch;
+                target.bpp = info.bpp;
+                image.frame = source;
+            } else {
+                const size_t frameSize = (size_t)info.pitch * (info.height + (info.height + 1) / 2);
+                EnsureBuffer(buffer, frameSize, FrameMemoryType::Host);
+                CUDA_DRVAPI_CALL(cuMemcpyDtoH(buffer.data, (CUdeviceptr)source.data(), frameSize));
+                target.data = buffer.data;
+                target.memoryType = FrameMemoryType::Host;
+                target.pitch = info.pitch;
+                target.bpp = info.bpp;
+            }
+        }
+        mStatistics[Stage_Convert].items++;
+
+        // Back to the decoder's pool (or unmapped) before waiting on the output stage, unless
+        // the sink reads it directly
+        frame.frame.reset();
+        if (!mImages.push(image)) {
+            return;
+        }
+    }
+}
+
+void
+Pipeline::outputStage()
+{
+    ImageItem image;
+    while (mImages.pop(image)) {
+        if (image.endOfStream) {
+            return;
+        }
+
+        if (mConfig.realTime) {
+            mClock.waitUntilDue(image.image.pts);
+        }
+        bool accepted;
+        {
+            BusyTimer timer(mStatistics[Stage_Output].busyNs, *mStageLatency[Stage_Output], kStageNames[Stage_Output]);
+            accepted = mSink.write(image.image);
+        }
+        image.frame.reset();
+        if (!accepted) {
+            // Window closed or output failed, stop everything upstream
+            abort();
+            return;
+        }
+        mStatistics[Stage_Output].items++;
+
+        if (!mFreeImages.push(image.slot)) {
+            return;
+        }
+    }
+}
+
+const uint8_t*
+Pipeline::getHostNv12(const FrameHandle& inFrame, int& outPitch)
+{
+    const FrameInfo& info = inFrame.info();
+    const uint8_t* pFrame = inFrame.data();
+    if (inFrame.getMemoryType() == FrameMemoryType::Device) {
+        const size_t frameSize = (size_t)info.pitch * (info.height + (info.height + 1) / 2);
+        EnsureBuffer(mDownloadBuffer, frameSize, FrameMemoryType::Host);
+        CUDA_DRVAPI_CALL(cuMemcpyDtoH(mDownloadBuffer.data, (CUdeviceptr)pFrame, frameSize));
+        pFrame = mDownloadBuffer.data;
+    }
+    outPitch = info.pitch;
+    if (info.bpp == 2) {
+        outPitch = (info.width + 1) & ~1;
+        EnsureBuffer(mNarrowBuffer, (size_t)outPitch * (info.height + (info.height + 1) / 2), FrameMemoryType::Host);
+        P016ToNv12Host(pFrame, info.pitch, mNarrowBuffer.data, outPitch, info.width, info.height);
+        pFrame = mNarrowBuffer.data;
+    }
+    return pFrame;
+}
+
+void
+Pipeline::EnsureBuffer(Buffer& ioBuffer, size_t inSize, FrameMemoryType inType)
+{
+    if (ioBuffer.data && ioBuffer.size >= inSize && ioBuffer.type == inType) {
+        return;
+    }
+    FreeBuffer(ioBuffer);
+    if (inType == FrameMemoryType::Device) {
+        CUdeviceptr dpBuffer = 0;
+        CUDA_DRVAPI_CALL(cuMemAlloc(&dpBuffer, inSize));
+        ioBuffer.data = (uint8_t*)dpBuffer;
+    } else {
+        ioBuffer.data = new uint8_t[inSize];
+    }
+    ioBuffer.size = inSize;
+    ioBuffer.type = inType;
+}
+
+void
+Pipeline::FreeBuffer(Buffer& ioBuffer)
+{
+    if (!ioBuffer.data) {
+        return;
+    }
+    if (ioBuffer.type == FrameMemoryType::Device) {
+        cuMemFree((CUdeviceptr)ioBuffer.data);
+    } else {
+        delete[] ioBuffer.data;
+    }
+    ioBuffer.data = nullptr;
+    ioBuffer.size = 0;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "DecodeProfile.hpp"
+#include "Decoder.hpp"
+#include "Displayer.hpp"
+#include "FrameSink.hpp"
+#include "HostScaleConvert.hpp"
+#include "PresentationClock.hpp"
+#include "SceneAnalyzer.hpp"
+#include "SpscQueue.hpp"
+#include "Telemetry.hpp"
+
+#include <cuda.h>
+#include "ColorSpace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct PipelineConfig {
+    int packetQueueDepth = 32;      // Access units between read and decode
+    int frameQueueDepth = 4;        // Decoded frames between decode and convert
+    int imageQueueDepth = 2;        // Converted images / frames between convert and output
+    bool hostConvert = false;       // Convert host frames on the CPU instead of uploading them first
+    // BGRA output size, 0 = frame size. Cropping or scaling runs the fused host scaler, device
+    // frames are downloaded for it.
+    int outputWidth = 0, outputHeight = 0;
+    CropRect crop;
+    ScaleFilter scaleFilter = ScaleFilter::Bilinear;
+    ThreadPool* pConvertPool = nullptr;
+    // The target of a StreamSeeker::seek(): decoded frames are dropped until the picture of this
+    // access unit comes out of the decoder. Frames come out in display order, so with reordering
+    // a reference decoded before the target may still follow it and is kept.
+    int64_t firstFrame = 0;
+    // Output paced by the frames' PTS, frames that are late already skip conversion
+    bool realTime = false;
+    PresentationConfig presentation;
+    // Scores every frame against the one before (FrameInfo::analysis, SinkFrame::analysis) at
+    // the start of the convert stage, before the filters and the conversion
+    bool analyzeScenes = false;
+    SceneAnalyzerConfig sceneAnalysis;
+    // With analysis: only every Nth frame of a static run is converted and output, 0 = all
+    int staticFrameInterval = 0;
+    // Filter graph run on every frame before conversion, see DisplayerConfig::graph. Device
+    // frames are downloaded for it.
+    std::string filterGraph;
+    bool fuseFilters = true;
+};
+
+// Runs read -> decode -> convert -> output with a dedicated thread per stage, connected by
+// bounded SPSC queues. A full queue stalls the stage in front of it, so the slowest stage sets
+// the pace and memory stays bounded by the queue depths. Decoded frames travel downstream as
+// FrameHandles and go back to the decoder's pool once converted. The convert stage gives the
+// sink what it asks for: BGRA images, or the decoded frames themselves (downloaded first if the
+// sink cannot read device memory). Images live in a fixed set of slots that come back through a
+// free-slot queue. End of stream flows through the queues as a marker and ends in FrameSink::close().
+// Every decoded frame gets a PTS, from its access unit or counted up at the frame rate; in real
+// time mode the output stage holds each frame back until it is due. Scene analysis and a filter
+// graph, if any, run at the start of the convert stage; static frames can be thinned out there.
+class Pipeline {
+public:
+    Pipeline(const PipelineConfig& inConfig, PacketSource& inPacketizer, Decoder& inDecoder,
+        FrameSink& inSink, CUcontext inCuContext);
+
+    ~Pipeline();
+
+    // Returns at end of stream or when the sink stops taking frames, the sink is closed either
+    // way. Rethrows the first exception raised by a stage. inCuContext may be null if neither
+    // the decoder nor the sink use the GPU.
+    void run();
+
+    // Frames the sink took
+    uint64_t getFrames() const { return mStatistics[Stage_Output].items; }
+
+    // From reading an access unit to getting its frame back from the decoder, so the packet
+    // queue counts, valid after run()
+    const DecodeLatencyTracker& getDecodeLatency() const { return mDecodeLatency; }
+
+    void printStatistics(std::ostream& inStream) const;
+
+private:
+    enum Stage {
+        Stage_Read,
+        Stage_Decode,
+        Stage_Convert,
+        Stage_Output,
+        Stage_Count
+    };
+
+    struct Buffer {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        FrameMemoryType type = FrameMemoryType::Host;
+    };
+
+    struct PacketItem {
+        AccessUnit unit;
+        int64_t readNs = 0;         // When the read stage submitted it, for the decode latency
+        bool endOfStream = false;
+    };
+
+    struct FrameItem {
+        FrameHandle frame;
+        int frameRateNum = 0, frameRateDen = 1;
+        // Interlaced frames NVDEC hands out are deinterlaced already
+        bool progressive = true;
+        bool endOfStream = false;
+    };
+
+    struct ImageItem {
+        int slot = -1;
+        FrameHandle frame;          // Set when image points into the decoded frame
+        SinkFrame image;
+        bool endOfStream = false;
+    };
+
+    struct StageStatistics {
+        std::atomic<uint64_t> items{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+    };
+
+    void readStage();
+    void decodeStage();
+    void convertStage();
+    void outputStage();
+    void runStage(Stage inStage);
+    void abort();
+
+    // inFrame as NV12 in host memory for the host scaler and converters: device frames are
+    // downloaded into mDownloadBuffer, P016 frames narrowed into mNarrowBuffer
+    const uint8_t* getHostNv12(const FrameHandle& inFrame, int& outPitch);
+
+    static void EnsureBuffer(Buffer& ioBuffer, size_t inSize, FrameMemoryType inType);
+    static void FreeBuffer(Buffer& ioBuffer);
+
+    PipelineConfig mConfig;
+    PacketSource& mPacketizer;
+    Decoder& mDecoder;
+    FrameSink& mSink;
+    CUcontext mCuContext;
+
+    // Before the queues, its frames may still be queued when they are destroyed
+    std::unique_ptr<Displayer> mpDisplayer;
+    SpscQueue<PacketItem> mPackets;
+    SpscQueue<FrameItem> mFrames;
+    SpscQueue<ImageItem> mImages;
+    SpscQueue<int> mFreeImages;
+
+    std::vector<Buffer> mImageBuffers;
+    // Host frames are uploaded here when converting on the GPU
+    Buffer mUploadBuffer;
+    // Device frames are downloaded here for the host scaler
+    Buffer mDownloadBuffer;
+    // P016 frames are narrowed to NV12 here for the host scaler and converters
+    Buffer mNarrowBuffer;
+    // GPU conversion for the matrix of the current sequence, convert stage only
+    int mConvertMatrix = -1;
+    Nv12ToColor32Func mConvert = nullptr;
+
+    std::mutex mErrorLock;
+    std::exception_ptr mError;
+    StageStatistics mStatistics[Stage_Count];
+    // Per item, process wide: every pipeline records into the same histograms
+    LatencyHistogram* mStageLatency[Stage_Count];
+    DecodeLatencyTracker mDecodeLatency;        // Decode stage only
+    PtsTracker mPts;                            // Decode stage only
+    bool mPreroll = false;                      // Decode stage only, firstFrame not out yet
+    PresentationClock mClock;
+    SceneAnalyzer mSceneAnalyzer;               // Convert stage only
+    LatencyHistogram* mAnalyzeLatency;
+    uint64_t mStaticRun = 0;                    // Static frames in a row, convert stage only
+    std::atomic<uint64_t> mStaticSkipped{ 0 };
+    double mElapsedSeconds = 0;
+};
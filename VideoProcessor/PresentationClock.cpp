@@ -0,0 +1,94 @@
+#include "PresentationClock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+void
+PtsTracker::record(int64_t inTimestamp, int64_t inPts)
+{
+    Pending& pending = mPending[inTimestamp & (kPendingCount - 1)];
+    pending.timestamp = inTimestamp;
+    pending.pts = inPts;
+}
+
+int64_t
+PtsTracker::stamp(int64_t inTimestamp, int inFrameRateNum, int inFrameRateDen)
+{
+    int64_t pts = kNoPts;
+    Pending& pending = mPending[inTimestamp & (kPendingCount - 1)];
+    if (pending.timestamp == inTimestamp) {
+        pts = pending.pts;
+        pending.timestamp = -1;
+    }
+    if (pts == kNoPts || (mLastPts != kNoPts && pts <= mLastPts)) {
+        const int64_t duration = GetFrameDuration(inFrameRateNum, inFrameRateDen);
+        // The first frame is an IDR picture, its decode order index is its display position too
+        pts = mLastPts != kNoPts ? mLastPts + duration : std::max<int64_t>(0, inTimestamp) * duration;
+    }
+    mLastPts = pts;
+    return pts;
+}
+
+int64_t
+PtsTracker::GetFrameDuration(int inFrameRateNum, int inFrameRateDen)
+{
+    if (inFrameRateNum <= 0 || inFrameRateDen <= 0) {
+        return 1000000 / 30;
+    }
+    return 1000000LL * inFrameRateDen / inFrameRateNum;
+}
+
+PresentationClock::PresentationClock(const PresentationConfig& inConfig)
+    : mConfig(inConfig)
+{
+}
+
+int64_t
+PresentationClock::NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t
+PresentationClock::getLateness(int64_t inPts)
+{
+    const int64_t now = mConfig.clock ? mConfig.clock() : NowUs();
+    int64_t origin = mOriginUs.load();
+    if (origin == kNoPts && mOriginUs.compare_exchange_strong(origin, now - inPts)) {
+        return 0;
+    }
+    const int64_t lateness = now - (origin + inPts);
+    if (lateness > mConfig.resyncUs || lateness < -mConfig.resyncUs) {
+        mOriginUs = now - inPts;
+        mResyncs++;
+        return 0;
+    }
+    return lateness;
+}
+
+bool
+PresentationClock::shouldDrop(int64_t inPts, int64_t inFrameDurationUs)
+{
+    const int64_t maxLateness = mConfig.maxLatenessUs > 0 ? mConfig.maxLatenessUs : inFrameDurationUs;
+    if (getLateness(inPts) <= maxLateness) {
+        return false;
+    }
+    mDropped++;
+    return true;
+}
+
+void
+PresentationClock::waitUntilDue(int64_t inPts)
+{
+    const int64_t lateness = getLateness(inPts);
+    if (lateness < 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(-lateness));
+    } else {
+        mTotalLatenessUs += lateness;
+        int64_t maxLateness = mMaxLatenessUs;
+        while (lateness > maxLateness && !mMaxLatenessUs.compare_exchange_weak(maxLateness, lateness)) {
+        }
+    }
+    mPresented++;
+}
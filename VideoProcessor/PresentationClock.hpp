@@ -0,0 +1,83 @@
+#pragma once
+
+#include "FramePool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Gives every decoded frame a presentation timestamp (microseconds). The decoders carry the
+// timestamp an access unit was decoded with (its frame index) over to the picture it codes;
+// record() keeps the access unit's PTS under that timestamp and stamp() looks it up again for
+// the frame. Streams without PTS, like Annex B elementary streams, get them counted up in
+// output (= presentation) order at the frame rate, and so do frames whose PTS does not move
+// forward. Decode stage only, not thread safe.
+class PtsTracker {
+public:
+    void record(int64_t inTimestamp, int64_t inPts);
+
+    // PTS of the frame decoded from the access unit with inTimestamp
+    int64_t stamp(int64_t inTimestamp, int inFrameRateNum, int inFrameRateDen);
+
+    // 30 fps when the stream does not tell
+    static int64_t GetFrameDuration(int inFrameRateNum, int inFrameRateDen);
+
+private:
+    static const int kPendingCount = 256;       // Access units in the decoder at most, a power of 2
+
+    struct Pending {
+        int64_t timestamp = -1;
+        int64_t pts = kNoPts;
+    };
+
+    Pending mPending[kPendingCount];
+    int64_t mLastPts = kNoPts;
+};
+
+struct PresentationConfig {
+    // Frames due longer ago than this are dropped before conversion, 0 = one frame duration
+    int64_t maxLatenessUs = 0;
+    // A frame this late or this early restarts the clock on it: the stream jumped, or the
+    // decoder is too slow to keep up even with every late frame dropped
+    int64_t resyncUs = 1000000;
+    // Steady time in microseconds, NowUs() when empty; tests run the clock by hand with it
+    std::function<int64_t()> clock;
+};
+
+// Wall clock the frames are presented by. Starts on the first frame asked about, which is due
+// right away; every later frame is due its PTS distance after it. The convert stage asks
+// shouldDrop() before doing any work on a frame, the output stage waits for it with
+// waitUntilDue(), so a slow sink or converter costs frames, never latency. Both may run on
+// different threads.
+class PresentationClock {
+public:
+    explicit PresentationClock(const PresentationConfig& inConfig = PresentationConfig());
+
+    // True if the frame is too late to be worth converting, counted as dropped
+    bool shouldDrop(int64_t inPts, int64_t inFrameDurationUs);
+
+    // Sleeps until the frame is due, returns at once for late frames
+    void waitUntilDue(int64_t inPts);
+
+    // Now minus the time inPts is due, 0 for the first frame. A frame more than resyncUs off
+    // restarts the clock on it and is 0 late.
+    int64_t getLateness(int64_t inPts);
+
+    uint64_t getPresented() const { return mPresented; }
+    uint64_t getDropped() const { return mDropped; }
+    uint64_t getResyncs() const { return mResyncs; }
+    // Of the presented frames, for the statistics
+    double getMeanLatenessMs() const { return mPresented ? mTotalLatenessUs / 1e3 / mPresented : 0; }
+    double getMaxLatenessMs() const { return mMaxLatenessUs / 1e3; }
+
+    static int64_t NowUs();
+
+private:
+    PresentationConfig mConfig;
+    std::atomic<int64_t> mOriginUs{ kNoPts };     // Wall time PTS 0 is due at
+    std::atomic<uint64_t> mPresented{ 0 };
+    std::atomic<uint64_t> mDropped{ 0 };
+    std::atomic<uint64_t> mResyncs{ 0 };
+    std::atomic<int64_t> mTotalLatenessUs{ 0 };
+    std::atomic<int64_t> mMaxLatenessUs{ 0 };
+};
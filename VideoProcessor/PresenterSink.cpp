@@ -0,0 +1,48 @@
+#include "PresenterSink.hpp"
+
+#include "Utils.hpp"
+
+#include <cuda.h>
+#include "FramePresenter.h"
+
+#include <algorithm>
+
+PresenterSink::PresenterSink(FramePresenter& inPresenter, int inWidth, int inHeight)
+    : mPresenter(inPresenter)
+    , mWidth(inWidth)
+    , mHeight(inHeight)
+{
+    mPresenter.endOfDecoding = false;
+}
+
+bool
+PresenterSink::write(const SinkFrame& inFrame)
+{
+    CUdeviceptr dpFrame = 0;
+    int nPitch = 0;
+    if (!mPresenter.GetDeviceFrameBuffer(&dpFrame, &nPitch)) {
+        // Window closed
+        return false;
+    }
+    CUDA_MEMCPY2D m = { 0 };
+    m.srcMemoryType = inFrame.memoryType == FrameMemoryType::Device ? CU_MEMORYTYPE_DEVICE : CU_MEMORYTYPE_HOST;
+    m.srcDevice = (CUdeviceptr)inFrame.data;
+    m.srcHost = inFrame.data;
+    m.srcPitch = inFrame.pitch;
+    m.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+    m.dstDevice = dpFrame;
+    m.dstPitch = nPitch;
+    m.WidthInBytes = (std::min)((std::min)(inFrame.width, mWidth) * 4, nPitch);
+    m.Height = (std::min)(inFrame.height, mHeight);
+    CUresult result = cuMemcpy2D(&m);
+    mPresenter.ReleaseDeviceFrameBuffer();
+    CUDA_DRVAPI_CALL(result);
+    mPresenter.nFrame++;
+    return true;
+}
+
+void
+PresenterSink::close()
+{
+    mPresenter.endOfDecoding = true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "FrameSink.hpp"
+
+class FramePresenter;
+
+// Shows BGRA images in a FramePresenter window of inWidth x inHeight, images are clipped to it.
+// Ends the presenter's render loop on close().
+class PresenterSink : public FrameSink {
+public:
+    PresenterSink(FramePresenter& inPresenter, int inWidth, int inHeight);
+
+    SinkFormat getFormat() const override { return SinkFormat::Bgra; }
+    bool needsHostMemory() const override { return false; }
+    bool write(const SinkFrame& inFrame) override;
+    void close() override;
+    const char* getName() const override { return "window"; }
+
+private:
+    FramePresenter& mPresenter;
+    int mWidth, mHeight;
+};
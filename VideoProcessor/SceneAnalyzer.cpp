@@ -0,0 +1,195 @@
+#include "SceneAnalyzer.hpp"
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SCENE_SSE2
+#endif
+
+namespace {
+
+const int kBlock = 8;                   // On the half resolution plane
+const int kMinBandsPerPart = 4;
+
+inline uint8_t Average(uint8_t a, uint8_t b) {
+    return (uint8_t)((a + b + 1) >> 1);
+}
+
+// Averages of the 2x2 quads of two frame rows: rows first, then column pairs, as pavgb/pavgw
+void DownsampleRows(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pOut, int nOutWidth) {
+    int x = 0;
+#ifdef SCENE_SSE2
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= nOutWidth; x += 16) {
+        __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x)), _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x)));
+        __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x + 16)), _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x + 16)));
+        a = _mm_avg_epu16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8));
+        b = _mm_avg_epu16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i*)(pOut + x), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; x < nOutWidth; x++) {
+        pOut[x] = Average(Average(pRow0[2 * x], pRow1[2 * x]), Average(pRow0[2 * x + 1], pRow1[2 * x + 1]));
+    }
+}
+
+uint64_t SumRow(const uint8_t* pRow, int nWidth) {
+    uint64_t sum = 0;
+    int x = 0;
+#ifdef SCENE_SSE2
+    __m128i sums = _mm_setzero_si128();
+    for (; x + 16 <= nWidth; x += 16) {
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pRow + x)), _mm_setzero_si128()));
+    }
+    sum = (uint64_t)_mm_cvtsi128_si32(sums) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+#endif
+    for (; x < nWidth; x++) {
+        sum += pRow[x];
+    }
+    return sum;
+}
+
+// Sums of absolute differences of the 8x8 blocks along a band of 8 rows. psadbw sums each half
+// of a register separately, which is two blocks side by side.
+void BandSad(const uint8_t* pCurrent, const uint8_t* pPrevious, int nPitch, int nBlocks, uint32_t* pSad) {
+    int block = 0;
+#ifdef SCENE_SSE2
+    for (; block + 2 <= nBlocks; block += 2) {
+        __m128i sum = _mm_setzero_si128();
+        for (int y = 0; y < kBlock; y++) {
+            const size_t offset = (size_t)y * nPitch + block * kBlock;
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pCurrent + offset)),
+                _mm_loadu_si128((const __m128i*)(pPrevious + offset))));
+        }
+        pSad[block] = (uint32_t)_mm_cvtsi128_si32(sum);
+        pSad[block + 1] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+#endif
+    for (; block < nBlocks; block++) {
+        uint32_t sum = 0;
+        for (int y = 0; y < kBlock; y++) {
+            const uint8_t* pA = pCurrent + (size_t)y * nPitch + block * kBlock;
+            const uint8_t* pB = pPrevious + (size_t)y * nPitch + block * kBlock;
+            for (int x = 0; x < kBlock; x++) {
+                sum += (uint32_t)std::abs(pA[x] - pB[x]);
+            }
+        }
+        pSad[block] = sum;
+    }
+}
+
+}
+
+SceneAnalyzer::SceneAnalyzer(const SceneAnalyzerConfig& inConfig)
+    : mConfig(inConfig)
+{
+    memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+FrameAnalysis
+SceneAnalyzer::analyze(const uint8_t* pLuma, int nPitch, int nWidth, int nHeight)
+{
+    FrameAnalysis analysis;
+    analysis.valid = true;
+    const int width = nWidth / 2, height = nHeight / 2;
+    if (width <= 0 || height <= 0) {
+        return analysis;
+    }
+    const bool newScene = nWidth != mWidth || nHeight != mHeight;
+    mWidth = nWidth;
+    mHeight = nHeight;
+    std::vector<uint8_t>& current = mPlanes[mCurrent];
+    const std::vector<uint8_t>& previous = mPlanes[1 - mCurrent];
+    current.resize((size_t)width * height);
+    uint32_t* pHistogram = mHistograms[mCurrent];
+    const uint32_t* pPreviousHistogram = mHistograms[1 - mCurrent];
+    memset(pHistogram, 0, sizeof(mHistograms[0]));
+
+    const int blocksX = width / kBlock, blocksY = height / kBlock;
+    const uint32_t movedSad = (uint32_t)(mConfig.blockThreshold * kBlock * kBlock);
+    const int bandCount = (height + kBlock - 1) / kBlock;
+    uint64_t sadTotal = 0, movedBlocks = 0, lumaTotal = 0;
+
+    auto runBands = [&](int inBegin, int inEnd) {
+        // Four histograms, so runs of equal values do not wait on their own increments
+        uint32_t histograms[4][kBins] = {};
+        std::vector<uint32_t> sads(blocksX);
+        uint64_t sad = 0, moved = 0, luma = 0;
+        for (int band = inBegin; band < inEnd; band++) {
+            const int top = band * kBlock, bottom = std::min(height, top + kBlock);
+            for (int y = top; y < bottom; y++) {
+                uint8_t* pRow = current.data() + (size_t)y * width;
+                DownsampleRows(pLuma + (size_t)(2 * y) * nPitch, pLuma + (size_t)(2 * y + 1) * nPitch, pRow, width);
+                luma += SumRow(pRow, width);
+                if (y & 1) {
+                    continue;
+                }
+                // Every other pixel of every other row is plenty for 64 bins, and table
+                // increments are the slowest part of the analysis
+                int x = 0;
+                for (; x + 8 <= width; x += 8) {
+                    histograms[0][pRow[x] >> 2]++;
+                    histograms[1][pRow[x + 2] >> 2]++;
+                    histograms[2][pRow[x + 4] >> 2]++;
+                    histograms[3][pRow[x + 6] >> 2]++;
+                }
+                for (; x < width; x += 2) {
+                    histograms[0][pRow[x] >> 2]++;
+                }
+            }
+            if (newScene || band >= blocksY || !blocksX) {
+                continue;
+            }
+            const size_t offset = (size_t)top * width;
+            BandSad(current.data() + offset, previous.data() + offset, width, blocksX, sads.data());
+            for (uint32_t blockSad : sads) {
+                sad += blockSad;
+                moved += blockSad > movedSad;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mMergeLock);
+        for (int bin = 0; bin < kBins; bin++) {
+            pHistogram[bin] += histograms[0][bin] + histograms[1][bin] + histograms[2][bin] + histograms[3][bin];
+        }
+        sadTotal += sad;
+        movedBlocks += moved;
+        lumaTotal += luma;
+    };
+    ThreadPool* pThreadPool = mConfig.pThreadPool;
+    if (!pThreadPool || pThreadPool->getThreadCount() == 1 || bandCount < 2 * kMinBandsPerPart) {
+        runBands(0, bandCount);
+    } else {
+        pThreadPool->parallelFor(bandCount, runBands);
+    }
+
+    const double pixels = (double)width * height;
+    analysis.meanLuma = (float)(lumaTotal / pixels);
+    if (newScene) {
+        analysis.sceneCut = true;
+    } else {
+        const int blocks = blocksX * blocksY;
+        analysis.sad = blocks ? (float)(sadTotal / ((double)blocks * kBlock * kBlock)) : 0;
+        analysis.motion = blocks ? (float)((double)movedBlocks / blocks) : 0;
+        uint64_t distance = 0, samples = 0;
+        for (int bin = 0; bin < kBins; bin++) {
+            distance += (uint64_t)std::abs((int64_t)pHistogram[bin] - (int64_t)pPreviousHistogram[bin]);
+            samples += pHistogram[bin];
+        }
+        // Half the L1 distance of the normalized histograms
+        analysis.histogramDelta = samples ? (float)(distance / (2.0 * samples)) : 0;
+        analysis.sceneCut = analysis.histogramDelta >= mConfig.sceneCutThreshold;
+        analysis.isStatic = !analysis.sceneCut && analysis.motion <= mConfig.staticMotion && analysis.sad < mConfig.staticSad;
+    }
+    mCurrent = 1 - mCurrent;
+
+    mFrames++;
+    mSceneCuts += analysis.sceneCut;
+    mStaticFrames += analysis.isStatic;
+    return analysis;
+}
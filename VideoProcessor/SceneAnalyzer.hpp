@@ -0,0 +1,55 @@
+#pragma once
+
+#include "FramePool.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+struct SceneAnalyzerConfig {
+    // A 16x16 block moved when its mean absolute difference is above this, which keeps
+    // sensor and compression noise out of the motion score
+    float blockThreshold = 6;
+    // Static: at most this share of the blocks moved and the mean difference stayed below staticSad
+    float staticMotion = 0.002f;
+    float staticSad = 1.5f;
+    // Scene cut: the luma histograms are at least this far apart
+    float sceneCutThreshold = 0.35f;
+    ThreadPool* pThreadPool = nullptr;
+};
+
+// Scene change and motion activity of a stream, measured on the decoder's NV12 output before
+// anything converts it. Only the luma plane is read, once: every 2x2 quad is averaged into a
+// half resolution plane, which is kept for the next frame instead of the frame itself (so no
+// pool slot is held) and which averages the noise out. On that plane, 8x8 blocks (16x16 in the
+// frame) are compared to the previous frame with psadbw and a 64 bin histogram is counted, band
+// by band while the band is in L1.
+class SceneAnalyzer {
+public:
+    explicit SceneAnalyzer(const SceneAnalyzerConfig& inConfig = SceneAnalyzerConfig());
+
+    // Analyzes an 8 bit luma plane in host memory against the frame analyzed before it
+    FrameAnalysis analyze(const uint8_t* pLuma, int nPitch, int nWidth, int nHeight);
+
+    // Forgets the previous frame, e.g. after a seek: the next frame is a scene cut
+    void reset() { mWidth = mHeight = 0; }
+
+    uint64_t getFrames() const { return mFrames; }
+    uint64_t getSceneCuts() const { return mSceneCuts; }
+    uint64_t getStaticFrames() const { return mStaticFrames; }
+
+private:
+    static const int kBins = 64;
+
+    SceneAnalyzerConfig mConfig;
+    int mWidth = 0, mHeight = 0;                // Of the frame the previous plane is from
+    std::vector<uint8_t> mPlanes[2];            // Half resolution luma, current and previous
+    int mCurrent = 0;
+    uint32_t mHistograms[2][kBins];             // Same
+    std::mutex mMergeLock;                      // Per thread totals into the current frame's
+    uint64_t mFrames = 0;
+    uint64_t mSceneCuts = 0;
+    uint64_t mStaticFrames = 0;
+};
@@ -0,0 +1,223 @@
+#include "SessionScheduler.hpp"
+
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+SessionScheduler::SessionScheduler(const SchedulerConfig& inConfig)
+    : mConfig(inConfig)
+{
+    // Node by node, so consecutive workers share a node and the first ones share caches
+    std::vector<int> cpus = GetAvailableCpus();
+    std::vector<std::pair<int, int>> nodeCpus;
+    for (int cpu : cpus) {
+        nodeCpus.emplace_back(GetCpuNumaNode(cpu), cpu);
+    }
+    std::stable_sort(nodeCpus.begin(), nodeCpus.end());
+
+    const int workerCount = mConfig.workerCount > 0 ? mConfig.workerCount : (int)nodeCpus.size();
+    for (int i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back(new Worker);
+        mWorkers.back()->node = nodeCpus[i % nodeCpus.size()].first;
+        mWorkers.back()->cpu = nodeCpus[i % nodeCpus.size()].second;
+    }
+}
+
+SessionScheduler::~SessionScheduler()
+{
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+bool
+SessionScheduler::addSession(std::unique_ptr<DecodeSession> inSession)
+{
+    DecodeSession* pSession = inSession.get();
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mActiveSessions >= mConfig.maxSessions) {
+            mRefusedSessions++;
+            std::cerr << "Session " << pSession->getId() << " refused, " << mActiveSessions << " sessions active" << std::endl;
+            return false;
+        }
+        mSessions.push_back(std::move(inSession));
+        mActiveSessions++;
+    }
+
+    Worker* pTarget = nullptr;
+    size_t targetLoad = SIZE_MAX;
+    for (std::unique_ptr<Worker>& worker : mWorkers) {
+        std::lock_guard<std::mutex> lock(worker->lock);
+        if (worker->runnable.size() < targetLoad) {
+            pTarget = worker.get();
+            targetLoad = worker->runnable.size();
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(pTarget->lock);
+        pTarget->runnable.push_back(pSession);
+    }
+    mWork.notify_all();
+    return true;
+}
+
+void
+SessionScheduler::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < (int)mWorkers.size(); i++) {
+        mThreads.emplace_back(&SessionScheduler::workerLoop, this, i);
+    }
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+    mElapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void
+SessionScheduler::workerLoop(int inWorker)
+{
+    Worker& worker = *mWorkers[inWorker];
+    if (mConfig.pinWorkers && !PinCurrentThread(worker.cpu)) {
+        std::cerr << "Pinning worker " << inWorker << " to processor " << worker.cpu << " failed" << std::endl;
+    }
+
+    while (true) {
+        DecodeSession* pSession = takeSession(inWorker);
+        if (!pSession) {
+            std::unique_lock<std::mutex> lock(mLock);
+            if (mActiveSessions == 0) {
+                return;
+            }
+            // Sessions requeued by busy workers don't notify, the timeout picks them up
+            mIdleWorkers++;
+            mWork.wait_for(lock, std::chrono::milliseconds(1));
+            mIdleWorkers--;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool more = false;
+        try {
+            more = pSession->runSlice(mConfig.sliceUnits, start + std::chrono::microseconds(mConfig.sliceMicroseconds));
+        } catch (...) {
+            std::cerr << "Session " << pSession->getId() << " (" << pSession->getPath() << ") failed" << std::endl;
+            std::lock_guard<std::mutex> lock(mLock);
+            mFailedSessions++;
+        }
+        worker.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        worker.slices++;
+
+        if (!more) {
+            finishSession();
+            continue;
+        }
+        // Back of its own queue: round robin among the sessions of this worker
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> lock(worker.lock);
+            worker.runnable.push_back(pSession);
+            queued = worker.runnable.size();
+        }
+        if (queued > 1) {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mIdleWorkers) {
+                mWork.notify_one();
+            }
+        }
+    }
+}
+
+DecodeSession*
+SessionScheduler::takeSession(int inWorker)
+{
+    Worker& worker = *mWorkers[inWorker];
+    {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        if (!worker.runnable.empty()) {
+            DecodeSession* pSession = worker.runnable.front();
+            worker.runnable.pop_front();
+            return pSession;
+        }
+    }
+
+    // Steal, same node first. The victim keeps the session at the front of its queue, which
+    // it is about to run itself.
+    const int workerCount = (int)mWorkers.size();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 1; i < workerCount; i++) {
+            Worker& victim = *mWorkers[(inWorker + i) % workerCount];
+            if ((victim.node == worker.node) != (pass == 0)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (victim.runnable.size() > 0) {
+                DecodeSession* pSession = victim.runnable.back();
+                victim.runnable.pop_back();
+                worker.steals++;
+                return pSession;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void
+SessionScheduler::finishSession()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    if (--mActiveSessions == 0) {
+        mWork.notify_all();
+    }
+}
+
+uint64_t
+SessionScheduler::getFrames() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    uint64_t frames = 0;
+    for (const std::unique_ptr<DecodeSession>& session : mSessions) {
+        frames += session->getFrames();
+    }
+    return frames;
+}
+
+void
+SessionScheduler::printStatistics(std::ostream& inStream) const
+{
+    const uint64_t frames = getFrames();
+    std::lock_guard<std::mutex> lock(mLock);
+    inStream << "Scheduler: " << mSessions.size() << " sessions (" << mFailedSessions << " failed, " << mRefusedSessions
+        << " refused) on " << mWorkers.size() << " workers, " << frames << " frames in " << mElapsedSeconds << " s = "
+        << (mElapsedSeconds > 0 ? frames / mElapsedSeconds : 0) << " fps" << std::endl;
+
+    for (int i = 0; i < (int)mWorkers.size(); i++) {
+        const Worker& worker = *mWorkers[i];
+        const double busy = worker.busyNs / 1e9;
+        inStream << "\tworker " << i << "\t: cpu " << worker.cpu << ", node " << worker.node << ", "
+            << worker.slices << " slices, " << worker.steals << " stolen, busy "
+            << (mElapsedSeconds > 0 ? 100.0 * busy / mElapsedSeconds : 0) << "%" << std::endl;
+    }
+
+    // Jain's index over the per-session rates: 1 when all sessions progressed equally fast
+    double sum = 0, sumSquares = 0, minFps = 0, maxFps = 0;
+    for (size_t i = 0; i < mSessions.size(); i++) {
+        const DecodeSession& session = *mSessions[i];
+        const double elapsed = session.getElapsedSeconds();
+        const double fps = elapsed > 0 ? session.getFrames() / elapsed : 0;
+        sum += fps;
+        sumSquares += fps * fps;
+        minFps = i ? (std::min)(minFps, fps) : fps;
+        maxFps = i ? (std::max)(maxFps, fps) : fps;
+    }
+    if (!mSessions.empty()) {
+        inStream << "\tsessions\t: " << minFps << " / " << sum / mSessions.size() << " / " << maxFps
+            << " fps min / avg / max, fairness " << (sumSquares > 0 ? sum * sum / (mSessions.size() * sumSquares) : 1)
+            << std::endl;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "DecodeSession.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct SchedulerConfig {
+    int workerCount = 0;            // 0 = one worker per available logical processor
+    int maxSessions = 64;           // Admission limit, addSession() refuses sessions beyond it
+    int sliceUnits = 8;             // Access units a session may decode per turn...
+    int sliceMicroseconds = 4000;   // ...and the time it may take for them
+    bool pinWorkers = true;         // Pin every worker to its own processor, NUMA node by node
+};
+
+// Runs many DecodeSessions on a fixed set of worker threads. Every worker owns a queue of
+// runnable sessions and gives each one a bounded slice (units and time) in turn, so a heavy
+// stream cannot starve the others on its worker. A worker that runs dry steals sessions from
+// the back of other queues, from its own NUMA node first, which keeps every core busy as
+// streams end at different times. A session is in at most one queue, so it never runs on two
+// workers at once.
+class SessionScheduler {
+public:
+    explicit SessionScheduler(const SchedulerConfig& inConfig);
+
+    ~SessionScheduler();
+
+    SessionScheduler(const SessionScheduler&) = delete;
+    SessionScheduler& operator=(const SessionScheduler&) = delete;
+
+    // Takes the session over and queues it on the least loaded worker. Returns false (and
+    // destroys the session) when maxSessions sessions are active. May be called while running.
+    bool addSession(std::unique_ptr<DecodeSession> inSession);
+
+    // Starts the workers and returns once every admitted session has finished. A session
+    // that throws is reported and dropped, the others go on.
+    void run();
+
+    int getWorkerCount() const { return (int)mWorkers.size(); }
+
+    uint64_t getFrames() const;
+    double getElapsedSeconds() const { return mElapsedSeconds; }
+
+    void printStatistics(std::ostream& inStream) const;
+
+private:
+    struct Worker {
+        int cpu = -1;
+        int node = 0;
+        std::mutex lock;
+        std::deque<DecodeSession*> runnable;
+        std::atomic<uint64_t> slices{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+    };
+
+    void workerLoop(int inWorker);
+    DecodeSession* takeSession(int inWorker);
+    void finishSession();
+
+    SchedulerConfig mConfig;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    mutable std::mutex mLock;
+    std::condition_variable mWork;
+    std::vector<std::unique_ptr<DecodeSession>> mSessions;
+    int mActiveSessions = 0;
+    int mRefusedSessions = 0;
+    int mFailedSessions = 0;
+    int mIdleWorkers = 0;
+    double mElapsedSeconds = 0;
+};
@@ -0,0 +1,292 @@
+#include "SharedMemorySink.hpp"
+
+#include "Telemetry.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Slots start on page boundaries, so frame data is as aligned as any allocation
+static const size_t kPageSize = 4096;
+
+static size_t AlignUp(size_t inSize, size_t inAlignment) {
+    return (inSize + inAlignment - 1) / inAlignment * inAlignment;
+}
+
+#ifdef _WIN32
+
+static std::string GetMappingName(const std::string& inName) {
+    return "Local\\" + inName;
+}
+
+// Creates (inSize > 0) or opens the named mapping and maps all of it
+static uint8_t* MapShared(const std::string& inName, size_t inSize, size_t& outSize, void*& outHandle) {
+    HANDLE mapping = inSize
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)inSize >> 32),
+            (DWORD)inSize, GetMappingName(inName).c_str())
+        : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, GetMappingName(inName).c_str());
+    if (!mapping) {
+        return nullptr;
+    }
+    uint8_t* pData = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!pData || !VirtualQuery(pData, &info, sizeof(info))) {
+        if (pData) {
+            UnmapViewOfFile(pData);
+        }
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    outSize = info.RegionSize;
+    outHandle = mapping;
+    return pData;
+}
+
+static void UnmapShared(void* inData, size_t, void* inHandle) {
+    UnmapViewOfFile(inData);
+    CloseHandle(inHandle);
+}
+
+static void RemoveShared(const std::string&) {
+    // The mapping goes away with its last handle
+}
+
+#else
+
+static std::string GetMappingName(const std::string& inName) {
+    return "/" + inName;
+}
+
+static uint8_t* MapShared(const std::string& inName, size_t inSize, size_t& outSize, void*& outHandle) {
+    const std::string name = GetMappingName(inName);
+    int fd = inSize ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) : shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    if ((inSize && ftruncate(fd, (off_t)inSize) != 0) || fstat(fd, &status) != 0 || status.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* pData = mmap(nullptr, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping keeps the object alive, the descriptor is not needed anymore
+    ::close(fd);
+    if (pData == MAP_FAILED) {
+        return nullptr;
+    }
+    outSize = (size_t)status.st_size;
+    outHandle = nullptr;
+    return (uint8_t*)pData;
+}
+
+static void UnmapShared(void* inData, size_t inSize, void*) {
+    munmap(inData, inSize);
+}
+
+static void RemoveShared(const std::string& inName) {
+    shm_unlink(GetMappingName(inName).c_str());
+}
+
+#endif
+
+static SharedFrameHeader* GetSlot(SharedFrameRingHeader* inRing, uint64_t inIndex) {
+    return (SharedFrameHeader*)((uint8_t*)inRing + inRing->headerSize + (inIndex % inRing->slotCount) * inRing->slotSize);
+}
+
+SharedMemorySink::SharedMemorySink(const SharedMemorySinkConfig& inConfig)
+    : mConfig(inConfig)
+{
+    if (mConfig.slotCount < 2) {
+        mConfig.slotCount = 2;
+    }
+}
+
+SharedMemorySink::~SharedMemorySink()
+{
+    if (mpRing) {
+        close();
+        UnmapShared(mpRing, mSize, mHandle);
+        RemoveShared(mConfig.name);
+    }
+}
+
+bool
+SharedMemorySink::create(const SinkFrame& inFrame)
+{
+    const size_t pitch = AlignUp((size_t)inFrame.width * inFrame.bpp, 64);
+    const size_t frameSize = pitch * (inFrame.height + (inFrame.height + 1) / 2);
+    const size_t headerSize = AlignUp(sizeof(SharedFrameRingHeader), kPageSize);
+    const size_t slotSize = AlignUp(SharedFrameHeader::kDataOffset + frameSize, kPageSize);
+
+    // Left behind by a producer that crashed; a consumer still attached to it keeps its copy
+    RemoveShared(mConfig.name);
+    uint8_t* pData = MapShared(mConfig.name, headerSize + slotSize * mConfig.slotCount, mSize, mHandle);
+    if (!pData) {
+        std::cerr << "Creating shared memory " << mConfig.name << " failed" << std::endl;
+        return false;
+    }
+
+    mpRing = new (pData) SharedFrameRingHeader();
+    mpRing->version = SharedFrameRingHeader::kVersion;
+    mpRing->slotCount = mConfig.slotCount;
+    mpRing->headerSize = (uint32_t)headerSize;
+    mpRing->slotSize = slotSize;
+    mpRing->closed.store(0, std::memory_order_relaxed);
+    mpRing->writeIndex.store(0, std::memory_order_relaxed);
+    mpRing->readIndex.store(0, std::memory_order_relaxed);
+    // Readers check the magic first, it goes in last
+    std::atomic_thread_fence(std::memory_order_release);
+    mpRing->magic = SharedFrameRingHeader::kMagic;
+
+    LOG_INFO("Shared memory ring " << GetMappingName(mConfig.name) << ": " << mConfig.slotCount << " slots of "
+        << slotSize << " bytes");
+    return true;
+}
+
+bool
+SharedMemorySink::write(const SinkFrame& inFrame)
+{
+    if (!mpRing && !create(inFrame)) {
+        return false;
+    }
+
+    const uint64_t sequence = mSequence++;
+    const size_t rowBytes = (size_t)inFrame.width * inFrame.bpp;
+    const size_t pitch = AlignUp(rowBytes, 64);
+    const int rows = inFrame.height + (inFrame.height + 1) / 2;
+    if (SharedFrameHeader::kDataOffset + pitch * rows > mpRing->slotSize) {
+        // Slots are sized for the first frame
+        if (!mResizedDropped++) {
+            LOG_WARNING("Shared memory ring: frame size changed to " << inFrame.width << "x" << inFrame.height
+                << ", frames of another size than the first are not published");
+        }
+        mDropped++;
+        return true;
+    }
+
+    const uint64_t writeIndex = mpRing->writeIndex.load(std::memory_order_relaxed);
+    if (writeIndex - mpRing->readIndex.load(std::memory_order_acquire) >= mpRing->slotCount
+        && (mConfig.dropWhenFull || !waitForConsumer(writeIndex))) {
+        mDropped++;
+        return true;
+    }
+
+    SharedFrameHeader* pSlot = GetSlot(mpRing, writeIndex);
+    uint8_t* pTarget = (uint8_t*)pSlot->data();
+    for (int y = 0; y < rows; y++) {
+        memcpy(pTarget + y * pitch, inFrame.data + (size_t)y * inFrame.pitch, rowBytes);
+    }
+    pSlot->timestamp = inFrame.timestamp;
+    pSlot->pts = inFrame.pts;
+    pSlot->sequence = sequence;
+    pSlot->width = inFrame.width;
+    pSlot->height = inFrame.height;
+    pSlot->pitch = (int32_t)pitch;
+    pSlot->bpp = inFrame.bpp;
+    pSlot->size = pitch * rows;
+    mpRing->writeIndex.store(writeIndex + 1, std::memory_order_release);
+    return true;
+}
+
+bool
+SharedMemorySink::waitForConsumer(uint64_t inWriteIndex)
+{
+    uint64_t readIndex = mpRing->readIndex.load(std::memory_order_acquire);
+    if (readIndex == mStalledReadIndex) {
+        // Still gone, no point in waiting for it once per frame
+        return false;
+    }
+    mStalledReadIndex = ~0ull;
+    auto lastRead = std::chrono::steady_clock::now();
+    while (inWriteIndex - readIndex >= mpRing->slotCount) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastRead > std::chrono::milliseconds(mConfig.consumerTimeoutMs)) {
+            LOG_WARNING("Shared memory ring: the consumer read nothing for " << mConfig.consumerTimeoutMs
+                << " ms, dropping frames until it reads again");
+            mStalledReadIndex = readIndex;
+            return false;
+        }
+        // No cross-process wakeup that works everywhere, poll
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const uint64_t nextReadIndex = mpRing->readIndex.load(std::memory_order_acquire);
+        if (nextReadIndex != readIndex) {
+            readIndex = nextReadIndex;
+            lastRead = now;
+        }
+    }
+    return true;
+}
+
+void
+SharedMemorySink::close()
+{
+    // Again from the destructor
+    if (!mpRing || mpRing->closed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    mpRing->closed.store(1, std::memory_order_release);
+    if (mResizedDropped) {
+        LOG_INFO("Shared memory ring: " << mDropped << " of " << mSequence << " frames dropped, " << mResizedDropped
+            << " of them for their size");
+    } else if (mDropped) {
+        LOG_INFO("Shared memory ring: " << mDropped << " of " << mSequence << " frames dropped");
+    }
+}
+
+SharedFrameRingReader::SharedFrameRingReader(const std::string& inName)
+{
+    uint8_t* pData = MapShared(inName, 0, mSize, mHandle);
+    if (!pData) {
+        return;
+    }
+    SharedFrameRingHeader* pRing = (SharedFrameRingHeader*)pData;
+    const bool valid = mSize >= sizeof(SharedFrameRingHeader) && pRing->magic == SharedFrameRingHeader::kMagic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || pRing->version != SharedFrameRingHeader::kVersion
+        || pRing->headerSize + (uint64_t)pRing->slotCount * pRing->slotSize > mSize) {
+        UnmapShared(pData, mSize, mHandle);
+        return;
+    }
+    mpRing = pRing;
+}
+
+SharedFrameRingReader::~SharedFrameRingReader()
+{
+    if (mpRing) {
+        UnmapShared(mpRing, mSize, mHandle);
+    }
+}
+
+const SharedFrameHeader*
+SharedFrameRingReader::acquire() const
+{
+    const uint64_t readIndex = mpRing->readIndex.load(std::memory_order_relaxed);
+    if (readIndex == mpRing->writeIndex.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return GetSlot(mpRing, readIndex);
+}
+
+void
+SharedFrameRingReader::release()
+{
+    mpRing->readIndex.fetch_add(1, std::memory_order_release);
+}
+
+bool
+SharedFrameRingReader::isClosed() const
+{
+    return mpRing->closed.load(std::memory_order_acquire) != 0;
+}
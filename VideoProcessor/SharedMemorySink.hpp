@@ -0,0 +1,121 @@
+#pragma once
+
+#include "FrameSink.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Layout of the shared memory ring. Producer and consumer may be built separately, so every
+// field has a fixed size; the atomics must be lock free (they are on every 64 bit target).
+//
+//   SharedFrameRingHeader | slot 0 | slot 1 | ... , slot = SharedFrameHeader + frame data
+//
+// Single producer, single consumer. The producer fills slot writeIndex % slotCount and then
+// bumps writeIndex, the consumer reads slot readIndex % slotCount in place and then bumps
+// readIndex. A slot is never written while the consumer may be reading it.
+struct SharedFrameRingHeader {
+    static const uint32_t kMagic = 0x47524656;  // "VFRG"
+    static const uint32_t kVersion = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t headerSize;        // Offset of slot 0
+    uint64_t slotSize;          // Distance between slots, SharedFrameHeader included
+    std::atomic<uint32_t> closed;
+    alignas(64) std::atomic<uint64_t> writeIndex;
+    alignas(64) std::atomic<uint64_t> readIndex;
+};
+
+// One frame in the ring: NV12 (P016 when bpp == 2), UV plane at pitch * height
+struct SharedFrameHeader {
+    static const uint32_t kDataOffset = 64;
+
+    int64_t timestamp;
+    uint64_t sequence;          // Frames written so far, gaps show frames dropped on a full ring
+    int32_t width, height;
+    int32_t pitch;
+    int32_t bpp;
+    uint64_t size;
+    int64_t pts;                // Microseconds, INT64_MIN if unknown
+
+    const uint8_t* data() const { return (const uint8_t*)this + kDataOffset; }
+};
+
+struct SharedMemorySinkConfig {
+    std::string name = "VideoProcessor";
+    int slotCount = 8;
+    // Full ring: drop the frame (default) or wait for the consumer, which ties decoding to its pace
+    bool dropWhenFull = true;
+    // Waiting only: a consumer that reads nothing for this long is taken as gone, and frames are
+    // dropped without waiting until it reads again
+    int consumerTimeoutMs = 2000;
+};
+
+// Publishes frames to another process on the same host through a named shared memory ring
+// (POSIX shm_open, or a named file mapping on Windows). The ring is created on the first frame,
+// sized for it, and removed by the destructor. The consumer (SharedFrameRingReader) works on the
+// frames in place; the only copy is the producer's, from the decoder's frame into the slot.
+class SharedMemorySink : public FrameSink {
+public:
+    explicit SharedMemorySink(const SharedMemorySinkConfig& inConfig);
+
+    ~SharedMemorySink();
+
+    SharedMemorySink(const SharedMemorySink&) = delete;
+    SharedMemorySink& operator=(const SharedMemorySink&) = delete;
+
+    SinkFormat getFormat() const override { return SinkFormat::Nv12; }
+    bool needsHostMemory() const override { return true; }
+    bool write(const SinkFrame& inFrame) override;
+    void close() override;
+    const char* getName() const override { return "shm"; }
+
+    // All frames not published, those of another size than the first included
+    uint64_t getDropped() const { return mDropped; }
+    uint64_t getResizedDropped() const { return mResizedDropped; }
+
+private:
+    bool create(const SinkFrame& inFrame);
+    // Waits for a free slot as long as the consumer keeps reading, false if it stopped
+    bool waitForConsumer(uint64_t inWriteIndex);
+
+    SharedMemorySinkConfig mConfig;
+    SharedFrameRingHeader* mpRing = nullptr;
+    size_t mSize = 0;
+    void* mHandle = nullptr;
+    uint64_t mSequence = 0;
+    uint64_t mDropped = 0;
+    uint64_t mResizedDropped = 0;
+    // readIndex when the consumer was found gone, ~0 while it reads
+    uint64_t mStalledReadIndex = ~0ull;
+};
+
+// Consumer side of a SharedMemorySink ring, for the downstream process
+class SharedFrameRingReader {
+public:
+    // Opens the ring of the sink with the given name; fails until the sink has seen a frame
+    explicit SharedFrameRingReader(const std::string& inName);
+
+    ~SharedFrameRingReader();
+
+    SharedFrameRingReader(const SharedFrameRingReader&) = delete;
+    SharedFrameRingReader& operator=(const SharedFrameRingReader&) = delete;
+
+    explicit operator bool() const { return mpRing != nullptr; }
+
+    // The oldest unread frame, or null if there is none yet. It stays valid and untouched by
+    // the producer until release().
+    const SharedFrameHeader* acquire() const;
+    void release();
+
+    // The producer has finished, acquire() returns what is left
+    bool isClosed() const;
+
+private:
+    SharedFrameRingHeader* mpRing = nullptr;
+    size_t mSize = 0;
+    void* mHandle = nullptr;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring. tryPush/tryPop never block; push/pop wait
+// with a spin, yield, sleep backoff, which is what gives the pipeline its backpressure.
+// close() wakes both sides: push fails from then on, pop fails once the ring is drained.
+template <class T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t inCapacity)
+        : mCapacity(inCapacity > 0 ? inCapacity : 1)
+    {
+        size_t size = 1;
+        while (size < mCapacity) {
+            size <<= 1;
+        }
+        mItems.resize(size);
+        mMask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    size_t capacity() const { return mCapacity; }
+
+    // Approximate, for statistics only
+    size_t size() const { return mTail.load(std::memory_order_relaxed) - mHead.load(std::memory_order_relaxed); }
+
+    // Producer side. inItem is left untouched on failure.
+    bool tryPush(T& inItem) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHeadCache == mCapacity) {
+            mHeadCache = mHead.load(std::memory_order_acquire);
+            if (tail - mHeadCache == mCapacity) {
+                return false;
+            }
+        }
+        mItems[tail & mMask] = std::move(inItem);
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool tryPop(T& outItem) {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTailCache) {
+            mTailCache = mTail.load(std::memory_order_acquire);
+            if (head == mTailCache) {
+                return false;
+            }
+        }
+        outItem = std::move(mItems[head & mMask]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Waits while the queue is full. Returns false if the queue was closed.
+    bool push(T inItem) {
+        for (int spins = 0; !tryPush(inItem); Backoff(spins)) {
+            if (mClosed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            mFullWaits.fetch_add(spins == 0, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Waits while the queue is empty. Returns false if the queue was closed and is drained.
+    bool pop(T& outItem) {
+        for (int spins = 0; !tryPop(outItem); Backoff(spins)) {
+            if (mClosed.load(std::memory_order_acquire)) {
+                return tryPop(outItem);
+            }
+            mEmptyWaits.fetch_add(spins == 0, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void close() { mClosed.store(true, std::memory_order_release); }
+    bool isClosed() const { return mClosed.load(std::memory_order_acquire); }
+
+    // Number of push()/pop() calls that had to wait
+    uint64_t getFullWaits() const { return mFullWaits.load(std::memory_order_relaxed); }
+    uint64_t getEmptyWaits() const { return mEmptyWaits.load(std::memory_order_relaxed); }
+
+private:
+    static void Backoff(int& ioSpins) {
+        if (++ioSpins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    std::vector<T> mItems;
+    size_t mCapacity;
+    size_t mMask;
+    std::atomic<bool> mClosed{ false };
+    std::atomic<uint64_t> mFullWaits{ 0 };
+    std::atomic<uint64_t> mEmptyWaits{ 0 };
+
+    // Consumer owned line: read index plus its cached copy of the write index
+    alignas(64) std::atomic<size_t> mHead{ 0 };
+    size_t mTailCache = 0;
+    // Producer owned line
+    alignas(64) std::atomic<size_t> mTail{ 0 };
+    size_t mHeadCache = 0;
+};
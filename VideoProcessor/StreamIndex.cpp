@@ -0,0 +1,366 @@
+#include "StreamIndex.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const char kIndexMagic[4] = { 'V', 'I', 'D', 'X' };
+static const uint32_t kIndexVersion = 1;
+
+static size_t AlignSize(size_t inSize) {
+    return (inSize + 7) & ~(size_t)7;
+}
+
+// Frame numbers a binary search can run over, and that index the entries
+static bool IsFrameList(const uint32_t* inFrames, uint32_t inCount, uint32_t inFrameCount) {
+    for (uint32_t i = 0; i < inCount; i++) {
+        if (inFrames[i] >= inFrameCount || (i && inFrames[i] <= inFrames[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the tables of a mapped sidecar only point into the stream its header describes. The
+// stamp alone does not vouch for the contents: a damaged sidecar can still match it.
+static bool IsConsistent(const StreamIndexHeader& inHeader, const StreamIndexEntry* inEntries, const uint32_t* inKeyframes,
+    const uint32_t* inRecoveryPoints, const StreamIndexParameterSet* inParameterSets)
+{
+    const uint64_t sourceSize = inHeader.sourceSize;
+    for (uint32_t i = 0; i < inHeader.frameCount; i++) {
+        if (inEntries[i].offset > sourceSize || inEntries[i].size > sourceSize - inEntries[i].offset) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < inHeader.parameterSetCount; i++) {
+        const StreamIndexParameterSet& parameterSet = inParameterSets[i];
+        if (parameterSet.offset > sourceSize || parameterSet.size > sourceSize - parameterSet.offset
+            || parameterSet.frame >= inHeader.frameCount || (i && parameterSet.frame < inParameterSets[i - 1].frame)) {
+            return false;
+        }
+    }
+    return IsFrameList(inKeyframes, inHeader.keyframeCount, inHeader.frameCount)
+        && IsFrameList(inRecoveryPoints, inHeader.recoveryPointCount, inHeader.frameCount);
+}
+
+// Walks the NAL units in front of the first slice of an access unit: records its parameter
+// sets and the PPS the first slice refers to
+static void IndexAccessUnitHeader(const AccessUnit& inUnit, StreamIndexEntry& ioEntry,
+    std::vector<StreamIndexParameterSet>& ioParameterSets)
+{
+    const uint8_t* end = inUnit.data + inUnit.size;
+    const uint8_t* startCode = FindStartCode(inUnit.data, end);
+    while (startCode < end) {
+        const uint8_t* header = startCode + 3;
+        if (header >= end) {
+            return;
+        }
+        const uint8_t* next = FindStartCode(header + 1, end);
+        const uint8_t* nalEnd = next;
+        while (nalEnd > header + 1 && nalEnd[-1] == 0) {
+            nalEnd--;
+        }
+
+        RbspReader reader(header + 1, nalEnd);
+        const int type = *header & 0x1f;
+        if (type == NalUnitType_Sps || type == NalUnitType_Pps) {
+            StreamIndexParameterSet parameterSet = {};
+            parameterSet.offset = inUnit.offset + (startCode - inUnit.data);
+            parameterSet.size = (uint32_t)(nalEnd - startCode);
+            parameterSet.frame = (uint32_t)inUnit.frameIndex;
+            parameterSet.type = (uint8_t)type;
+            if (type == NalUnitType_Sps) {
+                // profile_idc, constraint flags, level_idc
+                reader.readBits(24);
+                parameterSet.id = (uint8_t)reader.readUe();
+            } else {
+                parameterSet.id = (uint8_t)reader.readUe();
+                parameterSet.spsId = (uint8_t)reader.readUe();
+            }
+            if (reader.ok()) {
+                ioParameterSets.push_back(parameterSet);
+            }
+        } else if (type == NalUnitType_Slice || type == NalUnitType_IdrSlice) {
+            // first_mb_in_slice, slice_type, pic_parameter_set_id
+            reader.readUe();
+            reader.readUe();
+            ioEntry.ppsId = (uint8_t)reader.readUe();
+            return;
+        }
+        startCode = next;
+    }
+}
+
+void
+StreamIndex::build(const uint8_t* inData, size_t inSize)
+{
+    mSidecar.reset();
+    mBuiltEntries.clear();
+    mBuiltKeyframes.clear();
+    mBuiltRecoveryPoints.clear();
+    mBuiltParameterSets.clear();
+
+    AnnexBPacketizer packetizer(inData, inSize);
+    AccessUnit unit;
+    while (packetizer.next(unit)) {
+        if (!unit.picture) {
+            continue;
+        }
+        StreamIndexEntry entry = {};
+        entry.offset = unit.offset;
+        entry.size = (uint32_t)unit.size;
+        entry.flags = (uint16_t)((unit.idr ? StreamIndexFlag_Idr : 0) | (unit.recoveryPoint ? StreamIndexFlag_RecoveryPoint : 0)
+            | (unit.sps ? StreamIndexFlag_Sps : 0) | (unit.pps ? StreamIndexFlag_Pps : 0));
+        // Keyframes and parameter sets are walked again, up to the first slice only
+        if (unit.idr || unit.recoveryPoint || unit.sps || unit.pps) {
+            IndexAccessUnitHeader(unit, entry, mBuiltParameterSets);
+        }
+        if (unit.idr) {
+            mBuiltKeyframes.push_back((uint32_t)mBuiltEntries.size());
+        } else if (unit.recoveryPoint) {
+            mBuiltRecoveryPoints.push_back((uint32_t)mBuiltEntries.size());
+        }
+        mBuiltEntries.push_back(entry);
+    }
+    useBuiltTables();
+}
+
+void
+StreamIndex::useBuiltTables()
+{
+    mEntries = mBuiltEntries.data();
+    mKeyframes = mBuiltKeyframes.data();
+    mRecoveryPoints = mBuiltRecoveryPoints.data();
+    mParameterSets = mBuiltParameterSets.data();
+    mFrameCount = (int64_t)mBuiltEntries.size();
+    mKeyframeCount = (int64_t)mBuiltKeyframes.size();
+    mRecoveryPointCount = (int64_t)mBuiltRecoveryPoints.size();
+    mParameterSetCount = (int64_t)mBuiltParameterSets.size();
+}
+
+bool
+StreamIndex::save(const std::string& inPath, uint64_t inSourceSize, int64_t inSourceModified) const
+{
+    StreamIndexHeader header = {};
+    memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+    header.version = kIndexVersion;
+    header.sourceSize = inSourceSize;
+    header.sourceModified = inSourceModified;
+    header.frameCount = (uint32_t)mFrameCount;
+    header.keyframeCount = (uint32_t)mKeyframeCount;
+    header.recoveryPointCount = (uint32_t)mRecoveryPointCount;
+    header.parameterSetCount = (uint32_t)mParameterSetCount;
+
+    // Written under a temporary name and renamed, so a reader never maps half a sidecar
+    const std::string tempPath = inPath + ".tmp";
+    FILE* pFile = fopen(tempPath.c_str(), "wb");
+    if (!pFile) {
+        std::cerr << "Create file " << tempPath << " failed" << std::endl;
+        return false;
+    }
+    const size_t frameNumbers = (size_t)(mKeyframeCount + mRecoveryPointCount) * sizeof(uint32_t);
+    const uint8_t padding[8] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, pFile) == 1
+        && fwrite(mEntries, sizeof(StreamIndexEntry), (size_t)mFrameCount, pFile) == (size_t)mFrameCount
+        && fwrite(mKeyframes, sizeof(uint32_t), (size_t)mKeyframeCount, pFile) == (size_t)mKeyframeCount
+        && fwrite(mRecoveryPoints, sizeof(uint32_t), (size_t)mRecoveryPointCount, pFile) == (size_t)mRecoveryPointCount
+        && fwrite(padding, 1, AlignSize(frameNumbers) - frameNumbers, pFile) == AlignSize(frameNumbers) - frameNumbers
+        && fwrite(mParameterSets, sizeof(StreamIndexParameterSet), (size_t)mParameterSetCount, pFile) == (size_t)mParameterSetCount;
+    ok = fclose(pFile) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tempPath.c_str(), inPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tempPath.c_str(), inPath.c_str()) == 0;
+#endif
+    if (!ok) {
+        std::cerr << "Write file " << inPath << " failed" << std::endl;
+        remove(tempPath.c_str());
+    }
+    return ok;
+}
+
+bool
+StreamIndex::load(const std::string& inPath, uint64_t inSourceSize, int64_t inSourceModified)
+{
+    std::unique_ptr<MappedFile> pSidecar(new MappedFile(inPath));
+    if (!*pSidecar || pSidecar->size() < sizeof(StreamIndexHeader)) {
+        return false;
+    }
+    const uint8_t* pData = pSidecar->data();
+    const StreamIndexHeader& header = *(const StreamIndexHeader*)pData;
+    if (memcmp(header.magic, kIndexMagic, sizeof(header.magic)) != 0 || header.version != kIndexVersion
+        || header.sourceSize != inSourceSize || header.sourceModified != inSourceModified) {
+        return false;
+    }
+
+    const size_t entriesOffset = sizeof(StreamIndexHeader);
+    const size_t keyframesOffset = entriesOffset + (size_t)header.frameCount * sizeof(StreamIndexEntry);
+    const size_t recoveryPointsOffset = keyframesOffset + (size_t)header.keyframeCount * sizeof(uint32_t);
+    const size_t parameterSetsOffset = AlignSize(recoveryPointsOffset + (size_t)header.recoveryPointCount * sizeof(uint32_t));
+    if (pSidecar->size() != parameterSetsOffset + (size_t)header.parameterSetCount * sizeof(StreamIndexParameterSet)
+        || !IsConsistent(header, (const StreamIndexEntry*)(pData + entriesOffset), (const uint32_t*)(pData + keyframesOffset),
+            (const uint32_t*)(pData + recoveryPointsOffset), (const StreamIndexParameterSet*)(pData + parameterSetsOffset))) {
+        std::cerr << "Index " << inPath << " is damaged, rebuilding it" << std::endl;
+        return false;
+    }
+
+    mBuiltEntries.clear();
+    mBuiltKeyframes.clear();
+    mBuiltRecoveryPoints.clear();
+    mBuiltParameterSets.clear();
+    mEntries = (const StreamIndexEntry*)(pData + entriesOffset);
+    mKeyframes = (const uint32_t*)(pData + keyframesOffset);
+    mRecoveryPoints = (const uint32_t*)(pData + recoveryPointsOffset);
+    mParameterSets = (const StreamIndexParameterSet*)(pData + parameterSetsOffset);
+    mFrameCount = header.frameCount;
+    mKeyframeCount = header.keyframeCount;
+    mRecoveryPointCount = header.recoveryPointCount;
+    mParameterSetCount = header.parameterSetCount;
+    mSidecar = std::move(pSidecar);
+    return true;
+}
+
+bool
+StreamIndex::open(const std::string& inStreamPath, const MappedFile& inStream)
+{
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if (!GetFileStamp(inStreamPath, sourceSize, sourceModified)) {
+        return false;
+    }
+    const std::string sidecarPath = GetSidecarPath(inStreamPath);
+    if (load(sidecarPath, sourceSize, sourceModified)) {
+        return true;
+    }
+    build(inStream.data(), inStream.size());
+    save(sidecarPath, sourceSize, sourceModified);
+    return true;
+}
+
+bool
+StreamIndex::GetFileStamp(const std::string& inPath, uint64_t& outSize, int64_t& outModified)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(inPath.c_str(), GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+    outSize = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    outModified = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat status;
+    if (stat(inPath.c_str(), &status) != 0) {
+        return false;
+    }
+    outSize = (uint64_t)status.st_size;
+    outModified = (int64_t)status.st_mtime * 1000000000 + status.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+int64_t
+StreamIndex::findKeyframe(int64_t inFrame) const
+{
+    if (inFrame < 0 || inFrame >= mFrameCount) {
+        return -1;
+    }
+    const uint32_t* pKeyframe = std::upper_bound(mKeyframes, mKeyframes + mKeyframeCount, (uint32_t)inFrame);
+    if (pKeyframe != mKeyframes) {
+        return pKeyframe[-1];
+    }
+    const uint32_t* pRecoveryPoint = std::upper_bound(mRecoveryPoints, mRecoveryPoints + mRecoveryPointCount, (uint32_t)inFrame);
+    if (pRecoveryPoint != mRecoveryPoints) {
+        return pRecoveryPoint[-1];
+    }
+    return -1;
+}
+
+static bool EarlierFrame(const StreamIndexParameterSet& inSet, int64_t inFrame) {
+    return (int64_t)inSet.frame < inFrame;
+}
+
+const StreamIndexParameterSet*
+StreamIndex::findParameterSet(int inType, int inId, int64_t inBefore) const
+{
+    // Parameter sets are in stream order. Streams repeat them at every keyframe, so the
+    // search back from the keyframe ends after a few entries.
+    const StreamIndexParameterSet* pEnd = std::lower_bound(mParameterSets, mParameterSets + mParameterSetCount, inBefore, EarlierFrame);
+    for (const StreamIndexParameterSet* p = pEnd; p-- != mParameterSets;) {
+        if (p->type == inType && p->id == inId) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const StreamIndexParameterSet*>
+StreamIndex::getParameterSets(int64_t inKeyframe) const
+{
+    // Parameter sets in the keyframe access unit itself come with it
+    const StreamIndexParameterSet* pBegin = std::lower_bound(mParameterSets, mParameterSets + mParameterSetCount, inKeyframe, EarlierFrame);
+    const StreamIndexParameterSet* pEnd = pBegin;
+    while (pEnd != mParameterSets + mParameterSetCount && pEnd->frame == inKeyframe) {
+        pEnd++;
+    }
+    auto inKeyframeUnit = [&](int inType, int inId) {
+        return std::any_of(pBegin, pEnd, [&](const StreamIndexParameterSet& inSet) { return inSet.type == inType && inSet.id == inId; });
+    };
+
+    std::vector<const StreamIndexParameterSet*> parameterSets;
+    const int ppsId = mEntries[inKeyframe].ppsId;
+    const StreamIndexParameterSet* pPps = std::find_if(pBegin, pEnd,
+        [&](const StreamIndexParameterSet& inSet) { return inSet.type == NalUnitType_Pps && inSet.id == ppsId; });
+    const bool ppsInKeyframe = pPps != pEnd;
+    if (!ppsInKeyframe) {
+        pPps = findParameterSet(NalUnitType_Pps, ppsId, inKeyframe);
+        if (!pPps) {
+            return parameterSets;
+        }
+    }
+    if (!inKeyframeUnit(NalUnitType_Sps, pPps->spsId)) {
+        if (const StreamIndexParameterSet* pSps = findParameterSet(NalUnitType_Sps, pPps->spsId, inKeyframe)) {
+            parameterSets.push_back(pSps);
+        }
+    }
+    if (!ppsInKeyframe) {
+        parameterSets.push_back(pPps);
+    }
+    return parameterSets;
+}
+
+bool
+StreamSeeker::seek(int64_t inFrame)
+{
+    const int64_t keyframe = mIndex.findKeyframe(inFrame);
+    if (keyframe < 0) {
+        return false;
+    }
+
+    mDecoder.flush();
+    mParameterSets.clear();
+    for (const StreamIndexParameterSet* pParameterSet : mIndex.getParameterSets(keyframe)) {
+        const uint8_t* pNal = mStream + pParameterSet->offset;
+        mParameterSets.insert(mParameterSets.end(), pNal, pNal + pParameterSet->size);
+    }
+    if (!mParameterSets.empty()) {
+        // One chunk without a picture, anything a backend makes of it is dropped
+        mDecoder.decode(mParameterSets.data(), mParameterSets.size(), keyframe - 1, true);
+        while (mDecoder.getFrame()) {
+        }
+    }
+
+    mPacketizer.reset((size_t)mIndex.getEntry(keyframe).offset, keyframe);
+    mKeyframe = keyframe;
+    mTarget = inFrame;
+    mPreroll = true;
+    mPrerollFrames += inFrame - keyframe;
+    return true;
+}
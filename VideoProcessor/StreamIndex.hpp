@@ -0,0 +1,169 @@
+#pragma once
+
+#include "AnnexBPacketizer.hpp"
+#include "Decoder.hpp"
+#include "MappedFile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum StreamIndexFlags {
+    StreamIndexFlag_Idr = 1 << 0,
+    StreamIndexFlag_RecoveryPoint = 1 << 1,
+    StreamIndexFlag_Sps = 1 << 2,
+    StreamIndexFlag_Pps = 1 << 3,
+};
+
+// One access unit. Entry n is frame n in decode order, the frameIndex the packetizer gives it.
+struct StreamIndexEntry {
+    uint64_t offset;
+    uint32_t size;
+    uint16_t flags;             // StreamIndexFlags
+    uint8_t ppsId;              // PPS the first slice refers to
+    uint8_t reserved;
+};
+
+// One SPS or PPS NAL unit, start code included
+struct StreamIndexParameterSet {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t frame;             // Access unit the NAL unit is part of
+    uint8_t type;               // NalUnitType_Sps or NalUnitType_Pps
+    uint8_t id;
+    uint8_t spsId;              // PPS only: the SPS it refers to
+    uint8_t reserved[5];
+};
+
+// Sidecar file layout: the header, frameCount entries, the frame numbers (uint32) of the
+// keyframeCount IDR pictures and of the recoveryPointCount recovery points, padded to 8 bytes,
+// and parameterSetCount parameter sets. Everything is little endian and naturally aligned, so
+// a mapped sidecar is used in place.
+struct StreamIndexHeader {
+    char magic[4];              // "VIDX"
+    uint32_t version;
+    // Size and modification time of the indexed stream, the sidecar is stale when they change
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint32_t frameCount;
+    uint32_t keyframeCount;
+    uint32_t recoveryPointCount;
+    uint32_t parameterSetCount;
+};
+
+static_assert(sizeof(StreamIndexEntry) == 16, "StreamIndexEntry is part of the sidecar format");
+static_assert(sizeof(StreamIndexParameterSet) == 24, "StreamIndexParameterSet is part of the sidecar format");
+static_assert(sizeof(StreamIndexHeader) == 40, "StreamIndexHeader is part of the sidecar format");
+
+// Random access index of an H.264 Annex-B stream: where every access unit starts, which ones
+// decoding can start at (IDR pictures and recovery points) and where the parameter sets are.
+// Built with one pass of the packetizer, then kept next to the stream as <stream>.idx so
+// later runs map it instead of parsing the stream again.
+class StreamIndex {
+public:
+    StreamIndex() = default;
+
+    StreamIndex(const StreamIndex&) = delete;
+    StreamIndex& operator=(const StreamIndex&) = delete;
+
+    static std::string GetSidecarPath(const std::string& inStreamPath) { return inStreamPath + ".idx"; }
+
+    // Maps the sidecar of inStreamPath if it is up to date, otherwise indexes inStream and
+    // writes a new sidecar (a sidecar that cannot be written is reported, the index still works)
+    bool open(const std::string& inStreamPath, const MappedFile& inStream);
+
+    // Scans the whole stream
+    void build(const uint8_t* inData, size_t inSize);
+
+    // inSourceSize and inSourceModified identify the indexed stream, see GetFileStamp()
+    bool save(const std::string& inPath, uint64_t inSourceSize, int64_t inSourceModified) const;
+
+    // Fails on missing, damaged or stale (not matching inSourceSize/inSourceModified) sidecars.
+    // Damaged includes tables that point past the stream or are out of order, so open() rebuilds
+    // instead of handing StreamSeeker offsets it cannot trust.
+    bool load(const std::string& inPath, uint64_t inSourceSize, int64_t inSourceModified);
+
+    // Size and last write time of a file, false if it does not exist
+    static bool GetFileStamp(const std::string& inPath, uint64_t& outSize, int64_t& outModified);
+
+    int64_t getFrameCount() const { return mFrameCount; }
+    // IDR pictures, getKeyframe() returns the frame number of the inKeyframe-th one
+    int64_t getKeyframeCount() const { return mKeyframeCount; }
+    int64_t getKeyframe(int64_t inKeyframe) const { return mKeyframes[inKeyframe]; }
+    // Recovery points of non-IDR pictures, getRecoveryPoint() returns the frame number of the
+    // inRecoveryPoint-th one
+    int64_t getRecoveryPointCount() const { return mRecoveryPointCount; }
+    int64_t getRecoveryPoint(int64_t inRecoveryPoint) const { return mRecoveryPoints[inRecoveryPoint]; }
+    const StreamIndexEntry& getEntry(int64_t inFrame) const { return mEntries[inFrame]; }
+
+    // The frame decoding has to start at to get inFrame: the nearest IDR picture at or before
+    // it, or the nearest recovery point if no IDR picture precedes it. -1 if there is none.
+    // O(log n) in the number of keyframes.
+    int64_t findKeyframe(int64_t inFrame) const;
+
+    // The SPS and PPS decoding from inKeyframe needs that are not part of its own access unit,
+    // SPS first
+    std::vector<const StreamIndexParameterSet*> getParameterSets(int64_t inKeyframe) const;
+
+private:
+    const StreamIndexParameterSet* findParameterSet(int inType, int inId, int64_t inBefore) const;
+    void useBuiltTables();
+
+    const StreamIndexEntry* mEntries = nullptr;
+    const uint32_t* mKeyframes = nullptr;
+    const uint32_t* mRecoveryPoints = nullptr;
+    const StreamIndexParameterSet* mParameterSets = nullptr;
+    int64_t mFrameCount = 0;
+    int64_t mKeyframeCount = 0;
+    int64_t mRecoveryPointCount = 0;
+    int64_t mParameterSetCount = 0;
+
+    // Backing store: either built in memory or a mapped sidecar
+    std::vector<StreamIndexEntry> mBuiltEntries;
+    std::vector<uint32_t> mBuiltKeyframes;
+    std::vector<uint32_t> mBuiltRecoveryPoints;
+    std::vector<StreamIndexParameterSet> mBuiltParameterSets;
+    std::unique_ptr<MappedFile> mSidecar;
+};
+
+// Random access on top of a StreamIndex. seek() drops what the decoder has in flight, feeds it
+// the parameter sets the nearest keyframe needs and restarts the packetizer at that keyframe.
+// The frames from there to the target are decoded as references only: isPreroll() tells which
+// decoded frames to drop. The decoder outputs in display order, so with B-frames a reference
+// decoded before the target can be displayed after it; the frames to drop are the ones out of
+// the decoder before the target's own picture, not the ones with a lower decode order number.
+class StreamSeeker {
+public:
+    StreamSeeker(const StreamIndex& inIndex, const uint8_t* inStream, AnnexBPacketizer& ioPacketizer, Decoder& ioDecoder)
+        : mIndex(inIndex), mStream(inStream), mPacketizer(ioPacketizer), mDecoder(ioDecoder) {}
+
+    // Returns false (and changes nothing) if inFrame is out of range or has no keyframe before it
+    bool seek(int64_t inFrame);
+
+    // Call for every decoded frame in output order after seek(), with its timestamp (the decode
+    // order frame number): true until the target's picture comes out, false for it and after
+    bool isPreroll(int64_t inTimestamp) {
+        if (mPreroll && inTimestamp == mTarget) {
+            mPreroll = false;
+        }
+        return mPreroll;
+    }
+
+    int64_t getTarget() const { return mTarget; }
+    int64_t getKeyframe() const { return mKeyframe; }
+    // Access units decoded only to reach the target, over all seeks
+    uint64_t getPrerollFrames() const { return mPrerollFrames; }
+
+private:
+    const StreamIndex& mIndex;
+    const uint8_t* mStream;
+    AnnexBPacketizer& mPacketizer;
+    Decoder& mDecoder;
+    std::vector<uint8_t> mParameterSets;
+    int64_t mTarget = 0;
+    int64_t mKeyframe = 0;
+    bool mPreroll = false;
+    uint64_t mPrerollFrames = 0;
+};
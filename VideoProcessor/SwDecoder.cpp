@@ -0,0 +1,279 @@
+#include "SwDecoder.hpp"
+
+#include "Utils.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#define AV_API_CALL(avAPI)                                                                                      \
+    do {                                                                                                        \
+        int errorCode = avAPI;                                                                                  \
+        if (errorCode < 0) {                                                                                    \
+            char errName[AV_ERROR_MAX_STRING_SIZE] = {};                                                        \
+            av_strerror(errorCode, errName, sizeof(errName));                                                   \
+            LOG_ERROR("General error " << #avAPI << " returned error " << errName                               \
+                << " in " << __FUNCTION__ << "(" << __FILE__ << ":" << __LINE__ << ")");                        \
+            AsyncLogger::get().flush();                                                                         \
+            throw std::exception();                                                                             \
+        }                                                                                                       \
+    } while (0)
+
+SwDecoder::SwDecoder(int inThreadCount, const FramePoolConfig& inPoolConfig, const DecodeProfile& inProfile,
+    VideoCodec inCodec)
+    : mCodecContext(nullptr)
+    , mParser(nullptr)
+    , mPacket(nullptr)
+    , mFrame(nullptr)
+    , mThreadCount(inThreadCount > 0 ? inThreadCount : (std::max)(1u, std::thread::hardware_concurrency()))
+    , mPixelFormat(AV_PIX_FMT_NONE)
+{
+    FramePoolConfig poolConfig = inPoolConfig;
+    poolConfig.mapSurfaces = false;
+    if (poolConfig.capacity <= 0) {
+        poolConfig.capacity = (inProfile.frameThreading ? mThreadCount : 0) + 4;
+    }
+    mFramePool.reset(new FramePool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), poolConfig));
+
+    const AVCodec* codec = avcodec_find_decoder(inCodec == VideoCodec::Hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+    if (!codec) {
+        LOG_ERROR((inCodec == VideoCodec::Hevc ? "HEVC" : "H.264") << " software decoder not available");
+        AsyncLogger::get().flush();
+        throw std::exception();
+    }
+    mParser = av_parser_init(codec->id);
+    mCodecContext = avcodec_alloc_context3(codec);
+    mPacket = av_packet_alloc();
+    mFrame = av_frame_alloc();
+    if (!mParser || !mCodecContext || !mPacket || !mFrame) {
+        LOG_ERROR("Software decoder allocation failed");
+        AsyncLogger::get().flush();
+        throw std::exception();
+    }
+
+    // Frame threading keeps every core busy on streams with one slice per picture,
+    // slice threading helps on multi-slice streams and costs no extra latency.
+    mCodecContext->thread_count = mThreadCount;
+    mCodecContext->thread_type = inProfile.frameThreading ? FF_THREAD_FRAME | FF_THREAD_SLICE : FF_THREAD_SLICE;
+    AV_API_CALL(avcodec_open2(mCodecContext, codec, nullptr));
+}
+
+SwDecoder::~SwDecoder()
+{
+    av_frame_free(&mFrame);
+    av_packet_free(&mPacket);
+    avcodec_free_context(&mCodecContext);
+    if (mParser) {
+        av_parser_close(mParser);
+    }
+}
+
+int
+SwDecoder::decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp, bool inAccessUnit)
+{
+    bool endOfStream = !inData || inLength == 0;
+
+    if (!endOfStream) {
+        mInput.resize(inLength + AV_INPUT_BUFFER_PADDING_SIZE);
+        memcpy(mInput.data(), inData, inLength);
+        memset(mInput.data() + inLength, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    }
+
+    if (inAccessUnit && !endOfStream) {
+        // Already split, the parser would only add a picture of delay
+        mPacket->data = mInput.data();
+        mPacket->size = (int)inLength;
+        mPacket->pts = inTimestamp;
+        mPacket->dts = AV_NOPTS_VALUE;
+        DecodePacket(mPacket);
+        return (int)mReadyFrames.size();
+    }
+
+    const uint8_t* data = mInput.data();
+    size_t remaining = endOfStream ? 0 : inLength;
+    while (remaining > 0) {
+        int used = av_parser_parse2(mParser, mCodecContext, &mPacket->data, &mPacket->size,
+            data, (int)remaining, inTimestamp, AV_NOPTS_VALUE, 0);
+        AV_API_CALL(used);
+        data += used;
+        remaining -= used;
+        if (mPacket->size) {
+            DecodePacket(mPacket);
+        }
+    }
+
+    if (endOfStream) {
+        // Flush the access unit still held by the parser, then drain the decoder
+        av_parser_parse2(mParser, mCodecContext, &mPacket->data, &mPacket->size,
+            nullptr, 0, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (mPacket->size) {
+            DecodePacket(mPacket);
+        }
+        DecodePacket(nullptr);
+        avcodec_flush_buffers(mCodecContext);
+    }
+
+    return (int)mReadyFrames.size();
+}
+
+void
+SwDecoder::DecodePacket(AVPacket* inPacket)
+{
+    int result = avcodec_send_packet(mCodecContext, inPacket);
+    if (result == AVERROR_INVALIDDATA) {
+        // Same policy as NVDEC: a broken access unit is reported, the stream goes on
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_WARNING("Decode Error occurred for packet");
+        return;
+    }
+    if (result != AVERROR_EOF) {
+        AV_API_CALL(result);
+    }
+
+    while (true) {
+        result = avcodec_receive_frame(mCodecContext, mFrame);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            break;
+        }
+        AV_API_CALL(result);
+        if (mFrame->decode_error_flags) {
+            // libavcodec conceals what it cannot decode
+            Telemetry::Count(TelemetryCounter::FramesConcealed);
+            LOG_WARNING("Decode Error occurred for picture");
+        }
+        HandlePictureDisplay(mFrame);
+        av_frame_unref(mFrame);
+    }
+}
+
+void
+SwDecoder::HandleVideoSequence(const AVFrame* inFrame)
+{
+    switch (inFrame->format) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_NV12:
+        mBPP = 1;
+        mFormat.bitDepth = 8;
+        break;
+    case AV_PIX_FMT_YUV420P10LE:
+        mBPP = 2;
+        mFormat.bitDepth = 10;
+        break;
+    default:
+        Telemetry::Count(TelemetryCounter::DecodeErrors);
+        LOG_ERROR("Unsupported software decoder output format " << av_get_pix_fmt_name((AVPixelFormat)inFrame->format));
+        throw std::exception();
+    }
+
+    mPixelFormat = inFrame->format;
+    mWidth = inFrame->width;
+    mLumaHeight = inFrame->height;
+    mChromaHeight = (mLumaHeight + 1) / 2;
+    mNumChromaPlanes = 1;
+
+    mFormat.codedWidth = mCodecContext->coded_width;
+    mFormat.codedHeight = mCodecContext->coded_height;
+    mFormat.frameRateNum = mCodecContext->framerate.num;
+    mFormat.frameRateDen = mCodecContext->framerate.den ? mCodecContext->framerate.den : 1;
+    mFormat.matrixCoefficients = inFrame->colorspace;
+#ifdef AV_FRAME_FLAG_INTERLACED
+    mFormat.progressive = !(inFrame->flags & AV_FRAME_FLAG_INTERLACED);
+#else
+    mFormat.progressive = !inFrame->interlaced_frame;
+#endif
+    mFormat.displayRect = { 0, 0, inFrame->width, inFrame->height };
+
+    LOG_INFO("Video Input Information" << std::endl
+        << "\tCodec        : " << (mCodecContext->codec_id == AV_CODEC_ID_HEVC ? "H.265/HEVC" : "AVC/H.264")
+        << " (software, " << mThreadCount << " threads)" << std::endl
+        << "\tFrame rate   : " << mFormat.frameRateNum << "/" << mFormat.frameRateDen
+        << " = " << 1.0 * mFormat.frameRateNum / mFormat.frameRateDen << " fps" << std::endl
+        << "\tSequence     : " << (mFormat.progressive ? "Progressive" : "Interlaced") << std::endl
+        << "\tCoded size   : [" << mFormat.codedWidth << ", " << mFormat.codedHeight << "]" << std::endl
+        << "\tDisplay area : [0, 0, " << mWidth << ", " << mLumaHeight << "]" << std::endl
+        << "\tBit depth    : " << mFormat.bitDepth);
+}
+
+void
+SwDecoder::HandlePictureDisplay(const AVFrame* inFrame)
+{
+    if (inFrame->format != mPixelFormat || (unsigned)inFrame->width != mWidth || (unsigned)inFrame->height != mLumaHeight) {
+        HandleVideoSequence(inFrame);
+    }
+
+    // The pool grows slots that are too small for a new sequence
+    FrameHandle frame = AcquireFrame(GetFrameSize());
+    if (!frame) {
+        return;
+    }
+    const int nPitch = GetWidth() * mBPP;
+    FrameInfo& info = frame.info();
+    info.width = GetWidth();
+    info.height = mLumaHeight;
+    info.pitch = nPitch;
+    info.bpp = mBPP;
+    info.matrix = mFormat.matrixCoefficients;
+    info.timestamp = inFrame->pts;
+    uint8_t* pDecodedFrame = frame.data();
+    mReadyFrames.push_back(frame);
+
+    const int nChromaWidth = (mWidth + 1) / 2;
+    uint8_t* pDstChroma = pDecodedFrame + nPitch * mLumaHeight;
+    // An odd width leaves one column of padding in every luma row, the edge sample is repeated
+    // into it so the frame has no uninitialized bytes
+    const bool padLuma = GetWidth() > (int)mWidth;
+
+    if (mBPP == 1) {
+        // Copy luma plane
+        for (unsigned y = 0; y < mLumaHeight; y++) {
+            uint8_t* pDst = pDecodedFrame + y * nPitch;
+            memcpy(pDst, inFrame->data[0] + y * inFrame->linesize[0], mWidth);
+            if (padLuma) {
+                pDst[mWidth] = pDst[mWidth - 1];
+            }
+        }
+        // Copy or interleave chroma planes
+        for (unsigned y = 0; y < mChromaHeight; y++) {
+            uint8_t* pDst = pDstChroma + y * nPitch;
+            if (inFrame->format == AV_PIX_FMT_NV12) {
+                memcpy(pDst, inFrame->data[1] + y * inFrame->linesize[1], nChromaWidth * 2);
+                continue;
+            }
+            const uint8_t* pU = inFrame->data[1] + y * inFrame->linesize[1];
+            const uint8_t* pV = inFrame->data[2] + y * inFrame->linesize[2];
+            for (int x = 0; x < nChromaWidth; x++) {
+                pDst[2 * x] = pU[x];
+                pDst[2 * x + 1] = pV[x];
+            }
+        }
+        return;
+    }
+
+    // P016 keeps the samples MSB aligned, the decoder output is LSB aligned
+    const int nShift = 16 - mFormat.bitDepth;
+    for (unsigned y = 0; y < mLumaHeight; y++) {
+        const uint16_t* pSrc = (const uint16_t*)(inFrame->data[0] + y * inFrame->linesize[0]);
+        uint16_t* pDst = (uint16_t*)(pDecodedFrame + y * nPitch);
+        for (unsigned x = 0; x < mWidth; x++) {
+            pDst[x] = pSrc[x] << nShift;
+        }
+        if (padLuma) {
+            pDst[mWidth] = pDst[mWidth - 1];
+        }
+    }
+    for (unsigned y = 0; y < mChromaHeight; y++) {
+        const uint16_t* pU = (const uint16_t*)(inFrame->data[1] + y * inFrame->linesize[1]);
+        const uint16_t* pV = (const uint16_t*)(inFrame->data[2] + y * inFrame->linesize[2]);
+        uint16_t* pDst = (uint16_t*)(pDstChroma + y * nPitch);
+        for (int x = 0; x < nChromaWidth; x++) {
+            pDst[2 * x] = pU[x] << nShift;
+            pDst[2 * x + 1] = pV[x] << nShift;
+        }
+    }
+}
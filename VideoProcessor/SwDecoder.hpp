@@ -0,0 +1,47 @@
+#pragma once
+
+#include "DecodeProfile.hpp"
+#include "Decoder.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct AVCodecContext;
+struct AVCodecParserContext;
+struct AVPacket;
+struct AVFrame;
+
+// Software H.264/HEVC backend built on libavcodec. Uses frame + slice threading across
+// inThreadCount cores (0 = all cores) and converts the planar decoder output into the
+// same NV12/P016 layout NvDecoder hands out, in host memory. The default pool capacity
+// covers the frames a frame-threaded flush releases at once. Profiles without frame threading
+// use slice threading only, a frame is then held back only as long as the stream's picture
+// reordering requires.
+class SwDecoder : public Decoder {
+public:
+    SwDecoder(int inThreadCount = 0, const FramePoolConfig& inPoolConfig = FramePoolConfig(),
+        const DecodeProfile& inProfile = DecodeProfile(), VideoCodec inCodec = VideoCodec::H264);
+
+    ~SwDecoder();
+
+    int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp = 0, bool inAccessUnit = false) override;
+
+    const char* getName() const override { return "sw"; }
+
+    int GetThreadCount() const { return mThreadCount; }
+
+private:
+    void DecodePacket(AVPacket* inPacket);
+    void HandleVideoSequence(const AVFrame* inFrame);
+    void HandlePictureDisplay(const AVFrame* inFrame);
+
+    AVCodecContext* mCodecContext;
+    AVCodecParserContext* mParser;
+    AVPacket* mPacket;
+    AVFrame* mFrame;
+    int mThreadCount;
+    int mPixelFormat;
+
+    // Parser input must be followed by AV_INPUT_BUFFER_PADDING_SIZE zero bytes
+    std::vector<uint8_t> mInput;
+};
@@ -0,0 +1,66 @@
+#include "SyntheticDecoder.hpp"
+
+#include <cstring>
+
+SyntheticDecoder::SyntheticDecoder(int inWidth, int inHeight, int inWorkPerFrame, const FramePoolConfig& inPoolConfig)
+    : mWorkPerFrame(inWorkPerFrame)
+{
+    FramePoolConfig poolConfig = inPoolConfig;
+    poolConfig.mapSurfaces = false;
+    if (poolConfig.capacity <= 0) {
+        poolConfig.capacity = 4;
+    }
+    mFramePool.reset(new FramePool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), poolConfig));
+
+    mWidth = inWidth;
+    mLumaHeight = inHeight;
+    mChromaHeight = (inHeight + 1) / 2;
+    mNumChromaPlanes = 1;
+    mBPP = 1;
+    mFormat.codedWidth = inWidth;
+    mFormat.codedHeight = inHeight;
+    mFormat.frameRateNum = 30;
+    mFormat.displayRect = { 0, 0, inWidth, inHeight };
+}
+
+int
+SyntheticDecoder::decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp, bool /*inAccessUnit*/)
+{
+    if (!inData || inLength == 0) {
+        return (int)mReadyFrames.size();
+    }
+
+    // xorshift over the payload, every round depends on the previous one
+    uint32_t state = 2166136261u;
+    for (int i = 0; i < mWorkPerFrame; i++) {
+        state ^= inData[i % inLength];
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+    }
+
+    FrameHandle frame = AcquireFrame(GetFrameSize());
+    if (!frame) {
+        return (int)mReadyFrames.size();
+    }
+    const int nPitch = GetWidth();
+    FrameInfo& info = frame.info();
+    info.width = GetWidth();
+    info.height = mLumaHeight;
+    info.pitch = nPitch;
+    info.bpp = 1;
+    info.timestamp = inTimestamp;
+
+    // Moving ramp, so consumers see different frames
+    uint8_t* pFrame = frame.data();
+    for (unsigned y = 0; y < mLumaHeight; y++) {
+        for (int x = 0; x < nPitch; x++) {
+            pFrame[y * nPitch + x] = (uint8_t)(x + y + inTimestamp);
+        }
+    }
+    memset(pFrame + nPitch * mLumaHeight, 128, (size_t)nPitch * mChromaHeight);
+    pFrame[0] = (uint8_t)state;
+
+    mReadyFrames.push_back(frame);
+    return (int)mReadyFrames.size();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Decoder.hpp"
+
+#include <cstdint>
+
+// Stand-in backend without any codec or GPU: every access unit costs inWorkPerFrame rounds of
+// dependent integer arithmetic over its bytes and yields one inWidth x inHeight NV12 test
+// pattern in host memory. For scheduler and scaling measurements on CPU-only machines; the
+// cost is compute bound and per frame, so throughput should scale with cores.
+class SyntheticDecoder : public Decoder {
+public:
+    SyntheticDecoder(int inWidth = 320, int inHeight = 240, int inWorkPerFrame = 200000,
+        const FramePoolConfig& inPoolConfig = FramePoolConfig());
+
+    int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp = 0, bool inAccessUnit = false) override;
+
+    const char* getName() const override { return "synthetic"; }
+
+private:
+    int mWorkPerFrame;
+};
@@ -0,0 +1,426 @@
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+const char* kCounterNames[] = {
+    "frames_decoded", "frames_concealed", "decode_errors", "frames_dropped", "frames_late",
+    "frames_static", "scene_cuts", "access_units", "bytes_parsed",
+    "packets_received", "packets_lost", "frame_cache_hits", "frame_cache_misses", "log_messages_dropped",
+};
+
+int FloorLog2(uint64_t inValue)
+{
+    int result = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (inValue >> shift) {
+            inValue >>= shift;
+            result += shift;
+        }
+    }
+    return result;
+}
+
+// Replaces inPath with a finished file in one step
+bool ReplaceFile(const std::string& inTempPath, const std::string& inPath)
+{
+#ifdef _WIN32
+    return MoveFileExA(inTempPath.c_str(), inPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(inTempPath.c_str(), inPath.c_str()) == 0;
+#endif
+}
+
+void WriteJsonString(std::ostream& inStream, const std::string& inText)
+{
+    inStream << '"';
+    for (char c : inText) {
+        if (c == '"' || c == '\\') {
+            inStream << '\\';
+        }
+        inStream << ((unsigned char)c < 0x20 ? ' ' : c);
+    }
+    inStream << '"';
+}
+
+}
+
+LatencyHistogram::LatencyHistogram()
+    : mBuckets(new std::atomic<uint64_t>[kBucketCount])
+{
+    for (int i = 0; i < kBucketCount; i++) {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int
+LatencyHistogram::GetBucket(uint64_t inNs)
+{
+    const uint64_t kLinear = 1 << kSubBucketBits;
+    if (inNs < kLinear) {
+        return (int)inNs;
+    }
+    const int exponent = FloorLog2(inNs);
+    const int subBucket = (int)(inNs >> (exponent - kSubBucketBits)) & (kLinear - 1);
+    return ((exponent - kSubBucketBits + 1) << kSubBucketBits) + subBucket;
+}
+
+uint64_t
+LatencyHistogram::GetBucketLimit(int inBucket)
+{
+    const int kLinear = 1 << kSubBucketBits;
+    if (inBucket < kLinear) {
+        return inBucket;
+    }
+    const int shift = (inBucket >> kSubBucketBits) - 1;
+    const uint64_t lower = (uint64_t)(kLinear + (inBucket & (kLinear - 1))) << shift;
+    return lower + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t
+LatencyHistogram::getCount() const
+{
+    uint64_t count = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        count += mBuckets[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t
+LatencyHistogram::getPercentileNs(double inPercentile) const
+{
+    const uint64_t count = getCount();
+    if (!count) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(inPercentile / 100 * count + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return GetBucketLimit(i);
+        }
+    }
+    return GetBucketLimit(kBucketCount - 1);
+}
+
+uint64_t
+LatencyHistogram::getCountBelow(uint64_t inNs) const
+{
+    uint64_t count = 0;
+    for (int i = 0; i < kBucketCount && GetBucketLimit(i) < inNs; i++) {
+        count += mBuckets[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+AsyncLogger&
+AsyncLogger::get()
+{
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : mCells(new Cell[kCapacity])
+{
+    for (size_t i = 0; i < kCapacity; i++) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mWriter = std::thread(&AsyncLogger::writerLoop, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    mStopping = true;
+    mWriter.join();
+}
+
+void
+AsyncLogger::log(LogLevel inLevel, std::string inText)
+{
+    // Bounded MPMC ring with a sequence number per cell (Vyukov): a producer claims a position
+    // with one CAS and publishes the cell with a release store, nobody waits for anybody
+    size_t position = mEnqueue.load(std::memory_order_relaxed);
+    Cell* pCell;
+    while (true) {
+        pCell = &mCells[position & (kCapacity - 1)];
+        const size_t sequence = pCell->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (mEnqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            Telemetry::Count(TelemetryCounter::LogMessagesDropped);
+            return;
+        } else {
+            position = mEnqueue.load(std::memory_order_relaxed);
+        }
+    }
+    pCell->level = inLevel;
+    pCell->text = std::move(inText);
+    pCell->sequence.store(position + 1, std::memory_order_release);
+}
+
+void
+AsyncLogger::flush()
+{
+    const size_t target = mEnqueue.load(std::memory_order_acquire);
+    while (mDequeue.load(std::memory_order_acquire) < target && mWriter.joinable()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool
+AsyncLogger::writeNext()
+{
+    const size_t position = mDequeue.load(std::memory_order_relaxed);
+    Cell& cell = mCells[position & (kCapacity - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+        return false;
+    }
+    std::ostream& stream = cell.level == LogLevel::Info ? std::cout : std::cerr;
+    stream << cell.text << std::endl;
+    cell.text.clear();
+    cell.sequence.store(position + kCapacity, std::memory_order_release);
+    mDequeue.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+void
+AsyncLogger::writerLoop()
+{
+    while (true) {
+        const bool stopping = mStopping;
+        while (writeNext()) {
+        }
+        if (stopping) {
+            return;
+        }
+        // Polling keeps the producers free of any wakeup call
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+Telemetry&
+Telemetry::get()
+{
+    static Telemetry telemetry;
+    return telemetry;
+}
+
+int64_t
+Telemetry::NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Telemetry::ThreadBlock&
+Telemetry::GetThreadBlock()
+{
+    thread_local ThreadBlock* tpBlock = nullptr;
+    if (!tpBlock) {
+        tpBlock = &get().registerThread();
+    }
+    return *tpBlock;
+}
+
+Telemetry::ThreadBlock&
+Telemetry::registerThread()
+{
+    std::unique_ptr<ThreadBlock> pBlock(new ThreadBlock);
+    for (std::atomic<uint64_t>& counter : pBlock->counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    pBlock->id = (int)mThreads.size() + 1;
+    mThreads.push_back(std::move(pBlock));
+    return *mThreads.back();
+}
+
+void
+Telemetry::SetThreadName(const char* inName)
+{
+    ThreadBlock& block = GetThreadBlock();
+    std::lock_guard<std::mutex> lock(get().mLock);
+    block.name = inName;
+}
+
+uint64_t
+Telemetry::getCounter(TelemetryCounter inCounter) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    uint64_t value = 0;
+    for (const std::unique_ptr<ThreadBlock>& pBlock : mThreads) {
+        value += pBlock->counters[(int)inCounter].load(std::memory_order_relaxed);
+    }
+    return value;
+}
+
+const char*
+Telemetry::GetCounterName(TelemetryCounter inCounter)
+{
+    return kCounterNames[(int)inCounter];
+}
+
+LatencyHistogram&
+Telemetry::getHistogram(const std::string& inName, const std::string& inLabels)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    for (NamedHistogram& histogram : mHistograms) {
+        if (histogram.name == inName && histogram.labels == inLabels) {
+            return histogram.histogram;
+        }
+    }
+    mHistograms.emplace_back();
+    mHistograms.back().name = inName;
+    mHistograms.back().labels = inLabels;
+    return mHistograms.back().histogram;
+}
+
+void
+Telemetry::RecordTrace(const char* inName, int64_t inStartUs, int64_t inDurationUs)
+{
+    ThreadBlock& block = GetThreadBlock();
+    const uint32_t count = block.traceCount.load(std::memory_order_relaxed);
+    if (count == kTraceCapacity) {
+        return;
+    }
+    if (!block.traceEvents) {
+        block.traceEvents.reset(new TraceEvent[kTraceCapacity]);
+    }
+    block.traceEvents[count] = { inName, inStartUs, inDurationUs };
+    block.traceCount.store(count + 1, std::memory_order_release);
+}
+
+void
+Telemetry::writePrometheus(std::ostream& inStream) const
+{
+    for (int i = 0; i < (int)TelemetryCounter::Count; i++) {
+        const char* name = kCounterNames[i];
+        inStream << "# TYPE videoprocessor_" << name << "_total counter\n"
+            << "videoprocessor_" << name << "_total " << getCounter((TelemetryCounter)i) << "\n";
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    std::string lastName;
+    for (const NamedHistogram& named : mHistograms) {
+        const std::string name = "videoprocessor_" + named.name;
+        if (name != lastName) {
+            inStream << "# TYPE " << name << " histogram\n";
+            lastName = name;
+        }
+        const std::string labels = named.labels.empty() ? std::string() : named.labels + ",";
+        // Powers of two from 1 us to 8 s: bucket bounds of the histogram, so the counts are exact
+        for (int shift = 10; shift <= 33; shift++) {
+            const uint64_t limitNs = (uint64_t)1 << shift;
+            inStream << name << "_bucket{" << labels << "le=\"" << limitNs / 1e9 << "\"} "
+                << named.histogram.getCountBelow(limitNs) << "\n";
+        }
+        const uint64_t count = named.histogram.getCount();
+        inStream << name << "_bucket{" << labels << "le=\"+Inf\"} " << count << "\n";
+        const std::string suffix = named.labels.empty() ? std::string() : "{" + named.labels + "}";
+        inStream << name << "_sum" << suffix << " " << named.histogram.getSumNs() / 1e9 << "\n"
+            << name << "_count" << suffix << " " << count << "\n";
+    }
+}
+
+bool
+Telemetry::writePrometheus(const std::string& inPath) const
+{
+    const std::string tempPath = inPath + ".tmp";
+    {
+        std::ofstream file(tempPath);
+        writePrometheus(file);
+        if (!file) {
+            return false;
+        }
+    }
+    return ReplaceFile(tempPath, inPath);
+}
+
+bool
+Telemetry::writeChromeTrace(const std::string& inPath) const
+{
+    std::ofstream file(inPath);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::lock_guard<std::mutex> lock(mLock);
+    for (const std::unique_ptr<ThreadBlock>& pBlock : mThreads) {
+        const uint32_t count = pBlock->traceCount.load(std::memory_order_acquire);
+        if (!pBlock->name.empty()) {
+            file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pBlock->id
+                << ",\"args\":{\"name\":";
+            WriteJsonString(file, pBlock->name);
+            file << "}}";
+            first = false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const TraceEvent& event = pBlock->traceEvents[i];
+            file << (first ? "\n" : ",\n") << "{\"name\":";
+            WriteJsonString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBlock->id << ",\"ts\":" << event.startUs - mStartUs
+                << ",\"dur\":" << event.durationUs << "}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+TelemetryExporter::TelemetryExporter(const std::string& inMetricsPath, const std::string& inTracePath, int inIntervalMs)
+    : mMetricsPath(inMetricsPath)
+    , mTracePath(inTracePath)
+    , mIntervalMs(inIntervalMs)
+{
+    if (!mTracePath.empty()) {
+        Telemetry::get().setTracing(true);
+    }
+    if (!mMetricsPath.empty()) {
+        mThread = std::thread(&TelemetryExporter::exportLoop, this);
+    }
+}
+
+TelemetryExporter::~TelemetryExporter()
+{
+    if (mThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mStopping = true;
+        }
+        mStop.notify_all();
+        mThread.join();
+        if (!Telemetry::get().writePrometheus(mMetricsPath)) {
+            std::cerr << "Write file " << mMetricsPath << " failed" << std::endl;
+        }
+    }
+    if (!mTracePath.empty()) {
+        Telemetry::get().setTracing(false);
+        if (!Telemetry::get().writeChromeTrace(mTracePath)) {
+            std::cerr << "Write file " << mTracePath << " failed" << std::endl;
+        }
+    }
+}
+
+void
+TelemetryExporter::exportLoop()
+{
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStop.wait_for(lock, std::chrono::milliseconds(mIntervalMs), [this] { return mStopping; })) {
+        if (!Telemetry::get().writePrometheus(mMetricsPath)) {
+            LOG_WARNING("Write file " << mMetricsPath << " failed");
+        }
+    }
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process wide counters, summed over all threads on export
+enum class TelemetryCounter {
+    FramesDecoded,          // Frames out of a decoder
+    FramesConcealed,        // Decoded with errors the decoder concealed
+    DecodeErrors,           // Pictures or packets the decoder reported broken
+    FramesDropped,          // No frame pool slot left (FramePoolPolicy::Drop)
+    FramesLate,             // Dropped by the presentation clock
+    FramesStatic,           // Static frames the pipeline did not convert, see SceneAnalyzer
+    SceneCuts,              // Scene changes found by a SceneAnalyzer
+    AccessUnits,            // Access units packetized
+    BytesParsed,            // Bytes of the access units packetized
+    PacketsReceived,        // Datagrams taken in by a LiveIngest
+    PacketsLost,            // RTP packets given up on, or TS packets missing by continuity count
+    FrameCacheHits,         // Frames a FrameCache had
+    FrameCacheMisses,       // Frames a FrameCache did not have, decoded again
+    LogMessagesDropped,     // Log queue full
+    Count
+};
+
+// Log-linear histogram of durations in ns: 8 linear buckets per power of two, so every bucket
+// is at most 12.5% wide at any magnitude and the whole range fits in 496 counters. record() is
+// one relaxed atomic increment; threads may record into the same histogram.
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 3;
+    static const int kBucketCount = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    LatencyHistogram();
+
+    void record(uint64_t inNs) {
+        mBuckets[GetBucket(inNs)].fetch_add(1, std::memory_order_relaxed);
+        mSumNs.fetch_add(inNs, std::memory_order_relaxed);
+    }
+
+    uint64_t getCount() const;
+    uint64_t getSumNs() const { return mSumNs.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the inPercentile (0..100) sample
+    uint64_t getPercentileNs(double inPercentile) const;
+    // Samples below inNs, exact when inNs is a power of two
+    uint64_t getCountBelow(uint64_t inNs) const;
+
+    static int GetBucket(uint64_t inNs);
+    // Largest value falling into inBucket
+    static uint64_t GetBucketLimit(int inBucket);
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> mBuckets;
+    std::atomic<uint64_t> mSumNs{ 0 };
+};
+
+// Severity of a log message; Info goes to stdout, the rest to stderr
+enum class LogLevel {
+    Info,
+    Warning,
+    Error,
+};
+
+// Logging that never blocks the calling thread: messages go into a bounded lock-free queue
+// and a background thread writes them out. A full queue drops the message and counts it.
+class AsyncLogger {
+public:
+    static AsyncLogger& get();
+
+    // Writes out everything still queued
+    ~AsyncLogger();
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    void log(LogLevel inLevel, std::string inText);
+
+    // Waits until the messages queued so far are written, e.g. before printing a report
+    void flush();
+
+private:
+    static const size_t kCapacity = 1024;   // A power of 2
+
+    struct Cell {
+        std::atomic<size_t> sequence{ 0 };
+        LogLevel level = LogLevel::Info;
+        std::string text;
+    };
+
+    AsyncLogger();
+    void writerLoop();
+    bool writeNext();
+
+    std::unique_ptr<Cell[]> mCells;
+    alignas(64) std::atomic<size_t> mEnqueue{ 0 };
+    alignas(64) std::atomic<size_t> mDequeue{ 0 };     // Writer thread only, read by flush()
+    std::atomic<bool> mStopping{ false };
+    std::thread mWriter;
+};
+
+#define TELEMETRY_LOG(level, message)                                                                           \
+    do {                                                                                                        \
+        std::ostringstream logStream;                                                                           \
+        logStream << message;                                                                                   \
+        AsyncLogger::get().log(level, logStream.str());                                                         \
+    } while (0)
+
+#define LOG_INFO(message) TELEMETRY_LOG(LogLevel::Info, message)
+#define LOG_WARNING(message) TELEMETRY_LOG(LogLevel::Warning, message)
+#define LOG_ERROR(message) TELEMETRY_LOG(LogLevel::Error, message)
+
+// Registry behind the counters, histograms and trace events, with the exporters. Counters and
+// trace events are kept per thread: a thread only ever writes its own block, with plain relaxed
+// stores, and the exporters sum the blocks up. Blocks outlive their threads, so nothing counted
+// is lost when a pipeline shuts down.
+class Telemetry {
+public:
+    static Telemetry& get();
+
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    static void Count(TelemetryCounter inCounter, uint64_t inValue = 1) {
+        std::atomic<uint64_t>& counter = GetThreadBlock().counters[(int)inCounter];
+        counter.store(counter.load(std::memory_order_relaxed) + inValue, std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in the trace
+    static void SetThreadName(const char* inName);
+
+    uint64_t getCounter(TelemetryCounter inCounter) const;
+    static const char* GetCounterName(TelemetryCounter inCounter);
+
+    // Registered once and kept for the lifetime of the process, so callers keep the reference.
+    // inLabels is Prometheus label text, e.g. stage="decode".
+    LatencyHistogram& getHistogram(const std::string& inName, const std::string& inLabels = std::string());
+
+    // Trace events are only recorded while tracing is on, the first kTraceCapacity per thread
+    void setTracing(bool inEnabled) { mTracing = inEnabled; }
+    bool isTracing() const { return mTracing.load(std::memory_order_relaxed); }
+    static void RecordTrace(const char* inName, int64_t inStartUs, int64_t inDurationUs);
+
+    // Prometheus text exposition format, written to a temporary file and renamed, so a scraper
+    // never sees half a file
+    bool writePrometheus(const std::string& inPath) const;
+    void writePrometheus(std::ostream& inStream) const;
+    // Chrome trace event JSON (chrome://tracing, Perfetto)
+    bool writeChromeTrace(const std::string& inPath) const;
+
+    static int64_t NowUs();
+
+private:
+    static const uint32_t kTraceCapacity = 1 << 16;
+
+    struct TraceEvent {
+        const char* name;
+        int64_t startUs;
+        int64_t durationUs;
+    };
+
+    struct ThreadBlock {
+        std::atomic<uint64_t> counters[(int)TelemetryCounter::Count];
+        int id = 0;
+        std::string name;                                   // Under mLock
+        std::unique_ptr<TraceEvent[]> traceEvents;          // Allocated on the first event
+        std::atomic<uint32_t> traceCount{ 0 };              // Events before it are final
+    };
+
+    struct NamedHistogram {
+        std::string name;
+        std::string labels;
+        LatencyHistogram histogram;
+    };
+
+    Telemetry() = default;
+    static ThreadBlock& GetThreadBlock();
+    ThreadBlock& registerThread();
+
+    mutable std::mutex mLock;
+    std::vector<std::unique_ptr<ThreadBlock>> mThreads;
+    std::deque<NamedHistogram> mHistograms;                 // Stable references
+    std::atomic<bool> mTracing{ false };
+    const int64_t mStartUs = NowUs();
+};
+
+// Records its scope as a trace event while tracing is on
+class TraceScope {
+public:
+    explicit TraceScope(const char* inName)
+        : mName(Telemetry::get().isTracing() ? inName : nullptr)
+        , mStartUs(mName ? Telemetry::NowUs() : 0) {}
+    ~TraceScope() {
+        if (mName) {
+            Telemetry::RecordTrace(mName, mStartUs, Telemetry::NowUs() - mStartUs);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* mName;
+    int64_t mStartUs;
+};
+
+// Rewrites a Prometheus text file every inIntervalMs on a background thread, and once more when
+// destroyed. With a trace path, tracing is on for the exporter's lifetime and the trace is
+// written when it is destroyed. Either path may be empty.
+class TelemetryExporter {
+public:
+    TelemetryExporter(const std::string& inMetricsPath, const std::string& inTracePath, int inIntervalMs = 1000);
+    ~TelemetryExporter();
+
+    TelemetryExporter(const TelemetryExporter&) = delete;
+    TelemetryExporter& operator=(const TelemetryExporter&) = delete;
+
+private:
+    void exportLoop();
+
+    std::string mMetricsPath;
+    std::string mTracePath;
+    int mIntervalMs;
+    std::mutex mLock;
+    std::condition_variable mStop;
+    bool mStopping = false;
+    std::thread mThread;
+};
@@ -0,0 +1,85 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int inThreadCount)
+{
+    int threadCount = inThreadCount > 0 ? inThreadCount : (int)(std::max)(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < threadCount; i++) {
+        mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStop = true;
+    }
+    mWorkCondition.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void
+ThreadPool::parallelFor(int inCount, const std::function<void(int, int)>& inFunc)
+{
+    if (inCount <= 0) {
+        return;
+    }
+    if (mWorkers.empty() || inCount == 1) {
+        inFunc(0, inCount);
+        return;
+    }
+
+    std::lock_guard<std::mutex> callLock(mCallLock);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mJob = &inFunc;
+        mJobCount = inCount;
+        mPending = (int)mWorkers.size();
+        mGeneration++;
+    }
+    mWorkCondition.notify_all();
+
+    runPart(0);
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mDoneCondition.wait(lock, [this] { return mPending == 0; });
+    mJob = nullptr;
+}
+
+void
+ThreadPool::runPart(int inPart)
+{
+    const int parts = getThreadCount();
+    const int begin = (int)((int64_t)mJobCount * inPart / parts);
+    const int end = (int)((int64_t)mJobCount * (inPart + 1) / parts);
+    if (begin < end) {
+        (*mJob)(begin, end);
+    }
+}
+
+void
+ThreadPool::workerLoop(int inPart)
+{
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mWorkCondition.wait(lock, [&] { return mStop || mGeneration != generation; });
+            if (mStop) {
+                return;
+            }
+            generation = mGeneration;
+        }
+
+        runPart(inPart);
+
+        std::lock_guard<std::mutex> lock(mLock);
+        if (--mPending == 0) {
+            mDoneCondition.notify_one();
+        }
+    }
+}
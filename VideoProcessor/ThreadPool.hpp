@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel work on one frame (rows, tiles, planes).
+// The calling thread takes part in every job, so a pool of N threads spawns N - 1 workers.
+class ThreadPool {
+public:
+    // inThreadCount = 0 uses every hardware thread
+    explicit ThreadPool(int inThreadCount = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int getThreadCount() const { return (int)mWorkers.size() + 1; }
+
+    // Splits [0, inCount) into one contiguous range per thread, runs inFunc(begin, end)
+    // on every non-empty range and returns when all of them are done.
+    void parallelFor(int inCount, const std::function<void(int, int)>& inFunc);
+
+private:
+    void workerLoop(int inPart);
+    void runPart(int inPart);
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mCallLock;
+    std::mutex mLock;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    const std::function<void(int, int)>* mJob = nullptr;
+    int mJobCount = 0;
+    uint64_t mGeneration = 0;
+    int mPending = 0;
+    bool mStop = false;
+};
@@ -0,0 +1,130 @@
+#include "ThumbnailExtractor.hpp"
+
+#include "PresentationClock.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+ThumbnailExtractor::ThumbnailExtractor(const StreamIndex& inIndex, const uint8_t* inStream, Decoder& ioDecoder,
+    const ThumbnailConfig& inConfig)
+    : mIndex(inIndex)
+    , mStream(inStream)
+    , mDecoder(ioDecoder)
+    , mConfig(inConfig)
+{
+    // Recovery points up to the first IDR picture, then the IDR pictures, in stream order
+    const int64_t firstIdr = mIndex.getKeyframeCount() ? mIndex.getKeyframe(0) : mIndex.getFrameCount();
+    std::vector<int64_t> keyframes;
+    for (int64_t i = 0; i < mIndex.getRecoveryPointCount() && mIndex.getRecoveryPoint(i) < firstIdr; i++) {
+        keyframes.push_back(mIndex.getRecoveryPoint(i));
+    }
+    for (int64_t i = 0; i < mIndex.getKeyframeCount(); i++) {
+        keyframes.push_back(mIndex.getKeyframe(i));
+    }
+    for (int64_t keyframe : keyframes) {
+        if (mKeyframes.empty() || keyframe - mKeyframes.back() >= mConfig.minInterval) {
+            mKeyframes.push_back(keyframe);
+        }
+    }
+}
+
+bool
+ThumbnailExtractor::next(Thumbnail& outThumbnail)
+{
+    while (mThumbnails.empty()) {
+        if (mNextKeyframe < mKeyframes.size()) {
+            submit(mKeyframes[mNextKeyframe++]);
+        } else if (!mFlushed) {
+            // Whatever a frame-threaded or display-delayed decoder still holds
+            collect(mDecoder.decode(nullptr, 0));
+            mFlushed = true;
+        } else {
+            return false;
+        }
+    }
+    outThumbnail = std::move(mThumbnails.front());
+    mThumbnails.pop_front();
+    return true;
+}
+
+void
+ThumbnailExtractor::submit(int64_t inFrame)
+{
+    const StreamIndexEntry& entry = mIndex.getEntry(inFrame);
+    const uint8_t* pUnit = mStream + entry.offset;
+    std::vector<const StreamIndexParameterSet*> parameterSets = mIndex.getParameterSets(inFrame);
+    if (parameterSets.empty()) {
+        collect(mDecoder.decode(pUnit, entry.size, inFrame, true));
+        return;
+    }
+
+    // Parameter sets sent earlier in the stream go in front of the picture, as one access unit
+    mAccessUnit.clear();
+    for (const StreamIndexParameterSet* pParameterSet : parameterSets) {
+        const uint8_t* pNal = mStream + pParameterSet->offset;
+        mAccessUnit.insert(mAccessUnit.end(), pNal, pNal + pParameterSet->size);
+    }
+    mAccessUnit.insert(mAccessUnit.end(), pUnit, pUnit + entry.size);
+    collect(mDecoder.decode(mAccessUnit.data(), mAccessUnit.size(), inFrame, true));
+}
+
+void
+ThumbnailExtractor::collect(int inFrameCount)
+{
+    while (inFrameCount--) {
+        FrameHandle frame = mDecoder.getFrame();
+        if (!frame) {
+            continue;
+        }
+        Thumbnail thumbnail;
+        makeThumbnail(frame, thumbnail);
+        mThumbnails.push_back(std::move(thumbnail));
+    }
+}
+
+void
+ThumbnailExtractor::makeThumbnail(const FrameHandle& inFrame, Thumbnail& outThumbnail)
+{
+    const FrameInfo& info = inFrame.info();
+    const uint8_t* pNv12 = inFrame.data();
+    if (inFrame.getMemoryType() == FrameMemoryType::Device) {
+        if (!mConfig.downloadFrame) {
+            std::cerr << "Thumbnails of device frames need ThumbnailConfig::downloadFrame" << std::endl;
+            throw std::exception();
+        }
+        mDownload.resize((size_t)info.pitch * (info.height + (info.height + 1) / 2));
+        mConfig.downloadFrame(inFrame, mDownload.data(), mDownload.size());
+        pNv12 = mDownload.data();
+    }
+    int pitch = info.pitch;
+    if (info.bpp == 2) {
+        // The scaler is 8 bit only
+        pitch = (info.width + 1) & ~1;
+        mNarrow.resize((size_t)pitch * (info.height + (info.height + 1) / 2));
+        P016ToNv12Host(pNv12, info.pitch, mNarrow.data(), pitch, info.width, info.height);
+        pNv12 = mNarrow.data();
+    } else if (info.bpp != 1) {
+        std::cerr << "Thumbnails of " << info.bpp << " byte samples are not supported" << std::endl;
+        throw std::exception();
+    }
+
+    const VideoFormat& format = mDecoder.GetVideoFormat();
+    outThumbnail.frame = info.timestamp;
+    outThumbnail.pts = info.timestamp * PtsTracker::GetFrameDuration(format.frameRateNum, format.frameRateDen);
+    outThumbnail.width = std::max(2, mConfig.width & ~1);
+    outThumbnail.height = mConfig.height > 0 ? mConfig.height & ~1
+        : (int)((int64_t)outThumbnail.width * info.height / std::max(1, info.width)) & ~1;
+    outThumbnail.height = std::max(2, outThumbnail.height);
+    outThumbnail.pitch = outThumbnail.width * 4;
+    outThumbnail.bgra.resize((size_t)outThumbnail.pitch * outThumbnail.height);
+
+    ScaleOutput output;
+    output.data = outThumbnail.bgra.data();
+    output.pitch = outThumbnail.pitch;
+    output.width = outThumbnail.width;
+    output.height = outThumbnail.height;
+    Nv12ScaleToColor32Host<BGRA32>(pNv12, pitch, info.width, info.height, CropRect(), &output, 1, mConfig.filter,
+        info.matrix, mConfig.pConvertPool);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Decoder.hpp"
+#include "HostScaleConvert.hpp"
+#include "StreamIndex.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+struct ThumbnailConfig {
+    int width = 160;                // Rounded down to even
+    int height = 0;                 // 0 = from the aspect ratio of the frame
+    int64_t minInterval = 0;        // Frames between thumbnails at least, 0 = one per keyframe
+    ScaleFilter filter = ScaleFilter::Area;
+    ThreadPool* pConvertPool = nullptr;
+    // Copies a device frame (NVDEC) into inSize bytes of host memory for the scaler
+    std::function<void(const FrameHandle& inFrame, uint8_t* outHost, size_t inSize)> downloadFrame;
+};
+
+// One BGRA thumbnail of the frame decoded from a keyframe
+struct Thumbnail {
+    int64_t frame = 0;              // Decode order index of the picture
+    int64_t pts = 0;                // Microseconds, from the frame rate
+    int width = 0, height = 0;
+    int pitch = 0;
+    std::vector<uint8_t> bgra;
+};
+
+// Trick play for thumbnails and contact sheets: only keyframes go to the decoder, found through
+// the stream index, so no other access unit is read, let alone decoded. Keyframes are the IDR
+// pictures, and the recovery points before the first one, where StreamIndex::findKeyframe()
+// falls back to them as well (streams cut out of a broadcast may have no IDR picture at all).
+// Each keyframe is decoded with the parameter sets it needs, then scaled and converted in one
+// pass by the fused host scaler; high bit depth frames are narrowed to 8 bit first. Keyframes
+// reference nothing, so a frame-threaded software decoder works on several of them at once. A
+// recovery point with a gradual refresh (recovery_frame_cnt > 0) is not complete on its own,
+// its thumbnail shows what the picture itself refreshes.
+class ThumbnailExtractor {
+public:
+    // inIndex, inStream and ioDecoder must outlive the extractor
+    ThumbnailExtractor(const StreamIndex& inIndex, const uint8_t* inStream, Decoder& ioDecoder, const ThumbnailConfig& inConfig);
+
+    // Decodes up to the next thumbnail. Returns false after the last one.
+    bool next(Thumbnail& outThumbnail);
+
+    // IDR pictures and recovery points picked out of the stream
+    int64_t getKeyframeCount() const { return (int64_t)mKeyframes.size(); }
+    // Frames of the stream never handed to the decoder
+    int64_t getSkippedFrames() const { return mIndex.getFrameCount() - getKeyframeCount(); }
+
+private:
+    void submit(int64_t inFrame);
+    void collect(int inFrameCount);
+    void makeThumbnail(const FrameHandle& inFrame, Thumbnail& outThumbnail);
+
+    const StreamIndex& mIndex;
+    const uint8_t* mStream;
+    Decoder& mDecoder;
+    ThumbnailConfig mConfig;
+    std::vector<int64_t> mKeyframes;
+    size_t mNextKeyframe = 0;
+    bool mFlushed = false;
+    // Converted as soon as they come out of the decoder, so its pool never runs dry
+    std::deque<Thumbnail> mThumbnails;
+    std::vector<uint8_t> mAccessUnit;
+    std::vector<uint8_t> mDownload;
+    std::vector<uint8_t> mNarrow;
+};
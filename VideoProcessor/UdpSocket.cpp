@@ -0,0 +1,261 @@
+#include "UdpSocket.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+const Socket kNoSocket = INVALID_SOCKET;
+
+void CloseSocket(Socket inSocket) {
+    closesocket(inSocket);
+}
+
+bool Interrupted() {
+    return false;
+}
+
+int Poll(Socket inSocket, int inTimeoutMs) {
+    WSAPOLLFD descriptor = { inSocket, POLLRDNORM, 0 };
+    return WSAPoll(&descriptor, 1, inTimeoutMs);
+}
+
+// Winsock has to be started once per process before the first socket
+bool StartSockets() {
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+#else
+typedef int Socket;
+const Socket kNoSocket = -1;
+
+void CloseSocket(Socket inSocket) {
+    close(inSocket);
+}
+
+bool Interrupted() {
+    return errno == EINTR;
+}
+
+int Poll(Socket inSocket, int inTimeoutMs) {
+    pollfd descriptor = { inSocket, POLLIN, 0 };
+    return poll(&descriptor, 1, inTimeoutMs);
+}
+
+bool StartSockets() {
+    return true;
+}
+#endif
+
+bool MakeAddress(const std::string& inAddress, int inPort, sockaddr_in& outAddress) {
+    memset(&outAddress, 0, sizeof(outAddress));
+    outAddress.sin_family = AF_INET;
+    outAddress.sin_port = htons((uint16_t)inPort);
+    return inPort > 0 && inPort < 65536 && inet_pton(AF_INET, inAddress.c_str(), &outAddress.sin_addr) == 1;
+}
+
+}
+
+UdpSocket::UdpSocket(int inBatchSize)
+    : mBatchSize(std::max(inBatchSize, 1))
+{
+#ifndef _WIN32
+    mHeaders.resize(sizeof(mmsghdr) * mBatchSize);
+    mVectors.resize(sizeof(iovec) * mBatchSize);
+#endif
+}
+
+UdpSocket::~UdpSocket()
+{
+    if (mSocket != (intptr_t)kNoSocket) {
+        CloseSocket((Socket)mSocket);
+    }
+}
+
+bool
+UdpSocket::open()
+{
+    if (!StartSockets()) {
+        std::cerr << "Socket startup failed" << std::endl;
+        return false;
+    }
+    const Socket socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socketHandle == kNoSocket) {
+        std::cerr << "Create UDP socket failed" << std::endl;
+        return false;
+    }
+    mSocket = (intptr_t)socketHandle;
+    return true;
+}
+
+bool
+UdpSocket::bind(const std::string& inAddress, int inPort, int inReceiveBuffer)
+{
+    sockaddr_in address;
+    if (!MakeAddress(inAddress, inPort, address)) {
+        std::cerr << "Invalid address " << inAddress << ":" << inPort << std::endl;
+        return false;
+    }
+    if (!open()) {
+        return false;
+    }
+    const Socket socketHandle = (Socket)mSocket;
+    const int reuse = 1;
+    setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    if (inReceiveBuffer > 0) {
+        // Bursts of a live source land here while the receiver thread is descheduled
+        setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, (const char*)&inReceiveBuffer, sizeof(inReceiveBuffer));
+    }
+    const bool multicast = (ntohl(address.sin_addr.s_addr) >> 28) == 0xE;
+    sockaddr_in local = address;
+    if (multicast) {
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (::bind(socketHandle, (const sockaddr*)&local, sizeof(local)) != 0) {
+        std::cerr << "Bind " << inAddress << ":" << inPort << " failed" << std::endl;
+        return false;
+    }
+    if (multicast) {
+        ip_mreq group;
+        group.imr_multiaddr = address.sin_addr;
+        group.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(socketHandle, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&group, sizeof(group)) != 0) {
+            std::cerr << "Join multicast group " << inAddress << " failed" << std::endl;
+            return false;
+        }
+    }
+    mOpen = true;
+    return true;
+}
+
+bool
+UdpSocket::connect(const std::string& inAddress, int inPort, int inSendBuffer)
+{
+    sockaddr_in address;
+    if (!MakeAddress(inAddress, inPort, address)) {
+        std::cerr << "Invalid address " << inAddress << ":" << inPort << std::endl;
+        return false;
+    }
+    if (!open()) {
+        return false;
+    }
+    const Socket socketHandle = (Socket)mSocket;
+    if (inSendBuffer > 0) {
+        setsockopt(socketHandle, SOL_SOCKET, SO_SNDBUF, (const char*)&inSendBuffer, sizeof(inSendBuffer));
+    }
+    if (::connect(socketHandle, (const sockaddr*)&address, sizeof(address)) != 0) {
+        std::cerr << "Connect to " << inAddress << ":" << inPort << " failed" << std::endl;
+        return false;
+    }
+    mOpen = true;
+    return true;
+}
+
+int
+UdpSocket::receive(Datagram* ioDatagrams, int inCount, int inTimeoutMs)
+{
+    const Socket socketHandle = (Socket)mSocket;
+    inCount = std::min(inCount, mBatchSize);
+    const int ready = Poll(socketHandle, inTimeoutMs);
+    if (ready <= 0) {
+        return ready < 0 && !Interrupted() ? -1 : 0;
+    }
+#ifdef _WIN32
+    int received = 0;
+    for (; received < inCount; received++) {
+        Datagram& datagram = ioDatagrams[received];
+        if (received > 0 && Poll(socketHandle, 0) <= 0) {
+            break;
+        }
+        const int size = recv(socketHandle, (char*)datagram.data, (int)datagram.capacity, 0);
+        if (size < 0) {
+            datagram.truncated = WSAGetLastError() == WSAEMSGSIZE;
+            if (!datagram.truncated) {
+                return received ? received : -1;
+            }
+            datagram.size = datagram.capacity;
+            continue;
+        }
+        datagram.size = (size_t)size;
+        datagram.truncated = false;
+    }
+    return received;
+#else
+    mmsghdr* pHeaders = (mmsghdr*)mHeaders.data();
+    iovec* pVectors = (iovec*)mVectors.data();
+    for (int i = 0; i < inCount; i++) {
+        pVectors[i].iov_base = ioDatagrams[i].data;
+        pVectors[i].iov_len = ioDatagrams[i].capacity;
+        memset(&pHeaders[i], 0, sizeof(mmsghdr));
+        pHeaders[i].msg_hdr.msg_iov = &pVectors[i];
+        pHeaders[i].msg_hdr.msg_iovlen = 1;
+    }
+    // Whatever is queued already, without waiting for the batch to fill
+    const int received = recvmmsg(socketHandle, pHeaders, (unsigned)inCount, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < received; i++) {
+        ioDatagrams[i].size = std::min((size_t)pHeaders[i].msg_len, ioDatagrams[i].capacity);
+        ioDatagrams[i].truncated = (pHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+    return received;
+#endif
+}
+
+int
+UdpSocket::send(const Datagram* inDatagrams, int inCount)
+{
+    const Socket socketHandle = (Socket)mSocket;
+    int sent = 0;
+#ifdef _WIN32
+    for (; sent < inCount; sent++) {
+        if (::send(socketHandle, (const char*)inDatagrams[sent].data, (int)inDatagrams[sent].size, 0) < 0
+            && WSAGetLastError() != WSAECONNRESET) {
+            return sent ? sent : -1;
+        }
+    }
+#else
+    mmsghdr* pHeaders = (mmsghdr*)mHeaders.data();
+    iovec* pVectors = (iovec*)mVectors.data();
+    while (sent < inCount) {
+        const int count = std::min(inCount - sent, mBatchSize);
+        for (int i = 0; i < count; i++) {
+            pVectors[i].iov_base = inDatagrams[sent + i].data;
+            pVectors[i].iov_len = inDatagrams[sent + i].size;
+            memset(&pHeaders[i], 0, sizeof(mmsghdr));
+            pHeaders[i].msg_hdr.msg_iov = &pVectors[i];
+            pHeaders[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int result = sendmmsg(socketHandle, pHeaders, (unsigned)count, 0);
+        if (result < 0) {
+            // Nobody listening yet reports ECONNREFUSED once per ICMP error, the sender goes on
+            if (errno == EINTR || errno == ECONNREFUSED) {
+                continue;
+            }
+            return sent ? sent : -1;
+        }
+        sent += result;
+    }
+#endif
+    return sent;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One datagram of a batch: the caller's buffer and, after receive(), what landed in it
+struct Datagram {
+    uint8_t* data = nullptr;
+    size_t capacity = 0;
+    size_t size = 0;
+    bool truncated = false;     // Longer than capacity, the rest is lost
+};
+
+// IPv4 UDP socket moving datagrams in batches: recvmmsg/sendmmsg on Linux, one call per
+// datagram elsewhere. Check with operator bool like a stream.
+class UdpSocket {
+public:
+    // Up to inBatchSize datagrams per receive() or send()
+    explicit UdpSocket(int inBatchSize = 64);
+
+    ~UdpSocket();
+
+    UdpSocket(const UdpSocket&) = delete;
+    UdpSocket& operator=(const UdpSocket&) = delete;
+
+    explicit operator bool() const { return mOpen; }
+
+    // Receives on inAddress:inPort (multicast groups are joined), inReceiveBuffer bytes of kernel
+    // buffer or the system default for 0
+    bool bind(const std::string& inAddress, int inPort, int inReceiveBuffer = 0);
+
+    // Sends to inAddress:inPort
+    bool connect(const std::string& inAddress, int inPort, int inSendBuffer = 0);
+
+    // Waits up to inTimeoutMs for a datagram, then takes whatever else is queued, up to inCount
+    // (at most the batch size). Returns the number received, 0 on timeout, -1 on error.
+    int receive(Datagram* ioDatagrams, int inCount, int inTimeoutMs);
+
+    // Returns the number of datagrams sent, -1 on error
+    int send(const Datagram* inDatagrams, int inCount);
+
+    int getBatchSize() const { return mBatchSize; }
+
+private:
+    bool open();
+
+    int mBatchSize;
+    bool mOpen = false;
+    intptr_t mSocket = -1;
+    // recvmmsg/sendmmsg headers, sized once for the batch
+    std::vector<uint8_t> mHeaders;
+    std::vector<uint8_t> mVectors;
+};
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "Telemetry.hpp"
+
+#include <exception>
 #include <iostream>
 
+// The errors below end in an exception, the log is flushed first so the message is out even
+// if nobody catches it
 
 inline void check(int e, int iLine, const char* szFile) {
     if (e < 0) {
-        std::cerr << "General error " << e << " at line " << iLine << " in file " << szFile << std::endl;
+        LOG_ERROR("General error " << e << " at line " << iLine << " in file " << szFile);
+        AsyncLogger::get().flush();
         throw std::exception();
     }
 }
@@ -17,9 +23,9 @@ inline void check(int e, int iLine, const char* szFile) {
     do {                                                                                                        \
         CUresult errorCode = cuvidAPI;                                                                          \
         if (errorCode != CUDA_SUCCESS) {                                                                        \
-            std::cerr << "General error " << #cuvidAPI << " returned error " << errorCode                       \
-                << " in " << __FUNCTION__ << "(" << __FILE__ << ":" << __LINE__ << ")"                          \
-                << std::endl;                                                                                   \
+            LOG_ERROR("General error " << #cuvidAPI << " returned error " << errorCode                          \
+                << " in " << __FUNCTION__ << "(" << __FILE__ << ":" << __LINE__ << ")");                        \
+            AsyncLogger::get().flush();                                                                         \
             throw std::exception();                                                                             \
         }                                                                                                       \
     } while (0)
@@ -30,9 +36,9 @@ inline void check(int e, int iLine, const char* szFile) {
         if (errorCode != CUDA_SUCCESS) {                                                                        \
             const char *errName = nullptr;                                                                      \
             cuGetErrorName(errorCode, &errName);                                                                \
-            std::cerr << "General error " << #cudaAPI << " returned error " << errName                          \
-                << " in " << __FUNCTION__ << "(" << __FILE__ << ":" << __LINE__ << ")"                          \
-                << std::endl;                                                                                   \
+            LOG_ERROR("General error " << #cudaAPI << " returned error " << errName                             \
+                << " in " << __FUNCTION__ << "(" << __FILE__ << ":" << __LINE__ << ")");                        \
+            AsyncLogger::get().flush();                                                                         \
             throw std::exception();                                                                             \
         }                                                                                                       \
     } while (0)
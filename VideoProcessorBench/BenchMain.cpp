@@ -0,0 +1,1139 @@
+#include "Benchmark.hpp"
+#include "H264StreamGenerator.hpp"
+
+#include "AnnexBPacketizer.hpp"
+#include "ContainerDemuxer.hpp"
+#include "CpuFeatures.hpp"
+#include "DecodeProfile.hpp"
+#include "FrameCache.hpp"
+#include "Displayer.hpp"
+#include "FramePool.hpp"
+#include "GopParallelDecoder.hpp"
+#include "HostColorSpace.hpp"
+#include "HostScaleConvert.hpp"
+#include "LiveIngest.hpp"
+#include "LiveSender.hpp"
+#include "MosaicCompositor.hpp"
+#include "SceneAnalyzer.hpp"
+#include "SpscQueue.hpp"
+#include "StreamIndex.hpp"
+#include "SwDecoder.hpp"
+#include "Telemetry.hpp"
+#include "SyntheticDecoder.hpp"
+#include "ThreadPool.hpp"
+#include "ThumbnailExtractor.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    StreamGeneratorConfig stream;
+    int threadCount = 0;
+    std::string filter;
+    double minSeconds = 0.2;
+    std::string outputFile;
+    std::string streamFile;
+};
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string StreamName(const StreamGeneratorConfig& inConfig) {
+    return std::to_string(inConfig.width) + "x" + std::to_string(inConfig.height) + " gop " + std::to_string(inConfig.gopLength)
+        + " refresh " + std::to_string(inConfig.refreshPercent) + "%"
+        + (inConfig.bFrames > 0 ? " b " + std::to_string(inConfig.bFrames) : std::string());
+}
+
+void BenchStartCodes(BenchmarkRunner& ioRunner, const std::vector<uint8_t>& inStream) {
+    const BenchmarkParams params = { { "stream_bytes", std::to_string(inStream.size()) } };
+    if (ioRunner.isEnabled("start_code_scan")) {
+        ioRunner.run("start_code_scan", params, "bytes", (double)inStream.size(), [&] {
+            const uint8_t* p = inStream.data();
+            const uint8_t* end = p + inStream.size();
+            size_t count = 0;
+            while ((p = FindStartCode(p, end)) != end) {
+                p += 3;
+                count++;
+            }
+            if (!count) {
+                std::abort();
+            }
+        });
+    }
+    if (ioRunner.isEnabled("annexb_packetize")) {
+        AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+        AccessUnit unit;
+        size_t units = 0;
+        while (packetizer.next(unit)) {
+            units++;
+        }
+        ioRunner.run("annexb_packetize", params, "access_units", (double)units, [&] {
+            packetizer.reset();
+            while (packetizer.next(unit)) {
+            }
+        });
+    }
+}
+
+// Random access: building the index, and getting to a frame with it vs. packetizing up to it
+void BenchStreamIndex(BenchmarkRunner& ioRunner, const std::vector<uint8_t>& inStream) {
+    const BenchmarkParams params = { { "stream_bytes", std::to_string(inStream.size()) } };
+    StreamIndex index;
+    index.build(inStream.data(), inStream.size());
+    if (ioRunner.isEnabled("stream_index_build")) {
+        BenchmarkResult& result = ioRunner.run("stream_index_build", params, "bytes", (double)inStream.size(), [&] {
+            index.build(inStream.data(), inStream.size());
+        });
+        result.metrics.push_back({ "frames", (double)index.getFrameCount() });
+        result.metrics.push_back({ "keyframes", (double)index.getKeyframeCount() });
+    }
+
+    const int64_t frameCount = index.getFrameCount();
+    if (!frameCount) {
+        return;
+    }
+    const int targetCount = 64;
+    std::vector<int64_t> targets;
+    for (int i = 0; i < targetCount; i++) {
+        targets.push_back(frameCount * (2 * i + 1) / (2 * targetCount));
+    }
+    if (ioRunner.isEnabled("seek_indexed")) {
+        AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+        ioRunner.run("seek_indexed", params, "seeks", targetCount, [&] {
+            for (int64_t target : targets) {
+                const int64_t keyframe = index.findKeyframe(target);
+                if (keyframe < 0 || index.getParameterSets(keyframe).size() > 2) {
+                    std::abort();
+                }
+                packetizer.reset((size_t)index.getEntry(keyframe).offset, keyframe);
+            }
+        });
+    }
+    if (ioRunner.isEnabled("seek_by_parsing")) {
+        AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+        AccessUnit unit;
+        ioRunner.run("seek_by_parsing", params, "seeks", targetCount, [&] {
+            for (int64_t target : targets) {
+                packetizer.reset();
+                while (packetizer.next(unit) && unit.frameIndex < target) {
+                }
+            }
+        });
+    }
+}
+
+// Seeking with decoding: to each target from its keyframe, until the target's own picture comes
+// out of the decoder, checked to be the first frame after the preroll. On the configured stream
+// and on one with B-frames, where references decoded before the target come out after it.
+// Software decoder, synthetic (which does not reorder) without FFmpeg.
+void BenchSeekDecode(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream) {
+    if (!ioRunner.isEnabled("seek_decode")) {
+        return;
+    }
+    std::unique_ptr<Decoder> pDecoder;
+    try {
+        pDecoder.reset(new SwDecoder(inConfig.threadCount));
+    } catch (...) {
+        pDecoder.reset(new SyntheticDecoder(inConfig.stream.width, inConfig.stream.height));
+    }
+    Decoder& decoder = *pDecoder;
+
+    StreamGeneratorConfig reorderedConfig = inConfig.stream;
+    reorderedConfig.bFrames = 2;
+    std::vector<std::pair<StreamGeneratorConfig, std::vector<uint8_t>>> streams;
+    streams.emplace_back(inConfig.stream, inStream);
+    if (inConfig.stream.bFrames == 0) {
+        streams.emplace_back(reorderedConfig, GenerateH264Stream(reorderedConfig));
+    }
+    for (const auto& stream : streams) {
+        const std::vector<uint8_t>& data = stream.second;
+        StreamIndex index;
+        index.build(data.data(), data.size());
+        const int64_t frameCount = index.getFrameCount();
+        if (!frameCount) {
+            continue;
+        }
+        const int targetCount = 16;
+        std::vector<int64_t> targets;
+        for (int i = 0; i < targetCount; i++) {
+            targets.push_back(frameCount * (2 * i + 1) / (2 * targetCount));
+        }
+
+        AnnexBPacketizer packetizer(data.data(), data.size());
+        StreamSeeker seeker(index, data.data(), packetizer, decoder);
+        uint64_t seeks = 0, fed = 0, dropped = 0;
+        BenchmarkResult& result = ioRunner.run("seek_decode", { { "backend", decoder.getName() },
+            { "stream", StreamName(stream.first) } }, "seeks", targetCount, [&] {
+            for (int64_t target : targets) {
+                if (!seeker.seek(target)) {
+                    std::abort();
+                }
+                seeks++;
+                int64_t first = -1;
+                AccessUnit unit;
+                bool more = true;
+                while (first < 0 && more) {
+                    more = packetizer.next(unit);
+                    fed += more;
+                    int readyCount = more ? decoder.decode(unit.data, unit.size, unit.frameIndex, true) : decoder.decode(nullptr, 0);
+                    while (readyCount--) {
+                        FrameHandle frame = decoder.getFrame();
+                        if (!frame || first >= 0) {
+                            continue;
+                        }
+                        if (seeker.isPreroll(frame.info().timestamp)) {
+                            dropped++;
+                            continue;
+                        }
+                        first = frame.info().timestamp;
+                    }
+                }
+                if (first != target) {
+                    std::cerr << "Seek to frame " << target << " came out at frame " << first << std::endl;
+                    std::abort();
+                }
+            }
+        });
+        result.metrics.emplace_back("decoded_per_seek", (double)fed / seeks);
+        result.metrics.emplace_back("dropped_per_seek", (double)dropped / seeks);
+    }
+}
+
+// Appends a Matroska element with an 8 byte size field, which is always valid
+void AppendElement(std::vector<uint8_t>& ioOut, uint32_t inId, const std::vector<uint8_t>& inPayload) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if ((inId >> shift) || shift == 0) {
+            ioOut.push_back((uint8_t)(inId >> shift));
+        }
+    }
+    ioOut.push_back(0x01);
+    for (int shift = 48; shift >= 0; shift -= 8) {
+        ioOut.push_back((uint8_t)((uint64_t)inPayload.size() >> shift));
+    }
+    ioOut.insert(ioOut.end(), inPayload.begin(), inPayload.end());
+}
+
+// The generated stream as the video track of a Matroska file: parameter sets in CodecPrivate,
+// one SimpleBlock of 4 byte length prefixed NAL units per access unit, 30 per cluster
+std::vector<uint8_t> MuxMatroska(const std::vector<uint8_t>& inStream) {
+    std::vector<uint8_t> sps, pps, clusters, cluster;
+    AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+    AccessUnit unit;
+    while (packetizer.next(unit)) {
+        std::vector<uint8_t> block = { 0x81, 0, (uint8_t)(unit.frameIndex % 30), (uint8_t)(unit.idr ? 0x80 : 0) };
+        const uint8_t* end = unit.data + unit.size;
+        for (const uint8_t* nal = FindStartCode(unit.data, end); nal != end;) {
+            nal += 3;
+            const uint8_t* next = FindStartCode(nal, end);
+            const uint8_t* nalEnd = next;
+            while (nalEnd > nal && nalEnd[-1] == 0) {
+                nalEnd--;
+            }
+            const int type = nal[0] & 0x1F;
+            if (type == NalUnitType_Sps || type == NalUnitType_Pps) {
+                std::vector<uint8_t>& set = type == NalUnitType_Sps ? sps : pps;
+                if (set.empty()) {
+                    set.assign(nal, nalEnd);
+                }
+            } else if (type != NalUnitType_AccessUnitDelimiter) {
+                const size_t size = nalEnd - nal;
+                const uint8_t length[4] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size };
+                block.insert(block.end(), length, length + 4);
+                block.insert(block.end(), nal, nalEnd);
+            }
+            nal = next;
+        }
+        if (unit.frameIndex % 30 == 0) {
+            if (!cluster.empty()) {
+                AppendElement(clusters, 0x1F43B675, cluster);
+            }
+            cluster.clear();
+            AppendElement(cluster, 0xE7, { (uint8_t)(unit.frameIndex >> 8), (uint8_t)unit.frameIndex });
+        }
+        AppendElement(cluster, 0xA3, block);
+    }
+    AppendElement(clusters, 0x1F43B675, cluster);
+    if (sps.size() < 4 || pps.empty()) {
+        std::abort();
+    }
+
+    std::vector<uint8_t> avcC = { 1, sps[1], sps[2], sps[3], 0xFF, 0xE1, (uint8_t)(sps.size() >> 8), (uint8_t)sps.size() };
+    avcC.insert(avcC.end(), sps.begin(), sps.end());
+    avcC.insert(avcC.end(), { 1, (uint8_t)(pps.size() >> 8), (uint8_t)pps.size() });
+    avcC.insert(avcC.end(), pps.begin(), pps.end());
+    const std::string codec = "V_MPEG4/ISO/AVC";
+    std::vector<uint8_t> entry, tracks, segment, file;
+    AppendElement(entry, 0xD7, { 1 });
+    AppendElement(entry, 0x83, { 1 });
+    AppendElement(entry, 0x86, std::vector<uint8_t>(codec.begin(), codec.end()));
+    AppendElement(entry, 0x63A2, avcC);
+    AppendElement(tracks, 0xAE, entry);
+    AppendElement(segment, 0x1654AE6B, tracks);
+    segment.insert(segment.end(), clusters.begin(), clusters.end());
+    AppendElement(file, 0x1A45DFA3, { 0x42, 0x82, 0x88, 'm', 'a', 't', 'r', 'o', 's', 'k', 'a' });
+    AppendElement(file, 0x18538067, segment);
+    return file;
+}
+
+// Demuxing the same access units out of a container: samples rewritten to Annex-B in place
+void BenchContainerDemux(BenchmarkRunner& ioRunner, const std::vector<uint8_t>& inStream) {
+    if (!ioRunner.isEnabled("mkv_demux")) {
+        return;
+    }
+    const std::vector<uint8_t> file = MuxMatroska(inStream);
+    const BenchmarkParams params = { { "file_bytes", std::to_string(file.size()) } };
+    VideoTrackInfo track;
+    size_t units = 0;
+    {
+        std::unique_ptr<PacketSource> pSource = OpenPacketSource(file.data(), file.size(), 34, track);
+        AccessUnit unit;
+        while (pSource && pSource->next(unit)) {
+            units++;
+        }
+    }
+    if (!units) {
+        std::abort();
+    }
+    BenchmarkResult& result = ioRunner.run("mkv_demux", params, "bytes", (double)file.size(), [&] {
+        std::unique_ptr<PacketSource> pSource = OpenPacketSource(file.data(), file.size(), 34, track);
+        AccessUnit unit;
+        while (pSource->next(unit)) {
+        }
+    });
+    result.metrics.push_back({ "access_units", (double)units });
+}
+
+// Live ingest over loopback: a LiveSender replays the stream as fast as the socket takes it and
+// the access units are popped as soon as they are complete. The stream ends 20 ms after the last
+// packet, which the stream is repeated to keep small. Socket drops count as lost.
+void BenchLiveIngest(BenchmarkRunner& ioRunner, const std::vector<uint8_t>& inStream) {
+    const struct {
+        const char* name;
+        LiveProtocol protocol;
+    } cases[] = { { "live_ingest_rtp", LiveProtocol::Rtp }, { "live_ingest_ts", LiveProtocol::Ts } };
+    for (const auto& benchCase : cases) {
+        if (!ioRunner.isEnabled(benchCase.name)) {
+            continue;
+        }
+        LiveIngestConfig ingestConfig;
+        ingestConfig.protocol = benchCase.protocol;
+        ingestConfig.port = 15004;
+        ingestConfig.idleTimeoutMs = 20;
+        LiveSenderConfig senderConfig;
+        senderConfig.protocol = benchCase.protocol;
+        senderConfig.port = ingestConfig.port;
+        senderConfig.fps = 0;
+        senderConfig.loops = (int)std::max<size_t>(1, (64 << 20) / std::max<size_t>(inStream.size(), 1));
+        uint64_t sent = 0, received = 0, lost = 0, units = 0, bytes = 0;
+        auto iteration = [&] {
+            LiveIngest ingest(ingestConfig);
+            if (!ingest.start()) {
+                std::abort();
+            }
+            LiveSender sender(senderConfig);
+            std::thread sending([&] { sender.send(inStream.data(), inStream.size()); });
+            AccessUnit unit;
+            while (ingest.next(unit)) {
+            }
+            sending.join();
+            sent += sender.getPackets();
+            received += ingest.getPackets();
+            lost += ingest.getPacketsLost();
+            units += ingest.getUnits();
+            bytes = sender.getBytes();
+        };
+        iteration();
+        const BenchmarkParams params = { { "stream_bytes", std::to_string(inStream.size()) },
+            { "loops", std::to_string(senderConfig.loops) } };
+        sent = received = lost = units = 0;
+        BenchmarkResult& result = ioRunner.run(benchCase.name, params, "bytes", (double)bytes, iteration);
+        result.metrics.push_back({ "mbit_per_s", result.itemsPerSecond * 8 / 1e6 });
+        result.metrics.push_back({ "packets_lost_percent", sent ? 100.0 * (sent - received + lost) / sent : 0 });
+        result.metrics.push_back({ "access_units", (double)units });
+    }
+}
+
+template <class COLOR32>
+void BenchColorConversion(BenchmarkRunner& ioRunner, const char* inFormat, ThreadPool& inPool) {
+    if (!ioRunner.isEnabled("nv12_to_color32")) {
+        return;
+    }
+    const int width = 1920, height = 1080;
+    std::vector<uint8_t> nv12((size_t)width * height * 3 / 2);
+    for (size_t i = 0; i < nv12.size(); i++) {
+        nv12[i] = (uint8_t)(i * 7 + i / width * 3);
+    }
+    std::vector<uint8_t> reference((size_t)width * height * 4), image(reference.size());
+
+    // Every standard, max_error checks the fixed point kernels against the float reference for each
+    const int matrices[] = { ColorSpaceStandard_BT709, ColorSpaceStandard_Unspecified, ColorSpaceStandard_FCC,
+        ColorSpaceStandard_BT470, ColorSpaceStandard_BT601, ColorSpaceStandard_SMPTE240M, ColorSpaceStandard_YCgCo,
+        ColorSpaceStandard_BT2020, ColorSpaceStandard_BT2020C };
+    for (int matrix : matrices) {
+        Nv12ToColor32Host<COLOR32>(nv12.data(), width, reference.data(), width * 4, width, height, matrix, nullptr, SimdLevel::Scalar);
+        for (int level = (int)SimdLevel::Scalar; level <= (int)GetSimdLevel(); level++) {
+            for (ThreadPool* pPool : { (ThreadPool*)nullptr, &inPool }) {
+                if (pPool && (pPool->getThreadCount() == 1 || level != (int)GetSimdLevel())) {
+                    continue;
+                }
+                const BenchmarkParams params = { { "format", inFormat }, { "matrix", std::to_string(matrix) },
+                    { "simd", GetSimdLevelName((SimdLevel)level) }, { "threads", std::to_string(pPool ? pPool->getThreadCount() : 1) },
+                    { "size", "1920x1080" } };
+                BenchmarkResult& result = ioRunner.run("nv12_to_color32", params, "frames", 1, [&] {
+                    Nv12ToColor32Host<COLOR32>(nv12.data(), width, image.data(), width * 4, width, height, matrix, pPool, (SimdLevel)level);
+                });
+                // Fixed point kernels are allowed to be off by one from the float reference
+                int maxError = 0;
+                for (size_t i = 0; i < image.size(); i++) {
+                    maxError = (std::max)(maxError, std::abs(image[i] - reference[i]));
+                }
+                result.metrics.emplace_back("max_error", maxError);
+            }
+        }
+    }
+}
+
+// Letterboxed 1080p source cropped to 1920x800 and turned into a full, preview and thumbnail
+// BGRA ladder: fused in one pass, and as separate scale then convert passes per rung
+void BenchScaleConvert(BenchmarkRunner& ioRunner, ThreadPool& inPool) {
+    const bool fused = ioRunner.isEnabled("scale_convert_fused");
+    const bool separate = ioRunner.isEnabled("scale_then_convert");
+    if (!fused && !separate) {
+        return;
+    }
+    const int width = 1920, height = 1080;
+    std::vector<uint8_t> nv12((size_t)width * height * 3 / 2);
+    for (size_t i = 0; i < nv12.size(); i++) {
+        nv12[i] = (uint8_t)(i * 7 + i / width * 3);
+    }
+    CropRect crop;
+    crop.left = 0;
+    crop.top = 140;
+    crop.right = width;
+    crop.bottom = 940;
+    const int ladder[][2] = { { 1920, 800 }, { 960, 400 }, { 320, 134 } };
+    const int rungs = (int)(sizeof(ladder) / sizeof(ladder[0]));
+    std::vector<std::vector<uint8_t>> fusedImages(rungs), separateImages(rungs), scaled(rungs);
+    std::vector<ScaleOutput> outputs(rungs);
+    std::string ladderName;
+    for (int i = 0; i < rungs; i++) {
+        outputs[i].width = ladder[i][0];
+        outputs[i].height = ladder[i][1];
+        outputs[i].pitch = ladder[i][0] * 4;
+        fusedImages[i].resize((size_t)outputs[i].pitch * outputs[i].height);
+        separateImages[i].resize(fusedImages[i].size());
+        scaled[i].resize((size_t)ladder[i][0] * ladder[i][1] * 3 / 2);
+        outputs[i].data = fusedImages[i].data();
+        ladderName += (i ? "," : "") + std::to_string(ladder[i][0]) + "x" + std::to_string(ladder[i][1]);
+    }
+
+    for (ScaleFilter filter : { ScaleFilter::Bilinear, ScaleFilter::Area }) {
+        for (int level = (int)SimdLevel::Scalar; level <= (int)GetSimdLevel(); level++) {
+            for (ThreadPool* pPool : { (ThreadPool*)nullptr, &inPool }) {
+                if (pPool && (pPool->getThreadCount() == 1 || level != (int)GetSimdLevel())) {
+                    continue;
+                }
+                const BenchmarkParams params = { { "filter", filter == ScaleFilter::Area ? "area" : "bilinear" },
+                    { "simd", GetSimdLevelName((SimdLevel)level) }, { "threads", std::to_string(pPool ? pPool->getThreadCount() : 1) },
+                    { "source", "1920x1080 crop 1920x800" }, { "ladder", ladderName } };
+                if (fused) {
+                    ioRunner.run("scale_convert_fused", params, "frames", 1, [&] {
+                        Nv12ScaleToColor32Host<BGRA32>(nv12.data(), width, width, height, crop, outputs.data(), rungs,
+                            filter, 0, pPool, (SimdLevel)level);
+                    });
+                }
+                if (separate) {
+                    BenchmarkResult& result = ioRunner.run("scale_then_convert", params, "frames", 1, [&] {
+                        for (int i = 0; i < rungs; i++) {
+                            ScaleOutput target = outputs[i];
+                            target.data = scaled[i].data();
+                            target.pitch = target.width;
+                            Nv12ScaleHost(nv12.data(), width, width, height, crop, target, filter, pPool, (SimdLevel)level);
+                            Nv12ToColor32Host<BGRA32>(scaled[i].data(), target.width, separateImages[i].data(), outputs[i].pitch,
+                                target.width, target.height, 0, pPool, (SimdLevel)level);
+                        }
+                    });
+                    if (fused) {
+                        // Both paths filter and convert with the same arithmetic
+                        result.metrics.emplace_back("matches_fused", fusedImages == separateImages ? 1 : 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 1080p filter graphs with the point filters folded into the pass before them and with one
+// pass per filter. Both must produce the same frame, passes is what each one reads and writes.
+void BenchFilterGraph(BenchmarkRunner& ioRunner, ThreadPool& inPool) {
+    if (!ioRunner.isEnabled("filter_graph")) {
+        return;
+    }
+    const int width = 1920, height = 1080;
+    FrameInfo info;
+    info.width = width;
+    info.height = height;
+    info.pitch = width;
+    info.pts = 3723456000;
+    const size_t frameSize = (size_t)width * height * 3 / 2;
+    std::vector<uint8_t> nv12(frameSize);
+    for (size_t i = 0; i < nv12.size(); i++) {
+        nv12[i] = (uint8_t)(i * 7 + i / width * 3);
+    }
+    FramePoolConfig poolConfig;
+    poolConfig.capacity = 1;
+    FramePool sourcePool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), poolConfig);
+    FrameHandle source = sourcePool.acquire(frameSize);
+    source.info() = info;
+
+    const char* graphs[] = { "brightness=12,contrast=1.2,gamma=1.3", "denoise,brightness=12,contrast=1.2,gamma=1.3",
+        "deinterlace,denoise,timestamp" };
+    for (const char* graph : graphs) {
+        std::vector<uint8_t> outputs[2];
+        for (bool fuse : { false, true }) {
+            DisplayerConfig config;
+            config.graph = graph;
+            config.fuse = fuse;
+            config.pThreadPool = &inPool;
+            Displayer displayer(config);
+            memcpy(source.data(), nv12.data(), frameSize);
+            FrameHandle result = displayer.process(source, false);
+            outputs[fuse].assign(result.data(), result.data() + frameSize);
+            result.reset();
+
+            const BenchmarkParams params = { { "graph", graph }, { "fused", fuse ? "yes" : "no" },
+                { "threads", std::to_string(inPool.getThreadCount()) }, { "size", "1920x1080" } };
+            // The table passes run in place, so the source changes between iterations, not the work
+            BenchmarkResult& benchmark = ioRunner.run("filter_graph", params, "frames", 1, [&] {
+                displayer.process(source, false);
+            });
+            benchmark.metrics.emplace_back("passes", displayer.getPassCount());
+            if (fuse) {
+                benchmark.metrics.emplace_back("matches_unfused", outputs[0] == outputs[1] ? 1 : 0);
+            }
+        }
+    }
+}
+
+// 32 1080p feeds on a 4K wall: every tile new on each composite, and a quarter of them, which is
+// what 32 feeds at 30 fps look like to a wall composited at 120 Hz. feeds_at_30fps is how many
+// 30 fps feeds the measured tile rate keeps up with.
+void BenchMosaic(BenchmarkRunner& ioRunner, ThreadPool& inPool) {
+    if (!ioRunner.isEnabled("mosaic_composite")) {
+        return;
+    }
+    const int width = 1920, height = 1080, feeds = 32;
+    const size_t frameSize = (size_t)width * height * 3 / 2;
+    FramePoolConfig poolConfig;
+    poolConfig.capacity = 4;
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), poolConfig);
+    // A few distinct frames shared by the feeds, so the sources do not all sit in the cache
+    std::vector<FrameHandle> frames;
+    for (int i = 0; i < poolConfig.capacity; i++) {
+        frames.push_back(pool.acquire(frameSize));
+        FrameInfo& info = frames.back().info();
+        info.width = width;
+        info.height = height;
+        info.pitch = width;
+        for (size_t j = 0; j < frameSize; j++) {
+            frames.back().data()[j] = (uint8_t)(j * 7 + j / width * 3 + i * 50);
+        }
+    }
+
+    for (ThreadPool* pPool : { (ThreadPool*)nullptr, &inPool }) {
+        if (pPool && pPool->getThreadCount() == 1) {
+            continue;
+        }
+        MosaicConfig config;
+        config.width = 3840;
+        config.height = 2160;
+        config.tiles = MakeMosaicGrid(config.width, config.height, 8, 4, 2);
+        config.pThreadPool = pPool;
+        MosaicCompositor compositor(config);
+        for (int dirty : { feeds, feeds / 4 }) {
+            const BenchmarkParams params = { { "canvas", "3840x2160" }, { "feeds", std::to_string(feeds) },
+                { "source", "1920x1080" }, { "dirty_tiles", std::to_string(dirty) },
+                { "threads", std::to_string(pPool ? pPool->getThreadCount() : 1) } };
+            int next = 0;
+            BenchmarkResult& result = ioRunner.run("mosaic_composite", params, "composites", 1, [&] {
+                for (int i = 0; i < dirty; i++, next++) {
+                    compositor.submit(next % feeds, frames[next % frames.size()]);
+                }
+                compositor.composite();
+            });
+            const double tilesPerSecond = result.itemsPerSecond * dirty;
+            result.metrics.emplace_back("tiles_per_second", tilesPerSecond);
+            result.metrics.emplace_back("feeds_at_30fps", tilesPerSecond / 30);
+        }
+    }
+}
+
+// Surveillance-like 1080p: a still scene with sensor noise, and for 3 frames out of 30 a box
+// moving through it. scene_analysis is the analyzer alone; scene_convert_all converts every frame
+// to BGRA, scene_convert_changed analyzes every frame and converts only those that are not static.
+void BenchSceneAnalysis(BenchmarkRunner& ioRunner, ThreadPool& inPool) {
+    const bool analysis = ioRunner.isEnabled("scene_analysis");
+    const bool convertAll = ioRunner.isEnabled("scene_convert_all");
+    const bool convertChanged = ioRunner.isEnabled("scene_convert_changed");
+    if (!analysis && !convertAll && !convertChanged) {
+        return;
+    }
+    const int width = 1920, height = 1080, cycle = 30, moving = 3;
+    const size_t frameSize = (size_t)width * height * 3 / 2;
+    // Two noise patterns of the still scene, then the frames with the box
+    std::vector<std::vector<uint8_t>> frames(2 + moving, std::vector<uint8_t>(frameSize));
+    for (size_t i = 0; i < frameSize; i++) {
+        frames[0][i] = (uint8_t)(i * 7 + i / width * 3);
+        frames[1][i] = (uint8_t)std::min(255, frames[0][i] + (int)((uint32_t)(i * 2654435761u) >> 31));
+    }
+    for (int i = 0; i < moving; i++) {
+        frames[2 + i] = frames[i % 2];
+        for (int y = 400; y < 528; y++) {
+            memset(frames[2 + i].data() + (size_t)y * width + 600 + 48 * i, 235, 128);
+        }
+    }
+    std::vector<const uint8_t*> sequence;
+    for (int i = 0; i < cycle; i++) {
+        sequence.push_back(i < cycle - moving ? frames[i % 2].data() : frames[2 + i - (cycle - moving)].data());
+    }
+    std::vector<uint8_t> image((size_t)width * height * 4);
+
+    SceneAnalyzerConfig config;
+    config.pThreadPool = &inPool;
+    const BenchmarkParams params = { { "size", "1920x1080" }, { "moving_frames", std::to_string(moving) + "/" + std::to_string(cycle) },
+        { "threads", std::to_string(inPool.getThreadCount()) } };
+    if (analysis) {
+        SceneAnalyzer analyzer(config);
+        int staticFrames = 0, sceneCuts = 0;
+        BenchmarkResult& result = ioRunner.run("scene_analysis", params, "frames", cycle, [&] {
+            staticFrames = sceneCuts = 0;
+            for (const uint8_t* pFrame : sequence) {
+                FrameAnalysis frameAnalysis = analyzer.analyze(pFrame, width, width, height);
+                staticFrames += frameAnalysis.isStatic;
+                sceneCuts += frameAnalysis.sceneCut;
+            }
+        });
+        // Expected: every still frame but the one after the box left, no cuts
+        result.metrics.emplace_back("static_frames", staticFrames);
+        result.metrics.emplace_back("scene_cuts", sceneCuts);
+    }
+    if (convertAll) {
+        ioRunner.run("scene_convert_all", params, "frames", cycle, [&] {
+            for (const uint8_t* pFrame : sequence) {
+                Nv12ToColor32Host<BGRA32>(pFrame, width, image.data(), width * 4, width, height, 0, &inPool);
+            }
+        });
+    }
+    if (convertChanged) {
+        SceneAnalyzer analyzer(config);
+        ioRunner.run("scene_convert_changed", params, "frames", cycle, [&] {
+            for (const uint8_t* pFrame : sequence) {
+                if (!analyzer.analyze(pFrame, width, width, height).isStatic) {
+                    Nv12ToColor32Host<BGRA32>(pFrame, width, image.data(), width * 4, width, height, 0, &inPool);
+                }
+            }
+        });
+    }
+}
+
+// What the hot path pays for telemetry: a counter increment, a histogram sample, and a trace
+// scope while tracing is off
+void BenchTelemetry(BenchmarkRunner& ioRunner) {
+    const int batch = 10000;
+    if (ioRunner.isEnabled("telemetry_count")) {
+        ioRunner.run("telemetry_count", {}, "ops", batch, [&] {
+            for (int i = 0; i < batch; i++) {
+                Telemetry::Count(TelemetryCounter::AccessUnits);
+            }
+        });
+    }
+    if (ioRunner.isEnabled("telemetry_histogram_record")) {
+        LatencyHistogram histogram;
+        ioRunner.run("telemetry_histogram_record", {}, "ops", batch, [&] {
+            for (int i = 0; i < batch; i++) {
+                histogram.record((uint64_t)i * 977);
+            }
+        });
+    }
+    if (ioRunner.isEnabled("telemetry_trace_scope_off")) {
+        ioRunner.run("telemetry_trace_scope_off", {}, "ops", batch, [&] {
+            for (int i = 0; i < batch; i++) {
+                TraceScope scope("bench");
+            }
+        });
+    }
+}
+
+void BenchFramePool(BenchmarkRunner& ioRunner) {
+    const size_t frameSize = 1920 * 1080 * 3 / 2;
+    if (ioRunner.isEnabled("frame_pool_acquire_release")) {
+        FramePoolConfig config;
+        config.capacity = 8;
+        FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), config);
+        const int batch = 1000;
+        ioRunner.run("frame_pool_acquire_release", { { "capacity", "8" } }, "ops", batch, [&] {
+            for (int i = 0; i < batch; i++) {
+                FrameHandle frame = pool.acquire(frameSize);
+            }
+        });
+    }
+
+    // Producer acquires and stamps, consumer measures the hand-off and releases: the path a
+    // frame takes from the decode to the convert stage
+    if (ioRunner.isEnabled("frame_pool_handoff")) {
+        struct Item {
+            FrameHandle frame;
+            int64_t sentNs = 0;
+        };
+        const int itemCount = 200000;
+        FramePoolConfig config;
+        config.capacity = 8;
+        FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), config);
+        SpscQueue<Item> queue(4);
+        std::vector<double> samples;
+        samples.reserve(itemCount);
+        const int64_t start = NowNs();
+        std::thread consumer([&] {
+            Item item;
+            while (queue.pop(item)) {
+                samples.push_back((double)(NowNs() - item.sentNs));
+                item.frame.reset();
+            }
+        });
+        for (int i = 0; i < itemCount; i++) {
+            Item item;
+            item.frame = pool.acquire(frameSize);
+            item.sentNs = NowNs();
+            queue.push(std::move(item));
+        }
+        queue.close();
+        consumer.join();
+        const double seconds = (NowNs() - start) / 1e9;
+        BenchmarkResult& result = ioRunner.add("frame_pool_handoff", { { "capacity", "8" }, { "queue", "4" } }, "frames",
+            samples, itemCount / seconds);
+        result.metrics.emplace_back("pool_waits", (double)pool.getWaits());
+    }
+
+    if (ioRunner.isEnabled("spsc_queue_handoff")) {
+        const int itemCount = 1000000;
+        SpscQueue<int64_t> queue(32);
+        std::vector<double> samples;
+        samples.reserve(itemCount);
+        const int64_t start = NowNs();
+        std::thread consumer([&] {
+            int64_t sentNs;
+            while (queue.pop(sentNs)) {
+                samples.push_back((double)(NowNs() - sentNs));
+            }
+        });
+        for (int i = 0; i < itemCount; i++) {
+            queue.push(NowNs());
+        }
+        queue.close();
+        consumer.join();
+        const double seconds = (NowNs() - start) / 1e9;
+        BenchmarkResult& result = ioRunner.add("spsc_queue_handoff", { { "queue", "32" } }, "items", samples, itemCount / seconds);
+        result.metrics.emplace_back("full_waits", (double)queue.getFullWaits());
+        result.metrics.emplace_back("empty_waits", (double)queue.getEmptyWaits());
+    }
+}
+
+// Whole stream through a decoder (and optionally the host converter), one latency sample per
+// access unit, repeated until the minimum time is reached
+void BenchEndToEnd(BenchmarkRunner& ioRunner, const std::string& inName, const BenchConfig& inConfig,
+    const std::vector<uint8_t>& inStream, Decoder& ioDecoder, ThreadPool* pConvertPool) {
+    BenchmarkParams params = { { "backend", ioDecoder.getName() }, { "stream", StreamName(inConfig.stream) } };
+    if (pConvertPool) {
+        params.emplace_back("convert_threads", std::to_string(pConvertPool->getThreadCount()));
+    }
+
+    AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+    std::vector<uint8_t> image;
+    std::vector<double> samples;
+    uint64_t frames = 0;
+    const int64_t start = NowNs();
+    do {
+        packetizer.reset();
+        AccessUnit unit;
+        bool more = true;
+        while (more) {
+            const int64_t unitStart = NowNs();
+            more = packetizer.next(unit);
+            int frameCount = more ? ioDecoder.decode(unit.data, unit.size, unit.frameIndex, true) : ioDecoder.decode(nullptr, 0);
+            while (frameCount--) {
+                FrameHandle frame = ioDecoder.getFrame();
+                const FrameInfo& info = frame.info();
+                if (pConvertPool && frame.getMemoryType() == FrameMemoryType::Host) {
+                    image.resize((size_t)info.width * 4 * info.height);
+                    Nv12ToColor32Host<BGRA32>(frame.data(), info.pitch, image.data(), info.width * 4, info.width, info.height,
+                        info.matrix, pConvertPool);
+                }
+                frames++;
+            }
+            samples.push_back((double)(NowNs() - unitStart));
+        }
+    } while ((NowNs() - start) / 1e9 < ioRunner.getMinSeconds());
+    const double seconds = (NowNs() - start) / 1e9;
+
+    BenchmarkResult& result = ioRunner.add(inName, params, "frames", samples, frames / seconds);
+    result.metrics.emplace_back("frames", (double)frames);
+    result.metrics.emplace_back("dropped", (double)ioDecoder.GetFramePool().getDropped());
+}
+
+void BenchEndToEnd(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream,
+    ThreadPool& inPool) {
+    std::unique_ptr<Decoder> pSwDecoder;
+    if (ioRunner.isEnabled("e2e_")) {
+        try {
+            pSwDecoder.reset(new SwDecoder(inConfig.threadCount));
+        } catch (...) {
+            std::cerr << "Software decoder not available, skipping its end-to-end runs" << std::endl;
+        }
+    }
+    if (pSwDecoder && ioRunner.isEnabled("e2e_decode")) {
+        BenchEndToEnd(ioRunner, "e2e_decode", inConfig, inStream, *pSwDecoder, nullptr);
+    }
+    if (pSwDecoder && ioRunner.isEnabled("e2e_decode_convert")) {
+        BenchEndToEnd(ioRunner, "e2e_decode_convert", inConfig, inStream, *pSwDecoder, &inPool);
+    }
+    if (ioRunner.isEnabled("e2e_synthetic")) {
+        SyntheticDecoder decoder(inConfig.stream.width, inConfig.stream.height);
+        BenchEndToEnd(ioRunner, "e2e_synthetic", inConfig, inStream, decoder, nullptr);
+    }
+}
+
+// The whole stream on 1, 2, 4, ... decoders at once, cut into GOP segments, with the speedup
+// over one decoder. Software decoders with one thread each, synthetic ones without FFmpeg.
+void BenchGopParallel(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream) {
+    if (!ioRunner.isEnabled("gop_parallel_decode")) {
+        return;
+    }
+    StreamIndex index;
+    index.build(inStream.data(), inStream.size());
+    bool software = true;
+    try {
+        SwDecoder probe(1);
+    } catch (...) {
+        software = false;
+    }
+    FramePoolConfig poolConfig;
+    poolConfig.capacity = 4;
+    auto factory = [&](int) {
+        return std::unique_ptr<Decoder>(software ? (Decoder*)new SwDecoder(1, poolConfig)
+            : new SyntheticDecoder(inConfig.stream.width, inConfig.stream.height, 200000, poolConfig));
+    };
+
+    const int maxDecoders = inConfig.threadCount > 0 ? inConfig.threadCount : std::max(1, (int)std::thread::hardware_concurrency());
+    double baseRate = 0;
+    for (int decoders = 1;; decoders = std::min(2 * decoders, maxDecoders)) {
+        GopParallelConfig config;
+        config.decoderCount = decoders;
+        config.minSegmentFrames = inConfig.stream.gopLength;
+        const BenchmarkParams params = { { "backend", software ? "sw" : "synthetic" }, { "decoders", std::to_string(decoders) },
+            { "stream", StreamName(inConfig.stream) } };
+        int segments = 0;
+        BenchmarkResult& result = ioRunner.run("gop_parallel_decode", params, "frames", (double)index.getFrameCount(), [&] {
+            GopParallelDecoder decoder(index, inStream.data(), inStream.size(), factory, config);
+            while (decoder.getFrame()) {
+            }
+            segments = decoder.getSegmentCount();
+        });
+        if (!baseRate) {
+            baseRate = result.itemsPerSecond;
+        }
+        result.metrics.emplace_back("segments", (double)segments);
+        result.metrics.emplace_back("speedup", result.itemsPerSecond / baseRate);
+        if (decoders == maxDecoders) {
+            break;
+        }
+    }
+}
+
+// The stream through a decoder set up by every profile, one sample per frame from handing its
+// access unit to the decoder until getFrame() returns it. Software decoders, synthetic ones
+// (which have no delay to trade) without FFmpeg.
+void BenchDecodeProfiles(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream) {
+    if (!ioRunner.isEnabled("decode_latency")) {
+        return;
+    }
+    for (DecodeProfileType type : { DecodeProfileType::LowLatency, DecodeProfileType::Balanced, DecodeProfileType::Throughput }) {
+        const DecodeProfile& profile = GetDecodeProfile(type);
+        std::unique_ptr<Decoder> pDecoder;
+        try {
+            pDecoder.reset(new SwDecoder(inConfig.threadCount, FramePoolConfig(), profile));
+        } catch (...) {
+            pDecoder.reset(new SyntheticDecoder(inConfig.stream.width, inConfig.stream.height));
+        }
+        Decoder& decoder = *pDecoder;
+
+        AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+        std::vector<int64_t> submitNs;
+        std::vector<double> samples;
+        uint64_t frames = 0;
+        const int64_t start = NowNs();
+        do {
+            packetizer.reset();
+            AccessUnit unit;
+            bool more = true;
+            while (more) {
+                more = packetizer.next(unit);
+                int frameCount = 0;
+                if (more) {
+                    submitNs.resize(std::max<size_t>(submitNs.size(), (size_t)unit.frameIndex + 1));
+                    submitNs[(size_t)unit.frameIndex] = NowNs();
+                    frameCount = decoder.decode(unit.data, unit.size, unit.frameIndex, true);
+                } else {
+                    frameCount = decoder.decode(nullptr, 0);
+                }
+                while (frameCount--) {
+                    FrameHandle frame = decoder.getFrame();
+                    const int64_t timestamp = frame.info().timestamp;
+                    if (timestamp >= 0 && timestamp < (int64_t)submitNs.size()) {
+                        samples.push_back((double)(NowNs() - submitNs[(size_t)timestamp]));
+                    }
+                    frames++;
+                }
+            }
+        } while ((NowNs() - start) / 1e9 < ioRunner.getMinSeconds());
+        const double seconds = (NowNs() - start) / 1e9;
+
+        const BenchmarkParams params = { { "backend", decoder.getName() }, { "profile", profile.name },
+            { "stream", StreamName(inConfig.stream) } };
+        BenchmarkResult& result = ioRunner.add("decode_latency", params, "frames", samples, frames / seconds);
+        result.metrics.emplace_back("pool_capacity", (double)decoder.GetFramePool().getConfig().capacity);
+    }
+}
+
+// 160 pixel wide thumbnails of every IDR picture: decoding only those, and decoding every frame
+// and keeping the IDR pictures, which is what the keyframe mode replaces. Software decoder,
+// synthetic without FFmpeg.
+void BenchThumbnails(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream,
+    ThreadPool& inPool) {
+    if (!ioRunner.isEnabled("thumbnail")) {
+        return;
+    }
+    StreamIndex index;
+    index.build(inStream.data(), inStream.size());
+    std::unique_ptr<Decoder> pDecoder;
+    try {
+        pDecoder.reset(new SwDecoder(inConfig.threadCount));
+    } catch (...) {
+        pDecoder.reset(new SyntheticDecoder(inConfig.stream.width, inConfig.stream.height));
+    }
+    Decoder& decoder = *pDecoder;
+    ThumbnailConfig config;
+    config.pConvertPool = &inPool;
+    const BenchmarkParams params = { { "backend", decoder.getName() }, { "stream", StreamName(inConfig.stream) } };
+    const double thumbnailCount = (double)index.getKeyframeCount();
+
+    double keyframeRate = 0;
+    if (ioRunner.isEnabled("thumbnail_keyframes")) {
+        BenchmarkResult& result = ioRunner.run("thumbnail_keyframes", params, "thumbnails", thumbnailCount, [&] {
+            ThumbnailExtractor extractor(index, inStream.data(), decoder, config);
+            Thumbnail thumbnail;
+            while (extractor.next(thumbnail)) {
+            }
+        });
+        keyframeRate = result.itemsPerSecond;
+    }
+    if (ioRunner.isEnabled("thumbnail_full_decode")) {
+        std::vector<uint8_t> image;
+        BenchmarkResult& result = ioRunner.run("thumbnail_full_decode", params, "thumbnails", thumbnailCount, [&] {
+            AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+            AccessUnit unit;
+            bool more = true;
+            while (more) {
+                more = packetizer.next(unit);
+                int frameCount = more ? decoder.decode(unit.data, unit.size, unit.frameIndex, true) : decoder.decode(nullptr, 0);
+                while (frameCount--) {
+                    FrameHandle frame = decoder.getFrame();
+                    const FrameInfo& info = frame.info();
+                    if (!(index.getEntry(info.timestamp).flags & StreamIndexFlag_Idr)) {
+                        continue;
+                    }
+                    ScaleOutput output;
+                    output.width = config.width;
+                    output.height = (config.width * info.height / info.width) & ~1;
+                    output.pitch = output.width * 4;
+                    image.resize((size_t)output.pitch * output.height);
+                    output.data = image.data();
+                    Nv12ScaleToColor32Host<BGRA32>(frame.data(), info.pitch, info.width, info.height, CropRect(), &output, 1,
+                        config.filter, info.matrix, &inPool);
+                }
+            }
+        });
+        if (keyframeRate) {
+            result.metrics.emplace_back("keyframe_speedup", keyframeRate / result.itemsPerSecond);
+        }
+    }
+}
+
+// Interactive scrubbing: stepping back through the whole stream, then looping over a second
+// three times. Without a cache every step back decodes its GOP again from the IDR picture.
+void BenchFrameCache(BenchmarkRunner& ioRunner, const BenchConfig& inConfig, const std::vector<uint8_t>& inStream) {
+    if (!ioRunner.isEnabled("frame_cache_scrub")) {
+        return;
+    }
+    StreamIndex index;
+    index.build(inStream.data(), inStream.size());
+    std::unique_ptr<Decoder> pDecoder;
+    try {
+        pDecoder.reset(new SwDecoder(inConfig.threadCount));
+    } catch (...) {
+        pDecoder.reset(new SyntheticDecoder(inConfig.stream.width, inConfig.stream.height));
+    }
+    Decoder& decoder = *pDecoder;
+    std::vector<int64_t> frames;
+    for (int64_t frame = index.getFrameCount() - 1; frame >= 0; frame--) {
+        frames.push_back(frame);
+    }
+    const int64_t loopLength = std::min<int64_t>(30, index.getFrameCount());
+    for (int loop = 0; loop < 3; loop++) {
+        for (int64_t frame = 0; frame < loopLength; frame++) {
+            frames.push_back(index.getFrameCount() / 2 + frame - loopLength / 2);
+        }
+    }
+
+    const struct {
+        const char* cache;
+        size_t budget;
+        int downscale;
+    } cases[] = { { "off", 0, 1 }, { "nv12", (size_t)1 << 30, 1 }, { "nv12_half", (size_t)1 << 30, 2 } };
+    double uncachedRate = 0;
+    for (const auto& benchCase : cases) {
+        FrameCacheConfig config;
+        config.budget = benchCase.budget;
+        config.downscale = benchCase.downscale;
+        uint64_t decoded = 0, hits = 0, lookups = 0, bytes = 0;
+        BenchmarkResult& result = ioRunner.run("frame_cache_scrub", { { "backend", decoder.getName() },
+            { "stream", StreamName(inConfig.stream) }, { "cache", benchCase.cache } }, "frames", (double)frames.size(), [&] {
+            AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+            FrameCache cache(config);
+            FrameScrubber scrubber(index, inStream.data(), packetizer, decoder, cache);
+            for (int64_t frame : frames) {
+                if (!scrubber.get(frame)) {
+                    std::abort();
+                }
+            }
+            decoded = scrubber.getDecodedFrames();
+            hits = cache.getHits();
+            lookups = cache.getHits() + cache.getMisses();
+            bytes = std::max<uint64_t>(bytes, cache.getBytes());
+        });
+        result.metrics.emplace_back("decoded_per_frame", (double)decoded / frames.size());
+        result.metrics.emplace_back("hit_rate", (double)hits / lookups);
+        result.metrics.emplace_back("cache_mb", bytes / 1048576.0);
+        if (!benchCase.budget) {
+            uncachedRate = result.itemsPerSecond;
+        } else if (uncachedRate) {
+            result.metrics.emplace_back("speedup", result.itemsPerSecond / uncachedRate);
+        }
+    }
+}
+
+void showHelpAndExit(const char* inBadOption = nullptr) {
+    if (inBadOption) {
+        std::cerr << "Error parsing \"" << inBadOption << "\"" << std::endl;
+    }
+    std::cout << "Options:" << std::endl
+        << "-o             Write the JSON results to this file instead of stdout" << std::endl
+        << "-filter        Only run benchmarks whose name contains this string" << std::endl
+        << "-min-time      Seconds every benchmark runs at least (default: 0.2)" << std::endl
+        << "-threads       Decoder and converter threads (default: all cores)" << std::endl
+        << "-width         Generated stream width (default: 1920)" << std::endl
+        << "-height        Generated stream height (default: 1080)" << std::endl
+        << "-frames        Generated stream length (default: 120)" << std::endl
+        << "-gop           Generated stream IDR period (default: 30)" << std::endl
+        << "-refresh       Percentage of coded macroblocks in P and B frames (default: 0)" << std::endl
+        << "-bframes       B frames between reference frames in the generated stream (default: 0)" << std::endl
+        << "-write-stream  Also write the generated stream to this file" << std::endl;
+    exit(inBadOption ? 1 : 0);
+}
+
+}
+
+int
+main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "-h") {
+            showHelpAndExit();
+        }
+        if (i + 1 >= argc) {
+            showHelpAndExit(argv[i]);
+        }
+        if (option == "-o") {
+            config.outputFile = argv[++i];
+        } else if (option == "-filter") {
+            config.filter = argv[++i];
+        } else if (option == "-min-time") {
+            config.minSeconds = atof(argv[++i]);
+        } else if (option == "-threads") {
+            config.threadCount = atoi(argv[++i]);
+        } else if (option == "-width") {
+            config.stream.width = atoi(argv[++i]);
+        } else if (option == "-height") {
+            config.stream.height = atoi(argv[++i]);
+        } else if (option == "-frames") {
+            config.stream.frameCount = atoi(argv[++i]);
+        } else if (option == "-gop") {
+            config.stream.gopLength = atoi(argv[++i]);
+        } else if (option == "-refresh") {
+            config.stream.refreshPercent = atoi(argv[++i]);
+        } else if (option == "-bframes") {
+            config.stream.bFrames = atoi(argv[++i]);
+        } else if (option == "-write-stream") {
+            config.streamFile = argv[++i];
+        } else {
+            showHelpAndExit(argv[i]);
+        }
+    }
+
+    const std::vector<uint8_t> stream = GenerateH264Stream(config.stream);
+    if (!config.streamFile.empty()) {
+        std::ofstream(config.streamFile, std::ios::binary).write((const char*)stream.data(), stream.size());
+    }
+
+    BenchmarkRunner runner(config.minSeconds, config.filter);
+    ThreadPool pool(config.threadCount);
+    BenchStartCodes(runner, stream);
+    BenchStreamIndex(runner, stream);
+    BenchSeekDecode(runner, config, stream);
+    BenchContainerDemux(runner, stream);
+    BenchLiveIngest(runner, stream);
+    BenchColorConversion<BGRA32>(runner, "bgra32", pool);
+    BenchColorConversion<RGBA32>(runner, "rgba32", pool);
+    BenchScaleConvert(runner, pool);
+    BenchFilterGraph(runner, pool);
+    BenchMosaic(runner, pool);
+    BenchSceneAnalysis(runner, pool);
+    BenchFramePool(runner);
+    BenchTelemetry(runner);
+    BenchEndToEnd(runner, config, stream, pool);
+    BenchGopParallel(runner, config, stream);
+    BenchDecodeProfiles(runner, config, stream);
+    BenchThumbnails(runner, config, stream, pool);
+    BenchFrameCache(runner, config, stream);
+
+    if (config.outputFile.empty()) {
+        runner.writeJson(std::cout);
+        return 0;
+    }
+    std::ofstream output(config.outputFile);
+    runner.writeJson(output);
+    runner.printSummary(std::cout);
+    return output ? 0 : 1;
+}
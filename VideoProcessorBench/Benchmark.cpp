@@ -0,0 +1,127 @@
+#include "Benchmark.hpp"
+
+#include "CpuFeatures.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace {
+
+// Nearest rank on sorted samples
+double Percentile(const std::vector<double>& inSorted, double inPercent) {
+    if (inSorted.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)(inPercent / 100 * inSorted.size() + 0.5);
+    rank = (std::min)((std::max)(rank, (size_t)1), inSorted.size());
+    return inSorted[rank - 1];
+}
+
+std::string JsonString(const std::string& inValue) {
+    std::string quoted = "\"";
+    for (char c : inValue) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+}
+
+BenchmarkRunner::BenchmarkRunner(double inMinSeconds, const std::string& inFilter)
+    : mMinSeconds(inMinSeconds)
+    , mFilter(inFilter)
+{
+}
+
+bool
+BenchmarkRunner::isEnabled(const std::string& inName) const
+{
+    return mFilter.empty() || inName.find(mFilter) != std::string::npos;
+}
+
+BenchmarkResult&
+BenchmarkRunner::run(const std::string& inName, const BenchmarkParams& inParams, const std::string& inUnit,
+    double inItemsPerIteration, const std::function<void()>& inIteration)
+{
+    inIteration();
+
+    std::vector<double> samples;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (elapsed < mMinSeconds || samples.size() < 3) {
+        auto iterationStart = std::chrono::steady_clock::now();
+        inIteration();
+        auto iterationEnd = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(iterationEnd - iterationStart).count() / inItemsPerIteration);
+        elapsed = std::chrono::duration<double>(iterationEnd - start).count();
+    }
+    return add(inName, inParams, inUnit, samples, samples.size() * inItemsPerIteration / elapsed);
+}
+
+BenchmarkResult&
+BenchmarkRunner::add(const std::string& inName, const BenchmarkParams& inParams, const std::string& inUnit,
+    std::vector<double>& ioSamplesNs, double inItemsPerSecond)
+{
+    std::sort(ioSamplesNs.begin(), ioSamplesNs.end());
+    BenchmarkResult result;
+    result.name = inName;
+    result.params = inParams;
+    result.unit = inUnit;
+    result.samples = ioSamplesNs.size();
+    result.p50Ns = Percentile(ioSamplesNs, 50);
+    result.p99Ns = Percentile(ioSamplesNs, 99);
+    double sum = 0;
+    for (double sample : ioSamplesNs) {
+        sum += sample;
+    }
+    result.meanNs = ioSamplesNs.empty() ? 0 : sum / ioSamplesNs.size();
+    result.itemsPerSecond = inItemsPerSecond;
+    mResults.push_back(result);
+    return mResults.back();
+}
+
+void
+BenchmarkRunner::writeJson(std::ostream& inStream) const
+{
+    inStream << std::setprecision(10)
+        << "{\n  \"simd\": " << JsonString(GetSimdLevelName(GetSimdLevel()))
+        << ",\n  \"cpus\": " << GetAvailableCpus().size()
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < mResults.size(); i++) {
+        const BenchmarkResult& result = mResults[i];
+        inStream << (i ? "," : "") << "\n    {\"name\": " << JsonString(result.name) << ", \"params\": {";
+        for (size_t j = 0; j < result.params.size(); j++) {
+            inStream << (j ? ", " : "") << JsonString(result.params[j].first) << ": " << JsonString(result.params[j].second);
+        }
+        inStream << "}, \"unit\": " << JsonString(result.unit)
+            << ", \"samples\": " << result.samples
+            << ", \"p50_ns\": " << result.p50Ns
+            << ", \"p99_ns\": " << result.p99Ns
+            << ", \"mean_ns\": " << result.meanNs
+            << ", \"items_per_second\": " << result.itemsPerSecond;
+        for (const std::pair<std::string, double>& metric : result.metrics) {
+            inStream << ", " << JsonString(metric.first) << ": " << metric.second;
+        }
+        inStream << "}";
+    }
+    inStream << "\n  ]\n}\n";
+}
+
+void
+BenchmarkRunner::printSummary(std::ostream& inStream) const
+{
+    for (const BenchmarkResult& result : mResults) {
+        std::string name = result.name;
+        for (const std::pair<std::string, std::string>& param : result.params) {
+            name += " " + param.first + "=" + param.second;
+        }
+        inStream << std::left << std::setw(64) << name << std::right << std::fixed << std::setprecision(1)
+            << " p50 " << std::setw(12) << result.p50Ns << " ns  p99 " << std::setw(12) << result.p99Ns << " ns  "
+            << std::setprecision(0) << std::setw(14) << result.itemsPerSecond << " " << result.unit << "/s\n";
+        inStream << std::defaultfloat;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> BenchmarkParams;
+
+struct BenchmarkResult {
+    std::string name;
+    BenchmarkParams params;
+    std::string unit;               // What an item is: "frames", "bytes", ...
+    size_t samples = 0;
+    double p50Ns = 0, p99Ns = 0, meanNs = 0;    // Latency per item
+    double itemsPerSecond = 0;
+    std::vector<std::pair<std::string, double>> metrics;    // Benchmark specific extras
+};
+
+// Collects latency samples, reduces them to percentiles and writes everything as JSON.
+// Nothing is printed while a benchmark runs, so output cannot skew the measurement.
+class BenchmarkRunner {
+public:
+    // Every benchmark runs for at least inMinSeconds. inFilter skips names not containing it.
+    BenchmarkRunner(double inMinSeconds, const std::string& inFilter);
+
+    bool isEnabled(const std::string& inName) const;
+
+    // Calls inIteration until inMinSeconds passed (and at least 3 times, after one warm-up call).
+    // Every call is one sample covering inItemsPerIteration items.
+    BenchmarkResult& run(const std::string& inName, const BenchmarkParams& inParams, const std::string& inUnit,
+        double inItemsPerIteration, const std::function<void()>& inIteration);
+
+    // For benchmarks that measure themselves: one latency sample per item, plus the throughput
+    BenchmarkResult& add(const std::string& inName, const BenchmarkParams& inParams, const std::string& inUnit,
+        std::vector<double>& ioSamplesNs, double inItemsPerSecond);
+
+    double getMinSeconds() const { return mMinSeconds; }
+
+    void writeJson(std::ostream& inStream) const;
+    void printSummary(std::ostream& inStream) const;
+
+private:
+    double mMinSeconds;
+    std::string mFilter;
+    std::vector<BenchmarkResult> mResults;
+};
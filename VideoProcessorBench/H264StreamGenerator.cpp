@@ -0,0 +1,272 @@
+#include "H264StreamGenerator.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// MSB first bit writer for RBSP payloads
+class BitWriter {
+public:
+    void u(int inBits, uint32_t inValue) {
+        for (int i = inBits - 1; i >= 0; i--) {
+            mCurrent = (uint8_t)((mCurrent << 1) | ((inValue >> i) & 1));
+            if (++mBitCount == 8) {
+                mBytes.push_back(mCurrent);
+                mCurrent = 0;
+                mBitCount = 0;
+            }
+        }
+    }
+
+    // Exp-Golomb codes
+    void ue(uint32_t inValue) {
+        const uint64_t code = (uint64_t)inValue + 1;
+        int bits = 0;
+        while ((code >> bits) > 1) {
+            bits++;
+        }
+        u(bits, 0);
+        u(bits + 1, (uint32_t)code);
+    }
+
+    void se(int32_t inValue) {
+        ue(inValue > 0 ? 2 * inValue - 1 : -2 * inValue);
+    }
+
+    bool aligned() const { return mBitCount == 0; }
+
+    void alignZero() {
+        while (!aligned()) {
+            u(1, 0);
+        }
+    }
+
+    // Only on a byte boundary
+    void bytes(const uint8_t* inData, size_t inSize) {
+        mBytes.insert(mBytes.end(), inData, inData + inSize);
+    }
+
+    void trailingBits() {
+        u(1, 1);
+        alignZero();
+    }
+
+    const std::vector<uint8_t>& data() const { return mBytes; }
+
+private:
+    std::vector<uint8_t> mBytes;
+    uint8_t mCurrent = 0;
+    int mBitCount = 0;
+};
+
+void AppendNalUnit(std::vector<uint8_t>& ioStream, uint8_t inHeader, const std::vector<uint8_t>& inRbsp) {
+    const uint8_t startCode[] = { 0, 0, 0, 1 };
+    ioStream.insert(ioStream.end(), startCode, startCode + 4);
+    ioStream.push_back(inHeader);
+    // Emulation prevention: no 00 00 0x (x <= 3) inside the NAL unit
+    int zeros = 0;
+    for (uint8_t byte : inRbsp) {
+        if (zeros == 2 && byte <= 3) {
+            ioStream.push_back(3);
+            zeros = 0;
+        }
+        ioStream.push_back(byte);
+        zeros = byte ? 0 : zeros + 1;
+    }
+}
+
+// I_PCM samples, never 0 so the payload needs no emulation prevention in practice
+void WritePcmMacroblock(BitWriter& ioWriter, int inMbX, int inMbY, int inFrame) {
+    uint8_t samples[384];
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) {
+            samples[y * 16 + x] = (uint8_t)(16 + ((inMbX * 16 + x + inMbY * 16 + y + 2 * inFrame) & 0xff) * 219 / 255);
+        }
+    }
+    for (int i = 0; i < 64; i++) {
+        samples[256 + i] = (uint8_t)(128 + ((inMbX + inFrame) & 31) - 16);
+        samples[320 + i] = (uint8_t)(128 + ((inMbY - inFrame) & 31) - 16);
+    }
+    ioWriter.alignZero();
+    ioWriter.bytes(samples, sizeof(samples));
+}
+
+}
+
+std::vector<uint8_t> GenerateH264Stream(const StreamGeneratorConfig& inConfig) {
+    const int width = (std::max)(2, inConfig.width & ~1);
+    const int height = (std::max)(2, inConfig.height & ~1);
+    const int mbWidth = (width + 15) / 16;
+    const int mbHeight = (height + 15) / 16;
+    const int mbCount = mbWidth * mbHeight;
+    const int gopLength = (std::max)(1, inConfig.gopLength);
+    const int refreshCount = mbCount * (std::min)((std::max)(inConfig.refreshPercent, 0), 100) / 100;
+
+    const int bFrames = (std::max)(0, inConfig.bFrames);
+    const bool reorder = bFrames > 0;
+
+    std::vector<uint8_t> stream;
+
+    // Constrained baseline, POC type 2 (output order == decode order), one reference frame,
+    // 4 bit frame_num. Level 5.1 covers 4096x2304, beyond that 6.2. Reordered streams are main
+    // profile with POC type 0 and the two reference frames a B picture predicts from.
+    BitWriter sps;
+    sps.u(8, reorder ? 77 : 66);
+    sps.u(8, reorder ? 0x40 : 0xc0);
+    sps.u(8, mbCount <= 36864 ? 51 : 62);
+    sps.ue(0);
+    sps.ue(0);
+    if (reorder) {
+        sps.ue(0);
+        sps.ue(12);                     // 16 bit pic_order_cnt_lsb
+    } else {
+        sps.ue(2);
+    }
+    sps.ue(reorder ? 2 : 1);
+    sps.u(1, 0);
+    sps.ue(mbWidth - 1);
+    sps.ue(mbHeight - 1);
+    sps.u(1, 1);
+    sps.u(1, 1);
+    const bool cropping = width != mbWidth * 16 || height != mbHeight * 16;
+    sps.u(1, cropping);
+    if (cropping) {
+        // In units of 2 samples for 4:2:0
+        sps.ue(0);
+        sps.ue((mbWidth * 16 - width) / 2);
+        sps.ue(0);
+        sps.ue((mbHeight * 16 - height) / 2);
+    }
+    sps.u(1, reorder);
+    if (reorder) {
+        // VUI with the bitstream restriction only: one frame of reordering, so decoders output
+        // without guessing the delay
+        sps.u(8, 0);
+        sps.u(1, 1);
+        sps.u(1, 1);                    // motion_vectors_over_pic_boundaries_flag
+        sps.ue(0);
+        sps.ue(0);
+        sps.ue(16);
+        sps.ue(16);
+        sps.ue(1);                      // max_num_reorder_frames
+        sps.ue(2);                      // max_dec_frame_buffering
+    }
+    sps.trailingBits();
+
+    // CAVLC, deblocking control present so slices can switch the filter off
+    BitWriter pps;
+    pps.ue(0);
+    pps.ue(0);
+    pps.u(1, 0);
+    pps.u(1, 0);
+    pps.ue(0);
+    pps.ue(0);
+    pps.ue(0);
+    pps.u(1, 0);
+    pps.u(2, 0);
+    pps.se(0);
+    pps.se(0);
+    pps.se(0);
+    pps.u(1, 1);
+    pps.u(1, 0);
+    pps.u(1, 0);
+    pps.trailingBits();
+
+    // Decode order: each GOP starts with its IDR picture, every P picture comes before the B
+    // pictures displayed ahead of it
+    struct Picture {
+        int frame;                      // Display order
+        int gopFrame;
+        int type;                       // Slice type: 7 I, 5 P, 6 B
+        int frameNum;
+    };
+    std::vector<Picture> pictures;
+    for (int gopStart = 0; gopStart < inConfig.frameCount; gopStart += gopLength) {
+        const int length = (std::min)(gopLength, inConfig.frameCount - gopStart);
+        int references = 0;
+        pictures.push_back({ gopStart, 0, 7, references++ });
+        for (int gopFrame = 1; gopFrame < length;) {
+            const int reference = (std::min)(gopFrame + bFrames, length - 1);
+            pictures.push_back({ gopStart + reference, reference, 5, references++ });
+            for (; gopFrame < reference; gopFrame++) {
+                pictures.push_back({ gopStart + gopFrame, gopFrame, 6, references });
+            }
+            gopFrame = reference + 1;
+        }
+    }
+
+    int idrCount = 0;
+    for (const Picture& picture : pictures) {
+        const int frame = picture.frame;
+        const int gopFrame = picture.gopFrame;
+        const bool idr = picture.type == 7;
+        const bool b = picture.type == 6;
+
+        BitWriter aud;
+        aud.u(3, idr ? 0 : b ? 2 : 1);
+        aud.trailingBits();
+        AppendNalUnit(stream, 0x09, aud.data());
+
+        BitWriter slice;
+        slice.ue(0);                    // first_mb_in_slice
+        slice.ue(picture.type);         // I, P or B, all slices of the picture
+        slice.ue(0);                    // pic_parameter_set_id
+        slice.u(4, picture.frameNum & 15);  // frame_num
+        if (idr) {
+            slice.ue(idrCount++ & 1);   // idr_pic_id, differs between neighbouring IDRs
+        }
+        if (reorder) {
+            slice.u(16, (2 * gopFrame) & 0xffff);   // pic_order_cnt_lsb
+        }
+        if (b) {
+            slice.u(1, 1);              // direct_spatial_mv_pred_flag
+        }
+        if (!idr) {
+            slice.u(1, 0);              // num_ref_idx_active_override_flag
+            slice.u(1, 0);              // ref_pic_list_modification_flag_l0
+        }
+        if (b) {
+            slice.u(1, 0);              // ref_pic_list_modification_flag_l1
+        } else if (idr) {
+            slice.u(1, 0);              // no_output_of_prior_pics_flag
+            slice.u(1, 0);              // long_term_reference_flag
+        } else {
+            slice.u(1, 0);              // adaptive_ref_pic_marking_mode_flag
+        }
+        slice.se(0);                    // slice_qp_delta
+        slice.ue(1);                    // disable_deblocking_filter_idc
+
+        if (idr) {
+            AppendNalUnit(stream, 0x67, sps.data());
+            AppendNalUnit(stream, 0x68, pps.data());
+            for (int mb = 0; mb < mbCount; mb++) {
+                slice.ue(25);           // I_PCM
+                WritePcmMacroblock(slice, mb % mbWidth, mb / mbWidth, frame);
+            }
+            slice.trailingBits();
+            AppendNalUnit(stream, 0x65, slice.data());
+            continue;
+        }
+
+        // Coded band of refreshCount macroblocks, wrapping at the end of the picture
+        const int bandStart = (int)((int64_t)gopFrame * refreshCount % mbCount);
+        int skipRun = 0;
+        for (int mb = 0; mb < mbCount; mb++) {
+            if ((mb - bandStart + mbCount) % mbCount >= refreshCount) {
+                skipRun++;
+                continue;
+            }
+            slice.ue(skipRun);          // mb_skip_run
+            skipRun = 0;
+            slice.ue((b ? 23 : 5) + 25);    // I_PCM in a P or B slice
+            WritePcmMacroblock(slice, mb % mbWidth, mb / mbWidth, frame);
+        }
+        if (skipRun) {
+            slice.ue(skipRun);
+        }
+        slice.trailingBits();
+        // B pictures are not used for reference
+        AppendNalUnit(stream, b ? 0x01 : 0x41, slice.data());
+    }
+    return stream;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct StreamGeneratorConfig {
+    int width = 1920, height = 1080;    // Even, cropped from whole macroblocks
+    int frameCount = 120;
+    int gopLength = 30;                 // Frames from one IDR picture to the next, 1 = all intra
+    int refreshPercent = 0;             // Share of the macroblocks of a P or B picture that is coded, the rest is skipped
+    int bFrames = 0;                    // B pictures between reference pictures, 0 = no reordering
+};
+
+// Generates a constrained baseline H.264 Annex-B stream without an encoder: IDR pictures are
+// all I_PCM macroblocks (raw samples of a moving ramp), P pictures are P_Skip apart from a
+// band of I_PCM macroblocks that moves through the picture. Every access unit starts with an
+// AUD, IDR access units repeat SPS and PPS. Decode cost is dominated by the resolution and the
+// refresh share, which makes the streams useful for reproducible throughput runs.
+// With bFrames the stream is main profile instead: every P picture is sent ahead of the
+// bFrames non-reference B pictures (B_Skip apart from the band) displayed before it, so the
+// decoder outputs in a different order than it decodes. GOPs stay closed.
+std::vector<uint8_t> GenerateH264Stream(const StreamGeneratorConfig& inConfig);
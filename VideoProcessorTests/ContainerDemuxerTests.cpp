@@ -0,0 +1,344 @@
+#include "TestHarness.hpp"
+
+#include "ContainerDemuxer.hpp"
+#include "MkvDemuxer.hpp"
+#include "Mp4Demuxer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint8_t kSps[] = { 0x67, 0x42, 0xc0, 0x1e, 0x8c };
+const uint8_t kPps[] = { 0x68, 0xce, 0x3c, 0x80 };
+
+void Append(Bytes& ioOut, const Bytes& inData) {
+    ioOut.insert(ioOut.end(), inData.begin(), inData.end());
+}
+
+void AppendBe(Bytes& ioOut, uint64_t inValue, int inBytes) {
+    for (int i = inBytes - 1; i >= 0; i--) {
+        ioOut.push_back((uint8_t)(inValue >> (8 * i)));
+    }
+}
+
+Bytes Concat(std::initializer_list<Bytes> inParts) {
+    Bytes out;
+    for (const Bytes& part : inParts) {
+        Append(out, part);
+    }
+    return out;
+}
+
+// ISO base media box: 32 bit size, type, payload
+Bytes MakeBox(const char* inType, const Bytes& inPayload) {
+    Bytes box;
+    AppendBe(box, 8 + inPayload.size(), 4);
+    box.insert(box.end(), inType, inType + 4);
+    Append(box, inPayload);
+    return box;
+}
+
+// Full box table: version and flags, entry count, then 32 bit fields
+Bytes MakeTable(const char* inType, uint32_t inCount, std::initializer_list<uint32_t> inFields) {
+    Bytes payload;
+    AppendBe(payload, 0, 4);
+    AppendBe(payload, inCount, 4);
+    for (uint32_t field : inFields) {
+        AppendBe(payload, field, 4);
+    }
+    return MakeBox(inType, payload);
+}
+
+// AVCDecoderConfigurationRecord with one SPS and one PPS
+Bytes MakeAvcConfig(int inLengthSize = 4) {
+    Bytes config = { 1, 0x42, 0xc0, 0x1e, (uint8_t)(0xfc | (inLengthSize - 1)), 0xe1 };
+    AppendBe(config, sizeof(kSps), 2);
+    config.insert(config.end(), kSps, kSps + sizeof(kSps));
+    config.push_back(1);
+    AppendBe(config, sizeof(kPps), 2);
+    config.insert(config.end(), kPps, kPps + sizeof(kPps));
+    return config;
+}
+
+Bytes AnnexBParameterSets() {
+    Bytes out = { 0, 0, 0, 1 };
+    out.insert(out.end(), kSps, kSps + sizeof(kSps));
+    out.insert(out.end(), { 0, 0, 0, 1 });
+    out.insert(out.end(), kPps, kPps + sizeof(kPps));
+    return out;
+}
+
+// A sample of one NAL unit of inSize bytes (type 5 or 1), 4 byte length prefix
+Bytes MakeSample(size_t inSize, bool inKeyframe) {
+    Bytes sample;
+    AppendBe(sample, inSize, 4);
+    sample.push_back(inKeyframe ? 0x65 : 0x41);
+    for (size_t i = 1; i < inSize; i++) {
+        sample.push_back((uint8_t)i);
+    }
+    return sample;
+}
+
+// An MP4 file with one avc1 track of inSamples, all in one chunk at the end of the file.
+// inSampleSizes replaces the stsz box when set.
+Bytes MakeMp4(const std::vector<Bytes>& inSamples, const Bytes& inSampleSizes = Bytes()) {
+    Bytes visualEntry(78, 0);
+    visualEntry[25] = 64;       // width
+    visualEntry[27] = 48;       // height
+    Append(visualEntry, MakeBox("avcC", MakeAvcConfig()));
+    Bytes descriptions = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    Append(descriptions, MakeBox("avc1", visualEntry));
+
+    Bytes sizes;
+    if (!inSampleSizes.empty()) {
+        sizes = inSampleSizes;
+    } else {
+        Bytes payload;
+        AppendBe(payload, 0, 4);
+        AppendBe(payload, 0, 4);
+        AppendBe(payload, inSamples.size(), 4);
+        for (const Bytes& sample : inSamples) {
+            AppendBe(payload, sample.size(), 4);
+        }
+        sizes = MakeBox("stsz", payload);
+    }
+
+    const Bytes handler = MakeBox("hdlr", { 0, 0, 0, 0, 0, 0, 0, 0, 'v', 'i', 'd', 'e', 0, 0, 0, 0 });
+    Bytes mediaHeader(24, 0);
+    mediaHeader[15] = 30;       // timescale
+    const Bytes ftyp = MakeBox("ftyp", { 'i', 's', 'o', 'm', 0, 0, 0, 1 });
+
+    // The chunk offset depends on the size of moov, which does not depend on it
+    auto build = [&](uint32_t inChunkOffset) {
+        const Bytes table = Concat({ MakeBox("stsd", descriptions), sizes,
+            MakeTable("stco", 1, { inChunkOffset }), MakeTable("stsc", 1, { 1, (uint32_t)inSamples.size(), 1 }),
+            MakeTable("stts", 1, { (uint32_t)inSamples.size(), 1 }), MakeTable("stss", 1, { 1 }) });
+        const Bytes media = Concat({ handler, MakeBox("mdhd", mediaHeader),
+            MakeBox("minf", MakeBox("stbl", table)) });
+        return Concat({ ftyp, MakeBox("moov", MakeBox("trak", MakeBox("mdia", media))) });
+    };
+    Bytes file = build(0);
+    file = build((uint32_t)file.size() + 8);
+    Bytes data;
+    for (const Bytes& sample : inSamples) {
+        Append(data, sample);
+    }
+    Append(file, MakeBox("mdat", data));
+    return file;
+}
+
+// Matroska element: ID as given, then the size as an 8 byte vint
+Bytes MakeElement(std::initializer_list<uint8_t> inId, const Bytes& inPayload) {
+    Bytes element(inId);
+    element.push_back(0x01);
+    AppendBe(element, inPayload.size(), 7);
+    Append(element, inPayload);
+    return element;
+}
+
+Bytes MakeMkv(const std::vector<Bytes>& inSamples) {
+    const Bytes header = MakeElement({ 0x1A, 0x45, 0xDF, 0xA3 }, MakeElement({ 0x42, 0x82 }, { 'm', 'a', 't', 'r', 'o', 's', 'k', 'a' }));
+    const std::string codec = "V_MPEG4/ISO/AVC";
+    const Bytes track = Concat({ MakeElement({ 0xD7 }, { 1 }), MakeElement({ 0x83 }, { 1 }),
+        MakeElement({ 0x86 }, Bytes(codec.begin(), codec.end())), MakeElement({ 0x63, 0xA2 }, MakeAvcConfig()) });
+    Bytes cluster = MakeElement({ 0xE7 }, { 0 });
+    for (size_t i = 0; i < inSamples.size(); i++) {
+        // Track 1, timecode i, keyframe flag on the first block
+        Bytes block = { 0x81, 0, (uint8_t)i, (uint8_t)(i == 0 ? 0x80 : 0) };
+        Append(block, inSamples[i]);
+        Append(cluster, MakeElement({ 0xA3 }, block));
+    }
+    const Bytes segment = Concat({ MakeElement({ 0x16, 0x54, 0xAE, 0x6B }, MakeElement({ 0xAE }, track)),
+        MakeElement({ 0x1F, 0x43, 0xB6, 0x75 }, cluster) });
+    return Concat({ header, MakeElement({ 0x18, 0x53, 0x80, 0x67 }, segment) });
+}
+
+// The sample as the demuxer must hand it out: Annex-B, parameter sets in front of keyframes
+Bytes ExpectedUnit(const Bytes& inSample, bool inParameterSets) {
+    Bytes out = inParameterSets ? AnnexBParameterSets() : Bytes();
+    out.insert(out.end(), { 0, 0, 0, 1 });
+    out.insert(out.end(), inSample.begin() + 4, inSample.end());
+    return out;
+}
+
+std::vector<Bytes> ReadAll(PacketSource& ioSource) {
+    std::vector<Bytes> units;
+    AccessUnit unit;
+    while (ioSource.next(unit)) {
+        units.emplace_back(unit.data, unit.data + unit.size);
+    }
+    return units;
+}
+
+}
+
+TEST_CASE(ParseAvcConfigReadsParameterSets) {
+    const Bytes config = MakeAvcConfig(2);
+    VideoTrackInfo track;
+    REQUIRE(ParseAvcConfig(config.data(), config.size(), track));
+    CHECK(track.codec == VideoCodec::H264);
+    CHECK(track.nalLengthSize == 2);
+    CHECK(track.parameterSets == AnnexBParameterSets());
+
+    // Every truncation ends inside the record
+    for (size_t size = 0; size < config.size(); size++) {
+        CHECK_MESSAGE(!ParseAvcConfig(config.data(), size, track), size << " bytes");
+    }
+    Bytes bad = config;
+    bad[0] = 2;
+    CHECK(!ParseAvcConfig(bad.data(), bad.size(), track));
+    // 3 byte lengths are not allowed
+    bad = MakeAvcConfig(3);
+    CHECK(!ParseAvcConfig(bad.data(), bad.size(), track));
+    // A parameter set longer than the record
+    bad = config;
+    bad[7] = 0xff;
+    CHECK(!ParseAvcConfig(bad.data(), bad.size(), track));
+}
+
+TEST_CASE(ParseHevcConfigReadsParameterSets) {
+    const uint8_t vps[] = { 0x40, 0x01, 0x0c }, sps[] = { 0x42, 0x01, 0x01, 0x60 }, pps[] = { 0x44, 0x01 };
+    Bytes config(21, 0);
+    config[0] = 1;
+    config.push_back(0xfc | 3);
+    config.push_back(3);
+    for (const Bytes& nal : { Bytes(vps, vps + 3), Bytes(sps, sps + 4), Bytes(pps, pps + 2) }) {
+        config.push_back(0x80 | (nal[0] >> 1));
+        AppendBe(config, 1, 2);
+        AppendBe(config, nal.size(), 2);
+        Append(config, nal);
+    }
+    VideoTrackInfo track;
+    REQUIRE(ParseHevcConfig(config.data(), config.size(), track));
+    CHECK(track.codec == VideoCodec::Hevc);
+    CHECK(track.nalLengthSize == 4);
+    const Bytes expected = Concat({ { 0, 0, 0, 1 }, Bytes(vps, vps + 3), { 0, 0, 0, 1 }, Bytes(sps, sps + 4),
+        { 0, 0, 0, 1 }, Bytes(pps, pps + 2) });
+    CHECK(track.parameterSets == expected);
+
+    for (size_t size = 0; size < config.size(); size++) {
+        CHECK_MESSAGE(!ParseHevcConfig(config.data(), size, track), size << " bytes");
+    }
+    // More NAL units in an array than there are bytes for
+    Bytes bad = config;
+    bad[25] = 0xff;
+    CHECK(!ParseHevcConfig(bad.data(), bad.size(), track));
+}
+
+TEST_CASE(Mp4DemuxerReadsSamplesAsAnnexB) {
+    const std::vector<Bytes> samples = { MakeSample(20, true), MakeSample(7, false), MakeSample(33, false) };
+    const Bytes file = MakeMp4(samples);
+    CHECK(ProbeContainer(file.data(), file.size()) == ContainerFormat::Mp4);
+    Mp4Demuxer demuxer(file.data(), file.size(), 4);
+    REQUIRE(demuxer);
+    CHECK(demuxer.getTrack().width == 64 && demuxer.getTrack().height == 48);
+    CHECK(demuxer.getTrack().sampleCount == 3);
+    CHECK(demuxer.getTrack().maxSampleSize == samples[2].size());
+    const std::vector<Bytes> units = ReadAll(demuxer);
+    REQUIRE(units.size() == 3);
+    for (size_t i = 0; i < units.size(); i++) {
+        CHECK_MESSAGE(units[i] == ExpectedUnit(samples[i], i == 0), "sample " << i);
+    }
+}
+
+TEST_CASE(Mp4DemuxerStopsAtTruncation) {
+    const std::vector<Bytes> samples = { MakeSample(20, true), MakeSample(7, false), MakeSample(4000, false) };
+    Bytes file = MakeMp4(samples);
+    file.resize(file.size() - 100);
+    Mp4Demuxer demuxer(file.data(), file.size(), 4);
+    REQUIRE(demuxer);
+    // The sample past the end counts neither as a sample nor toward the buffer size
+    CHECK(demuxer.getTrack().sampleCount == 2);
+    CHECK(demuxer.getTrack().maxSampleSize == samples[0].size());
+    CHECK(ReadAll(demuxer).size() == 2);
+
+    // Cut inside moov: nothing to open, and no exception
+    file.resize(200);
+    Mp4Demuxer cut(file.data(), file.size(), 4);
+    CHECK(!cut);
+    CHECK(ReadAll(cut).empty());
+}
+
+TEST_CASE(Mp4DemuxerRejectsOversizedTables) {
+    const std::vector<Bytes> samples = { MakeSample(20, true), MakeSample(7, false) };
+
+    // 4G samples of a constant 1000 bytes: far more than the file holds
+    const Bytes constant = MakeMp4(samples, MakeTable("stsz", 1000, { 0xffffffff }));
+    Mp4Demuxer huge(constant.data(), constant.size(), 64);
+    CHECK(!huge);
+
+    // A sample size of almost 4 GB must not size the buffers
+    Bytes sizes;
+    AppendBe(sizes, 0, 8);
+    AppendBe(sizes, 2, 4);
+    AppendBe(sizes, samples[0].size(), 4);
+    AppendBe(sizes, 0xfffffff0u, 4);
+    const Bytes oversized = MakeMp4(samples, MakeBox("stsz", sizes));
+    Mp4Demuxer demuxer(oversized.data(), oversized.size(), 64);
+    REQUIRE(demuxer);
+    CHECK(demuxer.getTrack().maxSampleSize == samples[0].size());
+    CHECK(ReadAll(demuxer).size() == 1);
+
+    // A table with more entries than its box has bytes for
+    const Bytes table = MakeMp4(samples, MakeTable("stsz", 0, { 2, (uint32_t)samples[0].size() }));
+    Mp4Demuxer overrun(table.data(), table.size(), 64);
+    CHECK(!overrun);
+
+    // A box larger than its parent
+    Bytes box = MakeMp4(samples);
+    const size_t trak = std::string(box.begin(), box.end()).find("trak") - 4;
+    box[trak] = 0x7f;
+    Mp4Demuxer bad(box.data(), box.size(), 64);
+    CHECK(!bad);
+}
+
+TEST_CASE(MkvDemuxerReadsBlocksAsAnnexB) {
+    const std::vector<Bytes> samples = { MakeSample(20, true), MakeSample(7, false), MakeSample(33, false) };
+    const Bytes file = MakeMkv(samples);
+    CHECK(ProbeContainer(file.data(), file.size()) == ContainerFormat::Matroska);
+    MkvDemuxer demuxer(file.data(), file.size(), 4);
+    REQUIRE(demuxer);
+    const std::vector<Bytes> units = ReadAll(demuxer);
+    REQUIRE(units.size() == 3);
+    for (size_t i = 0; i < units.size(); i++) {
+        CHECK_MESSAGE(units[i] == ExpectedUnit(samples[i], i == 0), "block " << i);
+    }
+}
+
+TEST_CASE(MkvDemuxerHandlesTruncatedAndOversizedElements) {
+    const std::vector<Bytes> samples = { MakeSample(20, true), MakeSample(7, false), MakeSample(33, false) };
+    const Bytes file = MakeMkv(samples);
+
+    // Every cut of the file opens or not, and reads no more than the blocks that fit
+    for (size_t size = 0; size < file.size(); size++) {
+        MkvDemuxer demuxer(file.data(), size, 4);
+        const std::vector<Bytes> units = ReadAll(demuxer);
+        CHECK_MESSAGE(units.size() <= samples.size(), size << " bytes");
+        for (size_t i = 0; i + 1 < units.size(); i++) {
+            CHECK_MESSAGE(units[i] == ExpectedUnit(samples[i], i == 0), size << " bytes, block " << i);
+        }
+    }
+
+    // A NAL unit longer than its block is skipped, the blocks after it still come
+    std::vector<Bytes> broken = samples;
+    broken[1][3] = 0x7f;
+    const Bytes brokenFile = MakeMkv(broken);
+    MkvDemuxer demuxer(brokenFile.data(), brokenFile.size(), 4);
+    REQUIRE(demuxer);
+    CHECK(ReadAll(demuxer).size() == 2);
+
+    // A segment claiming 2^56 bytes is cut at the end of the file
+    Bytes oversized = file;
+    const size_t segment = std::string(oversized.begin(), oversized.end()).find("\x18\x53\x80\x67");
+    REQUIRE(segment != std::string::npos);
+    oversized[segment + 5] = 0x7f;
+    MkvDemuxer cut(oversized.data(), oversized.size(), 4);
+    REQUIRE(cut);
+    CHECK(ReadAll(cut).size() == 3);
+}
@@ -0,0 +1,208 @@
+#include "TestHarness.hpp"
+
+#include "FrameCache.hpp"
+#include "SyntheticDecoder.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// 16x8 NV12, 192 bytes cached per frame
+const int kWidth = 16, kHeight = 8;
+const size_t kFrameBytes = kWidth * (kHeight + kHeight / 2);
+
+FramePoolConfig MakePoolConfig(int inCapacity) {
+    FramePoolConfig config;
+    config.capacity = inCapacity;
+    return config;
+}
+
+FrameCacheConfig MakeConfig(int inFrames) {
+    FrameCacheConfig config;
+    config.budget = inFrames * kFrameBytes;
+    return config;
+}
+
+// A host frame filled with inValue
+FrameHandle MakeFrame(FramePool& ioPool, int64_t inTimestamp, uint8_t inValue) {
+    FrameHandle frame = ioPool.acquire(kFrameBytes);
+    FrameInfo& info = frame.info();
+    info.width = kWidth;
+    info.height = kHeight;
+    info.pitch = kWidth;
+    info.timestamp = inTimestamp;
+    std::fill(frame.data(), frame.data() + kFrameBytes, inValue);
+    return frame;
+}
+
+// Frame numbers inFrames are cached under inStream
+bool Holds(FrameCache& ioCache, int inStream, std::initializer_list<int64_t> inFrames) {
+    for (int64_t frame : inFrames) {
+        if (!ioCache.find(inStream, frame)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// An IDR picture every 10 frames, SPS and PPS in front of the first only
+std::vector<uint8_t> MakeStream(int inFrameCount) {
+    std::vector<uint8_t> stream;
+    auto appendNal = [&](std::initializer_list<uint8_t> inNal) {
+        const uint8_t startCode[] = { 0, 0, 0, 1 };
+        stream.insert(stream.end(), startCode, startCode + sizeof(startCode));
+        stream.insert(stream.end(), inNal);
+    };
+    appendNal({ 0x67, 0x42, 0x00, 0x1e, 0x80 });
+    appendNal({ 0x68, 0xc0 });
+    for (int frame = 0; frame < inFrameCount; frame++) {
+        appendNal({ (uint8_t)(frame % 10 == 0 ? 0x65 : 0x41), 0x88, 0x84, (uint8_t)frame, 0x5a });
+    }
+    return stream;
+}
+
+}
+
+TEST_CASE(FrameCacheCopiesFramesAndCountsLookups) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakePoolConfig(2));
+    FrameCache cache(MakeConfig(8));
+    CHECK(!cache.find(0, 0));
+    std::shared_ptr<const CachedFrame> pInserted = cache.insert(0, 0, MakeFrame(pool, 7, 42));
+    REQUIRE(pInserted);
+    CHECK(pInserted->frame == 0 && pInserted->timestamp == 7);
+    CHECK(pInserted->width == kWidth && pInserted->height == kHeight && pInserted->pitch == kWidth);
+    CHECK(pInserted->data.size() == kFrameBytes && pInserted->data[kFrameBytes - 1] == 42);
+    // Nothing of the pool is held
+    CHECK(pool.getInUse() == 0);
+
+    CHECK(cache.find(0, 0) == pInserted);
+    CHECK(!cache.find(1, 0));
+    CHECK(!cache.find(0, 1));
+    CHECK(cache.getHits() == 1);
+    CHECK(cache.getMisses() == 3);
+
+    // A frame cached already is not copied again
+    CHECK(cache.insert(0, 0, MakeFrame(pool, 8, 0)) == pInserted);
+    CHECK(cache.getInsertions() == 1);
+    CHECK(cache.getBytes() == kFrameBytes);
+}
+
+TEST_CASE(FrameCacheKeepsToTheBudget) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakePoolConfig(2));
+    FrameCache cache(MakeConfig(4));
+    for (int64_t i = 0; i < 10; i++) {
+        cache.insert(0, i, MakeFrame(pool, i, (uint8_t)i));
+        CHECK(cache.getBytes() <= cache.getBudget());
+    }
+    CHECK(cache.getFrameCount() == 4);
+    CHECK(cache.getEvictions() == 6);
+    // No playhead: least recently used first
+    CHECK(Holds(cache, 0, { 6, 7, 8, 9 }));
+
+    // The newest frame stays even when it alone is over the budget
+    FrameCache tiny(MakeConfig(0));
+    tiny.insert(0, 0, MakeFrame(pool, 0, 0));
+    tiny.insert(0, 1, MakeFrame(pool, 1, 1));
+    CHECK(tiny.getFrameCount() == 1);
+    CHECK(Holds(tiny, 0, { 1 }));
+}
+
+TEST_CASE(FrameCacheEvictsFarthestFromThePlayhead) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakePoolConfig(2));
+    FrameCache cache(MakeConfig(4));
+    for (int64_t i = 0; i < 4; i++) {
+        cache.insert(0, i, MakeFrame(pool, i, 0));
+    }
+    // Frames 0..3 with the playhead at 3: frame 0 is the farthest
+    cache.setPlayhead(0, 3);
+    cache.insert(0, 4, MakeFrame(pool, 4, 0));
+    CHECK(!cache.find(0, 0));
+    CHECK(Holds(cache, 0, { 1, 2, 3, 4 }));
+
+    // The viewer stepped back: frame 4 is the farthest now, recently used or not
+    cache.setPlayhead(0, 0);
+    cache.find(0, 4);
+    cache.insert(0, 0, MakeFrame(pool, 0, 0));
+    CHECK(!cache.find(0, 4));
+    CHECK(Holds(cache, 0, { 0, 1, 2, 3 }));
+
+    // Frames of a stream without a playhead go before any of a stream with one
+    cache.insert(1, 0, MakeFrame(pool, 0, 0));
+    cache.insert(0, 4, MakeFrame(pool, 4, 0));
+    CHECK(!cache.find(1, 0));
+    CHECK(cache.getFrameCount() == 4);
+
+    cache.erase(0);
+    CHECK(cache.getFrameCount() == 0);
+    CHECK(cache.getBytes() == 0);
+}
+
+TEST_CASE(FrameCacheReusesEvictedBuffers) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakePoolConfig(2));
+    FrameCache cache(MakeConfig(1));
+    const uint8_t* pBuffer = cache.insert(0, 0, MakeFrame(pool, 0, 1))->data.data();
+    // Frame 0 is evicted with nobody holding it, frame 2 gets its buffer
+    cache.insert(0, 1, MakeFrame(pool, 1, 2));
+    std::shared_ptr<const CachedFrame> pReused = cache.insert(0, 2, MakeFrame(pool, 2, 3));
+    CHECK(pReused->data.data() == pBuffer);
+    CHECK(pReused->frame == 2 && pReused->data[0] == 3);
+
+    // A frame a caller holds is not touched after its eviction
+    std::shared_ptr<const CachedFrame> pHeld = cache.find(0, 2);
+    for (int64_t i = 3; i < 8; i++) {
+        cache.insert(0, i, MakeFrame(pool, i, (uint8_t)(i + 1)));
+    }
+    CHECK(!cache.find(0, 2));
+    CHECK(pHeld->frame == 2);
+    CHECK(pHeld->data[0] == 3 && pHeld->data[kFrameBytes - 1] == 3);
+}
+
+TEST_CASE(FrameScrubberStepsBackFromTheCache) {
+    const std::vector<uint8_t> stream = MakeStream(40);
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    REQUIRE(index.getFrameCount() == 40);
+    AnnexBPacketizer packetizer(stream.data(), stream.size());
+    SyntheticDecoder decoder(kWidth, kHeight, 1000);
+    FrameCache cache(MakeConfig(64));
+    FrameScrubber scrubber(index, stream.data(), packetizer, decoder, cache);
+
+    // Seeks to keyframe 20 and decodes up to frame 25
+    std::shared_ptr<const CachedFrame> pFrame = scrubber.get(25);
+    REQUIRE(pFrame);
+    CHECK(pFrame->frame == 25 && pFrame->timestamp == 25);
+    // The ramp moves by one per frame
+    CHECK(pFrame->data[1] == (uint8_t)(1 + 25));
+    CHECK(scrubber.getSeeks() == 1);
+    CHECK(scrubber.getDecodedFrames() == 6);
+
+    // Stepping back through the GOP decodes nothing
+    for (int64_t frame = 24; frame >= 20; frame--) {
+        pFrame = scrubber.get(frame);
+        REQUIRE(pFrame);
+        CHECK(pFrame->frame == frame && pFrame->data[1] == (uint8_t)(1 + frame));
+    }
+    CHECK(scrubber.getDecodedFrames() == 6);
+    CHECK(cache.getHits() == 5);
+
+    // Stepping forward goes on from the decoder output
+    pFrame = scrubber.get(27);
+    REQUIRE(pFrame);
+    CHECK(pFrame->frame == 27);
+    CHECK(scrubber.getSeeks() == 1);
+    CHECK(scrubber.getDecodedFrames() == 8);
+
+    // Stepping back over the keyframe seeks to the previous GOP
+    pFrame = scrubber.get(19);
+    REQUIRE(pFrame);
+    CHECK(pFrame->frame == 19 && pFrame->data[1] == (uint8_t)(1 + 19));
+    CHECK(scrubber.getSeeks() == 2);
+    CHECK(scrubber.getDecodedFrames() == 18);
+
+    CHECK(!scrubber.get(40));
+    CHECK(!scrubber.get(-1));
+}
@@ -0,0 +1,211 @@
+#include "TestHarness.hpp"
+
+#include "FramePool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Host memory that counts what the pool does with it
+class CountingAllocator : public HostFrameAllocator {
+public:
+    explicit CountingAllocator(int& ioAllocations, int& ioFrees) : mAllocations(ioAllocations), mFrees(ioFrees) {}
+
+    uint8_t* allocate(size_t inSize) override {
+        mAllocations++;
+        return HostFrameAllocator::allocate(inSize);
+    }
+
+    void free(uint8_t* inData) override {
+        mFrees++;
+        HostFrameAllocator::free(inData);
+    }
+
+private:
+    int& mAllocations;
+    int& mFrees;
+};
+
+FramePoolConfig MakeConfig(int inCapacity, FramePoolPolicy inPolicy) {
+    FramePoolConfig config;
+    config.capacity = inCapacity;
+    config.policy = inPolicy;
+    return config;
+}
+
+// Until a thread blocked in acquire() counted its wait, or 5 s went by
+bool WaitForWaits(const FramePool& inPool, uint64_t inWaits) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (inPool.getWaits() < inWaits) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+}
+
+TEST_CASE(FramePoolReturnsSlotWithLastHandle) {
+    int allocations = 0, frees = 0;
+    {
+        FramePool pool(std::unique_ptr<FrameAllocator>(new CountingAllocator(allocations, frees)),
+            MakeConfig(1, FramePoolPolicy::Drop));
+        FrameHandle first = pool.acquire(1024);
+        REQUIRE(first);
+        uint8_t* pData = first.data();
+        FrameHandle copy = first;
+        first.reset();
+        CHECK(pool.getInUse() == 1);
+        CHECK(!pool.acquire(1024));
+
+        copy.reset();
+        CHECK(pool.getInUse() == 0);
+        FrameHandle again = pool.acquire(1024);
+        REQUIRE(again);
+        CHECK(again.data() == pData);
+        CHECK(allocations == 1);
+
+        // Moved from handles do not release
+        FrameHandle moved = std::move(again);
+        CHECK(!again);
+        CHECK(pool.getInUse() == 1);
+        moved = FrameHandle();
+        CHECK(pool.getInUse() == 0);
+        CHECK(pool.getAcquired() == 2);
+    }
+    CHECK(frees == allocations);
+}
+
+TEST_CASE(FramePoolDropPolicyFailsAtCapacity) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakeConfig(2, FramePoolPolicy::Drop));
+    FrameHandle a = pool.acquire(64);
+    FrameHandle b = pool.acquire(64);
+    REQUIRE(a && b);
+    CHECK(a.data() != b.data());
+    CHECK(!pool.acquire(64));
+    CHECK(pool.getDropped() == 1);
+    CHECK(pool.getWaits() == 0);
+    CHECK(pool.getPeakInUse() == 2);
+    b.reset();
+    CHECK(pool.acquire(64));
+}
+
+TEST_CASE(FramePoolBlockPolicyWaitsForRelease) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakeConfig(1, FramePoolPolicy::Block));
+    FrameHandle held = pool.acquire(64);
+    REQUIRE(held);
+
+    // Not when the caller may not block
+    CHECK(!pool.acquire(64, false));
+    CHECK(pool.getDropped() == 1);
+
+    std::atomic<bool> acquired{ false };
+    uint8_t* pAcquired = nullptr;
+    std::thread waiter([&] {
+        FrameHandle frame = pool.acquire(64);
+        pAcquired = frame.data();
+        acquired = true;
+    });
+    const bool blocked = WaitForWaits(pool, 1);
+    CHECK(blocked);
+    CHECK(!acquired);
+    uint8_t* pHeld = held.data();
+    held.reset();
+    waiter.join();
+    CHECK(acquired);
+    CHECK(pAcquired == pHeld);
+    CHECK(pool.getDropped() == 1);
+}
+
+TEST_CASE(FramePoolCloseWakesBlockedAcquire) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakeConfig(1, FramePoolPolicy::Block));
+    FrameHandle held = pool.acquire(64);
+    REQUIRE(held);
+
+    std::atomic<int> result{ -1 };
+    std::thread waiter([&] {
+        result = pool.acquire(64) ? 1 : 0;
+    });
+    CHECK(WaitForWaits(pool, 1));
+    pool.close();
+    waiter.join();
+    CHECK(result == 0);
+
+    // Closed for good, frames still out come back normally
+    held.reset();
+    CHECK(!pool.acquire(64));
+    CHECK(pool.getInUse() == 0);
+}
+
+TEST_CASE(FramePoolGrowsSlotForLargerFrames) {
+    int allocations = 0, frees = 0;
+    {
+        FramePool pool(std::unique_ptr<FrameAllocator>(new CountingAllocator(allocations, frees)),
+            MakeConfig(1, FramePoolPolicy::Block));
+        FrameHandle frame = pool.acquire(1000);
+        REQUIRE(frame);
+        CHECK(frame.capacity() >= 1000);
+        frame.info().width = 32;
+        frame.reset();
+
+        // Smaller frames reuse the buffer, and get a fresh FrameInfo
+        frame = pool.acquire(500);
+        REQUIRE(frame);
+        CHECK(frame.capacity() >= 1000);
+        CHECK(frame.info().width == 0);
+        CHECK(allocations == 1);
+        frame.reset();
+
+        // A format change to a larger frame replaces it
+        frame = pool.acquire(4000);
+        REQUIRE(frame);
+        CHECK(frame.capacity() >= 4000);
+        CHECK(allocations == 2);
+        CHECK(frees == 1);
+        memset(frame.data(), 0x5a, 4000);
+        frame.reset();
+    }
+    CHECK(frees == 2);
+}
+
+TEST_CASE(FramePoolExternalReleaseRunsOnceAfterLastHandle) {
+    FramePool pool(std::unique_ptr<FrameAllocator>(new HostFrameAllocator), MakeConfig(1, FramePoolPolicy::Drop));
+    std::vector<uint8_t> surface(256);
+    int releases = 0;
+    int inUseAtRelease = -1;
+
+    FrameHandle frame = pool.acquire(64);
+    REQUIRE(frame);
+    uint8_t* pOwn = frame.data();
+    frame.setExternal(surface.data(), [&] {
+        releases++;
+        inUseAtRelease = pool.getInUse();
+    });
+    CHECK(frame.data() == surface.data());
+    CHECK(frame.capacity() == 0);
+
+    FrameHandle copy = frame;
+    std::thread other([held = std::move(copy)]() mutable { held.reset(); });
+    other.join();
+    CHECK(releases == 0);
+    frame.reset();
+    CHECK(releases == 1);
+    // Before the slot was back in the pool for anyone to take
+    CHECK(inUseAtRelease == 1);
+
+    // The next user of the slot gets the pool's own memory and no callback
+    frame = pool.acquire(64);
+    REQUIRE(frame);
+    CHECK(frame.data() == pOwn);
+    frame.reset();
+    CHECK(releases == 1);
+}
@@ -0,0 +1,249 @@
+#include "TestHarness.hpp"
+
+#include "GopParallelDecoder.hpp"
+#include "SyntheticDecoder.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const int kFrameCount = 100;
+const int kWidth = 16, kHeight = 8, kWork = 1000;
+
+// Two leading non-IDR pictures, then an IDR picture every 10 frames from frame 2 on. The only
+// SPS and PPS are in frame 0, every later segment has to be primed with them. A slice header
+// of 88 84: first_mb_in_slice 0, slice_type 7, pic_parameter_set_id 0.
+Bytes MakeStream() {
+    Bytes stream;
+    auto appendNal = [&](std::initializer_list<uint8_t> inNal) {
+        const uint8_t startCode[] = { 0, 0, 0, 1 };
+        stream.insert(stream.end(), startCode, startCode + sizeof(startCode));
+        stream.insert(stream.end(), inNal);
+    };
+    appendNal({ 0x67, 0x42, 0x00, 0x1e, 0x80 });
+    appendNal({ 0x68, 0xc0 });
+    for (int frame = 0; frame < kFrameCount; frame++) {
+        const bool idr = frame >= 2 && (frame - 2) % 10 == 0;
+        appendNal({ (uint8_t)(idr ? 0x65 : 0x41), 0x88, 0x84, (uint8_t)frame, 0x5a, 0x5a });
+    }
+    return stream;
+}
+
+// The frames of one SyntheticDecoder fed inStream one access unit at a time
+std::vector<Bytes> DecodeSequentially(const Bytes& inStream) {
+    SyntheticDecoder decoder(kWidth, kHeight, kWork);
+    AnnexBPacketizer packetizer(inStream.data(), inStream.size());
+    std::vector<Bytes> frames;
+    AccessUnit unit;
+    auto take = [&](int inCount) {
+        while (inCount--) {
+            FrameHandle frame = decoder.getFrame();
+            frames.emplace_back(frame.data(), frame.data() + decoder.GetFrameSize());
+        }
+    };
+    while (packetizer.next(unit)) {
+        take(decoder.decode(unit.data, unit.size, unit.frameIndex, true));
+    }
+    take(decoder.decode(nullptr, 0));
+    return frames;
+}
+
+GopParallelDecoder::DecoderFactory MakeFactory(int inPoolCapacity = 0) {
+    return [inPoolCapacity](int) {
+        FramePoolConfig poolConfig;
+        poolConfig.capacity = inPoolCapacity;
+        return std::unique_ptr<Decoder>(new SyntheticDecoder(kWidth, kHeight, kWork, poolConfig));
+    };
+}
+
+// Notes the highest frame number any instance was given
+class WatchedDecoder : public SyntheticDecoder {
+public:
+    WatchedDecoder(std::atomic<int64_t>& ioHighest, const FramePoolConfig& inPoolConfig)
+        : SyntheticDecoder(kWidth, kHeight, kWork, inPoolConfig), mHighest(ioHighest) {}
+
+    int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp, bool inAccessUnit) override {
+        if (inData) {
+            int64_t highest = mHighest;
+            while (inTimestamp > highest && !mHighest.compare_exchange_weak(highest, inTimestamp)) {
+            }
+        }
+        return SyntheticDecoder::decode(inData, inLength, inTimestamp, inAccessUnit);
+    }
+
+private:
+    std::atomic<int64_t>& mHighest;
+};
+
+// Fails on one frame
+class FailingDecoder : public SyntheticDecoder {
+public:
+    explicit FailingDecoder(int64_t inFailingFrame) : SyntheticDecoder(kWidth, kHeight, kWork), mFailingFrame(inFailingFrame) {}
+
+    int decode(const uint8_t* inData, size_t inLength, int64_t inTimestamp, bool inAccessUnit) override {
+        if (inData && inTimestamp == mFailingFrame) {
+            throw std::runtime_error("broken access unit");
+        }
+        return SyntheticDecoder::decode(inData, inLength, inTimestamp, inAccessUnit);
+    }
+
+private:
+    int64_t mFailingFrame;
+};
+
+}
+
+TEST_CASE(GopParallelDecoderSegmentsAtKeyframes) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    REQUIRE(index.getFrameCount() == kFrameCount);
+
+    // Keyframes 2, 12, ... 92: segments of at least 20 frames start at 22, 42, 62 and 82, the
+    // leading frames go with the first
+    GopParallelConfig config;
+    config.decoderCount = 3;
+    config.minSegmentFrames = 20;
+    GopParallelDecoder decoder(index, stream.data(), stream.size(), MakeFactory(), config);
+    CHECK(decoder.getSegmentCount() == 5);
+    CHECK(decoder.getDecoderCount() == 3);
+    for (FrameHandle frame = decoder.getFrame(); frame; frame = decoder.getFrame()) {
+    }
+
+    // Every keyframe starts a segment, frames 0 and 1 are one of their own
+    config.minSegmentFrames = 1;
+    GopParallelDecoder fine(index, stream.data(), stream.size(), MakeFactory(), config);
+    CHECK(fine.getSegmentCount() == 11);
+    config.minSegmentFrames = 1000;
+    GopParallelDecoder whole(index, stream.data(), stream.size(), MakeFactory(), config);
+    CHECK(whole.getSegmentCount() == 1);
+    for (GopParallelDecoder* pDecoder : { &fine, &whole }) {
+        for (FrameHandle frame = pDecoder->getFrame(); frame; frame = pDecoder->getFrame()) {
+        }
+    }
+}
+
+TEST_CASE(GopParallelDecoderMatchesSequentialDecode) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    const std::vector<Bytes> expected = DecodeSequentially(stream);
+    REQUIRE(expected.size() == kFrameCount);
+
+    for (int decoders : { 1, 2, 4 }) {
+        GopParallelConfig config;
+        config.decoderCount = decoders;
+        config.minSegmentFrames = 10;
+        GopParallelDecoder decoder(index, stream.data(), stream.size(), MakeFactory(), config);
+        int64_t count = 0;
+        for (FrameHandle frame = decoder.getFrame(); frame; frame = decoder.getFrame()) {
+            REQUIRE(count < kFrameCount);
+            CHECK_MESSAGE(frame.info().timestamp == count, decoders << " decoders, frame " << count << ": " << frame.info().timestamp);
+            CHECK_MESSAGE(Bytes(frame.data(), frame.data() + expected[count].size()) == expected[count],
+                decoders << " decoders, frame " << count);
+            count++;
+        }
+        CHECK_MESSAGE(count == kFrameCount, decoders << " decoders: " << count << " frames");
+        // Past the end it stays empty
+        CHECK(!decoder.getFrame());
+    }
+}
+
+TEST_CASE(GopParallelDecoderBoundsTheReorderBuffer) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+
+    // 10 segments of 10 frames (the first one 12), at most 2 decoding ahead of the output, 3
+    // frames per decoder
+    std::atomic<int64_t> highest{ -1 };
+    std::vector<Decoder*> decoders;
+    GopParallelConfig config;
+    config.decoderCount = 4;
+    config.minSegmentFrames = 10;
+    config.maxSegmentsAhead = 2;
+    GopParallelDecoder decoder(index, stream.data(), stream.size(), [&](int) {
+        FramePoolConfig poolConfig;
+        poolConfig.capacity = 3;
+        decoders.push_back(new WatchedDecoder(highest, poolConfig));
+        return std::unique_ptr<Decoder>(decoders.back());
+    }, config);
+    REQUIRE(decoder.getSegmentCount() == 10);
+
+    // Nothing is output yet: segments 0 and 1 may start, each up to its decoder's pool
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK_MESSAGE(highest < 22, "frame " << highest.load() << " decoded with nothing output");
+    int inUse = 0;
+    for (Decoder* pDecoder : decoders) {
+        inUse += pDecoder->GetFramePool().getInUse();
+    }
+    CHECK_MESSAGE(inUse <= 6, inUse << " frames held");
+
+    int64_t count = 0;
+    for (FrameHandle frame = decoder.getFrame(); frame; frame = decoder.getFrame()) {
+        CHECK(frame.info().timestamp == count);
+        count++;
+    }
+    CHECK(count == kFrameCount);
+}
+
+TEST_CASE(GopParallelDecoderStops) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    GopParallelConfig config;
+    config.decoderCount = 2;
+    config.minSegmentFrames = 10;
+    GopParallelDecoder decoder(index, stream.data(), stream.size(), MakeFactory(2), config);
+    FrameHandle first = decoder.getFrame();
+    REQUIRE(first);
+    CHECK(first.info().timestamp == 0);
+    decoder.stop();
+    // The decoders blocked in their pools are woken up, and nothing more comes out
+    CHECK(!decoder.getFrame());
+    CHECK(!decoder.getFrame());
+    first.reset();
+}
+
+TEST_CASE(GopParallelDecoderRethrowsDecoderErrors) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    GopParallelConfig config;
+    config.decoderCount = 3;
+    config.minSegmentFrames = 10;
+    GopParallelDecoder decoder(index, stream.data(), stream.size(), [](int) {
+        return std::unique_ptr<Decoder>(new FailingDecoder(55));
+    }, config);
+
+    // The frames before the error come out in order as long as it has not happened yet
+    int64_t count = 0;
+    bool thrown = false;
+    try {
+        for (FrameHandle frame = decoder.getFrame(); frame; frame = decoder.getFrame()) {
+            CHECK(frame.info().timestamp == count);
+            count++;
+        }
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK_MESSAGE(count <= 55, count << " frames");
+    // It stays failed
+    thrown = false;
+    try {
+        decoder.getFrame();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
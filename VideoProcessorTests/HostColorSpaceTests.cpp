@@ -0,0 +1,210 @@
+#include "TestHarness.hpp"
+
+#include "HostColorSpace.hpp"
+#include "HostColorSpaceKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int kMatrices[] = {
+    ColorSpaceStandard_BT709, ColorSpaceStandard_Unspecified, ColorSpaceStandard_Reserved, ColorSpaceStandard_FCC,
+    ColorSpaceStandard_BT470, ColorSpaceStandard_BT601, ColorSpaceStandard_SMPTE240M, ColorSpaceStandard_YCgCo,
+    ColorSpaceStandard_BT2020, ColorSpaceStandard_BT2020C,
+};
+
+// Bytes of the destination the kernels must leave alone: pitch padding, and the last column or
+// row of odd sizes, which the 2x2 blocks do not cover
+const uint8_t kUntouched = 0xa5;
+
+// Deterministic NV12 noise covering the whole 8 bit range, beyond the video range on purpose
+std::vector<uint8_t> MakeNoiseFrame(int inPitch, int inHeight, uint32_t inSeed) {
+    std::vector<uint8_t> frame((size_t)inPitch * (inHeight + (inHeight + 1) / 2));
+    uint32_t state = inSeed * 2654435761u + 1;
+    for (uint8_t& sample : frame) {
+        state = state * 1664525u + 1013904223u;
+        sample = (uint8_t)(state >> 24);
+    }
+    return frame;
+}
+
+// Every kernel the CPU runs against the float reference, on sizes that leave the vector kernels
+// a remainder of every length and an unpaired last column and row
+template <class COLOR32>
+void CheckKernelsAgainstScalar(const char* inFormat) {
+    const int widths[] = { 1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 33, 63, 64, 65, 127, 129, 130, 257 };
+    const int heights[] = { 1, 2, 3, 5, 17 };
+    const Nv12RowsKernel<COLOR32> reference = Nv12ToColor32Rows_Scalar<COLOR32>;
+    for (int level = (int)SimdLevel::SSE41; level <= (int)SimdLevel::AVX512; level++) {
+        if (level > (int)GetSimdLevel()) {
+            std::cout << "    " << GetSimdLevelName((SimdLevel)level) << " not supported by this CPU, skipped" << std::endl;
+            continue;
+        }
+        const Nv12RowsKernel<COLOR32> kernel = GetNv12RowsKernel<COLOR32>((SimdLevel)level);
+        for (int matrix : kMatrices) {
+            const YuvToRgbCoefficients& c = GetYuvToRgbCoefficients(matrix);
+            for (int width : widths) {
+                for (int height : heights) {
+                    // Odd pitches, so no row starts aligned
+                    const int pitch = width + 3;
+                    const int dstPitch = width * 4 + 12;
+                    const std::vector<uint8_t> nv12 = MakeNoiseFrame(pitch, height, (uint32_t)(width * 31 + height));
+                    std::vector<uint8_t> expected((size_t)dstPitch * height, kUntouched);
+                    std::vector<uint8_t> actual(expected.size(), kUntouched);
+                    reference(nv12.data(), pitch, expected.data(), dstPitch, width, height, 0, height / 2, c);
+                    kernel(nv12.data(), pitch, actual.data(), dstPitch, width, height, 0, height / 2, c);
+
+                    int maxError = 0;
+                    size_t worst = 0;
+                    for (size_t i = 0; i < actual.size(); i++) {
+                        const int error = std::abs(actual[i] - expected[i]);
+                        if (error > maxError) {
+                            maxError = error;
+                            worst = i;
+                        }
+                    }
+                    CHECK_MESSAGE(maxError <= 1, inFormat << " " << GetSimdLevelName((SimdLevel)level) << " matrix "
+                        << matrix << " " << width << "x" << height << ": off by " << maxError << " at row "
+                        << worst / dstPitch << " byte " << worst % dstPitch);
+                }
+            }
+        }
+    }
+}
+
+// The fixed point remainder path of the vector kernels on its own, over whole rows
+template <class COLOR32>
+void Nv12ToColor32Rows_Fixed(const uint8_t* pNv12, int nNv12Pitch, uint8_t* pDst, int nDstPitch, int nWidth, int nHeight,
+    int nPairBegin, int nPairEnd, const YuvToRgbCoefficients& c) {
+    for (int pair = nPairBegin; pair < nPairEnd; pair++) {
+        const uint8_t* pY0 = pNv12 + 2 * pair * nNv12Pitch;
+        Nv12ToColor32RowPairFixed<COLOR32>(pY0, pY0 + nNv12Pitch, pNv12 + (nHeight + pair) * nNv12Pitch,
+            pDst + 2 * pair * nDstPitch, pDst + (2 * pair + 1) * nDstPitch, 0, nWidth & ~1, c);
+    }
+}
+
+// Every Y, U and V value through the fixed point kernels, against YuvToRgbMatrix<iMatrix>
+// evaluated in double. One 512x128 frame per V: block x has U = x, the 4 samples of the blocks
+// in row pair p have Y = 4p .. 4p + 3. Truncating either way, coefficients within the 0.05 LSB
+// the static_asserts in HostColorSpace.cpp allow can only be 1 off. The kernels must also
+// match the fixed point formula on the matrix's fixed coefficients exactly, which 1 LSB of
+// slack would hide overflows, saturation and coefficients that are off by a few units in.
+template <int iMatrix>
+void CheckFixedPointAccuracy() {
+    typedef YuvToRgbMatrix<iMatrix> M;
+    const int width = 512, height = 128, pitch = width;
+    const YuvToRgbCoefficients& c = GetYuvToRgbCoefficients(iMatrix);
+
+    std::vector<std::pair<std::string, Nv12RowsKernel<BGRA32>>> kernels;
+    kernels.emplace_back("fixed", Nv12ToColor32Rows_Fixed<BGRA32>);
+    for (int level = (int)SimdLevel::SSE41; level <= (int)GetSimdLevel(); level++) {
+        kernels.emplace_back(GetSimdLevelName((SimdLevel)level), GetNv12RowsKernel<BGRA32>((SimdLevel)level));
+    }
+    std::vector<int> maxErrors(kernels.size(), 0);
+    std::vector<uint64_t> notExact(kernels.size(), 0);
+
+    // The terms of the matrix product per input value
+    double yTerm[256], rvTerm[256], guTerm[256], gvTerm[256], buTerm[256];
+    for (int i = 0; i < 256; i++) {
+        yTerm[i] = (double)M::y * (i - 16);
+        rvTerm[i] = (double)M::rv * (i - 128);
+        guTerm[i] = (double)M::gu * (i - 128);
+        gvTerm[i] = (double)M::gv * (i - 128);
+        buTerm[i] = (double)M::bu * (i - 128);
+    }
+    auto toByte = [](double inValue) { return (uint8_t)std::min(255.0, std::max(0.0, std::floor(inValue))); };
+    auto fixedToByte = [](int inValue) { return (uint8_t)std::min(255, std::max(0, inValue >> kYuvToRgbShift)); };
+
+    std::vector<uint8_t> nv12((size_t)pitch * (height + height / 2));
+    std::vector<uint8_t> expected((size_t)width * height * 4), exact(expected.size()), actual(expected.size());
+    for (int v = 0; v < 256; v++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                nv12[y * pitch + x] = (uint8_t)(4 * (y / 2) + 2 * (y & 1) + (x & 1));
+            }
+        }
+        for (int x = 0; x < width; x += 2) {
+            for (int pair = 0; pair < height / 2; pair++) {
+                nv12[(height + pair) * pitch + x] = (uint8_t)(x / 2);
+                nv12[(height + pair) * pitch + x + 1] = (uint8_t)v;
+            }
+        }
+        for (int y = 0; y < height; y++) {
+            const uint8_t* pUV = nv12.data() + (height + y / 2) * pitch;
+            for (int x = 0; x < width; x++) {
+                const double luma = yTerm[nv12[y * pitch + x]];
+                const int u = pUV[x & ~1], v = pUV[x | 1];
+                BGRA32 rgb{};
+                rgb.c.r = toByte(luma + rvTerm[v]);
+                rgb.c.g = toByte(luma + guTerm[u] + gvTerm[v]);
+                rgb.c.b = toByte(luma + buTerm[u]);
+                memcpy(&expected[((size_t)y * width + x) * 4], &rgb.d, 4);
+
+                const int lumaFixed = M::yFixed * (nv12[y * pitch + x] - 16);
+                rgb.c.r = fixedToByte(lumaFixed + M::rvFixed * (v - 128));
+                rgb.c.g = fixedToByte(lumaFixed + M::guFixed * (u - 128) + M::gvFixed * (v - 128));
+                rgb.c.b = fixedToByte(lumaFixed + M::buFixed * (u - 128));
+                memcpy(&exact[((size_t)y * width + x) * 4], &rgb.d, 4);
+            }
+        }
+        for (size_t k = 0; k < kernels.size(); k++) {
+            kernels[k].second(nv12.data(), pitch, actual.data(), width * 4, width, height, 0, height / 2, c);
+            int maxError = 0;
+            for (size_t i = 0; i < actual.size(); i++) {
+                maxError = std::max(maxError, std::abs(actual[i] - expected[i]));
+            }
+            maxErrors[k] = std::max(maxErrors[k], maxError);
+            for (size_t i = 0; i < actual.size(); i++) {
+                notExact[k] += actual[i] != exact[i];
+            }
+        }
+    }
+
+    for (size_t k = 0; k < kernels.size(); k++) {
+        CHECK_MESSAGE(maxErrors[k] <= 1, "matrix " << iMatrix << " " << kernels[k].first << " off by " << maxErrors[k]);
+        CHECK_MESSAGE(notExact[k] == 0, "matrix " << iMatrix << " " << kernels[k].first << ": " << notExact[k]
+            << " samples differ from the fixed point formula");
+    }
+}
+
+}
+
+TEST_CASE(Nv12ToBgra32KernelsMatchScalar) {
+    CheckKernelsAgainstScalar<BGRA32>("BGRA32");
+}
+
+TEST_CASE(Nv12ToRgba32KernelsMatchScalar) {
+    CheckKernelsAgainstScalar<RGBA32>("RGBA32");
+}
+
+// The other standards share a matrix with one of these, see GetCanonicalColorSpace()
+template <int iMatrix, int iCanonical>
+void CheckSameMatrix() {
+    typedef YuvToRgbMatrix<iMatrix> M;
+    typedef YuvToRgbMatrix<iCanonical> C;
+    CHECK_MESSAGE(M::y == C::y && M::rv == C::rv && M::gu == C::gu && M::gv == C::gv && M::bu == C::bu,
+        "matrix " << iMatrix << " differs from " << iCanonical);
+    CHECK_MESSAGE(memcmp(&GetYuvToRgbCoefficients(iMatrix), &GetYuvToRgbCoefficients(iCanonical), sizeof(YuvToRgbCoefficients)) == 0,
+        "coefficients of matrix " << iMatrix << " differ from " << iCanonical);
+}
+
+TEST_CASE(FixedPointMatchesFloatMatrix) {
+    CheckFixedPointAccuracy<ColorSpaceStandard_BT709>();
+    CheckFixedPointAccuracy<ColorSpaceStandard_FCC>();
+    CheckFixedPointAccuracy<ColorSpaceStandard_BT601>();
+    CheckFixedPointAccuracy<ColorSpaceStandard_SMPTE240M>();
+    CheckFixedPointAccuracy<ColorSpaceStandard_BT2020>();
+    CheckSameMatrix<ColorSpaceStandard_Unspecified, ColorSpaceStandard_BT709>();
+    CheckSameMatrix<ColorSpaceStandard_Reserved, ColorSpaceStandard_BT709>();
+    CheckSameMatrix<ColorSpaceStandard_BT470, ColorSpaceStandard_BT601>();
+    CheckSameMatrix<ColorSpaceStandard_YCgCo, ColorSpaceStandard_BT709>();
+    CheckSameMatrix<ColorSpaceStandard_BT2020C, ColorSpaceStandard_BT2020>();
+}
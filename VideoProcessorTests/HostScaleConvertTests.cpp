@@ -0,0 +1,30 @@
+#include "TestHarness.hpp"
+
+#include "HostScaleConvert.hpp"
+
+#include <cstdint>
+#include <vector>
+
+TEST_CASE(P016ToNv12HostTakesHighBytes) {
+    // Odd size: the UV rows hold an even number of samples, the pitches are padded
+    const int width = 5, height = 3, p016Pitch = 16, nv12Pitch = 7;
+    const int rows = height + (height + 1) / 2;
+    std::vector<uint8_t> p016((size_t)p016Pitch * rows);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < p016Pitch / 2; x++) {
+            // 10 bit value v, MSB aligned
+            const int value = (y * 97 + x * 31) & 0x3ff;
+            const uint16_t sample = (uint16_t)(value << 6);
+            p016[(size_t)y * p016Pitch + 2 * x] = (uint8_t)sample;
+            p016[(size_t)y * p016Pitch + 2 * x + 1] = (uint8_t)(sample >> 8);
+        }
+    }
+    std::vector<uint8_t> nv12((size_t)nv12Pitch * rows, 0xa5);
+    P016ToNv12Host(p016.data(), p016Pitch, nv12.data(), nv12Pitch, width, height);
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < nv12Pitch; x++) {
+            const int expected = x < 6 ? ((y * 97 + x * 31) & 0x3ff) >> 2 : 0xa5;
+            CHECK_MESSAGE(nv12[(size_t)y * nv12Pitch + x] == expected, "row " << y << " byte " << x);
+        }
+    }
+}
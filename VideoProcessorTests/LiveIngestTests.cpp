@@ -0,0 +1,291 @@
+#include "TestHarness.hpp"
+
+#include "LiveIngest.hpp"
+#include "UdpSocket.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// The ingest runs for real on a loopback socket: the datagrams are sent before the first next(),
+// in the order given, and the stream ends on the idle timeout.
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint32_t kSsrc = 0x12345678;
+
+// One port per test
+const int kBasePort = 47120;
+
+struct ReceivedUnit {
+    Bytes data;
+    int64_t pts;
+    bool idr, sps, pps, picture;
+};
+
+Bytes Concat(std::initializer_list<Bytes> inParts) {
+    Bytes bytes;
+    for (const Bytes& part : inParts) {
+        bytes.insert(bytes.end(), part.begin(), part.end());
+    }
+    return bytes;
+}
+
+Bytes RtpPacket(uint16_t inSequence, uint32_t inTimestamp, bool inMarker, const Bytes& inPayload, uint32_t inSsrc = kSsrc) {
+    Bytes packet = {
+        0x80, (uint8_t)((inMarker ? 0x80 : 0) | 96), (uint8_t)(inSequence >> 8), (uint8_t)inSequence,
+        (uint8_t)(inTimestamp >> 24), (uint8_t)(inTimestamp >> 16), (uint8_t)(inTimestamp >> 8), (uint8_t)inTimestamp,
+        (uint8_t)(inSsrc >> 24), (uint8_t)(inSsrc >> 16), (uint8_t)(inSsrc >> 8), (uint8_t)inSsrc,
+    };
+    packet.insert(packet.end(), inPayload.begin(), inPayload.end());
+    return packet;
+}
+
+// A non-IDR slice NAL unit, inTag tells them apart
+Bytes Slice(uint8_t inTag) {
+    return { 0x41, 0x9a, inTag, 0x55 };
+}
+
+// What a NAL unit becomes in the Annex-B output
+Bytes AnnexB(const Bytes& inNal) {
+    return Concat({ { 0, 0, 0, 1 }, inNal });
+}
+
+LiveIngestConfig MakeConfig(LiveProtocol inProtocol, int inPort, int inJitterMs) {
+    LiveIngestConfig config;
+    config.protocol = inProtocol;
+    config.port = inPort;
+    config.packetSlots = 256;
+    config.slotSize = 1500;
+    config.jitterMs = inJitterMs;
+    config.idleTimeoutMs = 200;
+    return config;
+}
+
+bool Send(int inPort, std::vector<Bytes>& ioDatagrams) {
+    UdpSocket socket;
+    if (!socket.connect("127.0.0.1", inPort)) {
+        return false;
+    }
+    for (Bytes& bytes : ioDatagrams) {
+        Datagram datagram;
+        datagram.data = bytes.data();
+        datagram.size = bytes.size();
+        datagram.capacity = bytes.size();
+        if (socket.send(&datagram, 1) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Starts inIngest, sends inDatagrams to it and takes every unit up to the idle timeout
+std::vector<ReceivedUnit> Run(LiveIngest& ioIngest, int inPort, std::vector<Bytes> inDatagrams) {
+    std::vector<ReceivedUnit> units;
+    if (!ioIngest.start() || !Send(inPort, inDatagrams)) {
+        ioIngest.stop();
+        return units;
+    }
+    AccessUnit unit;
+    while (ioIngest.next(unit)) {
+        units.push_back({ Bytes(unit.data, unit.data + unit.size), unit.pts, unit.idr, unit.sps, unit.pps, unit.picture });
+    }
+    return units;
+}
+
+// 188 byte packet, inPayload stuffed to fill it through the adaptation field
+Bytes TsPacket(int inPid, bool inUnitStart, int inContinuity, const Bytes& inPayload) {
+    Bytes packet = { 0x47, (uint8_t)((inUnitStart ? 0x40 : 0) | (inPid >> 8)), (uint8_t)inPid, 0 };
+    const size_t stuffing = 184 - inPayload.size();
+    if (stuffing) {
+        packet[3] = (uint8_t)(0x30 | inContinuity);
+        packet.push_back((uint8_t)(stuffing - 1));
+        if (stuffing > 1) {
+            packet.push_back(0);
+            packet.insert(packet.end(), stuffing - 2, 0xff);
+        }
+    } else {
+        packet[3] = (uint8_t)(0x10 | inContinuity);
+    }
+    packet.insert(packet.end(), inPayload.begin(), inPayload.end());
+    return packet;
+}
+
+// PES header with a PTS, for a video stream of unbounded length
+Bytes PesHeader(int64_t inPts) {
+    return { 0, 0, 1, 0xe0, 0, 0, 0x80, 0x80, 5, (uint8_t)(0x21 | ((inPts >> 29) & 0x0e)), (uint8_t)(inPts >> 22),
+        (uint8_t)(((inPts >> 14) & 0xfe) | 1), (uint8_t)(inPts >> 7), (uint8_t)(((inPts << 1) & 0xfe) | 1) };
+}
+
+}
+
+TEST_CASE(LiveIngestDepacketizesStapAAndFuA) {
+    const int port = kBasePort;
+    LiveIngest ingest(MakeConfig(LiveProtocol::Rtp, port, 50));
+    const Bytes sps = { 0x67, 0x42, 0xc0, 0x1e, 0xd9 };
+    const Bytes pps = { 0x68, 0xce, 0x3c, 0x80 };
+    const Bytes stapA = Concat({ { 0x18, 0, (uint8_t)sps.size() }, sps, { 0, (uint8_t)pps.size() }, pps });
+    // An IDR slice in three fragments: indicator (NRI 3, FU-A), header (start/end, type 5)
+    const Bytes idrData = { 0x88, 0x84, 0x21, 0x10, 0x08, 0x04 };
+    std::vector<ReceivedUnit> units = Run(ingest, port, {
+        RtpPacket(7, 0, false, stapA),
+        RtpPacket(8, 0, false, { 0x7c, 0x85, 0x88, 0x84 }),
+        RtpPacket(9, 0, false, { 0x7c, 0x05, 0x21, 0x10 }),
+        RtpPacket(10, 0, true, { 0x7c, 0x45, 0x08, 0x04 }),
+        RtpPacket(11, 3000, true, Slice(1)),
+    });
+    REQUIRE(units.size() == 2);
+    CHECK(units[0].data == Concat({ AnnexB(sps), AnnexB(pps), AnnexB(Concat({ { 0x65 }, idrData })) }));
+    CHECK(units[0].idr && units[0].sps && units[0].pps && units[0].picture);
+    CHECK(units[0].pts == 0);
+    CHECK(units[1].data == AnnexB(Slice(1)));
+    CHECK(!units[1].idr && units[1].picture);
+    // 3000 ticks of the 90 kHz clock
+    CHECK(units[1].pts == 33333);
+    CHECK(ingest.getPackets() == 5 && ingest.getPacketsLost() == 0 && ingest.getPacketsDropped() == 0);
+}
+
+TEST_CASE(LiveIngestReordersRtp) {
+    const int port = kBasePort + 1;
+    // The late packet has all the time it needs
+    LiveIngest ingest(MakeConfig(LiveProtocol::Rtp, port, 1000));
+    std::vector<ReceivedUnit> units = Run(ingest, port, {
+        RtpPacket(65534, 0, true, Slice(0)),
+        RtpPacket(0, 6000, true, Slice(2)),
+        RtpPacket(65535, 3000, true, Slice(1)),
+        RtpPacket(1, 9000, true, Slice(3)),
+    });
+    REQUIRE(units.size() == 4);
+    const int64_t pts[] = { 0, 33333, 66666, 100000 };
+    for (size_t i = 0; i < units.size(); i++) {
+        CHECK_MESSAGE(units[i].data == AnnexB(Slice((uint8_t)i)), "unit " << i);
+        CHECK_MESSAGE(units[i].pts == pts[i], "unit " << i << ": " << units[i].pts);
+    }
+    CHECK(ingest.getPacketsReordered() == 1);
+    CHECK(ingest.getPacketsLost() == 0 && ingest.getPacketsLate() == 0);
+}
+
+TEST_CASE(LiveIngestSkipsLostAndBrokenPackets) {
+    const int port = kBasePort + 2;
+    LiveIngestConfig config = MakeConfig(LiveProtocol::Rtp, port, 10);
+    config.slotSize = 256;
+    LiveIngest ingest(config);
+    const Bytes sei = { 0x06, 0x05, 0x01, 0xaa, 0x80 };
+    std::vector<ReceivedUnit> units = Run(ingest, port, {
+        RtpPacket(0, 0, false, sei),
+        RtpPacket(1, 0, false, { 0x7c, 0x85, 0x88, 0x84 }),
+        // 2, the middle fragment, is lost: the end fragment has nothing to end
+        RtpPacket(3, 0, true, { 0x7c, 0x45, 0x08, 0x04 }),
+        RtpPacket(4, 3000, true, Slice(1)),
+        // A STAP-A unit overrunning the packet
+        RtpPacket(5, 6000, true, { 0x18, 0, 16, 0x41, 0x9a }),
+        // Shorter than an RTP header
+        { 0x80, 0x60, 0, 6 },
+        // Longer than a slot: truncated on receive, so 6 is lost as well
+        RtpPacket(6, 9000, true, Bytes(300, 0x41)),
+        RtpPacket(7, 12000, true, Slice(2)),
+        // A duplicate
+        RtpPacket(4, 3000, true, Slice(1)),
+    });
+    REQUIRE(units.size() == 3);
+    // The fragmented NAL unit is cut out, the rest of its access unit stays
+    CHECK(units[0].data == AnnexB(sei));
+    CHECK(!units[0].picture);
+    CHECK(units[1].data == AnnexB(Slice(1)) && units[1].pts == 33333);
+    CHECK(units[2].data == AnnexB(Slice(2)) && units[2].pts == 133333);
+    CHECK(ingest.getPacketsLost() == 2);
+    CHECK(ingest.getPacketsDropped() == 4);
+    CHECK(ingest.getPacketsLate() == 1);
+}
+
+TEST_CASE(LiveIngestResyncsOnRestartedSender) {
+    const int port = kBasePort + 3;
+    LiveIngest ingest(MakeConfig(LiveProtocol::Rtp, port, 50));
+    std::vector<ReceivedUnit> units = Run(ingest, port, {
+        RtpPacket(1000, 0, true, Slice(0)),
+        RtpPacket(1001, 3000, true, Slice(1)),
+        // A stray packet far out of the window, not followed up: dropped
+        RtpPacket(30000, 0, true, Slice(0xee)),
+        RtpPacket(1002, 6000, true, Slice(2)),
+        // The sender restarts behind the window, with new timestamps
+        RtpPacket(10, 500000, true, Slice(3)),
+        RtpPacket(11, 503000, true, Slice(4)),
+        RtpPacket(12, 506000, true, Slice(5)),
+        // A new source, inside the window
+        RtpPacket(20, 90000, true, Slice(6), 0xabcdef01),
+        RtpPacket(21, 93000, true, Slice(7), 0xabcdef01),
+    });
+    REQUIRE(units.size() == 8);
+    for (size_t i = 0; i < units.size(); i++) {
+        CHECK_MESSAGE(units[i].data == AnnexB(Slice((uint8_t)i)), "unit " << i);
+        // The PTS go on a frame after the last one
+        CHECK_MESSAGE(units[i].pts == (int64_t)i * 33333, "unit " << i << ": " << units[i].pts);
+    }
+    CHECK(ingest.getResyncs() == 2);
+    CHECK(ingest.getPacketsLate() == 1);
+    CHECK(ingest.getPacketsLost() == 0);
+}
+
+TEST_CASE(LiveIngestDemuxesTs) {
+    const int port = kBasePort + 4;
+    LiveIngest ingest(MakeConfig(LiveProtocol::Ts, port, 50));
+    const int pmtPid = 0x1000, videoPid = 0x100;
+    // CRCs are not checked
+    const Bytes pat = { 0, 0, 0xb0, 13, 0, 1, 0xc1, 0, 0, 0, 1, (uint8_t)(0xe0 | (pmtPid >> 8)), (uint8_t)pmtPid, 0, 0, 0, 0 };
+    // An HEVC stream in front of the H.264 one
+    const Bytes pmt = { 0, 2, 0xb0, 23, 0, 1, 0xc1, 0, 0, 0xe1, 0x00, 0xf0, 0, 0x24, 0xe1, 0x01, 0xf0, 0,
+        0x1b, (uint8_t)(0xe0 | (videoPid >> 8)), (uint8_t)videoPid, 0xf0, 0, 0, 0, 0, 0 };
+
+    // The first access unit spans two TS packets
+    Bytes idr = { 0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1e, 0xd9, 0, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80, 0, 0, 0, 1, 0x65 };
+    for (int i = 0; (int)idr.size() < 250; i++) {
+        idr.push_back((uint8_t)(0x10 + i % 64));
+    }
+    const Bytes first = Concat({ PesHeader(900000), idr });
+    const Bytes second = Concat({ PesHeader(903000), AnnexB(Slice(1)) });
+    const Bytes third = Concat({ PesHeader(909000), AnnexB(Slice(3)) });
+
+    std::vector<Bytes> packets = {
+        TsPacket(0, true, 0, pat),
+        TsPacket(pmtPid, true, 0, pmt),
+        TsPacket(videoPid, true, 0, Bytes(first.begin(), first.begin() + 184)),
+        TsPacket(videoPid, false, 1, Bytes(first.begin() + 184, first.end())),
+        TsPacket(videoPid, true, 2, second),
+        // Sent twice for robustness
+        TsPacket(videoPid, true, 2, second),
+        // Continuity counter 3 is lost
+        TsPacket(videoPid, true, 4, third),
+    };
+    // A datagram of the first five, one of the last two
+    std::vector<Bytes> datagrams(2);
+    for (size_t i = 0; i < packets.size(); i++) {
+        Bytes& datagram = datagrams[i < 5 ? 0 : 1];
+        datagram.insert(datagram.end(), packets[i].begin(), packets[i].end());
+    }
+    std::vector<ReceivedUnit> units = Run(ingest, port, datagrams);
+    REQUIRE(units.size() == 3);
+    CHECK(units[0].data == idr);
+    CHECK(units[0].idr && units[0].sps && units[0].pps && units[0].picture);
+    CHECK(units[0].pts == 0);
+    CHECK(units[1].data == AnnexB(Slice(1)) && units[1].pts == 33333);
+    CHECK(!units[1].idr && units[1].picture);
+    CHECK(units[2].data == AnnexB(Slice(3)) && units[2].pts == 100000);
+    CHECK(ingest.getPacketsLost() == 1);
+    CHECK(ingest.getPacketsDropped() == 0);
+}
+
+TEST_CASE(ParseLiveUrlSplitsHostAndPort) {
+    LiveProtocol protocol;
+    std::string host;
+    int port = 0;
+    CHECK(ParseLiveUrl("rtp://239.1.1.1:5004", protocol, host, port));
+    CHECK(protocol == LiveProtocol::Rtp && host == "239.1.1.1" && port == 5004);
+    CHECK(ParseLiveUrl("udp://localhost:1234", protocol, host, port));
+    CHECK(protocol == LiveProtocol::Ts && host == "localhost" && port == 1234);
+    CHECK(!ParseLiveUrl("http://localhost:80", protocol, host, port));
+    CHECK(!ParseLiveUrl("rtp://localhost", protocol, host, port));
+    CHECK(!ParseLiveUrl("rtp://localhost:70000", protocol, host, port));
+}
@@ -0,0 +1,149 @@
+#include "TestHarness.hpp"
+
+#include "MosaicCompositor.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const int kWidth = 32, kHeight = 16;
+const size_t kFrameBytes = kWidth * (kHeight + kHeight / 2);
+
+// Host memory handed out as device frames, for the download path
+class DeviceStandInAllocator : public HostFrameAllocator {
+public:
+    FrameMemoryType getMemoryType() const override { return FrameMemoryType::Device; }
+};
+
+std::unique_ptr<FramePool> MakePool(FrameAllocator* pAllocator) {
+    FramePoolConfig config;
+    config.capacity = 4;
+    return std::unique_ptr<FramePool>(new FramePool(std::unique_ptr<FrameAllocator>(pAllocator), config));
+}
+
+// A flat NV12 frame, luma inY and neutral chroma
+FrameHandle MakeFrame(FramePool& ioPool, uint8_t inY) {
+    FrameHandle frame = ioPool.acquire(kFrameBytes);
+    FrameInfo& info = frame.info();
+    info.width = kWidth;
+    info.height = kHeight;
+    info.pitch = kWidth;
+    memset(frame.data(), inY, kWidth * kHeight);
+    memset(frame.data() + kWidth * kHeight, 128, kFrameBytes - kWidth * kHeight);
+    return frame;
+}
+
+// Green channel of the canvas pixel at inX, inY
+int CanvasGreen(const MosaicCompositor& inCompositor, int inX, int inY) {
+    const SinkFrame canvas = inCompositor.getCanvas();
+    return canvas.data[(size_t)inY * canvas.pitch + inX * 4 + 1];
+}
+
+bool SameTile(const MosaicTile& inTile, int inX, int inY, int inWidth, int inHeight) {
+    return inTile.x == inX && inTile.y == inY && inTile.width == inWidth && inTile.height == inHeight;
+}
+
+}
+
+TEST_CASE(MakeMosaicGridCoversTheCanvas) {
+    const std::vector<MosaicTile> tiles = MakeMosaicGrid(100, 61, 2, 3);
+    REQUIRE(tiles.size() == 6);
+    // Row by row; the edges at the exact fractions, the last row and column take the remainder
+    CHECK(SameTile(tiles[0], 0, 0, 50, 20));
+    CHECK(SameTile(tiles[1], 50, 0, 50, 20));
+    CHECK(SameTile(tiles[2], 0, 20, 50, 20));
+    CHECK(SameTile(tiles[5], 50, 40, 50, 21));
+
+    // The gap is taken off the right and bottom of all but the last column and row
+    const std::vector<MosaicTile> gapped = MakeMosaicGrid(100, 60, 2, 2, 4);
+    REQUIRE(gapped.size() == 4);
+    CHECK(SameTile(gapped[0], 0, 0, 46, 26));
+    CHECK(SameTile(gapped[3], 50, 30, 50, 30));
+
+    CHECK(MakeMosaicGrid(100, 60, 0, 2).empty());
+}
+
+TEST_CASE(MosaicCompositorRedrawsDirtyTilesOnly) {
+    MosaicConfig config;
+    config.width = 64;
+    config.height = 32;
+    config.tiles = MakeMosaicGrid(config.width, config.height, 2, 2);
+    config.keepAspect = false;
+    MosaicCompositor compositor(config);
+    REQUIRE(compositor.getTileCount() == 4);
+    std::unique_ptr<FramePool> pPool = MakePool(new HostFrameAllocator);
+
+    // Nothing submitted: every tile is skipped, the canvas stays black
+    CHECK(compositor.composite() == 0);
+    CHECK(compositor.getTilesSkipped() == 4);
+    CHECK(CanvasGreen(compositor, 0, 0) == 0);
+
+    compositor.submit(0, MakeFrame(*pPool, 235));
+    compositor.submit(3, MakeFrame(*pPool, 235));
+    // Out of the layout
+    compositor.submit(4, MakeFrame(*pPool, 235));
+    CHECK(compositor.composite() == 2);
+    CHECK(compositor.getTilesDrawn() == 2);
+    CHECK(compositor.getTilesSkipped() == 6);
+    CHECK(CanvasGreen(compositor, 5, 5) > 240);
+    CHECK(CanvasGreen(compositor, 40, 5) == 0);
+    CHECK(CanvasGreen(compositor, 40, 20) > 240);
+    // The frames went back to the pool once drawn
+    CHECK(pPool->getInUse() == 0);
+
+    // A tile drawn stays as it is until a new frame comes, the newest of several is drawn
+    compositor.submit(0, MakeFrame(*pPool, 235));
+    compositor.submit(0, MakeFrame(*pPool, 16));
+    CHECK(compositor.getFramesReplaced() == 1);
+    CHECK(compositor.composite() == 1);
+    CHECK(compositor.getTilesSkipped() == 9);
+    CHECK(CanvasGreen(compositor, 5, 5) < 10);
+    CHECK(CanvasGreen(compositor, 40, 20) > 240);
+    CHECK(compositor.getComposites() == 3);
+}
+
+TEST_CASE(MosaicCompositorDownloadsOutsideTheTileLock) {
+    MosaicConfig config;
+    config.width = 64;
+    config.height = 32;
+    config.tiles = MakeMosaicGrid(config.width, config.height, 2, 1);
+    config.keepAspect = false;
+    MosaicCompositor* pCompositor = nullptr;
+    int downloads = 0;
+    bool compositeWaited = false;
+    // Outside the callback, so a composite stuck on the lock would fail the test, not hang it
+    std::future<int> composited;
+    config.downloadFrame = [&](const FrameHandle& inFrame, uint8_t* outHost, size_t inSize) {
+        memcpy(outHost, inFrame.data(), inSize);
+        // A composite meanwhile goes through instead of waiting for the transfer
+        if (downloads++ == 0) {
+            composited = std::async(std::launch::async, [&] { return pCompositor->composite(); });
+            compositeWaited = composited.wait_for(std::chrono::seconds(2)) != std::future_status::ready;
+        }
+    };
+    MosaicCompositor compositor(config);
+    pCompositor = &compositor;
+    std::unique_ptr<FramePool> pPool = MakePool(new DeviceStandInAllocator);
+
+    compositor.submit(1, MakeFrame(*pPool, 235));
+    CHECK(downloads == 1);
+    CHECK(!compositeWaited);
+    CHECK(composited.get() == 0);
+    // Held by nobody but the copy
+    CHECK(pPool->getInUse() == 0);
+    CHECK(compositor.composite() == 1);
+    CHECK(CanvasGreen(compositor, 40, 5) > 240);
+
+    // The download buffers go round without a frame getting mixed up
+    for (int i = 0; i < 3; i++) {
+        compositor.submit(1, MakeFrame(*pPool, i % 2 ? 235 : 16));
+        CHECK(compositor.composite() == 1);
+        CHECK((CanvasGreen(compositor, 40, 5) > 240) == (i % 2 == 1));
+    }
+    CHECK(downloads == 4);
+}
@@ -0,0 +1,145 @@
+#include "TestHarness.hpp"
+
+#include "PresentationClock.hpp"
+#include "SyntheticDecoder.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// 25 fps
+const int kFrameRateNum = 25, kFrameRateDen = 1;
+const int64_t kDuration = 40000;
+
+// Records inPts for access units 0, 1, ... (kNoPts for none), runs them through a
+// SyntheticDecoder and returns what stamp() makes of the frames that come out
+std::vector<int64_t> StampThroughDecoder(const std::vector<int64_t>& inPts) {
+    FramePoolConfig poolConfig;
+    poolConfig.capacity = (int)inPts.size();
+    SyntheticDecoder decoder(16, 8, 100, poolConfig);
+    PtsTracker tracker;
+    const uint8_t unit[] = { 0, 0, 0, 1, 0x41, 0x88, 0x84 };
+    int frameCount = 0;
+    for (size_t i = 0; i < inPts.size(); i++) {
+        if (inPts[i] != kNoPts) {
+            tracker.record((int64_t)i, inPts[i]);
+        }
+        frameCount = decoder.decode(unit, sizeof(unit), (int64_t)i, true);
+    }
+    // All of them held in the decoder before the first is stamped
+    std::vector<int64_t> stamped;
+    while (frameCount--) {
+        FrameHandle frame = decoder.getFrame();
+        stamped.push_back(tracker.stamp(frame.info().timestamp, kFrameRateNum, kFrameRateDen));
+    }
+    return stamped;
+}
+
+// A PresentationClock on a clock the test moves
+struct ManualClock {
+    int64_t nowUs = 5000000;
+
+    PresentationConfig makeConfig() {
+        PresentationConfig config;
+        config.clock = [this] { return nowUs; };
+        return config;
+    }
+};
+
+}
+
+TEST_CASE(PtsTrackerMatchesPtsThroughTheDecoder) {
+    // Irregular PTS come out as they went in
+    const std::vector<int64_t> pts = { 1000, 41000, 90000, 121000, 170000, 200000 };
+    CHECK(StampThroughDecoder(pts) == pts);
+
+    // Without any, they count up at the frame rate from the first frame's index
+    const std::vector<int64_t> none(4, kNoPts);
+    CHECK(StampThroughDecoder(none) == std::vector<int64_t>({ 0, kDuration, 2 * kDuration, 3 * kDuration }));
+
+    // A unit without PTS in between goes one frame after the last
+    const std::vector<int64_t> gap = { 1000, 41000, kNoPts, 121000 };
+    CHECK(StampThroughDecoder(gap) == std::vector<int64_t>({ 1000, 41000, 81000, 121000 }));
+}
+
+TEST_CASE(PtsTrackerFallsBackOnNonMonotonicPts) {
+    // Going back or standing still continues from the last frame instead
+    const std::vector<int64_t> pts = { 0, 40000, 20000, 40000, 200000 };
+    CHECK(StampThroughDecoder(pts) == std::vector<int64_t>({ 0, 40000, 80000, 120000, 200000 }));
+
+    // A PTS recorded for a timestamp that shares the slot is not taken for another one
+    PtsTracker tracker;
+    tracker.record(5, 900000);
+    CHECK(tracker.stamp(5 + 256, kFrameRateNum, kFrameRateDen) == 261 * kDuration);
+    // And a PTS is used once
+    tracker.record(300, 50000000);
+    CHECK(tracker.stamp(300, kFrameRateNum, kFrameRateDen) == 50000000);
+    CHECK(tracker.stamp(300, kFrameRateNum, kFrameRateDen) == 50000000 + kDuration);
+
+    CHECK(PtsTracker::GetFrameDuration(0, 0) == 1000000 / 30);
+    CHECK(PtsTracker::GetFrameDuration(30000, 1001) == 33366);
+}
+
+TEST_CASE(PresentationClockDropsLateFrames) {
+    ManualClock clock;
+    PresentationClock presentation(clock.makeConfig());
+    // The first frame starts the clock, due now
+    CHECK(presentation.getLateness(1000000) == 0);
+    CHECK(!presentation.shouldDrop(1000000, kDuration));
+
+    // Up to one frame duration late is presented
+    clock.nowUs += kDuration + 30000;
+    CHECK(presentation.getLateness(1000000 + kDuration) == 30000);
+    CHECK(!presentation.shouldDrop(1000000 + kDuration, kDuration));
+    clock.nowUs += 20000;
+    CHECK(presentation.getLateness(1000000 + kDuration) == kDuration + 10000);
+    CHECK(presentation.shouldDrop(1000000 + kDuration, kDuration));
+    CHECK(presentation.getDropped() == 1);
+
+    // Early frames are negative, and never dropped
+    CHECK(presentation.getLateness(1000000 + 10 * kDuration) == -8 * kDuration + 10000);
+    CHECK(!presentation.shouldDrop(1000000 + 10 * kDuration, kDuration));
+
+    // A configured limit replaces the frame duration
+    PresentationConfig config = clock.makeConfig();
+    config.maxLatenessUs = 100000;
+    PresentationClock tolerant(config);
+    CHECK(!tolerant.shouldDrop(0, kDuration));
+    clock.nowUs += 100000;
+    CHECK(!tolerant.shouldDrop(0, kDuration));
+    clock.nowUs += 1;
+    CHECK(tolerant.shouldDrop(0, kDuration));
+    CHECK(presentation.getResyncs() == 0 && tolerant.getResyncs() == 0);
+}
+
+TEST_CASE(PresentationClockResyncsOnJumps) {
+    ManualClock clock;
+    PresentationClock presentation(clock.makeConfig());
+    CHECK(presentation.getLateness(0) == 0);
+
+    // The decoder stalled for over resyncUs: the clock restarts on the frame instead of
+    // dropping everything until it caught up
+    clock.nowUs += 1500000;
+    CHECK(!presentation.shouldDrop(kDuration, kDuration));
+    CHECK(presentation.getResyncs() == 1);
+    clock.nowUs += kDuration;
+    CHECK(presentation.getLateness(2 * kDuration) == 0);
+
+    // The stream jumped ahead, or back
+    CHECK(presentation.getLateness(60000000) == 0);
+    CHECK(presentation.getResyncs() == 2);
+    CHECK(presentation.getLateness(60000000 + kDuration) == -kDuration);
+    CHECK(presentation.getLateness(0) == 0);
+    CHECK(presentation.getResyncs() == 3);
+
+    // Right at the limit is no jump yet
+    clock.nowUs += 1000000;
+    CHECK(presentation.getLateness(0) == 1000000);
+    CHECK(presentation.getResyncs() == 3);
+
+    // Late frames are presented at once and go into the statistics
+    presentation.waitUntilDue(0);
+    CHECK(presentation.getPresented() == 1);
+    CHECK(presentation.getMaxLatenessMs() == 1000);
+}
@@ -0,0 +1,107 @@
+#include "TestHarness.hpp"
+
+#include "SharedMemorySink.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+// A gray 8 bit frame of inWidth x inHeight
+struct TestFrame {
+    std::vector<uint8_t> data;
+    SinkFrame frame;
+
+    TestFrame(int inWidth, int inHeight, int64_t inTimestamp) : data((size_t)inWidth * inHeight * 3 / 2, 128) {
+        frame.data = data.data();
+        frame.width = inWidth;
+        frame.height = inHeight;
+        frame.pitch = inWidth;
+        frame.timestamp = inTimestamp;
+    }
+};
+
+SharedMemorySinkConfig MakeConfig(const char* inName, bool inDropWhenFull) {
+    SharedMemorySinkConfig config;
+    config.name = inName;
+    config.slotCount = 2;
+    config.dropWhenFull = inDropWhenFull;
+    config.consumerTimeoutMs = 50;
+    return config;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point inStart) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - inStart).count();
+}
+
+}
+
+TEST_CASE(SharedMemorySinkPublishesFrames) {
+    SharedMemorySink sink(MakeConfig("SharedMemorySinkTests1", true));
+    CHECK(sink.write(TestFrame(64, 32, 0).frame));
+    SharedFrameRingReader reader("SharedMemorySinkTests1");
+    REQUIRE(reader);
+    CHECK(sink.write(TestFrame(64, 32, 1).frame));
+    // Full: dropped
+    CHECK(sink.write(TestFrame(64, 32, 2).frame));
+    CHECK(sink.getDropped() == 1);
+
+    for (int64_t timestamp = 0; timestamp < 2; timestamp++) {
+        const SharedFrameHeader* pFrame = reader.acquire();
+        REQUIRE(pFrame);
+        CHECK(pFrame->timestamp == timestamp && pFrame->sequence == (uint64_t)timestamp);
+        CHECK(pFrame->width == 64 && pFrame->height == 32 && pFrame->pitch == 64);
+        CHECK(pFrame->data()[pFrame->size - 1] == 128);
+        reader.release();
+    }
+    CHECK(!reader.acquire());
+    CHECK(!reader.isClosed());
+    sink.close();
+    CHECK(reader.isClosed());
+}
+
+TEST_CASE(SharedMemorySinkCountsFramesOfAnotherSize) {
+    SharedMemorySink sink(MakeConfig("SharedMemorySinkTests2", true));
+    CHECK(sink.write(TestFrame(64, 32, 0).frame));
+    // Larger than the slots: dropped and counted, warned about once
+    for (int64_t i = 1; i < 4; i++) {
+        CHECK(sink.write(TestFrame(128, 64, i).frame));
+    }
+    CHECK(sink.getResizedDropped() == 3);
+    CHECK(sink.getDropped() == 3);
+    // Smaller ones fit
+    CHECK(sink.write(TestFrame(32, 16, 4).frame));
+    CHECK(sink.getDropped() == 3);
+}
+
+TEST_CASE(SharedMemorySinkStopsWaitingForAGoneConsumer) {
+    SharedMemorySink sink(MakeConfig("SharedMemorySinkTests3", false));
+    CHECK(sink.write(TestFrame(64, 32, 0).frame));
+    SharedFrameRingReader reader("SharedMemorySinkTests3");
+    REQUIRE(reader);
+    CHECK(sink.write(TestFrame(64, 32, 1).frame));
+
+    // Nobody reads: the first frame waits out the timeout, the next are dropped right away
+    auto start = std::chrono::steady_clock::now();
+    CHECK(sink.write(TestFrame(64, 32, 2).frame));
+    CHECK(MillisecondsSince(start) >= 50);
+    CHECK(sink.getDropped() == 1);
+    start = std::chrono::steady_clock::now();
+    for (int64_t i = 3; i < 10; i++) {
+        CHECK(sink.write(TestFrame(64, 32, i).frame));
+    }
+    CHECK_MESSAGE(MillisecondsSince(start) < 50, MillisecondsSince(start) << " ms");
+    CHECK(sink.getDropped() == 8);
+
+    // Reading again makes the sink wait for it again
+    REQUIRE(reader.acquire());
+    CHECK(reader.acquire()->timestamp == 0);
+    reader.release();
+    CHECK(sink.write(TestFrame(64, 32, 10).frame));
+    CHECK(sink.getDropped() == 8);
+    start = std::chrono::steady_clock::now();
+    CHECK(sink.write(TestFrame(64, 32, 11).frame));
+    CHECK(MillisecondsSince(start) >= 50);
+    CHECK(sink.getDropped() == 9);
+}
@@ -0,0 +1,344 @@
+#include "TestHarness.hpp"
+
+#include "StreamIndex.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+// RBSP bits MSB first, closed with the stop bit. The values used here never produce 00 00, so
+// no emulation prevention is needed.
+class BitWriter {
+public:
+    void writeBits(uint32_t inValue, int inCount) {
+        while (inCount--) {
+            mBits.push_back((inValue >> inCount) & 1);
+        }
+    }
+    void writeUe(uint32_t inValue) {
+        int length = 0;
+        while ((inValue + 1) >> (length + 1)) {
+            length++;
+        }
+        writeBits(0, length);
+        writeBits(inValue + 1, length + 1);
+    }
+    Bytes finish() {
+        mBits.push_back(1);
+        Bytes bytes((mBits.size() + 7) / 8);
+        for (size_t i = 0; i < mBits.size(); i++) {
+            bytes[i / 8] |= (uint8_t)(mBits[i] << (7 - i % 8));
+        }
+        return bytes;
+    }
+
+private:
+    std::vector<int> mBits;
+};
+
+void AppendNal(Bytes& ioStream, uint8_t inHeader, const Bytes& inPayload) {
+    const uint8_t startCode[] = { 0, 0, 0, 1 };
+    ioStream.insert(ioStream.end(), startCode, startCode + sizeof(startCode));
+    ioStream.push_back(inHeader);
+    ioStream.insert(ioStream.end(), inPayload.begin(), inPayload.end());
+}
+
+void AppendSps(Bytes& ioStream, int inId) {
+    BitWriter writer;
+    // Baseline profile, level 3.0
+    writer.writeBits(66, 8);
+    writer.writeBits(0, 8);
+    writer.writeBits(30, 8);
+    writer.writeUe(inId);
+    AppendNal(ioStream, 0x67, writer.finish());
+}
+
+void AppendPps(Bytes& ioStream, int inId, int inSpsId) {
+    BitWriter writer;
+    writer.writeUe(inId);
+    writer.writeUe(inSpsId);
+    AppendNal(ioStream, 0x68, writer.finish());
+}
+
+// A recovery point SEI message, recovery_frame_cnt 0
+void AppendRecoveryPoint(Bytes& ioStream) {
+    AppendNal(ioStream, 0x06, { 0x06, 0x01, 0xc4, 0x80 });
+}
+
+// The first slice of a picture
+void AppendSlice(Bytes& ioStream, bool inIdr, int inPpsId) {
+    BitWriter writer;
+    writer.writeUe(0);
+    writer.writeUe(inIdr ? 7 : 5);
+    writer.writeUe(inPpsId);
+    AppendNal(ioStream, inIdr ? 0x65 : 0x41, writer.finish());
+}
+
+// Seven pictures:
+//   0  SPS 0, PPS 0, recovery point, non-IDR slice
+//   1  slice
+//   2  IDR, parameter sets from frame 0
+//   3  slice
+//   4  recovery point, slice
+//   5  PPS 1 (SPS 0), IDR
+//   6  slice
+Bytes MakeStream() {
+    Bytes stream;
+    AppendSps(stream, 0);
+    AppendPps(stream, 0, 0);
+    AppendRecoveryPoint(stream);
+    AppendSlice(stream, false, 0);
+    AppendSlice(stream, false, 0);
+    AppendSlice(stream, true, 0);
+    AppendSlice(stream, false, 0);
+    AppendRecoveryPoint(stream);
+    AppendSlice(stream, false, 0);
+    AppendPps(stream, 1, 0);
+    AppendSlice(stream, true, 1);
+    AppendSlice(stream, false, 1);
+    return stream;
+}
+
+bool WriteFile(const std::string& inPath, const Bytes& inData) {
+    FILE* pFile = fopen(inPath.c_str(), "wb");
+    if (!pFile) {
+        return false;
+    }
+    const bool written = fwrite(inData.data(), 1, inData.size(), pFile) == inData.size();
+    return fclose(pFile) == 0 && written;
+}
+
+Bytes ReadFile(const std::string& inPath) {
+    Bytes data;
+    if (FILE* pFile = fopen(inPath.c_str(), "rb")) {
+        uint8_t buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0) {
+            data.insert(data.end(), buffer, buffer + read);
+        }
+        fclose(pFile);
+    }
+    return data;
+}
+
+// Whether inIndex describes the same tables as inExpected
+bool SameTables(const StreamIndex& inIndex, const StreamIndex& inExpected) {
+    if (inIndex.getFrameCount() != inExpected.getFrameCount() || inIndex.getKeyframeCount() != inExpected.getKeyframeCount()
+        || inIndex.getRecoveryPointCount() != inExpected.getRecoveryPointCount()) {
+        return false;
+    }
+    for (int64_t i = 0; i < inExpected.getFrameCount(); i++) {
+        if (memcmp(&inIndex.getEntry(i), &inExpected.getEntry(i), sizeof(StreamIndexEntry)) != 0) {
+            return false;
+        }
+    }
+    for (int64_t i = 0; i < inExpected.getKeyframeCount(); i++) {
+        if (inIndex.getKeyframe(i) != inExpected.getKeyframe(i)) {
+            return false;
+        }
+    }
+    for (int64_t i = 0; i < inExpected.getRecoveryPointCount(); i++) {
+        if (inIndex.getRecoveryPoint(i) != inExpected.getRecoveryPoint(i)) {
+            return false;
+        }
+    }
+    for (int64_t i = 0; i < inExpected.getFrameCount(); i++) {
+        const std::vector<const StreamIndexParameterSet*> sets = inIndex.getParameterSets(i);
+        const std::vector<const StreamIndexParameterSet*> expected = inExpected.getParameterSets(i);
+        if (sets.size() != expected.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < sets.size(); j++) {
+            if (memcmp(sets[j], expected[j], sizeof(StreamIndexParameterSet)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Overwrites the uint32 or uint64 at inOffset of a saved sidecar, the file size stays the same
+template <typename T>
+void Patch(Bytes& ioSidecar, size_t inOffset, T inValue) {
+    memcpy(ioSidecar.data() + inOffset, &inValue, sizeof(inValue));
+}
+
+const char* const kStreamPath = "StreamIndexTests.264";
+
+}
+
+TEST_CASE(StreamIndexFindsKeyframesAndRecoveryPoints) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    REQUIRE(index.getFrameCount() == 7);
+    REQUIRE(index.getKeyframeCount() == 2 && index.getRecoveryPointCount() == 2);
+    CHECK(index.getKeyframe(0) == 2 && index.getKeyframe(1) == 5);
+    CHECK(index.getRecoveryPoint(0) == 0 && index.getRecoveryPoint(1) == 4);
+    CHECK(index.getEntry(0).flags == (StreamIndexFlag_RecoveryPoint | StreamIndexFlag_Sps | StreamIndexFlag_Pps));
+    CHECK(index.getEntry(5).flags == (StreamIndexFlag_Idr | StreamIndexFlag_Pps) && index.getEntry(5).ppsId == 1);
+
+    // Entries tile the stream
+    uint64_t offset = 0;
+    for (int64_t frame = 0; frame < index.getFrameCount(); frame++) {
+        CHECK_MESSAGE(index.getEntry(frame).offset == offset, "frame " << frame);
+        offset += index.getEntry(frame).size;
+    }
+    CHECK(offset == stream.size());
+
+    // An IDR picture before the frame wins over a nearer recovery point, the recovery point at
+    // the start only counts while no IDR picture precedes
+    const int64_t expected[] = { 0, 0, 2, 2, 2, 5, 5 };
+    for (int64_t frame = 0; frame < 7; frame++) {
+        CHECK_MESSAGE(index.findKeyframe(frame) == expected[frame], "frame " << frame << ": " << index.findKeyframe(frame));
+    }
+    CHECK(index.findKeyframe(-1) == -1);
+    CHECK(index.findKeyframe(7) == -1);
+}
+
+TEST_CASE(StreamIndexGetParameterSetsSkipsTheKeyframeUnit) {
+    const Bytes stream = MakeStream();
+    StreamIndex index;
+    index.build(stream.data(), stream.size());
+    REQUIRE(index.getFrameCount() == 7);
+
+    // Frame 0 carries its own
+    CHECK(index.getParameterSets(0).empty());
+
+    // Frame 2 needs SPS 0 and PPS 0 from frame 0, SPS first
+    std::vector<const StreamIndexParameterSet*> sets = index.getParameterSets(2);
+    REQUIRE(sets.size() == 2);
+    CHECK(sets[0]->type == NalUnitType_Sps && sets[0]->id == 0 && sets[0]->frame == 0);
+    CHECK(sets[1]->type == NalUnitType_Pps && sets[1]->id == 0 && sets[1]->spsId == 0 && sets[1]->frame == 0);
+    for (const StreamIndexParameterSet* pSet : sets) {
+        // The NAL unit with its start code, trailing zeros excluded
+        REQUIRE(pSet->offset + pSet->size <= stream.size());
+        const uint8_t* p = stream.data() + pSet->offset;
+        CHECK(p[0] == 0 && p[1] == 0 && p[2] == 1 && (p[3] & 0x1f) == pSet->type);
+        CHECK(p[pSet->size - 1] != 0);
+    }
+
+    // Frame 5 brings PPS 1, only the SPS is missing
+    sets = index.getParameterSets(5);
+    REQUIRE(sets.size() == 1);
+    CHECK(sets[0]->type == NalUnitType_Sps && sets[0]->id == 0);
+}
+
+TEST_CASE(StreamIndexSidecarRoundTrip) {
+    const Bytes stream = MakeStream();
+    REQUIRE(WriteFile(kStreamPath, stream));
+    const std::string sidecarPath = StreamIndex::GetSidecarPath(kStreamPath);
+    uint64_t size = 0;
+    int64_t modified = 0;
+    REQUIRE(StreamIndex::GetFileStamp(kStreamPath, size, modified));
+    CHECK(size == stream.size());
+
+    StreamIndex built;
+    built.build(stream.data(), stream.size());
+    REQUIRE(built.save(sidecarPath, size, modified));
+
+    {
+        StreamIndex loaded;
+        CHECK(loaded.load(sidecarPath, size, modified));
+        CHECK(SameTables(loaded, built));
+    }
+
+    // Stale: the stream changed since
+    StreamIndex stale;
+    CHECK(!stale.load(sidecarPath, size + 1, modified));
+    CHECK(!stale.load(sidecarPath, size, modified + 1));
+    CHECK(!stale.load(sidecarPath + ".missing", size, modified));
+
+    // open() maps the sidecar it finds, and builds and writes one when there is none. The
+    // indexes are scoped: a mapped sidecar cannot be removed everywhere.
+    MappedFile mapped(kStreamPath);
+    REQUIRE(mapped);
+    {
+        StreamIndex opened;
+        CHECK(opened.open(kStreamPath, mapped));
+        CHECK(SameTables(opened, built));
+    }
+    remove(sidecarPath.c_str());
+    {
+        StreamIndex rebuilt;
+        CHECK(rebuilt.open(kStreamPath, mapped));
+        CHECK(SameTables(rebuilt, built));
+    }
+    {
+        StreamIndex loaded;
+        CHECK(loaded.load(sidecarPath, size, modified));
+    }
+    remove(sidecarPath.c_str());
+    remove(kStreamPath);
+}
+
+TEST_CASE(StreamIndexRebuildsCorruptedSidecars) {
+    const Bytes stream = MakeStream();
+    REQUIRE(WriteFile(kStreamPath, stream));
+    const std::string sidecarPath = StreamIndex::GetSidecarPath(kStreamPath);
+    uint64_t size = 0;
+    int64_t modified = 0;
+    REQUIRE(StreamIndex::GetFileStamp(kStreamPath, size, modified));
+    StreamIndex built;
+    built.build(stream.data(), stream.size());
+    REQUIRE(built.save(sidecarPath, size, modified));
+    const Bytes sidecar = ReadFile(sidecarPath);
+    REQUIRE(!sidecar.empty());
+
+    // Where the tables of a 7 frame, 2 keyframe, 2 recovery point sidecar are
+    const size_t entries = sizeof(StreamIndexHeader);
+    const size_t keyframes = entries + 7 * sizeof(StreamIndexEntry);
+    const size_t recoveryPoints = keyframes + 2 * sizeof(uint32_t);
+    const size_t parameterSets = (recoveryPoints + 2 * sizeof(uint32_t) + 7) & ~(size_t)7;
+    REQUIRE(sidecar.size() == parameterSets + 3 * sizeof(StreamIndexParameterSet));
+
+    struct Corruption {
+        const char* name;
+        size_t offset;
+        uint64_t value;
+        bool wide;
+    };
+    const Corruption corruptions[] = {
+        { "entry offset past the stream", entries + 3 * sizeof(StreamIndexEntry), size, true },
+        { "entry size past the stream", entries + 6 * sizeof(StreamIndexEntry) + 8, 0xffffffff, false },
+        { "entry offset wrapping around", entries, ~(uint64_t)0, true },
+        { "keyframes out of order", keyframes, 5, false },
+        { "keyframe past the last frame", keyframes + 4, 7, false },
+        { "recovery point past the last frame", recoveryPoints + 4, 100, false },
+        { "recovery points repeated", recoveryPoints, 4, false },
+        { "parameter set past the stream", parameterSets + 8, (uint32_t)size, false },
+        { "parameter sets out of order", parameterSets + 12, 6, false },
+    };
+    for (const Corruption& corruption : corruptions) {
+        Bytes damaged = sidecar;
+        if (corruption.wide) {
+            Patch<uint64_t>(damaged, corruption.offset, corruption.value);
+        } else {
+            Patch<uint32_t>(damaged, corruption.offset, (uint32_t)corruption.value);
+        }
+        REQUIRE(WriteFile(sidecarPath, damaged));
+        StreamIndex loaded;
+        CHECK_MESSAGE(!loaded.load(sidecarPath, size, modified), corruption.name);
+
+        // open() falls back to building the index again and replaces the sidecar
+        MappedFile mapped(kStreamPath);
+        StreamIndex opened;
+        CHECK(opened.open(kStreamPath, mapped));
+        CHECK_MESSAGE(SameTables(opened, built), corruption.name);
+        CHECK_MESSAGE(ReadFile(sidecarPath) == sidecar, corruption.name);
+    }
+
+    // Cut short
+    Bytes truncated(sidecar.begin(), sidecar.end() - 8);
+    REQUIRE(WriteFile(sidecarPath, truncated));
+    StreamIndex loaded;
+    CHECK(!loaded.load(sidecarPath, size, modified));
+    remove(sidecarPath.c_str());
+    remove(kStreamPath);
+}
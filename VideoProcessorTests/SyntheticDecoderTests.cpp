@@ -0,0 +1,124 @@
+#include "TestHarness.hpp"
+
+#include "SessionScheduler.hpp"
+#include "SyntheticDecoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kFramesPerSession = 200;
+
+// Below this, throughput on n workers is less than n * kMinEfficiency times the rate of one
+// decoder on the calling thread. The work is a chain of dependent xorshifts, latency bound, so
+// it scales on SMT siblings as well.
+const double kMinEfficiency = 0.6;
+
+const char* const kStreamPath = "SyntheticDecoderTests.264";
+
+// kFramesPerSession access units, an IDR slice each: SyntheticDecoder only counts them
+bool WriteStream(const std::string& inPath) {
+    std::vector<uint8_t> stream;
+    for (int frame = 0; frame < kFramesPerSession; frame++) {
+        const uint8_t header[] = { 0, 0, 0, 1, 0x65, 0x88 };
+        stream.insert(stream.end(), header, header + sizeof(header));
+        stream.insert(stream.end(), 58, 0x5a);
+    }
+    FILE* pFile = fopen(inPath.c_str(), "wb");
+    if (!pFile) {
+        return false;
+    }
+    const bool written = fwrite(stream.data(), 1, stream.size(), pFile) == stream.size();
+    return fclose(pFile) == 0 && written;
+}
+
+// Frames per second of one decoder on the calling thread, no scheduler in between
+double MeasureDecodeRate() {
+    SyntheticDecoder decoder;
+    const std::vector<uint8_t> accessUnit(64, 0x5a);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFramesPerSession; frame++) {
+        int frames = decoder.decode(accessUnit.data(), accessUnit.size(), frame, true);
+        while (frames--) {
+            decoder.getFrame();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return kFramesPerSession / seconds;
+}
+
+// Frames per second of inSessions sessions of the stream on inWorkers scheduler workers
+double MeasureSchedulerRate(int inWorkers, int inSessions, uint64_t& outFrames) {
+    SchedulerConfig config;
+    config.workerCount = inWorkers;
+    SessionScheduler scheduler(config);
+    for (int i = 0; i < inSessions; i++) {
+        std::unique_ptr<DecodeSession> pSession(new DecodeSession(i, kStreamPath, std::unique_ptr<Decoder>(new SyntheticDecoder())));
+        if (!*pSession || !scheduler.addSession(std::move(pSession))) {
+            outFrames = 0;
+            return 0;
+        }
+    }
+    scheduler.run();
+    outFrames = scheduler.getFrames();
+    return scheduler.getElapsedSeconds() > 0 ? outFrames / scheduler.getElapsedSeconds() : 0;
+}
+
+}
+
+TEST_CASE(SyntheticDecoderOutputsOneFramePerAccessUnit) {
+    SyntheticDecoder decoder(64, 48, 1000);
+    const std::vector<uint8_t> accessUnit(100, 7);
+    for (int64_t timestamp = 0; timestamp < 3; timestamp++) {
+        REQUIRE(decoder.decode(accessUnit.data(), accessUnit.size(), timestamp, true) == 1);
+        FrameHandle frame = decoder.getFrame();
+        REQUIRE(frame);
+        const FrameInfo& info = frame.info();
+        CHECK(info.width == 64 && info.height == 48 && info.pitch == 64 && info.bpp == 1);
+        CHECK(info.timestamp == timestamp);
+        CHECK(frame.data()[64 * 48] == 128);
+        CHECK(!decoder.getFrame());
+    }
+    CHECK(decoder.decode(nullptr, 0) == 0);
+    CHECK(decoder.GetVideoFormat().frameRateNum == 30);
+}
+
+// Two sessions per worker on 1, 2, 4, ... workers up to the core count, against one decoder on
+// the test thread: the cost is compute bound and per frame, and the scheduler slices, steals
+// and pins without getting in the way, what the scaling measurements of the server rely on.
+// On one core this still holds the scheduler to the rate of a bare decoder.
+TEST_CASE(SyntheticDecoderScalesWithCores) {
+    REQUIRE(WriteStream(kStreamPath));
+    const int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> workerCounts;
+    for (int workers = 1; workers < cores; workers *= 2) {
+        workerCounts.push_back(workers);
+    }
+    workerCounts.push_back(cores);
+
+    // Best of 3 runs, a busy machine only ever makes it slower
+    double baseRate = 0;
+    for (int run = 0; run < 3; run++) {
+        baseRate = std::max(baseRate, MeasureDecodeRate());
+    }
+    for (int workers : workerCounts) {
+        const int sessions = 2 * workers;
+        double rate = 0;
+        for (int run = 0; run < 3; run++) {
+            uint64_t frames = 0;
+            rate = std::max(rate, MeasureSchedulerRate(workers, sessions, frames));
+            CHECK_MESSAGE(frames == (uint64_t)sessions * kFramesPerSession, workers << " workers decoded " << frames << " frames");
+        }
+        const double efficiency = rate / baseRate / workers;
+        CHECK_MESSAGE(efficiency >= kMinEfficiency, workers << " workers at " << rate << " fps, " << 100 * efficiency
+            << "% efficiency against " << baseRate << " fps on one thread");
+    }
+    remove(kStreamPath);
+}
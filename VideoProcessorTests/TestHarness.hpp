@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+
+// Minimal test harness, host code only. TEST_CASE(name) defines a test that registers itself;
+// CHECK(condition) records a failure and the test goes on, REQUIRE(condition) ends it. The
+// runner reports every failure with its location and exits with 1 if there was any.
+typedef void (*TestFunction)();
+
+struct TestRegistration {
+    TestRegistration(const char* inName, TestFunction inFunction);
+};
+
+// Thrown by REQUIRE, caught by the runner
+struct TestAbort {};
+
+void ReportTestFailure(const char* inFile, int inLine, const std::string& inMessage);
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            ReportTestFailure(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+// inMessage is a stream expression: CHECK_MESSAGE(a == b, "a " << a << ", b " << b)
+#define CHECK_MESSAGE(condition, inMessage) \
+    do { \
+        if (!(condition)) { \
+            std::ostringstream testMessage; \
+            testMessage << #condition << ": " << inMessage; \
+            ReportTestFailure(__FILE__, __LINE__, testMessage.str()); \
+        } \
+    } while (0)
+
+#define REQUIRE(condition) \
+    do { \
+        if (!(condition)) { \
+            ReportTestFailure(__FILE__, __LINE__, #condition); \
+            throw TestAbort(); \
+        } \
+    } while (0)
@@ -0,0 +1,64 @@
+#include "TestHarness.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct RegisteredTest {
+    const char* name;
+    TestFunction function;
+};
+
+// Filled by the static registrations of the test files, before main() runs
+std::vector<RegisteredTest>& GetTests() {
+    static std::vector<RegisteredTest> tests;
+    return tests;
+}
+
+int gFailures = 0;
+
+}
+
+TestRegistration::TestRegistration(const char* inName, TestFunction inFunction)
+{
+    GetTests().push_back({ inName, inFunction });
+}
+
+void
+ReportTestFailure(const char* inFile, int inLine, const std::string& inMessage)
+{
+    std::cerr << inFile << "(" << inLine << "): check failed: " << inMessage << std::endl;
+    gFailures++;
+}
+
+// Runs every test, or the ones whose name contains the first argument
+int
+main(int argc, char* argv[]) {
+    const std::string filter = argc > 1 ? argv[1] : "";
+    int run = 0, failed = 0;
+    for (const RegisteredTest& test : GetTests()) {
+        if (std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        const int failuresBefore = gFailures;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            test.function();
+        } catch (const TestAbort&) {
+        } catch (const std::exception& e) {
+            ReportTestFailure(__FILE__, __LINE__, std::string("exception: ") + e.what());
+        } catch (...) {
+            ReportTestFailure(__FILE__, __LINE__, "unknown exception");
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const bool ok = gFailures == failuresBefore;
+        std::cout << (ok ? "ok     " : "FAILED ") << test.name << " (" << seconds * 1000 << " ms)" << std::endl;
+        run++;
+        failed += !ok;
+    }
+    std::cout << run << " tests, " << failed << " failed" << std::endl;
+    return failed || !run ? 1 : 0;
+}
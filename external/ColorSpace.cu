@@ -11,59 +11,14 @@
 
 #include "ColorSpace.h"
 
-__constant__ float matYuv2Rgb[3][3];
 __constant__ float matRgb2Yuv[3][3];
 
 
 void inline GetConstants(int iMatrix, float &wr, float &wb, int &black, int &white, int &max) {
-    black = 16; white = 235;
-    max = 255;
-
-    switch (iMatrix)
-    {
-    case ColorSpaceStandard_BT709:
-    default:
-        wr = 0.2126f; wb = 0.0722f;
-        break;
-
-    case ColorSpaceStandard_FCC:
-        wr = 0.30f; wb = 0.11f;
-        break;
-
-    case ColorSpaceStandard_BT470:
-    case ColorSpaceStandard_BT601:
-        wr = 0.2990f; wb = 0.1140f;
-        break;
-
-    case ColorSpaceStandard_SMPTE240M:
-        wr = 0.212f; wb = 0.087f;
-        break;
-
-    case ColorSpaceStandard_BT2020:
-    case ColorSpaceStandard_BT2020C:
-        wr = 0.2627f; wb = 0.0593f;
-        // 10-bit only
-        black = 64 << 6; white = 940 << 6;
-        max = (1 << 16) - 1;
-        break;
-    }
-}
-
-void SetMatYuv2Rgb(int iMatrix) {
-    float wr, wb;
-    int black, white, max;
-    GetConstants(iMatrix, wr, wb, black, white, max);
-    float mat[3][3] = {
-        1.0f, 0.0f, (1.0f - wr) / 0.5f,
-        1.0f, -wb * (1.0f - wb) / 0.5f / (1 - wb - wr), -wr * (1 - wr) / 0.5f / (1 - wb - wr),
-        1.0f, (1.0f - wb) / 0.5f, 0.0f,
-    };
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            mat[i][j] = (float)(1.0 * max / (white - black) * mat[i][j]);
-        }
-    }
-    cudaMemcpyToSymbol(matYuv2Rgb, mat, sizeof(mat));
+    const ColorSpaceConstants k = GetColorSpaceConstants(iMatrix);
+    wr = k.wr; wb = k.wb;
+    black = k.black; white = k.white;
+    max = k.max;
 }
 
 void SetMatRgb2Yuv(int iMatrix) {
@@ -88,17 +43,29 @@ __device__ static T Clamp(T x, T lower, T upper) {
     return x < lower ? lower : (x > upper ? upper : x);
 }
 
-template<class Rgb, class YuvUnit>
+// The matrix is a compile time constant of the kernel: no per frame upload, no constant memory
+// reads. 8 bit input takes the fixed point path of the host kernels (HostColorSpaceKernels.hpp),
+// which is exact to well below an LSB and matches them bit for bit.
+template<class Rgb, int iMatrix, class YuvUnit>
 __device__ inline Rgb YuvToRgbForPixel(YuvUnit y, YuvUnit u, YuvUnit v) {
+    typedef YuvToRgbMatrix<iMatrix> M;
     const int 
         low = 1 << (sizeof(YuvUnit) * 8 - 4),
         mid = 1 << (sizeof(YuvUnit) * 8 - 1);
-    float fy = (int)y - low, fu = (int)u - mid, fv = (int)v - mid;
-    const float maxf = (1 << sizeof(YuvUnit) * 8) - 1.0f;
-    YuvUnit 
-        r = (YuvUnit)Clamp(matYuv2Rgb[0][0] * fy + matYuv2Rgb[0][1] * fu + matYuv2Rgb[0][2] * fv, 0.0f, maxf),
-        g = (YuvUnit)Clamp(matYuv2Rgb[1][0] * fy + matYuv2Rgb[1][1] * fu + matYuv2Rgb[1][2] * fv, 0.0f, maxf),
-        b = (YuvUnit)Clamp(matYuv2Rgb[2][0] * fy + matYuv2Rgb[2][1] * fu + matYuv2Rgb[2][2] * fv, 0.0f, maxf);
+    YuvUnit r, g, b;
+    if (sizeof(YuvUnit) == 1) {
+        const int iy = M::yFixed * ((int)y - low), iu = (int)u - mid, iv = (int)v - mid;
+        r = (YuvUnit)Clamp((iy + M::rvFixed * iv) >> kYuvToRgbShift, 0, 255);
+        g = (YuvUnit)Clamp((iy + M::guFixed * iu + M::gvFixed * iv) >> kYuvToRgbShift, 0, 255);
+        b = (YuvUnit)Clamp((iy + M::buFixed * iu) >> kYuvToRgbShift, 0, 255);
+    } else {
+        // 16 bit samples would overflow the fixed point sums
+        float fy = (int)y - low, fu = (int)u - mid, fv = (int)v - mid;
+        const float maxf = (1 << sizeof(YuvUnit) * 8) - 1.0f;
+        r = (YuvUnit)Clamp(M::y * fy + M::rv * fv, 0.0f, maxf);
+        g = (YuvUnit)Clamp(M::y * fy + M::gu * fu + M::gv * fv, 0.0f, maxf);
+        b = (YuvUnit)Clamp(M::y * fy + M::bu * fu, 0.0f, maxf);
+    }
     
     Rgb rgb{};
     const int nShift = abs((int)sizeof(YuvUnit) - (int)sizeof(rgb.c.r)) * 8;
@@ -114,7 +81,7 @@ __device__ inline Rgb YuvToRgbForPixel(YuvUnit y, YuvUnit u, YuvUnit v) {
     return rgb;
 }
 
-template<class YuvUnitx2, class Rgb, class RgbIntx2>
+template<class YuvUnitx2, class Rgb, class RgbIntx2, int iMatrix>
 __global__ static void YuvToRgbKernel(uint8_t *pYuv, int nYuvPitch, uint8_t *pRgb, int nRgbPitch, int nWidth, int nHeight) {
     int x = (threadIdx.x + blockIdx.x * blockDim.x) * 2;
     int y = (threadIdx.y + blockIdx.y * blockDim.y) * 2;
@@ -130,22 +97,40 @@ __global__ static void YuvToRgbKernel(uint8_t *pYuv, int nYuvPitch, uint8_t *pRg
     YuvUnitx2 ch = *(YuvUnitx2 *)(pSrc + (nHeight - y / 2) * nYuvPitch);
 
     *(RgbIntx2 *)pDst = RgbIntx2 {
-        YuvToRgbForPixel<Rgb>(l0.x, ch.x, ch.y).d,
-        YuvToRgbForPixel<Rgb>(l0.y, ch.x, ch.y).d,
+        YuvToRgbForPixel<Rgb, iMatrix>(l0.x, ch.x, ch.y).d,
+        YuvToRgbForPixel<Rgb, iMatrix>(l0.y, ch.x, ch.y).d,
     };
     *(RgbIntx2 *)(pDst + nRgbPitch) = RgbIntx2 {
-        YuvToRgbForPixel<Rgb>(l1.x, ch.x, ch.y).d, 
-        YuvToRgbForPixel<Rgb>(l1.y, ch.x, ch.y).d,
+        YuvToRgbForPixel<Rgb, iMatrix>(l1.x, ch.x, ch.y).d, 
+        YuvToRgbForPixel<Rgb, iMatrix>(l1.y, ch.x, ch.y).d,
     };
 }
 
-template <class COLOR32>
-void Nv12ToColor32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
-    SetMatYuv2Rgb(iMatrix);
-    YuvToRgbKernel<uchar2, COLOR32, uint2>
+template <class COLOR32, int iMatrix>
+static void Nv12ToColor32Specialized(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight) {
+    YuvToRgbKernel<uchar2, COLOR32, uint2, iMatrix>
         <<<dim3((nWidth + 63) / 32 / 2, (nHeight + 3) / 2 / 2), dim3(32, 2)>>>
         (dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
 }
 
+template <class COLOR32>
+Nv12ToColor32Func GetNv12ToColor32(int iMatrix) {
+    switch (GetCanonicalColorSpace(iMatrix)) {
+    case ColorSpaceStandard_FCC:        return Nv12ToColor32Specialized<COLOR32, ColorSpaceStandard_FCC>;
+    case ColorSpaceStandard_BT601:      return Nv12ToColor32Specialized<COLOR32, ColorSpaceStandard_BT601>;
+    case ColorSpaceStandard_SMPTE240M:  return Nv12ToColor32Specialized<COLOR32, ColorSpaceStandard_SMPTE240M>;
+    case ColorSpaceStandard_BT2020:     return Nv12ToColor32Specialized<COLOR32, ColorSpaceStandard_BT2020>;
+    default:                            return Nv12ToColor32Specialized<COLOR32, ColorSpaceStandard_BT709>;
+    }
+}
+
+template <class COLOR32>
+void Nv12ToColor32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix) {
+    GetNv12ToColor32<COLOR32>(iMatrix)(dpNv12, nNv12Pitch, dpBgra, nBgraPitch, nWidth, nHeight);
+}
+
 // Explicit Instantiation
+template Nv12ToColor32Func GetNv12ToColor32<BGRA32>(int iMatrix);
+template Nv12ToColor32Func GetNv12ToColor32<RGBA32>(int iMatrix);
 template void Nv12ToColor32<BGRA32>(uint8_t* dpNv12, int nNv12Pitch, uint8_t* dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix);
+template void Nv12ToColor32<RGBA32>(uint8_t* dpNv12, int nNv12Pitch, uint8_t* dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix);
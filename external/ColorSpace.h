@@ -46,3 +46,70 @@ union RGBA64 {
         uint16_t r, g, b, a;
     } c;
 };
+
+// Luma weights and code range of a ColorSpaceStandard
+struct ColorSpaceConstants {
+    float wr, wb;
+    int black, white, max;
+};
+
+// BT.470 is BT.601 and BT.2020C uses the BT.2020 matrix; reserved, unspecified and unknown
+// standards (YCgCo included) are converted as BT.709
+constexpr int GetCanonicalColorSpace(int iMatrix) {
+    return iMatrix == ColorSpaceStandard_BT470 ? ColorSpaceStandard_BT601
+        : iMatrix == ColorSpaceStandard_BT2020C ? ColorSpaceStandard_BT2020
+        : (iMatrix == ColorSpaceStandard_FCC || iMatrix == ColorSpaceStandard_BT601
+            || iMatrix == ColorSpaceStandard_SMPTE240M || iMatrix == ColorSpaceStandard_BT2020) ? iMatrix
+        : ColorSpaceStandard_BT709;
+}
+
+constexpr ColorSpaceConstants GetColorSpaceConstants(int iMatrix) {
+    return GetCanonicalColorSpace(iMatrix) == ColorSpaceStandard_FCC ? ColorSpaceConstants{ 0.30f, 0.11f, 16, 235, 255 }
+        : GetCanonicalColorSpace(iMatrix) == ColorSpaceStandard_BT601 ? ColorSpaceConstants{ 0.2990f, 0.1140f, 16, 235, 255 }
+        : GetCanonicalColorSpace(iMatrix) == ColorSpaceStandard_SMPTE240M ? ColorSpaceConstants{ 0.212f, 0.087f, 16, 235, 255 }
+        // 10-bit only
+        : GetCanonicalColorSpace(iMatrix) == ColorSpaceStandard_BT2020 ? ColorSpaceConstants{ 0.2627f, 0.0593f, 64 << 6, 940 << 6, (1 << 16) - 1 }
+        : ColorSpaceConstants{ 0.2126f, 0.0722f, 16, 235, 255 };
+}
+
+// Element (i, j) of the YUV to RGB matrix, scaled from the code range to the full output range.
+// Same arithmetic the per frame SetMatYuv2Rgb() did, evaluated at compile time.
+constexpr float GetYuvToRgbElement(ColorSpaceConstants k, int i, int j) {
+    return (float)(1.0 * k.max / (k.white - k.black) * (
+        j == 0 ? 1.0f
+        : i == 0 ? (j == 1 ? 0.0f : (1.0f - k.wr) / 0.5f)
+        : i == 1 ? (j == 1 ? -k.wb * (1.0f - k.wb) / 0.5f / (1 - k.wb - k.wr) : -k.wr * (1 - k.wr) / 0.5f / (1 - k.wb - k.wr))
+        : (j == 1 ? (1.0f - k.wb) / 0.5f : 0.0f)));
+}
+
+// Fractional bits of the fixed point coefficients. With 13 bits the largest coefficient
+// (BT.2020 Cb -> B, ~2.2) still fits int16 for _mm_madd_epi16 and the quantization error
+// stays below 0.05 LSB over the whole 8 bit input range.
+const int kYuvToRgbShift = 13;
+
+constexpr int GetYuvToRgbFixed(float f) {
+    return (int)((double)f * (1 << kYuvToRgbShift) + (f < 0 ? -0.5 : 0.5));
+}
+
+// The non trivial matrix elements of one standard as compile time constants, float and fixed point.
+// Kernels specialized on iMatrix fold them into immediates.
+template <int iMatrix>
+struct YuvToRgbMatrix {
+    static constexpr float y = GetYuvToRgbElement(GetColorSpaceConstants(iMatrix), 0, 0);
+    static constexpr float rv = GetYuvToRgbElement(GetColorSpaceConstants(iMatrix), 0, 2);
+    static constexpr float gu = GetYuvToRgbElement(GetColorSpaceConstants(iMatrix), 1, 1);
+    static constexpr float gv = GetYuvToRgbElement(GetColorSpaceConstants(iMatrix), 1, 2);
+    static constexpr float bu = GetYuvToRgbElement(GetColorSpaceConstants(iMatrix), 2, 1);
+    static constexpr int yFixed = GetYuvToRgbFixed(y);
+    static constexpr int rvFixed = GetYuvToRgbFixed(rv);
+    static constexpr int guFixed = GetYuvToRgbFixed(gu);
+    static constexpr int gvFixed = GetYuvToRgbFixed(gv);
+    static constexpr int buFixed = GetYuvToRgbFixed(bu);
+};
+
+// NV12 to 32 bit color conversion specialized on one ColorSpaceStandard. Look it up once per
+// stream (when the matrix coefficients become known) and call it per frame.
+typedef void (*Nv12ToColor32Func)(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight);
+
+template <class COLOR32>
+Nv12ToColor32Func GetNv12ToColor32(int iMatrix);
@@ -71,5 +71,6 @@ private:
     std::thread t;
 };
 
+// Looks the conversion up on every call, see GetNv12ToColor32() in ColorSpace.h
 template <class COLOR32>
 void Nv12ToColor32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0);